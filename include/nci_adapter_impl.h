@@ -50,6 +50,13 @@ G_BEGIN_DECLS
 
 typedef struct nci_adapter_priv NciAdapterPriv;
 
+typedef
+void
+(*NciAdapterPresenceCheckFunc)(
+    NfcTarget* target,
+    gboolean ok,
+    void* user_data);
+
 struct nci_adapter {
     NfcAdapter parent;
     NfcTarget* target;
@@ -64,11 +71,36 @@ typedef struct nci_adapter_class {
     void (*current_state_changed)(NciAdapter* adapter);
     void (*next_state_changed)(NciAdapter* adapter);
 
+    /*
+     * Activation hooks (since 1.3.0). Overrides may handle the cases
+     * they care about and chain up for everything else.
+     *
+     * intf_activated runs the whole object detection, which in turn
+     * calls create_target and create_initiator. Either may return NULL
+     * to let the adapter try the next possibility. Objects which don't
+     * come from the base implementation don't get RF data packets from
+     * the adapter and have to talk to NciCore themselves.
+     *
+     * presence_check is invoked periodically while a tag is in the
+     * field. It returns zero on failure, otherwise an id which can be
+     * passed to nfc_target_cancel_transmit(). Zero deactivates the tag.
+     *
+     * create_target and presence_check must be overridden together.
+     * The base presence_check only works for targets created by the
+     * base create_target. Without an override, foreign targets simply
+     * don't get checked, and their removal has to be detected by
+     * other means.
+     */
+    void (*intf_activated)(NciAdapter* adapter,
+        const NciIntfActivationNtf* ntf);
+    NfcTarget* (*create_target)(NciAdapter* adapter,
+        const NciIntfActivationNtf* ntf);
+    NfcInitiator* (*create_initiator)(NciAdapter* adapter,
+        const NciIntfActivationNtf* ntf);
+    guint (*presence_check)(NciAdapter* adapter, NfcTarget* target,
+        NciAdapterPresenceCheckFunc done, void* user_data);
+
     /* Padding for future expansion */
-    void (*_reserved1)(void);
-    void (*_reserved2)(void);
-    void (*_reserved3)(void);
-    void (*_reserved4)(void);
     void (*_reserved5)(void);
     void (*_reserved6)(void);
     void (*_reserved7)(void);
@@ -98,6 +130,221 @@ void
 nci_adapter_finalize_core(
     NciAdapter* adapter);
 
+/* NFCEE and listen mode routing (since 1.3.0) */
+
+typedef
+void
+(*NciAdapterNfceeActivationFunc)(
+    NciAdapter* adapter,
+    const NciIntfActivationNtf* ntf,
+    void* user_data);
+
+typedef
+void
+(*NciAdapterNfceeActionFunc)(
+    NciAdapter* adapter,
+    const NciNfceeAction* action,
+    void* user_data);
+
+const NciNfcee* const*
+nci_adapter_nfcees(
+    NciAdapter* adapter); /* NULL terminated */
+
+guint
+nci_adapter_add_route(
+    NciAdapter* adapter,
+    const NciRoute* route);
+
+void
+nci_adapter_remove_route(
+    NciAdapter* adapter,
+    guint id);
+
+void
+nci_adapter_get_routing_usage(
+    NciAdapter* adapter,
+    NciRoutingUsage* usage);
+
+gulong
+nci_adapter_add_nfcee_activated_handler(
+    NciAdapter* adapter,
+    NciAdapterNfceeActivationFunc func,
+    void* user_data);
+
+gulong
+nci_adapter_add_nfcee_action_handler(
+    NciAdapter* adapter,
+    NciAdapterNfceeActionFunc func,
+    void* user_data);
+
+void
+nci_adapter_remove_handler(
+    NciAdapter* adapter,
+    gulong id);
+
+/* Logical connections to NFCEEs (since 1.3.0) */
+
+typedef struct nci_adapter_conn {
+    NciAdapter* adapter;
+    guint8 cid;             /* Valid once the connection is open */
+    guint8 nfcee;
+    guint8 protocol;
+} NciAdapterConn;
+
+typedef
+void
+(*NciAdapterConnFunc)(
+    NciAdapterConn* conn,
+    void* user_data);
+
+typedef
+void
+(*NciAdapterConnDataFunc)(
+    NciAdapterConn* conn,
+    const GUtilData* data,
+    void* user_data);
+
+/*
+ * closed is invoked if the connection couldn't be opened or has been
+ * lost (e.g. because NFCC has been reset). It still has to be released
+ * with nci_adapter_conn_close() after that. nci_adapter_conn_open()
+ * returns NULL while NFCC is being reset.
+ */
+typedef struct nci_adapter_conn_callbacks {
+    NciAdapterConnFunc opened;
+    NciAdapterConnFunc closed;
+    NciAdapterConnDataFunc received;
+} NciAdapterConnCallbacks;
+
+NciAdapterConn*
+nci_adapter_conn_open(
+    NciAdapter* adapter,
+    guint8 nfcee,
+    guint8 protocol,
+    const NciAdapterConnCallbacks* cb,
+    void* user_data);
+
+gboolean
+nci_adapter_conn_send(
+    NciAdapterConn* conn,
+    GBytes* data);
+
+void
+nci_adapter_conn_close(
+    NciAdapterConn* conn);
+
+/*
+ * Time spent in each NciCore state and in each state of the adapter's
+ * own state machine (since 1.3.0). Adapter states are numbered from
+ * zero, nci_adapter_state_name() returns NULL past the last one.
+ * See nci_stats.h
+ */
+
+gboolean
+nci_adapter_get_core_residency(
+    NciAdapter* adapter,
+    NCI_STATE state,
+    NciResidency* residency);
+
+const char*
+nci_adapter_state_name(
+    guint state);
+
+gboolean
+nci_adapter_get_state_residency(
+    NciAdapter* adapter,
+    guint state,
+    NciResidency* residency);
+
+/* Milestone latencies (since 1.3.0), see nci_stats.h */
+
+gboolean
+nci_adapter_get_latency(
+    NciAdapter* adapter,
+    NCI_ADAPTER_LATENCY which,
+    NciLatency* latency);
+
+/*
+ * Card emulation APDU statistics (since 1.3.0), per INS byte of the
+ * command. Returns FALSE if no such command has been seen.
+ */
+
+gboolean
+nci_adapter_get_apdu_stats(
+    NciAdapter* adapter,
+    guint8 ins,
+    NciApduStats* stats);
+
+void
+nci_adapter_clear_apdu_stats(
+    NciAdapter* adapter);
+
+/*
+ * Latency watchdog (since 1.3.0). Whenever a latency exceeds its
+ * threshold, the adapter saves a snapshot of its state into a small
+ * ring (the oldest snapshots are dropped). Zero threshold disables
+ * the check. Snapshot index zero is the oldest one.
+ */
+
+#define NCI_SLO_MAX_SNAPSHOTS (16)
+
+void
+nci_adapter_set_latency_threshold(
+    NciAdapter* adapter,
+    NCI_ADAPTER_LATENCY which,
+    guint ms);
+
+guint
+nci_adapter_slo_snapshot_count(
+    NciAdapter* adapter);
+
+const NciSloSnapshot*
+nci_adapter_slo_snapshot(
+    NciAdapter* adapter,
+    guint index);
+
+void
+nci_adapter_clear_slo_snapshots(
+    NciAdapter* adapter);
+
+/* Feeds all of the above to the sink (since 1.3.0), see nci_metrics.h */
+
+void
+nci_adapter_export_metrics(
+    NciAdapter* adapter,
+    NciMetricsSink* sink);
+
+/* Process-wide, for leak checks (since 1.3.0) */
+
+void
+nci_adapter_object_counts(
+    NciObjectCounts* counts);
+
+/* NCI traffic capture (since 1.3.0), NULL stops capturing */
+
+void
+nci_adapter_set_capture(
+    NciAdapter* adapter,
+    NciCapture* capture);
+
+/*
+ * Time source for timers and statistics (since 1.3.0), NULL for the
+ * system clock. Pending timers are restarted on the new clock, see
+ * nci_clock.h
+ */
+
+void
+nci_adapter_set_clock(
+    NciAdapter* adapter,
+    NciClock* clock);
+
+/* Event timeline (since 1.3.0), NULL stops tracing */
+
+void
+nci_adapter_set_trace(
+    NciAdapter* adapter,
+    NciTrace* trace);
+
 G_END_DECLS
 
 #endif /* NCI_PLUGIN_H */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_CAPTURE_H
+#define NCI_CAPTURE_H
+
+#include <nci_plugin_types.h>
+#include <nci_hal.h>
+
+G_BEGIN_DECLS
+
+/*
+ * NCI traffic capture (since 1.3.0)
+ *
+ * Capture file is a flat, append-only sequence of little-endian records
+ * which can be mapped into memory and walked without parsing anything
+ * but the record headers:
+ *
+ *   File header (16 bytes):
+ *     "NCICAP"           magic (6 bytes)
+ *     version            uint16, NCI_CAPTURE_VERSION
+ *     start              int64, wall clock time (microseconds)
+ *
+ *   Record header (8 bytes), followed by the frame padded to 4 bytes:
+ *     delta              uint32, microseconds since the previous record
+ *     length             uint16, frame length
+ *     type               uint8, NCI_CAPTURE_RECORD_TYPE
+ *     reserved           uint8, zero
+ *
+ * The delta is measured with the monotonic clock, or with the adapter's
+ * NciClock when the capture is attached to an adapter, and the first
+ * record's delta is zero. If it doesn't fit into 32 bits, a CLOCK record
+ * carrying the 64-bit offset since the first record is written first.
+ */
+
+#define NCI_CAPTURE_MAGIC "NCICAP"
+#define NCI_CAPTURE_MAGIC_SIZE (6)
+#define NCI_CAPTURE_VERSION (1)
+#define NCI_CAPTURE_HEADER_SIZE (16)
+#define NCI_CAPTURE_RECORD_HEADER_SIZE (8)
+
+typedef enum nci_capture_record_type {
+    NCI_CAPTURE_RECORD_CLOCK,   /* uint64 offset since start */
+    NCI_CAPTURE_RECORD_TX,      /* Host to NFCC */
+    NCI_CAPTURE_RECORD_RX       /* NFCC to host */
+} NCI_CAPTURE_RECORD_TYPE;
+
+NciCapture*
+nci_capture_new(
+    const char* path); /* Truncates the file, NULL on failure */
+
+NciCapture*
+nci_capture_ref(
+    NciCapture* capture);
+
+void
+nci_capture_unref(
+    NciCapture* capture);
+
+/* Appends one frame, possibly scattered across several chunks */
+void
+nci_capture_frame(
+    NciCapture* capture,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const GUtilData* chunks,
+    guint count);
+
+/* Same as above, with the timestamp (microseconds) from another clock */
+void
+nci_capture_frame_at(
+    NciCapture* capture,
+    gint64 now,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const GUtilData* chunks,
+    guint count);
+
+G_END_DECLS
+
+#endif /* NCI_CAPTURE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
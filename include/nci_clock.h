@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_CLOCK_H
+#define NCI_CLOCK_H
+
+#include <nci_plugin_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Time source and timer factory (since 1.3.0)
+ *
+ * All adapter timers (presence checks, CE reactivation, command
+ * timeouts) and timestamps (statistics, traces) come from NciClock,
+ * which is the system clock by default. The virtual clock doesn't
+ * advance by itself, it jumps straight to the next timer when asked
+ * to, which lets simulated sessions run as fast as the CPU allows.
+ *
+ * Time is monotonic, in microseconds. Timer handles are only meaningful
+ * for the clock which has issued them, and only until the timer is
+ * removed or its callback returns FALSE. The clock must outlive the
+ * objects using it.
+ */
+
+typedef struct nci_clock_functions {
+    gint64 (*now)(NciClock* clock);
+    NciClockTimer* (*timeout_add)(NciClock* clock, guint ms,
+        GSourceFunc fn, gpointer data);
+    void (*remove)(NciClock* clock, NciClockTimer* timer);
+} NciClockFunctions;
+
+struct nci_clock {
+    const NciClockFunctions* fn;
+};
+
+/* Thread-default main context and g_get_monotonic_time() */
+NciClock*
+nci_clock_system(
+    void);
+
+/* NULL clock means the system one */
+
+gint64
+nci_clock_now(
+    NciClock* clock);
+
+NciClockTimer*
+nci_clock_timeout_add(
+    NciClock* clock,
+    guint ms,
+    GSourceFunc fn,
+    gpointer data);
+
+/* Removes the timer and zeros the handle, does nothing if it's NULL */
+void
+nci_clock_clear(
+    NciClock* clock,
+    NciClockTimer** timer);
+
+/*
+ * Virtual clock. Starts at NCI_VIRTUAL_CLOCK_START rather than zero
+ * because zero timestamps often mean "none".
+ */
+
+#define NCI_VIRTUAL_CLOCK_START (1000000)
+
+NciClock*
+nci_virtual_clock_new(
+    void);
+
+void
+nci_virtual_clock_free(
+    NciClock* clock);
+
+/*
+ * Moves the time forward by the given number of microseconds, firing
+ * the timers in order. Between the timers, the main context (NULL for
+ * the default one) is iterated until it runs out of pending events,
+ * so that the work scheduled with g_idle_add() gets done at the right
+ * virtual time.
+ */
+void
+nci_virtual_clock_run(
+    NciClock* clock,
+    GMainContext* context,
+    gint64 us);
+
+/* Number of pending timers */
+guint
+nci_virtual_clock_pending(
+    NciClock* clock);
+
+G_END_DECLS
+
+#endif /* NCI_CLOCK_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_HAL_DEV_H
+#define NCI_HAL_DEV_H
+
+#include <nci_plugin_types.h>
+#include <nci_hal.h>
+
+G_BEGIN_DECLS
+
+/*
+ * NciHalIo over a character device (since 1.3.0)
+ *
+ * Reference HAL for /dev/nq-nci, /dev/pn544 and similar kernel drivers,
+ * which also works with anything else that carries NCI packets over a
+ * file descriptor (a pty, a socket). The descriptor is non-blocking and
+ * watched by the thread-default main context. Each wakeup reads all the
+ * packets queued by the time into a buffer which is reused, so there
+ * are no allocations on the receive path.
+ *
+ * Power management and any other driver-specific ioctls remain the
+ * business of the derived adapter, which can use the fd for that.
+ */
+
+typedef enum nci_hal_dev_flags {
+    NCI_HAL_DEV_FLAGS_NONE = 0x00,
+    /*
+     * Read the header and the payload of each packet separately.
+     * Needed by the drivers which pass each read() straight to the
+     * I2C bus and can't be asked for more than one packet at a time.
+     */
+    NCI_HAL_DEV_FLAG_SPLIT_READS = 0x01
+} NCI_HAL_DEV_FLAGS;
+
+typedef struct nci_hal_dev {
+    NciHalIo* io;               /* Give this one to NciCore */
+    int fd;
+    guint64 rx_packets;
+    guint64 rx_wakeups;         /* Wakeups which delivered something */
+    guint64 tx_writes;          /* Write requests from the client */
+} NciHalDev;
+
+NciHalDev*
+nci_hal_dev_new(
+    const char* path,
+    NCI_HAL_DEV_FLAGS flags); /* NULL if the device can't be opened */
+
+/* Takes ownership of the descriptor */
+NciHalDev*
+nci_hal_dev_new_fd(
+    int fd,
+    NCI_HAL_DEV_FLAGS flags);
+
+void
+nci_hal_dev_free(
+    NciHalDev* dev);
+
+G_END_DECLS
+
+#endif /* NCI_HAL_DEV_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_HAL_SHM_H
+#define NCI_HAL_SHM_H
+
+#include <nci_plugin_types.h>
+#include <nci_hal.h>
+
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * NciHalIo over shared memory (since 1.3.0)
+ *
+ * For the setups where NFCC is owned by a separate (vendor) process.
+ * The two processes share a memory region with a pair of single
+ * producer, single consumer rings, one per direction, and kick each
+ * other with eventfd doorbells. Each wakeup drains everything that the
+ * other side has queued, packets which don't wrap around the end of
+ * the ring are delivered straight from the shared memory.
+ *
+ * The host side (the one that runs NciCore) creates the region with
+ * nci_hal_shm_new() and hands its descriptors over to the peer, either
+ * by inheritance or with SCM_RIGHTS. The peer maps the same region with
+ * nci_hal_shm_attach(), swapping the doorbells, and usually connects it
+ * to the actual hardware with NciHalShmBridge.
+ */
+
+typedef struct nci_hal_shm_bridge NciHalShmBridge;
+
+typedef struct nci_hal_shm {
+    NciHalIo* io;
+    int fd;                     /* Shared memory */
+    int rx_event;               /* Kicked by the other side */
+    int tx_event;               /* Kicks the other side */
+    guint64 rx_packets;
+    guint64 rx_wakeups;         /* Wakeups which delivered something */
+    guint64 tx_packets;         /* Write requests from the client */
+} NciHalShm;
+
+typedef
+void
+(*NciHalShmBridgeFunc)(
+    NciHalShmBridge* bridge,
+    void* user_data);
+
+#define NCI_HAL_SHM_DEFAULT_RING_SIZE (0x4000)
+
+NciHalShm*
+nci_hal_shm_new(
+    guint ring_size); /* Rounded up to a power of 2, zero for default */
+
+/* Takes ownership of the descriptors, NULL if they don't make sense */
+NciHalShm*
+nci_hal_shm_attach(
+    int fd,
+    int rx_event,
+    int tx_event);
+
+void
+nci_hal_shm_free(
+    NciHalShm* shm);
+
+/*
+ * Forwards packets between the shared memory and another NciHalIo
+ * (e.g. NciHalDev) until either side fails or the other process lets
+ * go of the shared memory, at which point the callback is invoked.
+ */
+NciHalShmBridge*
+nci_hal_shm_bridge_new(
+    NciHalShm* shm,
+    NciHalIo* io,
+    NciHalShmBridgeFunc closed,
+    void* user_data);
+
+void
+nci_hal_shm_bridge_free(
+    NciHalShmBridge* bridge);
+
+/*
+ * Starts a stand-in peer process for testing and benchmarking, e.g.
+ * tools/nci-shm-sim which bridges the shared memory to NciSim. The
+ * executable is run with the given arguments followed by the numbers
+ * of the inherited shared memory descriptor and the two doorbells, in
+ * the order nci_hal_shm_attach() takes them. The child is expected to
+ * exit when the host side is freed. Returns the child pid or -1.
+ */
+pid_t
+nci_hal_shm_spawn(
+    NciHalShm* shm,
+    const char* path,
+    const char* const* args); /* NULL terminated, may be NULL */
+
+G_END_DECLS
+
+#endif /* NCI_HAL_SHM_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
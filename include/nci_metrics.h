@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_METRICS_H
+#define NCI_METRICS_H
+
+#include <nci_plugin_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Metrics export (since 1.3.0)
+ *
+ * nci_adapter_export_metrics() walks all the statistics collected by
+ * the adapter and feeds them to the sink, one metric family at a time
+ * (all samples with the same name come together). Names are short and
+ * unprefixed, like "latency" or "core_state_visits", and take at most
+ * one label. Names of time values end with "_us", histograms are always
+ * in microseconds.
+ *
+ * Everything happens on the adapter's thread and nothing is locked,
+ * the sink receives a consistent snapshot of the counters as they are
+ * at the time of the call.
+ */
+
+typedef enum nci_metric_type {
+    NCI_METRIC_COUNTER,
+    NCI_METRIC_GAUGE
+} NCI_METRIC_TYPE;
+
+typedef struct nci_metrics_sink_functions {
+    void (*value)(NciMetricsSink* sink, const char* name,
+        NCI_METRIC_TYPE type, const char* label, const char* label_value,
+        guint64 value);
+    void (*histogram)(NciMetricsSink* sink, const char* name,
+        const char* label, const char* label_value,
+        const NciHistogram* hist);
+} NciMetricsSinkFunctions;
+
+struct nci_metrics_sink {
+    const NciMetricsSinkFunctions* fn;
+};
+
+/* Prometheus text exposition format, g_free() the result */
+char*
+nci_metrics_to_prometheus(
+    NciAdapter* adapter);
+
+/*
+ * Reference exporter. Every interval_ms it formats the adapter metrics
+ * in Prometheus text format and either atomically replaces the file at
+ * the given path (suitable for node_exporter's textfile collector), or,
+ * if the path starts with "unix:", serves the most recent text to each
+ * client connecting to the unix socket at the rest of the path. Writes
+ * never block, a client which can't keep up is dropped.
+ */
+
+typedef struct nci_metrics_exporter NciMetricsExporter;
+
+#define NCI_METRICS_UNIX_PREFIX "unix:"
+
+NciMetricsExporter*
+nci_metrics_exporter_new(
+    NciAdapter* adapter,
+    const char* path,
+    guint interval_ms); /* NULL on failure */
+
+void
+nci_metrics_exporter_free(
+    NciMetricsExporter* exporter);
+
+/* Refreshes the metrics right away */
+void
+nci_metrics_exporter_update(
+    NciMetricsExporter* exporter);
+
+G_END_DECLS
+
+#endif /* NCI_METRICS_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -42,6 +42,126 @@
 G_BEGIN_DECLS
 
 typedef struct nci_adapter NciAdapter;
+typedef struct nci_capture NciCapture; /* Since 1.3.0 */
+typedef struct nci_trace NciTrace; /* Since 1.3.0 */
+typedef struct nci_histogram NciHistogram; /* Since 1.3.0 */
+typedef struct nci_residency NciResidency; /* Since 1.3.0 */
+typedef struct nci_latency NciLatency; /* Since 1.3.0 */
+typedef struct nci_apdu_stats NciApduStats; /* Since 1.3.0 */
+typedef struct nci_metrics_sink NciMetricsSink; /* Since 1.3.0 */
+typedef struct nci_clock NciClock; /* Since 1.3.0 */
+typedef struct nci_clock_timer NciClockTimer; /* Since 1.3.0 */
+
+/* NFC Execution Environments (since 1.3.0) */
+
+#define NCI_NFCEE_ID_DH (0x00) /* Device Host, i.e. us */
+
+typedef enum nci_nfcee_status {
+    NCI_NFCEE_STATUS_ENABLED = 0x00,
+    NCI_NFCEE_STATUS_DISABLED = 0x01,
+    NCI_NFCEE_STATUS_REMOVED = 0x02
+} NCI_NFCEE_STATUS;
+
+typedef struct nci_nfcee {
+    guint8 id;
+    NCI_NFCEE_STATUS status;
+    GUtilData protocols;
+} NciNfcee;
+
+typedef struct nci_nfcee_action {
+    guint8 id;
+    guint8 trigger;
+    GUtilData data;
+} NciNfceeAction;
+
+/* Listen mode routing (since 1.3.0) */
+
+typedef enum nci_route_type {
+    NCI_ROUTE_TECHNOLOGY = 0x00,
+    NCI_ROUTE_PROTOCOL = 0x01,
+    NCI_ROUTE_AID = 0x02
+} NCI_ROUTE_TYPE;
+
+typedef enum nci_route_tech {
+    NCI_ROUTE_TECH_A = 0x00,
+    NCI_ROUTE_TECH_B = 0x01,
+    NCI_ROUTE_TECH_F = 0x02,
+    NCI_ROUTE_TECH_V = 0x03
+} NCI_ROUTE_TECH;
+
+typedef enum nci_route_power {
+    NCI_ROUTE_POWER_NONE = 0x00,
+    NCI_ROUTE_POWER_ON = 0x01,
+    NCI_ROUTE_POWER_OFF = 0x02,
+    NCI_ROUTE_POWER_BATTERY_OFF = 0x04
+} NCI_ROUTE_POWER;
+
+typedef enum nci_route_flags {
+    NCI_ROUTE_FLAGS_NONE = 0x00,
+    NCI_ROUTE_FLAG_AID_PREFIX = 0x01  /* Match AID prefix (NCI 2.0) */
+} NCI_ROUTE_FLAGS;
+
+typedef struct nci_route {
+    NCI_ROUTE_TYPE type;
+    guint8 nfcee;           /* NCI_NFCEE_ID_DH to route to the host */
+    NCI_ROUTE_POWER power;
+    NCI_ROUTE_FLAGS flags;
+    union {
+        NCI_ROUTE_TECH tech;
+        NCI_PROTOCOL protocol;
+        GUtilData aid;
+    } value;
+} NciRoute;
+
+typedef struct nci_routing_usage {
+    guint size;             /* Bytes occupied by the table */
+    guint max_size;         /* NFCC capacity, zero if unknown */
+    guint entries;          /* Total number of entries */
+    guint aids;             /* Number of AID routes */
+    guint aid_entries;      /* AID entries after aggregation */
+    guint dropped;          /* AID routes which didn't fit */
+} NciRoutingUsage;
+
+/* Latency milestones (since 1.3.0) */
+typedef enum nci_adapter_latency {
+    NCI_ADAPTER_LATENCY_MODE_SWITCH,    /* Mode request => mode notify */
+    NCI_ADAPTER_LATENCY_STARTUP,        /* NFCC reset => RFST_DISCOVERY */
+    NCI_ADAPTER_LATENCY_PUBLISH,        /* Activation => NfcTag etc. */
+    NCI_ADAPTER_LATENCY_TRANSMIT,       /* NfcTarget transmit round trip */
+    NCI_ADAPTER_LATENCY_REACTIVATION,   /* Deactivation => reactivation */
+    NCI_ADAPTER_LATENCY_COUNT
+} NCI_ADAPTER_LATENCY;
+
+/* Latency watchdog (since 1.3.0) */
+typedef enum nci_slo_flags {
+    NCI_SLO_FLAGS_NONE = 0x00,
+    NCI_SLO_FLAG_ACTIVE_INTF = 0x01,    /* rf_intf, protocol, mode valid */
+    NCI_SLO_FLAG_PRESENCE_CHECK = 0x02, /* Presence check in progress */
+    NCI_SLO_FLAG_EARLY_REPLY = 0x04     /* Reply came before send completed */
+} NCI_SLO_FLAGS;
+
+typedef struct nci_slo_snapshot {
+    gint64 time;                /* Adapter clock, see nci_clock.h */
+    NCI_ADAPTER_LATENCY which;
+    guint threshold_ms;
+    guint64 latency_us;
+    guint internal_state;       /* See nci_adapter_state_name() */
+    NCI_STATE current_state;
+    NCI_STATE next_state;
+    NCI_SLO_FLAGS flags;
+    NCI_RF_INTERFACE rf_intf;
+    NCI_PROTOCOL protocol;
+    NCI_MODE mode;
+    const char* trace;          /* Recent NciTrace events (JSON) or NULL */
+} NciSloSnapshot;
+
+/* Live object counts, to check that nothing accumulates (since 1.3.0) */
+typedef struct nci_object_counts {
+    guint targets;
+    guint initiators;
+    guint intf_blocks;      /* Activation info, including the spare one */
+    guint conns;            /* Logical connections to NFCEEs */
+} NciObjectCounts;
 
 /* Logging */
 
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_STATS_H
+#define NCI_STATS_H
+
+#include <nci_plugin_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Latency and residency statistics (since 1.3.0)
+ *
+ * Histogram buckets are powers of two in milliseconds. Bucket 0 counts
+ * samples up to 1 ms, bucket i counts samples in (2^(i-1), 2^i] ms and
+ * the last one collects everything that didn't fit into the others.
+ */
+
+#define NCI_HISTOGRAM_BUCKETS (16)
+
+struct nci_histogram {
+    guint64 count;
+    guint64 sum_us;
+    guint64 max_us;
+    guint buckets[NCI_HISTOGRAM_BUCKETS];
+};
+
+struct nci_residency {
+    guint64 total_us;       /* Including the current visit, if any */
+    guint visits;
+    NciHistogram hist;      /* Completed visits */
+};
+
+struct nci_latency {
+    guint64 last_us;        /* Most recent sample */
+    NciHistogram hist;
+};
+
+/*
+ * Card emulation APDUs, per INS byte. The host part is the time from
+ * receiving the command to submitting the response, the send part is
+ * the time it takes to hand the response over to the NFCC.
+ */
+struct nci_apdu_stats {
+    guint8 ins;
+    guint8 cla;             /* Class byte of the most recent command */
+    guint64 errors;         /* Responses that failed to go out */
+    NciHistogram host;
+    NciHistogram send;
+    NciHistogram total;
+};
+
+/* Upper bound of the bucket, microseconds (max_us for the last one) */
+guint64
+nci_histogram_bucket_limit(
+    const NciHistogram* hist,
+    guint bucket);
+
+/* Estimate of the given percentile (0..100), in microseconds */
+guint64
+nci_histogram_percentile(
+    const NciHistogram* hist,
+    guint percent);
+
+G_END_DECLS
+
+#endif /* NCI_STATS_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_TRACE_H
+#define NCI_TRACE_H
+
+#include <nci_plugin_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Adapter timeline (since 1.3.0)
+ *
+ * Fixed size ring of timestamped adapter events: NCI and adapter state
+ * transitions, activations, transmissions, presence checks and timers.
+ * Once attached with nci_adapter_set_trace(), it can be exported at any
+ * time in Chrome trace event format, understood by chrome://tracing and
+ * ui.perfetto.dev. The oldest events are overwritten when the ring is
+ * full.
+ */
+
+NciTrace*
+nci_trace_new(
+    guint max_events);
+
+NciTrace*
+nci_trace_ref(
+    NciTrace* trace);
+
+void
+nci_trace_unref(
+    NciTrace* trace);
+
+void
+nci_trace_clear(
+    NciTrace* trace);
+
+/* Chrome trace JSON, g_free() the result */
+char*
+nci_trace_to_json(
+    NciTrace* trace);
+
+gboolean
+nci_trace_save(
+    NciTrace* trace,
+    const char* path);
+
+G_END_DECLS
+
+#endif /* NCI_TRACE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
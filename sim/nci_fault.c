@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_fault.h"
+#include "nci_clock.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+/* How long the write completion can be held waiting for the reply */
+#define FAULT_REORDER_TIMEOUT_MS (100)
+
+typedef struct nci_fault_packet {
+    gint64 due;                 /* Clock time, microseconds */
+    GBytes* data;
+} NciFaultPacket;
+
+typedef struct nci_fault_priv {
+    NciFault pub;
+    NciHalIo io;                /* What NciCore talks to */
+    NciHalClient client;        /* What the real HAL talks to */
+    NciHalIo* hal;
+    NciHalClient* up;
+    NciFaultConfig config;
+    NciClock* clock;            /* NULL for the system clock */
+    GRand* rand;
+    GByteArray* rx_buf;         /* Partial incoming packet */
+    GQueue rx;                  /* NciFaultPacket */
+    NciClockTimer* rx_timer;
+    gint64 bus_free;            /* When the bus becomes available */
+    NciHalClientFunc write_complete;
+    gint64 write_due;           /* Throttled completion time */
+    gboolean write_ok;
+    gboolean write_is_data;
+    gboolean write_held;        /* Completed, waiting to be delivered */
+    NciClockTimer* write_timer;
+    gint64 write_timer_due;
+} NciFaultPriv;
+
+static inline NciFaultPriv* nci_fault_cast(NciFault* pub)
+    { return G_CAST(pub, NciFaultPriv, pub); }
+
+static
+void
+nci_fault_rx_schedule(
+    NciFaultPriv* self);
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gint64
+nci_fault_bus_time(
+    NciFaultPriv* self,
+    gsize len)
+{
+    const guint bps = self->config.bytes_per_sec;
+
+    return bps ? ((gint64) len * G_USEC_PER_SEC / bps) : 0;
+}
+
+static
+NciClockTimer*
+nci_fault_timeout_add(
+    NciFaultPriv* self,
+    gint64 due,
+    GSourceFunc fn)
+{
+    const gint64 now = nci_clock_now(self->clock);
+
+    return nci_clock_timeout_add(self->clock, (due > now) ?
+        (guint) ((due - now + 999) / 1000) : 0, fn, self);
+}
+
+static
+void
+nci_fault_packet_free(
+    NciFaultPacket* pkt)
+{
+    g_bytes_unref(pkt->data);
+    g_slice_free(NciFaultPacket, pkt);
+}
+
+static
+void
+nci_fault_write_complete(
+    NciFaultPriv* self)
+{
+    NciHalClientFunc complete = self->write_complete;
+
+    nci_clock_clear(self->clock, &self->write_timer);
+    self->write_complete = NULL;
+    self->write_held = FALSE;
+    if (complete && self->up) {
+        complete(self->up, self->write_ok);
+    }
+}
+
+static
+gboolean
+nci_fault_write_timer(
+    gpointer user_data)
+{
+    NciFaultPriv* self = user_data;
+
+    self->write_timer = NULL;
+    nci_fault_write_complete(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_fault_write_done(
+    NciHalClient* client,
+    gboolean ok)
+{
+    NciFaultPriv* self = G_CAST(client, NciFaultPriv, client);
+    const gint64 now = nci_clock_now(self->clock);
+
+    self->write_ok = ok;
+    self->write_held = TRUE;
+    if (ok && self->write_is_data && self->config.reorder_data_completion) {
+        /* Let the reply overtake the completion (as seen on pn547) */
+        self->write_timer_due = now + FAULT_REORDER_TIMEOUT_MS * 1000;
+        self->write_timer = nci_fault_timeout_add(self,
+            self->write_timer_due, nci_fault_write_timer);
+    } else if (self->write_due > now) {
+        self->write_timer_due = self->write_due;
+        self->write_timer = nci_fault_timeout_add(self,
+            self->write_timer_due, nci_fault_write_timer);
+    } else {
+        nci_fault_write_complete(self);
+    }
+}
+
+static
+gboolean
+nci_fault_rx_timer(
+    gpointer user_data)
+{
+    NciFaultPriv* self = user_data;
+    const gint64 now = nci_clock_now(self->clock);
+    NciFaultPacket* pkt;
+
+    self->rx_timer = NULL;
+    while (self->up && (pkt = g_queue_peek_head(&self->rx)) != NULL &&
+        pkt->due <= now) {
+        gsize len;
+        const guint8* data = g_bytes_get_data(pkt->data, &len);
+        const gboolean is_data = (data[0] & NCI_HDR_MT_MASK) ==
+            NCI_HDR_MT_DATA;
+
+        g_queue_pop_head(&self->rx);
+        self->pub.rx_packets++;
+        self->up->fn->read(self->up, data, len);
+        nci_fault_packet_free(pkt);
+        if (is_data && self->write_held && self->write_is_data &&
+            self->config.reorder_data_completion) {
+            self->pub.reordered++;
+            nci_fault_write_complete(self);
+        }
+    }
+    nci_fault_rx_schedule(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_fault_rx_schedule(
+    NciFaultPriv* self)
+{
+    const NciFaultPacket* pkt = g_queue_peek_head(&self->rx);
+
+    if (pkt && !self->rx_timer) {
+        self->rx_timer = nci_fault_timeout_add(self, pkt->due,
+            nci_fault_rx_timer);
+    }
+}
+
+static
+void
+nci_fault_rx_packet(
+    NciFaultPriv* self,
+    const guint8* data,
+    guint len)
+{
+    if ((data[0] & NCI_HDR_MT_MASK) == NCI_HDR_MT_NTF &&
+        self->config.ntf_drop_permille &&
+        (guint) g_rand_int_range(self->rand, 0, 1000) <
+        self->config.ntf_drop_permille) {
+        GDEBUG("Dropping NTF %02x/%02x", data[0] & NCI_HDR_GID_MASK,
+            data[1] & NCI_HDR_OID_MASK);
+        self->pub.dropped_ntf++;
+    } else {
+        NciFaultPacket* pkt = g_slice_new(NciFaultPacket);
+        const NciFaultPacket* last = g_queue_peek_tail(&self->rx);
+        gint64 due = nci_clock_now(self->clock) +
+            (gint64) self->config.delay_ms * 1000;
+
+        if (self->config.jitter_ms) {
+            due += g_rand_int_range(self->rand, 0,
+                self->config.jitter_ms * 1000 + 1);
+        }
+
+        /* Packets never overtake each other */
+        if (last && last->due > due) {
+            due = last->due;
+        }
+        if (self->bus_free > due) {
+            due = self->bus_free;
+        }
+        due += nci_fault_bus_time(self, len);
+        self->bus_free = due;
+
+        pkt->due = due;
+        pkt->data = g_bytes_new(data, len);
+        g_queue_push_tail(&self->rx, pkt);
+        nci_fault_rx_schedule(self);
+    }
+}
+
+static
+void
+nci_fault_reset(
+    NciFaultPriv* self)
+{
+    NciFaultPacket* pkt;
+
+    nci_clock_clear(self->clock, &self->rx_timer);
+    nci_clock_clear(self->clock, &self->write_timer);
+    while ((pkt = g_queue_pop_head(&self->rx)) != NULL) {
+        nci_fault_packet_free(pkt);
+    }
+    g_byte_array_set_size(self->rx_buf, 0);
+    self->write_complete = NULL;
+    self->write_held = FALSE;
+    self->bus_free = 0;
+}
+
+/*==========================================================================*
+ * NciHalClient (what the real HAL sees)
+ *==========================================================================*/
+
+static
+void
+nci_fault_client_error(
+    NciHalClient* client)
+{
+    NciFaultPriv* self = G_CAST(client, NciFaultPriv, client);
+
+    if (self->up) {
+        self->up->fn->error(self->up);
+    }
+}
+
+static
+void
+nci_fault_client_read(
+    NciHalClient* client,
+    const void* data,
+    guint len)
+{
+    NciFaultPriv* self = G_CAST(client, NciFaultPriv, client);
+    GByteArray* buf = self->rx_buf;
+    guint off = 0;
+
+    /* Split the stream into packets, each one gets its own delay */
+    g_byte_array_append(buf, data, len);
+    while (buf->len - off >= NCI_HDR_SIZE &&
+        buf->len - off >= (guint) NCI_HDR_SIZE + buf->data[off + 2]) {
+        const guint pkt_len = NCI_HDR_SIZE + buf->data[off + 2];
+
+        nci_fault_rx_packet(self, buf->data + off, pkt_len);
+        off += pkt_len;
+    }
+    g_byte_array_remove_range(buf, 0, off);
+}
+
+/*==========================================================================*
+ * NciHalIo (what NciCore sees)
+ *==========================================================================*/
+
+static
+gboolean
+nci_fault_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciFaultPriv* self = G_CAST(io, NciFaultPriv, io);
+
+    self->up = client;
+    if (self->hal->fn->start(self->hal, &self->client)) {
+        return TRUE;
+    }
+    self->up = NULL;
+    return FALSE;
+}
+
+static
+void
+nci_fault_io_stop(
+    NciHalIo* io)
+{
+    NciFaultPriv* self = G_CAST(io, NciFaultPriv, io);
+
+    self->hal->fn->stop(self->hal);
+    nci_fault_reset(self);
+    self->up = NULL;
+}
+
+static
+gboolean
+nci_fault_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciFaultPriv* self = G_CAST(io, NciFaultPriv, io);
+    const guint8* hdr = chunks[0].bytes;
+    const gint64 now = nci_clock_now(self->clock);
+    gsize len = 0;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        len += chunks[i].size;
+    }
+
+    self->write_complete = complete;
+    self->write_is_data = (hdr[0] & NCI_HDR_MT_MASK) == NCI_HDR_MT_DATA;
+    self->write_held = FALSE;
+    self->write_due = MAX(now, self->bus_free) + nci_fault_bus_time(self,
+        len);
+    self->bus_free = self->write_due;
+    if (self->hal->fn->write(self->hal, chunks, count, nci_fault_write_done)) {
+        self->pub.tx_packets++;
+        return TRUE;
+    }
+    self->write_complete = NULL;
+    return FALSE;
+}
+
+static
+void
+nci_fault_io_cancel_write(
+    NciHalIo* io)
+{
+    NciFaultPriv* self = G_CAST(io, NciFaultPriv, io);
+
+    nci_clock_clear(self->clock, &self->write_timer);
+    self->write_complete = NULL;
+    if (!self->write_held) {
+        self->hal->fn->cancel_write(self->hal);
+    }
+    self->write_held = FALSE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciFault*
+nci_fault_new(
+    NciHalIo* hal,
+    const NciFaultConfig* config)
+{
+    if (G_LIKELY(hal)) {
+        static const NciHalIoFunctions fault_io_fn = {
+            .start = nci_fault_io_start,
+            .stop = nci_fault_io_stop,
+            .write = nci_fault_io_write,
+            .cancel_write = nci_fault_io_cancel_write
+        };
+        static const NciHalClientFunctions fault_client_fn = {
+            .error = nci_fault_client_error,
+            .read = nci_fault_client_read
+        };
+        NciFaultPriv* self = g_slice_new0(NciFaultPriv);
+
+        self->io.fn = &fault_io_fn;
+        self->client.fn = &fault_client_fn;
+        self->pub.io = &self->io;
+        self->hal = hal;
+        self->rx_buf = g_byte_array_new();
+        g_queue_init(&self->rx);
+        nci_fault_set_config(&self->pub, config);
+        return &self->pub;
+    }
+    return NULL;
+}
+
+void
+nci_fault_free(
+    NciFault* fault)
+{
+    if (G_LIKELY(fault)) {
+        NciFaultPriv* self = nci_fault_cast(fault);
+
+        nci_fault_reset(self);
+        g_byte_array_unref(self->rx_buf);
+        g_rand_free(self->rand);
+        g_slice_free(NciFaultPriv, self);
+    }
+}
+
+void
+nci_fault_set_config(
+    NciFault* fault,
+    const NciFaultConfig* config)
+{
+    if (G_LIKELY(fault)) {
+        NciFaultPriv* self = nci_fault_cast(fault);
+
+        if (config) {
+            self->config = *config;
+        } else {
+            memset(&self->config, 0, sizeof(self->config));
+        }
+        if (self->rand) {
+            g_rand_free(self->rand);
+        }
+        self->rand = self->config.seed ?
+            g_rand_new_with_seed(self->config.seed) : g_rand_new();
+    }
+}
+
+void
+nci_fault_set_clock(
+    NciFault* fault,
+    NciClock* clock)
+{
+    if (G_LIKELY(fault)) {
+        NciFaultPriv* self = nci_fault_cast(fault);
+
+        if (self->clock != clock) {
+            const gint64 delta = nci_clock_now(clock) -
+                nci_clock_now(self->clock);
+            const gboolean write_pending = (self->write_timer != NULL);
+            GList* l;
+
+            /* Everything keeps its delay */
+            nci_clock_clear(self->clock, &self->rx_timer);
+            nci_clock_clear(self->clock, &self->write_timer);
+            for (l = self->rx.head; l; l = l->next) {
+                ((NciFaultPacket*) l->data)->due += delta;
+            }
+            if (self->bus_free) {
+                self->bus_free += delta;
+            }
+            self->write_due += delta;
+            self->write_timer_due += delta;
+            self->clock = clock;
+            nci_fault_rx_schedule(self);
+            if (write_pending) {
+                self->write_timer = nci_fault_timeout_add(self,
+                    self->write_timer_due, nci_fault_write_timer);
+            }
+        }
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
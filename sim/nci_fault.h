@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_FAULT_H
+#define NCI_FAULT_H
+
+#include <nci_plugin_types.h>
+#include <nci_hal.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Fault and latency injection
+ *
+ * NciHalIo decorator which sits between NciCore (or the simulator,
+ * or the replay engine) and the real HAL and makes the link look
+ * worse than it is. Packet order is preserved unless reordering of
+ * write completions is explicitly requested.
+ */
+
+typedef struct nci_fault_config {
+    guint delay_ms;             /* Added to each packet from NFCC */
+    guint jitter_ms;            /* Random extra delay, up to this much */
+    guint ntf_drop_permille;    /* Dropped notifications per 1000 */
+    guint bytes_per_sec;        /* Bus throughput, zero if unlimited */
+    gboolean reorder_data_completion; /* Reply to data first */
+    guint32 seed;               /* Zero for random */
+} NciFaultConfig;
+
+typedef struct nci_fault {
+    NciHalIo* io;               /* Give this one to NciCore */
+    guint rx_packets;           /* Delivered to NciCore */
+    guint tx_packets;           /* Written to NFCC */
+    guint dropped_ntf;
+    guint reordered;            /* Completions delivered after the reply */
+} NciFault;
+
+NciFault*
+nci_fault_new(
+    NciHalIo* hal,
+    const NciFaultConfig* config);
+
+void
+nci_fault_free(
+    NciFault* fault);
+
+/* Can be changed on the fly */
+void
+nci_fault_set_config(
+    NciFault* fault,
+    const NciFaultConfig* config);
+
+/* NULL for the system clock, see nci_clock.h */
+void
+nci_fault_set_clock(
+    NciFault* fault,
+    NciClock* clock);
+
+G_END_DECLS
+
+#endif /* NCI_FAULT_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
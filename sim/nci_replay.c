@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_replay.h"
+#include "nci_clock.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+#include <string.h>
+
+#define REPLAY_ALIGN(n) (((n) + 3) & ~3u)
+
+typedef struct nci_replay_priv {
+    NciReplay pub;
+    NciHalIo io;
+    NciHalClient* client;
+    GMappedFile* map;
+    const guint8* ptr;          /* Next record */
+    const guint8* end;
+    guint64 offset;             /* Of the last record, microseconds */
+    guint64 clock_delay;        /* Carried by the CLOCK record(s) */
+    gdouble speed;
+    NciReplayDoneFunc done;
+    void* user_data;
+    GQueue written;             /* Early writes, GBytes */
+    NciHalClientFunc write_complete;
+    GSource* write_source;
+    NciClockTimer* timer;
+    NciClock* clock;            /* NULL for the system clock */
+    gboolean finished;
+} NciReplayPriv;
+
+static inline NciReplayPriv* nci_replay_cast(NciReplay* pub)
+    { return G_CAST(pub, NciReplayPriv, pub); }
+
+static
+void
+nci_replay_next(
+    NciReplayPriv* self);
+
+/*==========================================================================*
+ * Record decoding
+ *==========================================================================*/
+
+static
+guint16
+nci_replay_get16(
+    const guint8* ptr)
+{
+    return ptr[0] | ((guint16) ptr[1] << 8);
+}
+
+static
+guint32
+nci_replay_get32(
+    const guint8* ptr)
+{
+    return nci_replay_get16(ptr) | ((guint32) nci_replay_get16(ptr + 2)
+        << 16);
+}
+
+static
+guint64
+nci_replay_get64(
+    const guint8* ptr)
+{
+    return nci_replay_get32(ptr) | ((guint64) nci_replay_get32(ptr + 4)
+        << 32);
+}
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+/* Returns the payload of the next record, NULL if there's none */
+static
+const guint8*
+nci_replay_peek(
+    NciReplayPriv* self,
+    guint* type,
+    guint* len)
+{
+    const guint8* rec = self->ptr;
+
+    if (rec + NCI_CAPTURE_RECORD_HEADER_SIZE <= self->end) {
+        const guint size = nci_replay_get16(rec + 4);
+
+        if (rec + NCI_CAPTURE_RECORD_HEADER_SIZE + size <= self->end) {
+            *type = rec[6];
+            *len = size;
+            return rec + NCI_CAPTURE_RECORD_HEADER_SIZE;
+        }
+    }
+    if (rec < self->end) {
+        /* The writer didn't get to finish the last record */
+        GWARN("Capture is truncated");
+        self->ptr = self->end;
+    }
+    return NULL;
+}
+
+/* Moves to the next record and returns the delay in microseconds */
+static
+guint64
+nci_replay_advance(
+    NciReplayPriv* self)
+{
+    const guint8* rec = self->ptr;
+    const guint len = nci_replay_get16(rec + 4);
+    const guint64 prev = self->offset;
+
+    if (rec[6] == NCI_CAPTURE_RECORD_CLOCK && len >= 8) {
+        self->offset = nci_replay_get64(rec + NCI_CAPTURE_RECORD_HEADER_SIZE);
+    } else {
+        self->offset += nci_replay_get32(rec);
+    }
+    self->ptr += NCI_CAPTURE_RECORD_HEADER_SIZE + REPLAY_ALIGN(len);
+    if (self->ptr > self->end) {
+        /* The last record may be missing its padding */
+        self->ptr = self->end;
+    }
+    return self->offset - prev;
+}
+
+static
+gboolean
+nci_replay_timer(
+    gpointer user_data)
+{
+    NciReplayPriv* self = user_data;
+    guint type, len;
+    const guint8* frame = nci_replay_peek(self, &type, &len);
+
+    self->timer = NULL;
+    self->clock_delay = 0;
+    nci_replay_advance(self);
+    self->pub.frames++;
+    self->client->fn->read(self->client, frame, len);
+    if (self->client) {
+        nci_replay_next(self);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_replay_next(
+    NciReplayPriv* self)
+{
+    guint type, len;
+    const guint8* frame;
+
+    while (!self->timer && (frame = nci_replay_peek(self, &type, &len))) {
+        if (type == NCI_CAPTURE_RECORD_RX) {
+            const guint64 delay = self->clock_delay +
+                nci_replay_get32(self->ptr);
+
+            self->timer = nci_clock_timeout_add(self->clock,
+                (self->speed > 0) ? (guint) (delay / 1000 / self->speed) : 0,
+                nci_replay_timer, self);
+        } else if (type == NCI_CAPTURE_RECORD_TX) {
+            GBytes* written = g_queue_peek_head(&self->written);
+
+            if (!written) {
+                /* Wait for the host */
+                return;
+            }
+            g_queue_pop_head(&self->written);
+            if (g_bytes_get_size(written) != len ||
+                memcmp(g_bytes_get_data(written, NULL), frame, len)) {
+                GDEBUG("Replay mismatch at frame %u", self->pub.frames);
+                self->pub.mismatches++;
+            }
+            g_bytes_unref(written);
+            nci_replay_advance(self);
+            self->clock_delay = 0;
+            self->pub.frames++;
+        } else {
+            self->clock_delay += nci_replay_advance(self);
+        }
+    }
+
+    if (!self->timer && !self->finished && self->ptr >= self->end) {
+        self->finished = TRUE;
+        GDEBUG("Replay finished, %u frame(s), %u mismatch(es)",
+            self->pub.frames, self->pub.mismatches);
+        if (self->done) {
+            self->done(&self->pub, self->user_data);
+        }
+    }
+}
+
+static
+void
+nci_replay_reset(
+    NciReplayPriv* self)
+{
+    GBytes* written;
+
+    nci_clock_clear(self->clock, &self->timer);
+    nci_source_clear(&self->write_source);
+    self->write_complete = NULL;
+    while ((written = g_queue_pop_head(&self->written)) != NULL) {
+        g_bytes_unref(written);
+    }
+    self->ptr = (const guint8*) g_mapped_file_get_contents(self->map) +
+        NCI_CAPTURE_HEADER_SIZE;
+    self->offset = 0;
+    self->clock_delay = 0;
+    self->finished = FALSE;
+}
+
+static
+gboolean
+nci_replay_write_done(
+    gpointer user_data)
+{
+    NciReplayPriv* self = user_data;
+    NciHalClientFunc complete = self->write_complete;
+
+    self->write_source = NULL;
+    self->write_complete = NULL;
+    if (complete) {
+        complete(self->client, TRUE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+nci_replay_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciReplayPriv* self = G_CAST(io, NciReplayPriv, io);
+
+    nci_replay_reset(self);
+    self->client = client;
+    nci_replay_next(self);
+    return TRUE;
+}
+
+static
+void
+nci_replay_io_stop(
+    NciHalIo* io)
+{
+    NciReplayPriv* self = G_CAST(io, NciReplayPriv, io);
+
+    nci_replay_reset(self);
+    self->client = NULL;
+}
+
+static
+gboolean
+nci_replay_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciReplayPriv* self = G_CAST(io, NciReplayPriv, io);
+    GByteArray* buf = g_byte_array_new();
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        g_byte_array_append(buf, chunks[i].bytes, chunks[i].size);
+    }
+    g_queue_push_tail(&self->written, g_byte_array_free_to_bytes(buf));
+    self->write_complete = complete;
+    if (!self->write_source) {
+        self->write_source = nci_idle_add(nci_replay_write_done, self);
+    }
+    nci_replay_next(self);
+    return TRUE;
+}
+
+static
+void
+nci_replay_io_cancel_write(
+    NciHalIo* io)
+{
+    NciReplayPriv* self = G_CAST(io, NciReplayPriv, io);
+
+    self->write_complete = NULL;
+    nci_source_clear(&self->write_source);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciReplay*
+nci_replay_new(
+    const char* path,
+    gdouble speed,
+    NciReplayDoneFunc done,
+    void* user_data)
+{
+    GError* error = NULL;
+    GMappedFile* map = g_mapped_file_new(path, FALSE, &error);
+
+    if (map) {
+        const guint8* data = (const guint8*) g_mapped_file_get_contents(map);
+        const gsize size = g_mapped_file_get_length(map);
+
+        if (size >= NCI_CAPTURE_HEADER_SIZE &&
+            !memcmp(data, NCI_CAPTURE_MAGIC, NCI_CAPTURE_MAGIC_SIZE) &&
+            nci_replay_get16(data + NCI_CAPTURE_MAGIC_SIZE) ==
+            NCI_CAPTURE_VERSION) {
+            static const NciHalIoFunctions replay_io_fn = {
+                .start = nci_replay_io_start,
+                .stop = nci_replay_io_stop,
+                .write = nci_replay_io_write,
+                .cancel_write = nci_replay_io_cancel_write
+            };
+            NciReplayPriv* self = g_slice_new0(NciReplayPriv);
+
+            self->io.fn = &replay_io_fn;
+            self->pub.io = &self->io;
+            self->map = map;
+            self->end = data + size;
+            self->speed = speed;
+            self->done = done;
+            self->user_data = user_data;
+            g_queue_init(&self->written);
+            nci_replay_reset(self);
+            return &self->pub;
+        }
+        GWARN("%s is not an NCI capture", path);
+        g_mapped_file_unref(map);
+    } else {
+        GWARN("%s", error->message);
+        g_error_free(error);
+    }
+    return NULL;
+}
+
+void
+nci_replay_set_clock(
+    NciReplay* replay,
+    NciClock* clock)
+{
+    if (G_LIKELY(replay)) {
+        NciReplayPriv* self = nci_replay_cast(replay);
+
+        if (self->clock != clock) {
+            const gboolean pending = (self->timer != NULL);
+
+            /* The pending frame starts waiting anew */
+            nci_clock_clear(self->clock, &self->timer);
+            self->clock = clock;
+            if (pending) {
+                nci_replay_next(self);
+            }
+        }
+    }
+}
+
+void
+nci_replay_free(
+    NciReplay* replay)
+{
+    if (G_LIKELY(replay)) {
+        NciReplayPriv* self = nci_replay_cast(replay);
+
+        nci_replay_reset(self);
+        g_mapped_file_unref(self->map);
+        g_slice_free(NciReplayPriv, self);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
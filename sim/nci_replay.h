@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_REPLAY_H
+#define NCI_REPLAY_H
+
+#include <nci_capture.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Capture replay
+ *
+ * NciHalIo which plays a capture written by NciCapture back to the
+ * host. TX frames recorded in the file are expected to be written
+ * by the host in the same order (mismatches are counted but otherwise
+ * ignored), RX frames are delivered to the host with the recorded
+ * delays divided by the speed factor, counting from the previous frame.
+ * Zero speed means no delays at all.
+ */
+
+typedef struct nci_replay NciReplay;
+
+typedef
+void
+(*NciReplayDoneFunc)(
+    NciReplay* replay,
+    void* user_data);
+
+struct nci_replay {
+    NciHalIo* io;               /* Give this one to NciCore */
+    guint frames;               /* Frames replayed so far */
+    guint mismatches;           /* TX frames which didn't match */
+};
+
+NciReplay*
+nci_replay_new(
+    const char* path,
+    gdouble speed,
+    NciReplayDoneFunc done,
+    void* user_data); /* NULL if the file is not a valid capture */
+
+void
+nci_replay_free(
+    NciReplay* replay);
+
+/* NULL for the system clock, see nci_clock.h */
+void
+nci_replay_set_clock(
+    NciReplay* replay,
+    NciClock* clock);
+
+G_END_DECLS
+
+#endif /* NCI_REPLAY_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
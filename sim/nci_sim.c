@@ -0,0 +1,1609 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_sim.h"
+#include "nci_clock.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+#define SIM_DEFAULT_NCI_VERSION (0x20)
+#define SIM_MAX_DATA_PAYLOAD (0xff)
+#define SIM_ROUTING_TABLE_SIZE (0x100)
+#define SIM_NFCEE_PROTOCOL_APDU (0x00)
+#define SIM_NFCEE_MODE_ENABLE (0x01)
+
+/* RF_DEACTIVATE types and reasons */
+#define SIM_DEACTIVATE_IDLE (0x00)
+#define SIM_DEACTIVATE_SLEEP (0x01)
+#define SIM_DEACTIVATE_SLEEP_AF (0x02)
+#define SIM_DEACTIVATE_DISCOVERY (0x03)
+#define SIM_REASON_DH_REQUEST (0x00)
+#define SIM_REASON_ENDPOINT_REQUEST (0x01)
+#define SIM_REASON_RF_LINK_LOSS (0x02)
+
+/* Type 2 tag commands */
+#define T2T_CMD_READ (0x30)
+#define T2T_CMD_WRITE (0xa2)
+#define T2T_ACK (0x0a)
+#define T2T_NAK (0x00)
+#define T2T_BLOCK_SIZE (4)
+#define T2T_READ_SIZE (16)
+
+/* Type 4 tag (NFC Forum T4T, mapping version 2.0) */
+#define T4T_CC_FILE_ID (0xe103)
+#define T4T_NDEF_FILE_ID (0xe104)
+#define T4T_CC_SIZE (15)
+#define T4T_MAX_NDEF_FILE_SIZE (0x1000)
+#define ISO_CLA (0x00)
+#define ISO_INS_SELECT (0xa4)
+#define ISO_INS_READ_BINARY (0xb0)
+#define ISO_INS_UPDATE_BINARY (0xd6)
+#define ISO_SW_OK (0x9000)
+#define ISO_SW_WRONG_LENGTH (0x6700)
+#define ISO_SW_NOT_FOUND (0x6a82)
+#define ISO_SW_WRONG_P1P2 (0x6b00)
+#define ISO_SW_INS_NOT_SUPPORTED (0x6d00)
+#define ISO_SW_CLA_NOT_SUPPORTED (0x6e00)
+#define ISO_SW_NOT_ALLOWED (0x6986)
+
+typedef enum nci_sim_object_type {
+    SIM_OBJECT_T2,
+    SIM_OBJECT_T4,
+    SIM_OBJECT_PEER,
+    SIM_OBJECT_READER
+} NCI_SIM_OBJECT_TYPE;
+
+typedef enum nci_sim_t4_file {
+    T4_FILE_NONE,
+    T4_FILE_APP,
+    T4_FILE_CC,
+    T4_FILE_NDEF
+} NCI_SIM_T4_FILE;
+
+struct nci_sim_object {
+    gint ref_count;
+    NCI_SIM_OBJECT_TYPE type;
+    guint8 uid[10];
+    guint8 uid_len;
+    GByteArray* mem;            /* T2 memory or T4 NDEF file */
+    NCI_SIM_T4_FILE t4_file;
+    GPtrArray* apdus;           /* Reader script, GBytes */
+    guint next_apdu;
+    NciSimApduFunc apdu_fn;
+    void* user_data;
+};
+
+typedef enum nci_sim_rf_state {
+    SIM_RFST_IDLE,
+    SIM_RFST_DISCOVERY,
+    SIM_RFST_POLL_ACTIVE,
+    SIM_RFST_POLL_SLEEP,
+    SIM_RFST_LISTEN_ACTIVE,
+    SIM_RFST_LISTEN_SLEEP
+} NCI_SIM_RF_STATE;
+
+typedef enum nci_sim_event_type {
+    SIM_EVENT_WRITE_DONE,
+    SIM_EVENT_PACKET,
+    SIM_EVENT_NFCEE,            /* Packet which CORE_RESET cancels */
+    SIM_EVENT_ACTIVATE,
+    SIM_EVENT_APDU,
+    SIM_EVENT_SLEEP,
+    SIM_EVENT_LEAVE
+} NCI_SIM_EVENT_TYPE;
+
+typedef struct nci_sim_event {
+    gint64 due;                 /* Monotonic time, microseconds */
+    guint epoch;                /* Dropped if RF state has changed */
+    NCI_SIM_EVENT_TYPE type;
+    GBytes* pkt;
+    NciHalClientFunc complete;
+} NciSimEvent;
+
+typedef struct nci_sim_priv {
+    NciSim pub;
+    NciHalIo io;
+    NciHalClient* client;
+    NciSimConfig config;
+    NCI_SIM_RF_STATE rf_state;
+    guint epoch;                /* Incremented on each RF state change */
+    gboolean poll_a;            /* Configured by RF_DISCOVER_CMD */
+    gboolean listen_a;
+    NciSimObject* obj;          /* In the field */
+    GQueue events;              /* Sorted by due time */
+    NciClockTimer* timer;
+    NciClock* clock;            /* NULL for the system clock */
+    GByteArray* rx;             /* Segmented data message from DH */
+    gboolean nfcee_enabled;
+    GByteArray* routing;        /* Routing table being received */
+    GBytes* routing_table;      /* The last complete one */
+} NciSimPriv;
+
+static inline NciSimPriv* nci_sim_cast(NciSim* pub)
+    { return G_CAST(pub, NciSimPriv, pub); }
+
+static
+void
+nci_sim_schedule(
+    NciSimPriv* self);
+
+/*==========================================================================*
+ * Event queue
+ *==========================================================================*/
+
+static
+void
+nci_sim_event_free(
+    NciSimEvent* event)
+{
+    if (event->pkt) {
+        g_bytes_unref(event->pkt);
+    }
+    g_slice_free(NciSimEvent, event);
+}
+
+static
+NciSimEvent*
+nci_sim_queue(
+    NciSimPriv* self,
+    NCI_SIM_EVENT_TYPE type,
+    guint delay_ms,
+    guint epoch)
+{
+    NciSimEvent* event = g_slice_new0(NciSimEvent);
+    GList* l;
+
+    event->due = nci_clock_now(self->clock) + (gint64) delay_ms * 1000;
+    event->epoch = epoch;
+    event->type = type;
+
+    /* Events due at the same time are delivered in order of submission */
+    for (l = self->events.tail; l; l = l->prev) {
+        const NciSimEvent* prev = l->data;
+
+        if (prev->due <= event->due) {
+            break;
+        }
+    }
+    if (l) {
+        g_queue_insert_after(&self->events, l, event);
+    } else {
+        g_queue_push_head(&self->events, event);
+    }
+    nci_sim_schedule(self);
+    return event;
+}
+
+static
+void
+nci_sim_queue_packet(
+    NciSimPriv* self,
+    NCI_SIM_EVENT_TYPE type,
+    guint delay_ms,
+    guint epoch,
+    guint8 hdr0,
+    guint8 hdr1,
+    const void* payload,
+    guint len)
+{
+    GByteArray* buf = g_byte_array_sized_new(NCI_HDR_SIZE + len);
+    guint8 hdr[NCI_HDR_SIZE];
+
+    hdr[0] = hdr0;
+    hdr[1] = hdr1;
+    hdr[2] = (guint8) len;
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+    g_byte_array_append(buf, payload, len);
+    nci_sim_queue(self, type, delay_ms, epoch)->pkt =
+        g_byte_array_free_to_bytes(buf);
+}
+
+static
+void
+nci_sim_rsp(
+    NciSimPriv* self,
+    guint8 gid,
+    guint8 oid,
+    const void* payload,
+    guint len)
+{
+    nci_sim_queue_packet(self, SIM_EVENT_PACKET, self->config.rsp_latency_ms,
+        0, NCI_HDR_MT_RSP | gid, oid, payload, len);
+}
+
+static
+void
+nci_sim_status_rsp(
+    NciSimPriv* self,
+    guint8 gid,
+    guint8 oid,
+    guint8 status)
+{
+    nci_sim_rsp(self, gid, oid, &status, 1);
+}
+
+static
+void
+nci_sim_ntf(
+    NciSimPriv* self,
+    guint delay_ms,
+    guint8 gid,
+    guint8 oid,
+    const void* payload,
+    guint len)
+{
+    nci_sim_queue_packet(self, SIM_EVENT_PACKET, delay_ms, 0,
+        NCI_HDR_MT_NTF | gid, oid, payload, len);
+}
+
+/* Sends data message from the remote endpoint, segmenting if necessary */
+static
+void
+nci_sim_data(
+    NciSimPriv* self,
+    guint delay_ms,
+    const void* data,
+    guint len)
+{
+    const guint8* ptr = data;
+
+    do {
+        const guint n = MIN(len, SIM_MAX_DATA_PAYLOAD);
+
+        nci_sim_queue_packet(self, SIM_EVENT_PACKET, delay_ms, self->epoch,
+            NCI_HDR_MT_DATA | NCI_STATIC_RF_CONN_ID |
+            ((n < len) ? NCI_HDR_PBF : 0), 0, ptr, n);
+        ptr += n;
+        len -= n;
+    } while (len > 0);
+}
+
+static
+void
+nci_sim_rf_changed(
+    NciSimPriv* self,
+    NCI_SIM_RF_STATE state)
+{
+    /* Whatever was in flight for the previous state is now void */
+    self->rf_state = state;
+    if (!++(self->epoch)) {
+        self->epoch++;
+    }
+    g_byte_array_set_size(self->rx, 0);
+}
+
+/*==========================================================================*
+ * Remote endpoints
+ *==========================================================================*/
+
+static
+void
+nci_sim_t2_transceive(
+    NciSimPriv* self,
+    NciSimObject* obj,
+    const guint8* cmd,
+    guint len)
+{
+    GByteArray* mem = obj->mem;
+    guint8 rsp[T2T_READ_SIZE + 1];
+
+    if (len == 2 && cmd[0] == T2T_CMD_READ) {
+        const guint blocks = mem->len / T2T_BLOCK_SIZE;
+        guint i;
+
+        /* Reading beyond the last block rolls over to block 0 */
+        for (i = 0; i < T2T_READ_SIZE; i++) {
+            const guint block = (cmd[1] + i / T2T_BLOCK_SIZE) % blocks;
+
+            rsp[i] = mem->data[block * T2T_BLOCK_SIZE + i % T2T_BLOCK_SIZE];
+        }
+        rsp[T2T_READ_SIZE] = NCI_STATUS_OK;
+        nci_sim_data(self, self->config.data_latency_ms, rsp, sizeof(rsp));
+    } else {
+        /* Short frame (4 bits) */
+        rsp[0] = T2T_NAK;
+        rsp[1] = NCI_STATUS_STATUS_OK_4_BIT;
+        if (len == 2 + T2T_BLOCK_SIZE && cmd[0] == T2T_CMD_WRITE &&
+            cmd[1] >= 4 && (cmd[1] + 1) * T2T_BLOCK_SIZE <= mem->len) {
+            memcpy(mem->data + cmd[1] * T2T_BLOCK_SIZE, cmd + 2,
+                T2T_BLOCK_SIZE);
+            rsp[0] = T2T_ACK;
+        }
+        nci_sim_data(self, self->config.data_latency_ms, rsp, 2);
+    }
+}
+
+static
+guint
+nci_sim_t4_apdu(
+    NciSimObject* obj,
+    const guint8* apdu,
+    guint len,
+    GByteArray* rsp)
+{
+    static const guint8 ndef_aid[] = {
+        0xd2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01
+    };
+    guint lc = 0;
+    const guint8* data = NULL;
+
+    if (len < 4) {
+        return ISO_SW_WRONG_LENGTH;
+    } else if (apdu[0] != ISO_CLA) {
+        return ISO_SW_CLA_NOT_SUPPORTED;
+    }
+    if (len > 5) {
+        lc = apdu[4];
+        data = apdu + 5;
+        if (len < 5 + lc) {
+            return ISO_SW_WRONG_LENGTH;
+        }
+    }
+
+    switch (apdu[1]) {
+    case ISO_INS_SELECT:
+        if (apdu[2] == 0x04 && lc == sizeof(ndef_aid) &&
+            !memcmp(data, ndef_aid, lc)) {
+            obj->t4_file = T4_FILE_APP;
+            return ISO_SW_OK;
+        } else if (apdu[2] == 0x00 && lc == 2 &&
+            obj->t4_file != T4_FILE_NONE) {
+            const guint fid = (data[0] << 8) | data[1];
+
+            if (fid == T4T_CC_FILE_ID) {
+                obj->t4_file = T4_FILE_CC;
+                return ISO_SW_OK;
+            } else if (fid == T4T_NDEF_FILE_ID) {
+                obj->t4_file = T4_FILE_NDEF;
+                return ISO_SW_OK;
+            }
+        }
+        return ISO_SW_NOT_FOUND;
+    case ISO_INS_READ_BINARY:
+        if (obj->t4_file == T4_FILE_CC || obj->t4_file == T4_FILE_NDEF) {
+            const guint off = (apdu[2] << 8) | apdu[3];
+            const guint le = (len == 5) ? (apdu[4] ? apdu[4] : 256) : 256;
+            guint8 cc[T4T_CC_SIZE];
+            const guint8* file;
+            guint size;
+
+            if (obj->t4_file == T4_FILE_CC) {
+                /*
+                 * CCLEN(2), Mapping Version(1), MLe(2), MLc(2),
+                 * NDEF File Control TLV(8)
+                 */
+                cc[0] = 0x00; cc[1] = T4T_CC_SIZE;
+                cc[2] = 0x20;
+                cc[3] = 0x00; cc[4] = 0xff;
+                cc[5] = 0x00; cc[6] = 0xff;
+                cc[7] = 0x04; cc[8] = 0x06;
+                cc[9] = (guint8) (T4T_NDEF_FILE_ID >> 8);
+                cc[10] = (guint8) T4T_NDEF_FILE_ID;
+                cc[11] = (guint8) (T4T_MAX_NDEF_FILE_SIZE >> 8);
+                cc[12] = (guint8) T4T_MAX_NDEF_FILE_SIZE;
+                cc[13] = 0x00; cc[14] = 0x00;
+                file = cc;
+                size = sizeof(cc);
+            } else {
+                file = obj->mem->data;
+                size = obj->mem->len;
+            }
+            if (off > size) {
+                return ISO_SW_WRONG_P1P2;
+            }
+            g_byte_array_append(rsp, file + off, MIN(le, size - off));
+            return ISO_SW_OK;
+        }
+        return ISO_SW_NOT_ALLOWED;
+    case ISO_INS_UPDATE_BINARY:
+        if (obj->t4_file == T4_FILE_NDEF && data) {
+            const guint off = (apdu[2] << 8) | apdu[3];
+
+            if (off + lc > T4T_MAX_NDEF_FILE_SIZE) {
+                return ISO_SW_WRONG_P1P2;
+            }
+            if (obj->mem->len < off + lc) {
+                g_byte_array_set_size(obj->mem, off + lc);
+            }
+            memcpy(obj->mem->data + off, data, lc);
+            return ISO_SW_OK;
+        }
+        return ISO_SW_NOT_ALLOWED;
+    }
+    return ISO_SW_INS_NOT_SUPPORTED;
+}
+
+static
+void
+nci_sim_t4_transceive(
+    NciSimPriv* self,
+    NciSimObject* obj,
+    const guint8* apdu,
+    guint len)
+{
+    if (len) {
+        GByteArray* rsp = g_byte_array_new();
+        const guint sw = nci_sim_t4_apdu(obj, apdu, len, rsp);
+        guint8 sw_bytes[2];
+
+        sw_bytes[0] = (guint8) (sw >> 8);
+        sw_bytes[1] = (guint8) sw;
+        g_byte_array_append(rsp, sw_bytes, sizeof(sw_bytes));
+        nci_sim_data(self, self->config.data_latency_ms, rsp->data,
+            rsp->len);
+        g_byte_array_unref(rsp);
+    } else {
+        /* Presence check (empty I-block) */
+        nci_sim_data(self, self->config.data_latency_ms, NULL, 0);
+    }
+}
+
+static
+void
+nci_sim_reader_send_next(
+    NciSimPriv* self,
+    NciSimObject* reader)
+{
+    if (reader->next_apdu < reader->apdus->len) {
+        NciSimEvent* event = nci_sim_queue(self, SIM_EVENT_APDU,
+            self->config.data_latency_ms, self->epoch);
+
+        event->pkt = g_bytes_ref(reader->apdus->pdata[reader->next_apdu]);
+    }
+}
+
+static
+void
+nci_sim_reader_receive(
+    NciSimPriv* self,
+    NciSimObject* reader,
+    const guint8* data,
+    guint len)
+{
+    if (reader->next_apdu < reader->apdus->len) {
+        const guint index = reader->next_apdu++;
+
+        if (reader->apdu_fn) {
+            GUtilData rsp;
+
+            rsp.bytes = data;
+            rsp.size = len;
+            reader->apdu_fn(reader, index, &rsp, reader->user_data);
+        }
+        nci_sim_reader_send_next(self, reader);
+    }
+}
+
+static
+void
+nci_sim_data_from_dh(
+    NciSimPriv* self,
+    const guint8* data,
+    guint len)
+{
+    NciSimObject* obj = self->obj;
+    static const guint8 symm[] = { 0x00, 0x00 };
+
+    if (!obj) {
+        return;
+    }
+    switch (self->rf_state) {
+    case SIM_RFST_POLL_ACTIVE:
+        switch (obj->type) {
+        case SIM_OBJECT_T2:
+            nci_sim_t2_transceive(self, obj, data, len);
+            break;
+        case SIM_OBJECT_T4:
+            nci_sim_t4_transceive(self, obj, data, len);
+            break;
+        case SIM_OBJECT_PEER:
+            /* LLCP link is kept alive but nothing else happens */
+            nci_sim_data(self, self->config.data_latency_ms, symm,
+                sizeof(symm));
+            break;
+        case SIM_OBJECT_READER:
+            break;
+        }
+        break;
+    case SIM_RFST_LISTEN_ACTIVE:
+        if (obj->type == SIM_OBJECT_READER) {
+            nci_sim_reader_receive(self, obj, data, len);
+        }
+        break;
+    case SIM_RFST_IDLE:
+    case SIM_RFST_DISCOVERY:
+    case SIM_RFST_POLL_SLEEP:
+    case SIM_RFST_LISTEN_SLEEP:
+        GDEBUG("Sim: unexpected data in state %d", self->rf_state);
+        break;
+    }
+}
+
+/*==========================================================================*
+ * RF
+ *==========================================================================*/
+
+static
+gboolean
+nci_sim_can_activate(
+    NciSimPriv* self)
+{
+    NciSimObject* obj = self->obj;
+
+    if (obj) {
+        switch (obj->type) {
+        case SIM_OBJECT_T2:
+        case SIM_OBJECT_T4:
+        case SIM_OBJECT_PEER:
+            return self->poll_a;
+        case SIM_OBJECT_READER:
+            return self->listen_a;
+        }
+    }
+    return FALSE;
+}
+
+static
+void
+nci_sim_schedule_activation(
+    NciSimPriv* self)
+{
+    if (self->rf_state == SIM_RFST_DISCOVERY && nci_sim_can_activate(self)) {
+        nci_sim_queue(self, SIM_EVENT_ACTIVATE, self->config.rf_latency_ms,
+            self->epoch);
+    }
+}
+
+static
+void
+nci_sim_activate(
+    NciSimPriv* self)
+{
+    NciSimObject* obj = self->obj;
+    GByteArray* ntf = g_byte_array_new();
+    guint8 hdr[7];
+    guint8 tail[4];
+    guint8 tech[16];
+    guint8 act[32];
+    guint tech_len = 0, act_len = 0;
+    NCI_SIM_RF_STATE state = SIM_RFST_POLL_ACTIVE;
+
+    /* Discovery ID, RF Interface, RF Protocol, Mode, Max Payload, Credits */
+    hdr[0] = 0x01;
+    hdr[4] = SIM_MAX_DATA_PAYLOAD;
+    hdr[5] = 0x01;
+    hdr[3] = NCI_MODE_PASSIVE_POLL_A;
+
+    switch (obj->type) {
+    case SIM_OBJECT_T2:
+    case SIM_OBJECT_T4:
+    case SIM_OBJECT_PEER:
+        /* SENS_RES(2), NFCID1 Length(1), NFCID1, SEL_RES Length(1), SEL_RES */
+        tech[tech_len++] = (obj->type == SIM_OBJECT_T2) ? 0x44 : 0x04;
+        tech[tech_len++] = 0x00;
+        tech[tech_len++] = obj->uid_len;
+        memcpy(tech + tech_len, obj->uid, obj->uid_len);
+        tech_len += obj->uid_len;
+        tech[tech_len++] = 0x01;
+        switch (obj->type) {
+        case SIM_OBJECT_T2:
+            tech[tech_len++] = 0x00;
+            hdr[1] = NCI_RF_INTERFACE_FRAME;
+            hdr[2] = NCI_PROTOCOL_T2T;
+            break;
+        case SIM_OBJECT_T4:
+            tech[tech_len++] = 0x20;
+            hdr[1] = NCI_RF_INTERFACE_ISO_DEP;
+            hdr[2] = NCI_PROTOCOL_ISO_DEP;
+            /* RATS Response Length(1), ATS (TL, T0, TA, TB, TC) */
+            act[act_len++] = 0x05;
+            act[act_len++] = 0x05;
+            act[act_len++] = 0x78;
+            act[act_len++] = 0x80;
+            act[act_len++] = 0x70;
+            act[act_len++] = 0x02;
+            break;
+        default:
+            tech[tech_len++] = 0x40;
+            hdr[1] = NCI_RF_INTERFACE_NFC_DEP;
+            hdr[2] = NCI_PROTOCOL_NFC_DEP;
+            /*
+             * ATR_RES Length(1), ATR_RES starting with NFCID3: NFCID3(10),
+             * DID(1), BS(1), BR(1), TO(1), PP(1), General Bytes (LLCP
+             * magic and version 1.1)
+             */
+            act[act_len++] = 21;
+            memset(act + act_len, 0, 10);
+            memcpy(act + act_len, obj->uid, obj->uid_len);
+            act_len += 10;
+            act[act_len++] = 0x00;
+            act[act_len++] = 0x00;
+            act[act_len++] = 0x00;
+            act[act_len++] = 0x0e;
+            act[act_len++] = 0x32;
+            act[act_len++] = 0x46;
+            act[act_len++] = 0x66;
+            act[act_len++] = 0x6d;
+            act[act_len++] = 0x01;
+            act[act_len++] = 0x01;
+            act[act_len++] = 0x11;
+            break;
+        }
+        break;
+    case SIM_OBJECT_READER:
+        hdr[1] = NCI_RF_INTERFACE_ISO_DEP;
+        hdr[2] = NCI_PROTOCOL_ISO_DEP;
+        hdr[3] = NCI_MODE_PASSIVE_LISTEN_A;
+        /* RATS Command Param Byte */
+        act[act_len++] = 0x80;
+        state = SIM_RFST_LISTEN_ACTIVE;
+        obj->next_apdu = 0;
+        break;
+    }
+    hdr[6] = (guint8) tech_len;
+
+    /* Data Exchange Mode, Transmit Rate, Receive Rate, Activation Params */
+    tail[0] = hdr[3];
+    tail[1] = 0x00;
+    tail[2] = 0x00;
+    tail[3] = (guint8) act_len;
+
+    g_byte_array_append(ntf, hdr, sizeof(hdr));
+    g_byte_array_append(ntf, tech, tech_len);
+    g_byte_array_append(ntf, tail, sizeof(tail));
+    g_byte_array_append(ntf, act, act_len);
+
+    GDEBUG("Sim: activating %s", (state == SIM_RFST_POLL_ACTIVE) ?
+        "remote target" : "remote reader");
+    obj->t4_file = T4_FILE_NONE;
+    nci_sim_rf_changed(self, state);
+    nci_sim_ntf(self, 0, NCI_GID_RF, NCI_OID_RF_INTF_ACTIVATED,
+        ntf->data, ntf->len);
+    g_byte_array_unref(ntf);
+
+    if (obj->type == SIM_OBJECT_READER) {
+        nci_sim_reader_send_next(self, obj);
+    }
+}
+
+static
+void
+nci_sim_deactivate_ntf(
+    NciSimPriv* self,
+    guint delay_ms,
+    guint8 type,
+    guint8 reason)
+{
+    const guint8 ntf[] = { type, reason };
+
+    nci_sim_ntf(self, delay_ms, NCI_GID_RF, NCI_OID_RF_DEACTIVATE,
+        ntf, sizeof(ntf));
+}
+
+static
+gboolean
+nci_sim_rf_active(
+    NciSimPriv* self)
+{
+    switch (self->rf_state) {
+    case SIM_RFST_POLL_ACTIVE:
+    case SIM_RFST_POLL_SLEEP:
+    case SIM_RFST_LISTEN_ACTIVE:
+    case SIM_RFST_LISTEN_SLEEP:
+        return TRUE;
+    case SIM_RFST_IDLE:
+    case SIM_RFST_DISCOVERY:
+        break;
+    }
+    return FALSE;
+}
+
+/* The remote endpoint has left the field */
+static
+void
+nci_sim_link_loss(
+    NciSimPriv* self)
+{
+    if (nci_sim_rf_active(self)) {
+        GDEBUG("Sim: link loss");
+        nci_sim_rf_changed(self, SIM_RFST_DISCOVERY);
+        nci_sim_deactivate_ntf(self, 0, SIM_DEACTIVATE_DISCOVERY,
+            SIM_REASON_RF_LINK_LOSS);
+    }
+}
+
+/*==========================================================================*
+ * Control messages
+ *==========================================================================*/
+
+static
+void
+nci_sim_nfcc_reset(
+    NciSimPriv* self)
+{
+    GList* l = self->events.head;
+
+    /* Pending NFCEE_MODE_SET outcome is lost along with the NFCEE mode */
+    while (l) {
+        GList* next = l->next;
+        NciSimEvent* event = l->data;
+
+        if (event->type == SIM_EVENT_NFCEE) {
+            g_queue_delete_link(&self->events, l);
+            nci_sim_event_free(event);
+        }
+        l = next;
+    }
+    nci_sim_schedule(self);
+    self->nfcee_enabled = FALSE;
+
+    /* And the routing table */
+    g_byte_array_set_size(self->routing, 0);
+    if (self->routing_table) {
+        g_bytes_unref(self->routing_table);
+        self->routing_table = NULL;
+    }
+    nci_sim_rf_changed(self, SIM_RFST_IDLE);
+}
+
+static
+void
+nci_sim_core_cmd(
+    NciSimPriv* self,
+    guint8 oid,
+    const guint8* payload,
+    guint len)
+{
+    const guint8 version = self->config.nci_version;
+    GByteArray* rsp = g_byte_array_new();
+    guint8 status = NCI_STATUS_OK;
+
+    switch (oid) {
+    case NCI_OID_CORE_RESET:
+        nci_sim_nfcc_reset(self);
+        g_byte_array_append(rsp, &status, 1);
+        if (version >= 0x20) {
+            /*
+             * Reset Trigger(1), Configuration Status(1), NCI Version(1),
+             * Manufacturer ID(1), Manufacturer Specific Info Length(1)
+             */
+            const guint8 ntf[] = {
+                0x02, len ? payload[0] : 0x00, version, 0x00, 0x00
+            };
+
+            nci_sim_rsp(self, NCI_GID_CORE, oid, rsp->data, rsp->len);
+            nci_sim_ntf(self, self->config.rsp_latency_ms, NCI_GID_CORE,
+                oid, ntf, sizeof(ntf));
+            g_byte_array_set_size(rsp, 0);
+        } else {
+            /* NCI Version(1), Configuration Status(1) */
+            const guint8 tail[] = { version, len ? payload[0] : 0x00 };
+
+            g_byte_array_append(rsp, tail, sizeof(tail));
+        }
+        break;
+    case NCI_OID_CORE_INIT:
+        /* Status(1), NFCC Features(4) */
+        {
+            const guint8 head[] = { NCI_STATUS_OK, 0x00, 0x0e, 0x00, 0x00 };
+
+            g_byte_array_append(rsp, head, sizeof(head));
+        }
+        if (version >= 0x20) {
+            /*
+             * Max Logical Connections(1), Max Routing Table Size(2),
+             * Max Control Packet Payload Size(1), Max Data Packet
+             * Payload Size of the Static HCI Connection(1), Number of
+             * Credits of the Static HCI Connection(1), Max NFC-V RF
+             * Frame Size(2), Number of Supported RF Interfaces(1),
+             * RF Interfaces with no extensions (2 bytes each)
+             */
+            const guint8 tail[] = {
+                0x04,
+                (guint8) SIM_ROUTING_TABLE_SIZE,
+                (guint8) (SIM_ROUTING_TABLE_SIZE >> 8),
+                NCI_MAX_CTRL_PAYLOAD, SIM_MAX_DATA_PAYLOAD, 0x01,
+                0x00, 0x01,
+                0x03,
+                NCI_RF_INTERFACE_FRAME, 0x00,
+                NCI_RF_INTERFACE_ISO_DEP, 0x00,
+                NCI_RF_INTERFACE_NFC_DEP, 0x00
+            };
+
+            g_byte_array_append(rsp, tail, sizeof(tail));
+        } else {
+            /*
+             * Number of Supported RF Interfaces(1), RF Interfaces(n),
+             * Max Logical Connections(1), Max Routing Table Size(2),
+             * Max Control Packet Payload Size(1), Max Size for Large
+             * Parameters(2), Manufacturer ID(1), Manufacturer Specific
+             * Information(4)
+             */
+            const guint8 tail[] = {
+                0x03,
+                NCI_RF_INTERFACE_FRAME,
+                NCI_RF_INTERFACE_ISO_DEP,
+                NCI_RF_INTERFACE_NFC_DEP,
+                0x04,
+                (guint8) SIM_ROUTING_TABLE_SIZE,
+                (guint8) (SIM_ROUTING_TABLE_SIZE >> 8),
+                NCI_MAX_CTRL_PAYLOAD,
+                0x00, 0x00,
+                0x00,
+                0x00, 0x00, 0x00, 0x00
+            };
+
+            g_byte_array_append(rsp, tail, sizeof(tail));
+        }
+        break;
+    case NCI_OID_CORE_SET_CONFIG:
+        /* Status(1), Number of Parameters(1) */
+        {
+            const guint8 ok[] = { NCI_STATUS_OK, 0x00 };
+
+            g_byte_array_append(rsp, ok, sizeof(ok));
+        }
+        break;
+    case NCI_OID_CORE_GET_CONFIG:
+        /* Every requested parameter is reported empty */
+        g_byte_array_append(rsp, &status, 1);
+        if (len >= 1 && len >= 1u + payload[0]) {
+            guint i;
+
+            g_byte_array_append(rsp, payload, 1);
+            for (i = 0; i < payload[0]; i++) {
+                const guint8 param[] = { payload[1 + i], 0x00 };
+
+                g_byte_array_append(rsp, param, sizeof(param));
+            }
+        } else {
+            const guint8 none = 0;
+
+            g_byte_array_append(rsp, &none, 1);
+        }
+        break;
+    case NCI_OID_CORE_CONN_CREATE:
+        /* Logical connections to the NFCEE aren't simulated */
+        status = NCI_STATUS_REJECTED;
+        g_byte_array_append(rsp, &status, 1);
+        break;
+    default:
+        g_byte_array_append(rsp, &status, 1);
+        break;
+    }
+    if (rsp->len) {
+        nci_sim_rsp(self, NCI_GID_CORE, oid, rsp->data, rsp->len);
+    }
+    g_byte_array_unref(rsp);
+}
+
+static
+void
+nci_sim_rf_discover(
+    NciSimPriv* self,
+    const guint8* payload,
+    guint len)
+{
+    /* Number of Configurations(1), then RF Mode(1) + Frequency(1) each */
+    self->poll_a = self->listen_a = FALSE;
+    if (len >= 1 && len >= 1u + 2 * payload[0]) {
+        guint i;
+
+        for (i = 0; i < payload[0]; i++) {
+            switch (payload[1 + 2 * i]) {
+            case NCI_MODE_PASSIVE_POLL_A:
+            case NCI_MODE_ACTIVE_POLL_A:
+                self->poll_a = TRUE;
+                break;
+            case NCI_MODE_PASSIVE_LISTEN_A:
+            case NCI_MODE_ACTIVE_LISTEN_A:
+                self->listen_a = TRUE;
+                break;
+            }
+        }
+    }
+    nci_sim_status_rsp(self, NCI_GID_RF, NCI_OID_RF_DISCOVER, NCI_STATUS_OK);
+    nci_sim_rf_changed(self, SIM_RFST_DISCOVERY);
+    nci_sim_schedule_activation(self);
+}
+
+static
+void
+nci_sim_rf_deactivate(
+    NciSimPriv* self,
+    const guint8* payload,
+    guint len)
+{
+    const guint8 type = len ? payload[0] : SIM_DEACTIVATE_IDLE;
+    const gboolean active = nci_sim_rf_active(self);
+
+    nci_sim_status_rsp(self, NCI_GID_RF, NCI_OID_RF_DEACTIVATE,
+        NCI_STATUS_OK);
+    switch (type) {
+    case SIM_DEACTIVATE_SLEEP:
+    case SIM_DEACTIVATE_SLEEP_AF:
+        if (active) {
+            nci_sim_rf_changed(self, (self->rf_state ==
+                SIM_RFST_LISTEN_ACTIVE) ? SIM_RFST_LISTEN_SLEEP :
+                SIM_RFST_POLL_SLEEP);
+        }
+        break;
+    case SIM_DEACTIVATE_DISCOVERY:
+        if (active) {
+            nci_sim_rf_changed(self, SIM_RFST_DISCOVERY);
+        }
+        break;
+    default:
+        nci_sim_rf_changed(self, SIM_RFST_IDLE);
+        break;
+    }
+
+    /* There's no RF_DEACTIVATE_NTF when deactivating from RFST_DISCOVERY */
+    if (active) {
+        nci_sim_deactivate_ntf(self, self->config.rsp_latency_ms, type,
+            SIM_REASON_DH_REQUEST);
+        /* The object is still there and will be found again */
+        nci_sim_schedule_activation(self);
+    }
+}
+
+static
+void
+nci_sim_rf_set_routing(
+    NciSimPriv* self,
+    const guint8* payload,
+    guint len)
+{
+    const guint8* end = payload + len;
+    const guint8* ptr = payload + MIN(len, 2);
+    guint8 status = NCI_STATUS_REJECTED;
+    guint n = 0;
+
+    /* More(1), Number of Routing Entries(1), then TLVs */
+    while (ptr + 2 <= end && ptr + 2 + ptr[1] <= end) {
+        ptr += 2 + ptr[1];
+        n++;
+    }
+    if (len >= 2 && ptr == end && n == payload[1] &&
+        self->routing->len + (len - 2) <= SIM_ROUTING_TABLE_SIZE) {
+        g_byte_array_append(self->routing, payload + 2, len - 2);
+        if (!payload[0]) {
+            /* That was the last part */
+            if (self->routing_table) {
+                g_bytes_unref(self->routing_table);
+            }
+            self->routing_table = g_bytes_new(self->routing->data,
+                self->routing->len);
+            g_byte_array_set_size(self->routing, 0);
+        }
+        status = NCI_STATUS_OK;
+    } else {
+        /* Start over with the next command */
+        GWARN("Sim: invalid routing table");
+        g_byte_array_set_size(self->routing, 0);
+    }
+    nci_sim_status_rsp(self, NCI_GID_RF, NCI_OID_RF_SET_LISTEN_MODE_ROUTING,
+        status);
+}
+
+static
+void
+nci_sim_rf_cmd(
+    NciSimPriv* self,
+    guint8 oid,
+    const guint8* payload,
+    guint len)
+{
+    switch (oid) {
+    case NCI_OID_RF_DISCOVER:
+        nci_sim_rf_discover(self, payload, len);
+        break;
+    case NCI_OID_RF_DEACTIVATE:
+        nci_sim_rf_deactivate(self, payload, len);
+        break;
+    case NCI_OID_RF_SET_LISTEN_MODE_ROUTING:
+        nci_sim_rf_set_routing(self, payload, len);
+        break;
+    default:
+        nci_sim_status_rsp(self, NCI_GID_RF, oid, NCI_STATUS_OK);
+        break;
+    }
+}
+
+static
+void
+nci_sim_nfcee_cmd(
+    NciSimPriv* self,
+    guint8 oid,
+    const guint8* payload,
+    guint len)
+{
+    const guint8 id = self->config.nfcee_id;
+    const guint8 ok = NCI_STATUS_OK;
+
+    switch (oid) {
+    case NCI_OID_NFCEE_DISCOVER:
+        {
+            /* Status(1), Number of NFCEEs(1) */
+            const guint8 rsp[] = { NCI_STATUS_OK, id ? 0x01 : 0x00 };
+
+            nci_sim_rsp(self, NCI_GID_NFCEE, oid, rsp, sizeof(rsp));
+        }
+        if (id) {
+            /*
+             * NFCEE ID(1), NFCEE Status(1), Number of Protocol Information
+             * Entries(1), Protocols(1), Number of NFCEE Information TLVs(1)
+             * and NCI 2.0 adds NFCEE Power Supply(1)
+             */
+            const guint8 ntf[] = {
+                id, self->nfcee_enabled ? NCI_NFCEE_STATUS_ENABLED :
+                NCI_NFCEE_STATUS_DISABLED, 0x01, SIM_NFCEE_PROTOCOL_APDU,
+                0x00, 0x00
+            };
+
+            nci_sim_ntf(self, self->config.rsp_latency_ms, NCI_GID_NFCEE,
+                oid, ntf, (self->config.nci_version >= 0x20) ?
+                sizeof(ntf) : (sizeof(ntf) - 1));
+        }
+        return;
+    case NCI_OID_NFCEE_MODE_SET:
+        /* NFCEE ID(1), NFCEE Mode(1) */
+        if (id && len >= 2 && payload[0] == id &&
+            payload[1] <= SIM_NFCEE_MODE_ENABLE) {
+            const guint delay_ms = self->config.rsp_latency_ms +
+                self->config.nfcee_latency_ms;
+
+            self->nfcee_enabled = (payload[1] == SIM_NFCEE_MODE_ENABLE);
+            if (self->config.nci_version >= 0x20) {
+                /* The outcome is reported by NFCEE_MODE_SET_NTF */
+                nci_sim_rsp(self, NCI_GID_NFCEE, oid, &ok, 1);
+                nci_sim_queue_packet(self, SIM_EVENT_NFCEE, delay_ms, 0,
+                    NCI_HDR_MT_NTF | NCI_GID_NFCEE, oid, &ok, 1);
+            } else {
+                nci_sim_queue_packet(self, SIM_EVENT_NFCEE, delay_ms, 0,
+                    NCI_HDR_MT_RSP | NCI_GID_NFCEE, oid, &ok, 1);
+            }
+            return;
+        }
+        break;
+    }
+    nci_sim_status_rsp(self, NCI_GID_NFCEE, oid, NCI_STATUS_REJECTED);
+}
+
+static
+void
+nci_sim_handle_packet(
+    NciSimPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    const guint8* payload = pkt + NCI_HDR_SIZE;
+    const guint payload_len = len - NCI_HDR_SIZE;
+
+    switch (pkt[0] & NCI_HDR_MT_MASK) {
+    case NCI_HDR_MT_CMD:
+        switch (pkt[0] & NCI_HDR_GID_MASK) {
+        case NCI_GID_CORE:
+            nci_sim_core_cmd(self, pkt[1] & NCI_HDR_OID_MASK, payload,
+                payload_len);
+            break;
+        case NCI_GID_RF:
+            nci_sim_rf_cmd(self, pkt[1] & NCI_HDR_OID_MASK, payload,
+                payload_len);
+            break;
+        case NCI_GID_NFCEE:
+            nci_sim_nfcee_cmd(self, pkt[1] & NCI_HDR_OID_MASK, payload,
+                payload_len);
+            break;
+        default:
+            /* Proprietary commands just succeed */
+            nci_sim_status_rsp(self, pkt[0] & NCI_HDR_GID_MASK,
+                pkt[1] & NCI_HDR_OID_MASK, NCI_STATUS_OK);
+            break;
+        }
+        break;
+    case NCI_HDR_MT_DATA:
+        if ((pkt[0] & NCI_HDR_CID_MASK) == NCI_STATIC_RF_CONN_ID) {
+            /* Conn ID(1), Credits(1) */
+            const guint8 credits[] = { 0x01, NCI_STATIC_RF_CONN_ID, 0x01 };
+
+            nci_sim_ntf(self, 0, NCI_GID_CORE, NCI_OID_CORE_CONN_CREDITS,
+                credits, sizeof(credits));
+            g_byte_array_append(self->rx, payload, payload_len);
+            if (!(pkt[0] & NCI_HDR_PBF)) {
+                GByteArray* rx = self->rx;
+
+                /* Handler may reset self->rx */
+                self->rx = g_byte_array_new();
+                nci_sim_data_from_dh(self, rx->data, rx->len);
+                g_byte_array_unref(self->rx);
+                self->rx = rx;
+                g_byte_array_set_size(rx, 0);
+            }
+        }
+        break;
+    default:
+        GWARN("Sim: unexpected packet type 0x%02x", pkt[0]);
+        break;
+    }
+}
+
+/*==========================================================================*
+ * Event delivery
+ *==========================================================================*/
+
+static
+void
+nci_sim_deliver(
+    NciSimPriv* self,
+    NciSimEvent* event)
+{
+    NciSimObject* obj = self->obj;
+    gsize len;
+    const guint8* data;
+
+    switch (event->type) {
+    case SIM_EVENT_WRITE_DONE:
+        if (event->complete && self->client) {
+            event->complete(self->client, TRUE);
+        }
+        break;
+    case SIM_EVENT_PACKET:
+    case SIM_EVENT_NFCEE:
+        if (self->client) {
+            data = g_bytes_get_data(event->pkt, &len);
+            self->client->fn->read(self->client, data, len);
+        }
+        break;
+    case SIM_EVENT_ACTIVATE:
+        /* The reader may also wake us up from LISTEN_SLEEP */
+        if ((self->rf_state == SIM_RFST_DISCOVERY ||
+            (self->rf_state == SIM_RFST_LISTEN_SLEEP && obj &&
+             obj->type == SIM_OBJECT_READER)) &&
+            nci_sim_can_activate(self)) {
+            nci_sim_activate(self);
+        }
+        break;
+    case SIM_EVENT_APDU:
+        data = g_bytes_get_data(event->pkt, &len);
+        nci_sim_data(self, 0, data, len);
+        break;
+    case SIM_EVENT_SLEEP:
+        /* Wake up after a while */
+        if (self->rf_state == SIM_RFST_LISTEN_ACTIVE && obj) {
+            nci_sim_rf_changed(self, SIM_RFST_LISTEN_SLEEP);
+            nci_sim_deactivate_ntf(self, 0, SIM_DEACTIVATE_SLEEP,
+                SIM_REASON_ENDPOINT_REQUEST);
+            nci_sim_queue(self, SIM_EVENT_ACTIVATE,
+                self->config.rf_latency_ms, self->epoch);
+        }
+        break;
+    case SIM_EVENT_LEAVE:
+        nci_sim_link_loss(self);
+        nci_sim_schedule_activation(self);
+        break;
+    }
+}
+
+static
+gboolean
+nci_sim_timer(
+    gpointer user_data)
+{
+    NciSimPriv* self = user_data;
+    NciSimEvent* event;
+
+    self->timer = NULL;
+    while ((event = g_queue_peek_head(&self->events)) != NULL &&
+        event->due <= nci_clock_now(self->clock)) {
+        g_queue_pop_head(&self->events);
+        if (!event->epoch || event->epoch == self->epoch) {
+            nci_sim_deliver(self, event);
+        }
+        nci_sim_event_free(event);
+    }
+    nci_sim_schedule(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_sim_schedule(
+    NciSimPriv* self)
+{
+    const NciSimEvent* event = g_queue_peek_head(&self->events);
+
+    nci_clock_clear(self->clock, &self->timer);
+    if (event) {
+        const gint64 now = nci_clock_now(self->clock);
+        const gint64 ms = (event->due > now) ?
+            ((event->due - now + 999) / 1000) : 0;
+
+        self->timer = nci_clock_timeout_add(self->clock, (guint) ms,
+            nci_sim_timer, self);
+    }
+}
+
+static
+void
+nci_sim_clear_events(
+    NciSimPriv* self)
+{
+    NciSimEvent* event;
+
+    while ((event = g_queue_pop_head(&self->events)) != NULL) {
+        nci_sim_event_free(event);
+    }
+    nci_clock_clear(self->clock, &self->timer);
+}
+
+/*==========================================================================*
+ * NciHalIo
+ *==========================================================================*/
+
+static
+gboolean
+nci_sim_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciSimPriv* self = G_CAST(io, NciSimPriv, io);
+
+    self->client = client;
+    return TRUE;
+}
+
+static
+void
+nci_sim_io_stop(
+    NciHalIo* io)
+{
+    NciSimPriv* self = G_CAST(io, NciSimPriv, io);
+
+    self->client = NULL;
+    nci_sim_clear_events(self);
+    nci_sim_rf_changed(self, SIM_RFST_IDLE);
+}
+
+static
+gboolean
+nci_sim_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciSimPriv* self = G_CAST(io, NciSimPriv, io);
+    GByteArray* buf = g_byte_array_new();
+    const guint8* ptr;
+    const guint8* end;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        g_byte_array_append(buf, chunks[i].bytes, chunks[i].size);
+    }
+
+    /* Write completes before anything else happens */
+    nci_sim_queue(self, SIM_EVENT_WRITE_DONE, 0, 0)->complete = complete;
+    ptr = buf->data;
+    end = ptr + buf->len;
+    while (ptr + NCI_HDR_SIZE <= end && ptr + NCI_HDR_SIZE + ptr[2] <= end) {
+        const guint pkt_len = NCI_HDR_SIZE + ptr[2];
+
+        nci_sim_handle_packet(self, ptr, pkt_len);
+        ptr += pkt_len;
+    }
+    g_byte_array_unref(buf);
+    return TRUE;
+}
+
+static
+void
+nci_sim_io_cancel_write(
+    NciHalIo* io)
+{
+    NciSimPriv* self = G_CAST(io, NciSimPriv, io);
+    GList* l;
+
+    for (l = self->events.head; l; l = l->next) {
+        NciSimEvent* event = l->data;
+
+        if (event->type == SIM_EVENT_WRITE_DONE) {
+            event->complete = NULL;
+        }
+    }
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciSim*
+nci_sim_new(
+    const NciSimConfig* config)
+{
+    static const NciHalIoFunctions sim_io_fn = {
+        .start = nci_sim_io_start,
+        .stop = nci_sim_io_stop,
+        .write = nci_sim_io_write,
+        .cancel_write = nci_sim_io_cancel_write
+    };
+    NciSimPriv* self = g_slice_new0(NciSimPriv);
+
+    if (config) {
+        self->config = *config;
+    }
+    if (!self->config.nci_version) {
+        self->config.nci_version = SIM_DEFAULT_NCI_VERSION;
+    }
+    self->io.fn = &sim_io_fn;
+    self->pub.io = &self->io;
+    self->rf_state = SIM_RFST_IDLE;
+    self->epoch = 1;
+    self->rx = g_byte_array_new();
+    self->routing = g_byte_array_new();
+    g_queue_init(&self->events);
+    return &self->pub;
+}
+
+void
+nci_sim_free(
+    NciSim* sim)
+{
+    if (G_LIKELY(sim)) {
+        NciSimPriv* self = nci_sim_cast(sim);
+
+        nci_sim_clear_events(self);
+        nci_sim_object_unref(self->obj);
+        g_byte_array_unref(self->rx);
+        g_byte_array_unref(self->routing);
+        if (self->routing_table) {
+            g_bytes_unref(self->routing_table);
+        }
+        g_slice_free(NciSimPriv, self);
+    }
+}
+
+void
+nci_sim_set_clock(
+    NciSim* sim,
+    NciClock* clock)
+{
+    if (G_LIKELY(sim)) {
+        NciSimPriv* self = nci_sim_cast(sim);
+
+        if (self->clock != clock) {
+            const gint64 delta = nci_clock_now(clock) -
+                nci_clock_now(self->clock);
+            GList* l;
+
+            /* Pending events keep their delays */
+            nci_clock_clear(self->clock, &self->timer);
+            for (l = self->events.head; l; l = l->next) {
+                ((NciSimEvent*) l->data)->due += delta;
+            }
+            self->clock = clock;
+            nci_sim_schedule(self);
+        }
+    }
+}
+
+void
+nci_sim_place(
+    NciSim* sim,
+    NciSimObject* obj)
+{
+    if (G_LIKELY(sim)) {
+        NciSimPriv* self = nci_sim_cast(sim);
+
+        if (self->obj != obj) {
+            nci_sim_link_loss(self);
+            nci_sim_object_unref(self->obj);
+            self->obj = nci_sim_object_ref(obj);
+            nci_sim_schedule_activation(self);
+        }
+    }
+}
+
+void
+nci_sim_take(
+    NciSim* sim)
+{
+    nci_sim_place(sim, NULL);
+}
+
+void
+nci_sim_bounce(
+    NciSim* sim)
+{
+    if (G_LIKELY(sim)) {
+        nci_sim_queue(nci_sim_cast(sim), SIM_EVENT_LEAVE, 0, 0);
+    }
+}
+
+void
+nci_sim_sleep(
+    NciSim* sim)
+{
+    if (G_LIKELY(sim)) {
+        NciSimPriv* self = nci_sim_cast(sim);
+
+        nci_sim_queue(self, SIM_EVENT_SLEEP, 0, self->epoch);
+    }
+}
+
+gboolean
+nci_sim_nfcee_enabled(
+    NciSim* sim)
+{
+    return G_LIKELY(sim) && nci_sim_cast(sim)->nfcee_enabled;
+}
+
+GBytes*
+nci_sim_routing_table(
+    NciSim* sim)
+{
+    return G_LIKELY(sim) ? nci_sim_cast(sim)->routing_table : NULL;
+}
+
+static
+NciSimObject*
+nci_sim_object_new(
+    NCI_SIM_OBJECT_TYPE type,
+    const GUtilData* uid)
+{
+    NciSimObject* obj = g_slice_new0(NciSimObject);
+
+    g_atomic_int_set(&obj->ref_count, 1);
+    obj->type = type;
+    if (uid && uid->size) {
+        obj->uid_len = (guint8) MIN(uid->size, sizeof(obj->uid));
+        memcpy(obj->uid, uid->bytes, obj->uid_len);
+    } else {
+        /* Random single size UID */
+        obj->uid_len = 4;
+        obj->uid[0] = 0x08;
+        obj->uid[1] = (guint8) g_random_int();
+        obj->uid[2] = (guint8) g_random_int();
+        obj->uid[3] = (guint8) g_random_int();
+    }
+    return obj;
+}
+
+NciSimObject*
+nci_sim_tag_t2_new(
+    const GUtilData* uid,
+    const GUtilData* memory)
+{
+    NciSimObject* obj = nci_sim_object_new(SIM_OBJECT_T2, uid);
+    guint size = memory ? memory->size : 0;
+
+    /* At least 16 blocks, whole blocks only */
+    size = MAX(size, 16 * T2T_BLOCK_SIZE);
+    size = (size + T2T_BLOCK_SIZE - 1) / T2T_BLOCK_SIZE * T2T_BLOCK_SIZE;
+    obj->mem = g_byte_array_sized_new(size);
+    g_byte_array_set_size(obj->mem, size);
+    memset(obj->mem->data, 0, size);
+    if (memory && memory->size) {
+        memcpy(obj->mem->data, memory->bytes, memory->size);
+    }
+    return obj;
+}
+
+NciSimObject*
+nci_sim_tag_t4_new(
+    const GUtilData* uid,
+    const GUtilData* ndef)
+{
+    NciSimObject* obj = nci_sim_object_new(SIM_OBJECT_T4, uid);
+    const guint size = ndef ? MIN(ndef->size, T4T_MAX_NDEF_FILE_SIZE - 2) : 0;
+    guint8 nlen[2];
+
+    /* NLEN(2) followed by NDEF message */
+    nlen[0] = (guint8) (size >> 8);
+    nlen[1] = (guint8) size;
+    obj->mem = g_byte_array_new();
+    g_byte_array_append(obj->mem, nlen, sizeof(nlen));
+    if (size) {
+        g_byte_array_append(obj->mem, ndef->bytes, size);
+    }
+    return obj;
+}
+
+NciSimObject*
+nci_sim_peer_new(
+    void)
+{
+    return nci_sim_object_new(SIM_OBJECT_PEER, NULL);
+}
+
+NciSimObject*
+nci_sim_reader_new(
+    const GUtilData* apdus,
+    guint count,
+    NciSimApduFunc fn,
+    void* user_data)
+{
+    NciSimObject* obj = nci_sim_object_new(SIM_OBJECT_READER, NULL);
+    guint i;
+
+    obj->apdus = g_ptr_array_new_with_free_func((GDestroyNotify)
+        g_bytes_unref);
+    for (i = 0; i < count; i++) {
+        g_ptr_array_add(obj->apdus, g_bytes_new(apdus[i].bytes,
+            apdus[i].size));
+    }
+    obj->apdu_fn = fn;
+    obj->user_data = user_data;
+    return obj;
+}
+
+NciSimObject*
+nci_sim_object_ref(
+    NciSimObject* obj)
+{
+    if (G_LIKELY(obj)) {
+        g_atomic_int_inc(&obj->ref_count);
+    }
+    return obj;
+}
+
+void
+nci_sim_object_unref(
+    NciSimObject* obj)
+{
+    if (G_LIKELY(obj) && g_atomic_int_dec_and_test(&obj->ref_count)) {
+        if (obj->mem) {
+            g_byte_array_unref(obj->mem);
+        }
+        if (obj->apdus) {
+            g_ptr_array_free(obj->apdus, TRUE);
+        }
+        g_slice_free(NciSimObject, obj);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
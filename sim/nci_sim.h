@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_SIM_H
+#define NCI_SIM_H
+
+#include <nci_plugin_types.h>
+#include <nci_hal.h>
+
+G_BEGIN_DECLS
+
+/*
+ * NFCC simulator
+ *
+ * NciHalIo implementation which speaks enough NCI to take NciCore
+ * through initialization, discovery and activation with a virtual
+ * object (tag, peer or reader) placed into the field, and to play
+ * the role of that object afterwards. It may also have a single NFCEE
+ * which can be discovered, enabled and have things routed to it. It
+ * runs on the main loop with configurable delays and needs no hardware.
+ */
+
+typedef struct nci_sim_object NciSimObject;
+
+typedef struct nci_sim {
+    NciHalIo* io;               /* Give this one to NciCore */
+} NciSim;
+
+typedef struct nci_sim_config {
+    guint8 nci_version;         /* 0x10 or 0x20 */
+    guint rsp_latency_ms;       /* Control message turnaround */
+    guint rf_latency_ms;        /* Activation and deactivation */
+    guint data_latency_ms;      /* Remote endpoint's turnaround */
+    guint8 nfcee_id;            /* Zero if there's no NFCEE */
+    guint nfcee_latency_ms;     /* NFCEE_MODE_SET takes that much longer */
+} NciSimConfig;
+
+typedef
+void
+(*NciSimApduFunc)(
+    NciSimObject* reader,
+    guint index,
+    const GUtilData* rsp,
+    void* user_data);
+
+NciSim*
+nci_sim_new(
+    const NciSimConfig* config); /* NULL for defaults */
+
+void
+nci_sim_free(
+    NciSim* sim);
+
+/* NULL for the system clock, see nci_clock.h */
+void
+nci_sim_set_clock(
+    NciSim* sim,
+    NciClock* clock);
+
+/* Puts the object into the field, replacing the previous one */
+void
+nci_sim_place(
+    NciSim* sim,
+    NciSimObject* obj);
+
+/* Takes the object out of the field */
+void
+nci_sim_take(
+    NciSim* sim);
+
+/* The object briefly leaves the field and comes back */
+void
+nci_sim_bounce(
+    NciSim* sim);
+
+/* The reader puts us to sleep (HLTA) and wakes us up again */
+void
+nci_sim_sleep(
+    NciSim* sim);
+
+/* Whether the NFCEE is enabled by NFCEE_MODE_SET_CMD */
+gboolean
+nci_sim_nfcee_enabled(
+    NciSim* sim);
+
+/* TLVs of the last complete listen mode routing table, NULL if none */
+GBytes*
+nci_sim_routing_table(
+    NciSim* sim);
+
+/* Virtual objects */
+
+NciSimObject*
+nci_sim_tag_t2_new(
+    const GUtilData* uid,
+    const GUtilData* memory); /* Whole memory image, 4-byte blocks */
+
+NciSimObject*
+nci_sim_tag_t4_new(
+    const GUtilData* uid,
+    const GUtilData* ndef); /* NDEF message */
+
+NciSimObject*
+nci_sim_peer_new(
+    void);
+
+NciSimObject*
+nci_sim_reader_new(
+    const GUtilData* apdus,
+    guint count,
+    NciSimApduFunc fn,
+    void* user_data);
+
+NciSimObject*
+nci_sim_object_ref(
+    NciSimObject* obj);
+
+void
+nci_sim_object_unref(
+    NciSimObject* obj);
+
+G_END_DECLS
+
+#endif /* NCI_SIM_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
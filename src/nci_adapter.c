@@ -39,14 +39,21 @@
  */
 
 #include "nci_adapter_impl.h"
+#include "nci_capture.h"
+#include "nci_clock.h"
+#include "nci_metrics.h"
+#include "nci_stats.h"
+#include "nci_trace.h"
 #include "nci_plugin_p.h"
 #include "nci_plugin_log.h"
+#include "nci_plugin_probe.h"
 
 #include <nfc_adapter_impl.h>
 #include <nfc_initiator_impl.h>
 #include <nfc_target_impl.h>
 #include <nfc_tag_t2.h>
 #include <nfc_tag_t4.h>
+#include <nfc_host.h>
 #include <nfc_peer.h>
 
 #include <nci_core.h>
@@ -57,14 +64,29 @@
 
 GLOG_MODULE_DEFINE("nciplugin");
 
+gint nci_object_count[NCI_OBJECT_TYPES];
+
 /* NCI core events */
 enum {
     CORE_EVENT_CURRENT_STATE,
     CORE_EVENT_NEXT_STATE,
     CORE_EVENT_INTF_ACTIVATED,
+    CORE_EVENT_DATA_PACKET,
     CORE_EVENT_COUNT
 };
 
+/* Adapter signals */
+enum nci_adapter_signal {
+    SIGNAL_NFCEE_ACTIVATED,
+    SIGNAL_NFCEE_ACTION,
+    SIGNAL_COUNT
+};
+
+#define SIGNAL_NFCEE_ACTIVATED_NAME "nci-adapter-nfcee-activated"
+#define SIGNAL_NFCEE_ACTION_NAME    "nci-adapter-nfcee-action"
+
+static guint nci_adapter_signals[SIGNAL_COUNT] = { 0 };
+
 typedef struct nci_adapter_intf_info {
     NCI_RF_INTERFACE rf_intf;
     NCI_PROTOCOL protocol;
@@ -72,6 +94,7 @@ typedef struct nci_adapter_intf_info {
     GUtilData mode_param;
     GUtilData activation_param;
     NciModeParam* mode_param_parsed;
+    gsize size; /* Allocated */
 } NciAdapterIntfInfo;
 
 /*==========================================================================*
@@ -122,6 +145,18 @@ typedef struct nci_adapter_intf_info {
  *                                            yes--->| REACTIVATED_CE |<---/
  *                                                   +----------------+
  *
+ * Card emulation also survives the reader putting us to sleep (HLTA or
+ * SLP_REQ) without going through the reactivation cycle:
+ *
+ *  +----------------+                    +-------------+
+ *  | HAVE_INITIATOR | -- LISTEN_SLEEP -> | SLEEPING_CE | -- Deactivation --\
+ *  | REACTIVATED_CE |                    +-------------+                   |
+ *  +----------------+                           |                          |
+ *          ^                                Activation                     v
+ *          |                                    |                REACTIVATING_CE
+ *          \------------ yes ---------- Does the interface
+ *                                        info match? -- no --> IDLE
+ *
  *==========================================================================*/
 
 typedef enum nci_adapter_state {
@@ -130,27 +165,74 @@ typedef enum nci_adapter_state {
     NCI_ADAPTER_HAVE_INITIATOR,
     NCI_ADAPTER_REACTIVATING_TARGET,
     NCI_ADAPTER_REACTIVATING_CE,
-    NCI_ADAPTER_REACTIVATED_CE
+    NCI_ADAPTER_REACTIVATED_CE,
+    NCI_ADAPTER_SLEEPING_CE
 } NCI_ADAPTER_STATE;
 
+#define NCI_ADAPTER_STATES (NCI_ADAPTER_SLEEPING_CE + 1)
+
+typedef struct nci_adapter_slo_snapshot {
+    NciSloSnapshot pub;
+    char* trace;
+} NciAdapterSloSnapshot;
+
+/* Number of trace events saved with the SLO snapshot */
+#define SLO_TRACE_EVENTS (32)
+
+typedef struct nci_adapter_conn_priv {
+    NciAdapterConn pub;
+    NciAdapterConnCallbacks cb;
+    void* user_data;
+    guint create_id;        /* Pending CORE_CONN_CREATE_CMD */
+    gboolean open;
+} NciAdapterConnPriv;
+
 struct nci_adapter_priv {
     gulong nci_event_id[CORE_EVENT_COUNT];
     NFC_MODE desired_mode;
     NFC_MODE current_mode;
     gboolean mode_change_pending;
-    guint mode_check_id;
+    GSource* mode_check_source;
     guint presence_check_id;
-    guint presence_check_timer;
+    NciClockTimer* presence_check_timer;
     NciAdapterIntfInfo* active_intf;
+    NciAdapterIntfInfo* spare_intf; /* Reused by the next activation */
     NfcInitiator* initiator;
+    NciAdapterEndpoint* endpoint; /* Target or initiator */
     NCI_ADAPTER_STATE internal_state;
-    guint ce_reactivation_timer;
+    NciClockTimer* ce_reactivation_timer;
     NCI_TECH supported_techs;
     NCI_TECH active_techs;
     NCI_TECH active_tech_mask;
-    NfcTag* tag;     /* Weak pointer */
-    NfcHost* host;   /* Weak pointer */
-    NfcPeer* peer;   /* Weak pointer */
+    NfcTag* tag;     /* Released when the target is dropped */
+    NfcHost* host;   /* Released when the initiator is dropped */
+    NfcPeer* peer;   /* Released when either of them is dropped */
+    gboolean published; /* Something has been published since cleared */
+    NciAdapterIo* io;
+    GPtrArray* nfcees; /* NULL terminated */
+    gboolean nfcee_discovered;
+    gboolean nfcee_enable_pending; /* One NFCEE_MODE_SET at a time */
+    guint8 nfcee_enabling;
+    guint nfcee_enable_id;
+    gboolean nfcc_reset; /* CORE_RESET sent, waiting for CORE_INIT_RSP */
+    guint32 nfcee_failed[8]; /* Bitmap, not retried until rediscovered */
+    NciRouting* routing;
+    gboolean routing_dirty;
+    GSource* routing_check_source;
+    GSList* conns;
+    NciAdapterConnPriv* conn_by_cid[NCI_MAX_CONN_ID + 1];
+    NciTrace* trace;
+    NciClock* clock; /* NULL for the system clock */
+    NCI_STATE core_state;
+    gint64 core_state_since;
+    gint64 internal_state_since;
+    NciResidency core_residency[NCI_CORE_STATES];
+    NciResidency internal_residency[NCI_ADAPTER_STATES];
+    gint64 latency_start[NCI_ADAPTER_LATENCY_COUNT]; /* Zero if none */
+    NciLatency latency[NCI_ADAPTER_LATENCY_COUNT];
+    guint latency_threshold_ms[NCI_ADAPTER_LATENCY_COUNT];
+    GQueue slo_snapshots; /* NciAdapterSloSnapshot */
+    NciApduStats* apdu_stats[256]; /* Indexed by INS, allocated on demand */
 };
 
 #define PARENT_CLASS nci_adapter_parent_class
@@ -171,7 +253,30 @@ G_DEFINE_ABSTRACT_TYPE(NciAdapter, nci_adapter, NFC_TYPE_ADAPTER)
  * Implementation
  *==========================================================================*/
 
-#if GUTIL_LOG_DEBUG
+static
+const char*
+nci_adapter_core_state_name(
+    NCI_STATE state)
+{
+    switch (state) {
+    #define NCI_STATE_(x) case NCI_##x: return #x
+    NCI_STATE_(STATE_INIT);
+    NCI_STATE_(STATE_ERROR);
+    NCI_STATE_(STATE_STOP);
+    NCI_STATE_(RFST_IDLE);
+    NCI_STATE_(RFST_DISCOVERY);
+    NCI_STATE_(RFST_W4_ALL_DISCOVERIES);
+    NCI_STATE_(RFST_W4_HOST_SELECT);
+    NCI_STATE_(RFST_POLL_ACTIVE);
+    NCI_STATE_(RFST_LISTEN_ACTIVE);
+    NCI_STATE_(RFST_LISTEN_SLEEP);
+    #undef NCI_STATE_
+    case NCI_CORE_STATES:
+        break;
+    }
+    return "?";
+}
+
 static
 const char*
 nci_adapter_internal_state_name(
@@ -185,11 +290,185 @@ nci_adapter_internal_state_name(
     NCI_ADAPTER_(REACTIVATING_TARGET);
     NCI_ADAPTER_(REACTIVATING_CE);
     NCI_ADAPTER_(REACTIVATED_CE);
+    NCI_ADAPTER_(SLEEPING_CE);
     #undef NCI_ADAPTER_
     }
     return "?";
 }
-#endif
+
+static
+void
+nci_adapter_slo_snapshot_free(
+    NciAdapterSloSnapshot* snapshot)
+{
+    g_free(snapshot->trace);
+    g_slice_free(NciAdapterSloSnapshot, snapshot);
+}
+
+static
+void
+nci_adapter_slo_snapshot_take(
+    NciAdapter* self,
+    NCI_ADAPTER_LATENCY which,
+    gint64 us,
+    NCI_SLO_FLAGS flags)
+{
+    NciAdapterPriv* priv = self->priv;
+    NciAdapterSloSnapshot* snapshot = g_slice_new0(NciAdapterSloSnapshot);
+    NciSloSnapshot* pub = &snapshot->pub;
+    const NciAdapterIntfInfo* intf = priv->active_intf;
+
+    pub->time = nci_clock_now(priv->clock);
+    pub->which = which;
+    pub->threshold_ms = priv->latency_threshold_ms[which];
+    pub->latency_us = us;
+    pub->internal_state = priv->internal_state;
+    pub->current_state = self->nci->current_state;
+    pub->next_state = self->nci->next_state;
+    pub->flags = flags;
+    if (intf) {
+        pub->flags |= NCI_SLO_FLAG_ACTIVE_INTF;
+        pub->rf_intf = intf->rf_intf;
+        pub->protocol = intf->protocol;
+        pub->mode = intf->mode;
+    }
+    if (priv->presence_check_id) {
+        pub->flags |= NCI_SLO_FLAG_PRESENCE_CHECK;
+    }
+    if (priv->trace) {
+        pub->trace = snapshot->trace = nci_trace_json(priv->trace,
+            SLO_TRACE_EVENTS);
+    }
+
+    GDEBUG("Latency %d exceeded %u ms (%u ms)", which, pub->threshold_ms,
+        (guint) (us / 1000));
+    g_queue_push_tail(&priv->slo_snapshots, snapshot);
+    if (priv->slo_snapshots.length > NCI_SLO_MAX_SNAPSHOTS) {
+        nci_adapter_slo_snapshot_free(g_queue_pop_head(&priv->slo_snapshots));
+    }
+}
+
+static
+void
+nci_adapter_clear_slo_snapshots_priv(
+    NciAdapterPriv* priv)
+{
+    NciAdapterSloSnapshot* snapshot;
+
+    while ((snapshot = g_queue_pop_head(&priv->slo_snapshots)) != NULL) {
+        nci_adapter_slo_snapshot_free(snapshot);
+    }
+}
+
+static
+void
+nci_adapter_clear_apdu_stats_priv(
+    NciAdapterPriv* priv)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(priv->apdu_stats); i++) {
+        g_free(priv->apdu_stats[i]);
+        priv->apdu_stats[i] = NULL;
+    }
+}
+
+static
+void
+nci_adapter_export_residency(
+    NciMetricsSink* sink,
+    const char* prefix,
+    const NciResidency* res,
+    const char* const* names,
+    guint n)
+{
+    const NciMetricsSinkFunctions* fn = sink->fn;
+    char* time_name = g_strconcat(prefix, "_time_us", NULL);
+    char* visits_name = g_strconcat(prefix, "_visits", NULL);
+    guint i;
+
+    /* One metric family at a time */
+    for (i = 0; i < n; i++) {
+        fn->value(sink, time_name, NCI_METRIC_COUNTER, "state", names[i],
+            res[i].total_us);
+    }
+    for (i = 0; i < n; i++) {
+        fn->value(sink, visits_name, NCI_METRIC_COUNTER, "state", names[i],
+            res[i].visits);
+    }
+    for (i = 0; i < n; i++) {
+        fn->histogram(sink, prefix, "state", names[i], &res[i].hist);
+    }
+    g_free(time_name);
+    g_free(visits_name);
+}
+
+static
+void
+nci_adapter_export_apdu_stats(
+    NciAdapterPriv* priv,
+    NciMetricsSink* sink)
+{
+    static const char* names[] = {
+        "apdu", "apdu_host", "apdu_send", "apdu_errors"
+    };
+    const NciMetricsSinkFunctions* fn = sink->fn;
+    guint k, i;
+
+    /* One metric family at a time */
+    for (k = 0; k < G_N_ELEMENTS(names); k++) {
+        for (i = 0; i < G_N_ELEMENTS(priv->apdu_stats); i++) {
+            const NciApduStats* stats = priv->apdu_stats[i];
+
+            if (stats) {
+                char ins[3];
+
+                g_snprintf(ins, sizeof(ins), "%02x", i);
+                switch (k) {
+                case 0:
+                    fn->histogram(sink, names[k], "ins", ins, &stats->total);
+                    break;
+                case 1:
+                    fn->histogram(sink, names[k], "ins", ins, &stats->host);
+                    break;
+                case 2:
+                    fn->histogram(sink, names[k], "ins", ins, &stats->send);
+                    break;
+                default:
+                    fn->value(sink, names[k], NCI_METRIC_COUNTER, "ins", ins,
+                        stats->errors);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static
+void
+nci_adapter_latency_start(
+    NciAdapterPriv* priv,
+    NCI_ADAPTER_LATENCY which)
+{
+    priv->latency_start[which] = nci_clock_now(priv->clock);
+}
+
+static
+void
+nci_adapter_latency_done(
+    NciAdapter* self,
+    NCI_ADAPTER_LATENCY which)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    if (priv->latency_start[which]) {
+        const gint64 us = nci_clock_now(priv->clock) -
+            priv->latency_start[which];
+
+        priv->latency_start[which] = 0;
+        nci_adapter_latency_sample(self, which, us, NCI_SLO_FLAGS_NONE);
+    }
+}
 
 static
 void
@@ -198,24 +477,48 @@ nci_adapter_set_internal_state(
     NCI_ADAPTER_STATE state)
 {
     if (priv->internal_state != state) {
+        const gint64 now = nci_clock_now(priv->clock);
+
         GDEBUG("Internal state %s => %s",
             nci_adapter_internal_state_name(priv->internal_state),
             nci_adapter_internal_state_name(state));
+        NCI_PROBE2(internal_state, priv->internal_state, state);
+        nci_residency_add(priv->internal_residency + priv->internal_state,
+            now - priv->internal_state_since);
+        priv->internal_state_since = now;
         priv->internal_state = state;
+        if (priv->trace) {
+            nci_trace_add(priv->trace, NCI_TRACE_TRACK_ADAPTER,
+                NCI_TRACE_STATE, nci_adapter_internal_state_name(state), 0);
+        }
     }
 }
 
 static
 NciAdapterIntfInfo*
 nci_adapter_intf_info_new(
+    NciAdapterPriv* priv,
     const NciIntfActivationNtf* ntf)
 {
     if (ntf) {
         /* Allocate the whole thing from a single memory block */
         const gsize total = G_ALIGN8(sizeof(NciAdapterIntfInfo)) +
             G_ALIGN8(ntf->mode_param_len) + ntf->activation_param_len;
-        NciAdapterIntfInfo* info = g_malloc(total);
-        guint8* ptr = (guint8*)info;
+        NciAdapterIntfInfo* info = priv->spare_intf;
+        guint8* ptr;
+
+        /* Reuse the block left by the previous activation if it's enough */
+        priv->spare_intf = NULL;
+        if (!info || info->size < total) {
+            if (info) {
+                g_free(info);
+            } else {
+                NCI_OBJECT_CREATED(NCI_OBJECT_INTF_BLOCK);
+            }
+            info = g_malloc(total);
+            info->size = total;
+        }
+        ptr = (guint8*)info;
 
         info->rf_intf = ntf->rf_intf;
         info->protocol = ntf->protocol;
@@ -253,11 +556,32 @@ nci_adapter_intf_info_free(
     NciAdapterIntfInfo* info)
 {
     if (info) {
+        NCI_OBJECT_DESTROYED(NCI_OBJECT_INTF_BLOCK);
         g_free(info->mode_param_parsed);
         g_free(info);
     }
 }
 
+static
+void
+nci_adapter_intf_info_recycle(
+    NciAdapterPriv* priv,
+    NciAdapterIntfInfo* info)
+{
+    if (info) {
+        g_free(info->mode_param_parsed);
+        info->mode_param_parsed = NULL;
+        if (!priv->spare_intf) {
+            priv->spare_intf = info;
+        } else if (priv->spare_intf->size < info->size) {
+            nci_adapter_intf_info_free(priv->spare_intf);
+            priv->spare_intf = info;
+        } else {
+            nci_adapter_intf_info_free(info);
+        }
+    }
+}
+
 static
 gboolean
 mode_param_match_poll_a(
@@ -372,31 +696,33 @@ nci_adapter_intf_info_matches(
         ntf->activation_param_bytes, ntf->activation_param_len));
 }
 
-static
-gpointer
-nci_adapter_set_active_object(
-    gpointer obj,
-    gpointer* weak_ptr)
-{
-    if (*weak_ptr != obj) {
-        if (*weak_ptr) {
-            g_object_remove_weak_pointer(*weak_ptr, weak_ptr);
-        }
-        *weak_ptr = obj;
-        if (obj) {
-            g_object_add_weak_pointer(obj, weak_ptr);
-        }
-    }
-    return obj;
-}
-
+/*
+ * Tags, peers and hosts live exactly as long as the target or initiator
+ * they have been created for. NFC core lets go of them when it receives
+ * the target's or the initiator's "gone" notification, and those come
+ * from nfc_target_gone() and nfc_initiator_gone(), which are only ever
+ * called by nci_adapter_drop_target() and nci_adapter_drop_initiator().
+ * Both release the corresponding references before notifying anyone.
+ *
+ * Therefore, a non-NULL tag, peer or host pointer always refers to an
+ * object which NFC core still considers present, just like it did with
+ * weak pointers. Holding a plain reference is cheaper though, because
+ * weak pointers go through a global lock.
+ */
 static
 NfcTag*
 nci_adapter_set_active_tag(
     NciAdapterPriv* priv,
     NfcTag* tag)
 {
-    return nci_adapter_set_active_object(tag, (gpointer*) &priv->tag);
+    if (priv->tag != tag) {
+        nfc_tag_unref(priv->tag);
+        priv->tag = nfc_tag_ref(tag);
+    }
+    if (tag) {
+        priv->published = TRUE;
+    }
+    return tag;
 }
 
 static
@@ -405,7 +731,14 @@ nci_adapter_set_active_peer(
     NciAdapterPriv* priv,
     NfcPeer* peer)
 {
-    return nci_adapter_set_active_object(peer, (gpointer*) &priv->peer);
+    if (priv->peer != peer) {
+        nfc_peer_unref(priv->peer);
+        priv->peer = nfc_peer_ref(peer);
+    }
+    if (peer) {
+        priv->published = TRUE;
+    }
+    return peer;
 }
 
 static
@@ -414,7 +747,24 @@ nci_adapter_set_active_host(
     NciAdapterPriv* priv,
     NfcHost* host)
 {
-    return nci_adapter_set_active_object(host, (gpointer*) &priv->host);
+    if (priv->host != host) {
+        nfc_host_unref(priv->host);
+        priv->host = nfc_host_ref(host);
+    }
+    if (host) {
+        priv->published = TRUE;
+    }
+    return host;
+}
+
+static
+gboolean
+nci_adapter_have_host(
+    NciAdapterPriv* priv)
+{
+    /* See the comment above */
+    GASSERT(!priv->host || priv->initiator);
+    return priv->host != NULL;
 }
 
 static
@@ -423,11 +773,21 @@ nci_adapter_clear_active_intf(
     NciAdapterPriv* priv)
 {
     if (priv->active_intf) {
-        nci_adapter_intf_info_free(priv->active_intf);
+        nci_adapter_intf_info_recycle(priv, priv->active_intf);
         priv->active_intf = NULL;
     }
 }
 
+static
+void
+nci_adapter_set_active_intf(
+    NciAdapterPriv* priv,
+    const NciIntfActivationNtf* ntf)
+{
+    nci_adapter_clear_active_intf(priv);
+    priv->active_intf = nci_adapter_intf_info_new(priv, ntf);
+}
+
 static
 void
 nci_adapter_drop_target(
@@ -439,8 +799,9 @@ nci_adapter_drop_target(
         NciAdapterPriv* priv = self->priv;
 
         self->target = NULL;
+        priv->endpoint = NULL;
         nci_adapter_clear_active_intf(priv);
-        gutil_source_clear(&priv->presence_check_timer);
+        nci_clock_clear(priv->clock, &priv->presence_check_timer);
         nci_adapter_set_active_peer(priv, NULL);
         nci_adapter_set_active_tag(priv, NULL);
         if (priv->presence_check_id) {
@@ -463,9 +824,10 @@ nci_adapter_drop_initiator(
 
     if (initiator) {
         priv->initiator = NULL;
+        priv->endpoint = NULL;
         priv->active_tech_mask = NCI_TECH_ALL;
         nci_adapter_clear_active_intf(priv);
-        gutil_source_clear(&priv->ce_reactivation_timer);
+        nci_clock_clear(priv->clock, &priv->ce_reactivation_timer);
         nci_adapter_set_active_peer(priv, NULL);
         nci_adapter_set_active_host(priv, NULL);
         nci_core_set_tech(self->nci, priv->active_techs);
@@ -484,15 +846,36 @@ nci_adapter_drop_all(
     nci_adapter_drop_initiator(self);
 }
 
+static
+guint
+nci_adapter_presence_check(
+    NciAdapter* self,
+    NfcTarget* target,
+    NciAdapterPresenceCheckFunc done,
+    void* user_data)
+{
+    return nci_target_presence_check(target, done, user_data);
+}
+
 static
 gboolean
 nci_adapter_need_presence_checks(
     NciAdapter* self)
 {
-    const NciAdapterIntfInfo* intf = self->priv->active_intf;
+    NciAdapterPriv* priv = self->priv;
+    const NciAdapterIntfInfo* intf = priv->active_intf;
 
     /* NFC-DEP presence checks are done at LLCP level by NFC core */
-    return (self->target && intf && intf->protocol != NCI_PROTOCOL_NFC_DEP);
+    if (self->target && intf && intf->protocol != NCI_PROTOCOL_NFC_DEP) {
+        /*
+         * The base implementation only knows how to check our own
+         * targets. For a foreign one (no endpoint) it would fail on
+         * the first tick and kick us back to discovery.
+         */
+        return priv->endpoint || NCI_ADAPTER_GET_CLASS(self)->presence_check
+            != nci_adapter_presence_check;
+    }
+    return FALSE;
 }
 
 static
@@ -506,6 +889,11 @@ nci_adapter_presence_check_done(
     NciAdapterPriv* priv = self->priv;
 
     GDEBUG("Presence check %s", ok ? "ok" : "failed");
+    NCI_PROBE1(presence_check_done, ok);
+    if (priv->trace) {
+        nci_trace_add(priv->trace, NCI_TRACE_TRACK_PRESENCE, NCI_TRACE_END,
+            "presence_check", ok);
+    }
     priv->presence_check_id = 0;
     if (!ok) {
         nci_adapter_deactivate_target(self, target);
@@ -524,11 +912,19 @@ nci_adapter_presence_check_timer(
         & NFC_SEQUENCE_FLAG_ALLOW_PRESENCE_CHECK);
 
     if (!priv->presence_check_id && do_presence_check) {
-        priv->presence_check_id = nci_target_presence_check(self->target,
+        NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
+
+        NCI_PROBE1(presence_check_start, priv->active_intf->protocol);
+        if (priv->trace) {
+            nci_trace_add(priv->trace, NCI_TRACE_TRACK_PRESENCE,
+                NCI_TRACE_BEGIN, "presence_check",
+                priv->active_intf->protocol);
+        }
+        priv->presence_check_id = klass->presence_check(self, self->target,
             nci_adapter_presence_check_done, self);
         if (!priv->presence_check_id) {
             GDEBUG("Failed to start presence check");
-            priv->presence_check_timer = 0;
+            priv->presence_check_timer = NULL;
             nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
             return G_SOURCE_REMOVE;
         }
@@ -548,11 +944,12 @@ nci_adapter_mode_check(
     const NFC_MODE mode = (nci->current_state > NCI_RFST_IDLE) ?
         priv->desired_mode : NFC_MODE_NONE;
 
-    gutil_source_clear(&priv->mode_check_id);
+    nci_source_clear(&priv->mode_check_source);
     if (priv->mode_change_pending) {
         if (mode == priv->desired_mode) {
             priv->mode_change_pending = FALSE;
             priv->current_mode = mode;
+            nci_adapter_latency_done(self, NCI_ADAPTER_LATENCY_MODE_SWITCH);
             nfc_adapter_mode_notify(NFC_ADAPTER(self), mode, TRUE);
         }
     } else if (priv->current_mode != mode) {
@@ -569,7 +966,7 @@ nci_adapter_mode_check_cb(
     NciAdapter* self = THIS(user_data);
     NciAdapterPriv* priv = self->priv;
 
-    priv->mode_check_id = 0;
+    priv->mode_check_source = NULL;
     nci_adapter_mode_check(self);
     return G_SOURCE_REMOVE;
 }
@@ -581,8 +978,9 @@ nci_adapter_schedule_mode_check(
 {
     NciAdapterPriv* priv = self->priv;
 
-    if (!priv->mode_check_id) {
-        priv->mode_check_id = g_idle_add(nci_adapter_mode_check_cb, self);
+    if (!priv->mode_check_source) {
+        priv->mode_check_source = nci_idle_add(nci_adapter_mode_check_cb,
+            self);
     }
 }
 
@@ -1017,7 +1415,12 @@ nci_adapter_ce_reactivation_timeout(
     NciAdapterPriv* priv = self->priv;
 
     GDEBUG("CE reactivation timeout has expired");
-    priv->ce_reactivation_timer = 0;
+    NCI_PROBE0(ce_reactivation_timeout);
+    if (priv->trace) {
+        nci_trace_add(priv->trace, NCI_TRACE_TRACK_TIMERS,
+            NCI_TRACE_INSTANT, "ce_reactivation_timeout", 0);
+    }
+    priv->ce_reactivation_timer = NULL;
     nci_adapter_set_internal_state(priv, NCI_ADAPTER_IDLE);
     nci_adapter_drop_all(self);
     return G_SOURCE_REMOVE;
@@ -1032,9 +1435,52 @@ nci_adapter_start_ce_reactivation_timer(
 
     GDEBUG("%s CE reactivation timer", priv->ce_reactivation_timer ?
         "Restarting" : "Starting");
-    gutil_source_remove(priv->ce_reactivation_timer);
-    priv->ce_reactivation_timer = g_timeout_add(CE_REACTIVATION_TIMEOUT_MS,
-        nci_adapter_ce_reactivation_timeout, self);
+    if (priv->trace) {
+        nci_trace_add(priv->trace, NCI_TRACE_TRACK_TIMERS,
+            NCI_TRACE_INSTANT, "ce_reactivation_timer",
+            CE_REACTIVATION_TIMEOUT_MS);
+    }
+    nci_clock_clear(priv->clock, &priv->ce_reactivation_timer);
+    priv->ce_reactivation_timer = nci_clock_timeout_add(priv->clock,
+        CE_REACTIVATION_TIMEOUT_MS, nci_adapter_ce_reactivation_timeout, self);
+}
+
+static
+void
+nci_adapter_start_ce_reactivation(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+    NCI_TECH ce_tech = NCI_TECH_NONE;
+
+    /* Lock the card emulation tech */
+    switch (priv->initiator->technology) {
+    case NFC_TECHNOLOGY_A:
+        ce_tech = NCI_TECH_A_LISTEN;
+        break;
+    case NFC_TECHNOLOGY_B:
+        ce_tech = NCI_TECH_B_LISTEN;
+        break;
+    case NFC_TECHNOLOGY_F:
+    case NFC_TECHNOLOGY_UNKNOWN:
+        break;
+    }
+
+    NCI_PROBE1(ce_reactivation_start, ce_tech);
+    nci_adapter_set_internal_state(priv, NCI_ADAPTER_REACTIVATING_CE);
+    nci_adapter_start_ce_reactivation_timer(self);
+
+    /*
+     * The same technology must be used for reactivation, otherwise
+     * the peer may not (and most likely won't) recognize us as the
+     * came card.
+     */
+    if (ce_tech) {
+        const NCI_TECH tech = priv->active_techs & ce_tech;
+
+        priv->active_tech_mask = ce_tech;
+        nci_core_set_tech(self->nci, tech);
+    }
 }
 
 static
@@ -1044,11 +1490,23 @@ nci_adapter_activation(
     const NciIntfActivationNtf* ntf)
 {
     NfcAdapter* adapter = NFC_ADAPTER(self);
+    NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
     NciAdapterPriv* priv = self->priv;
     NciCore* nci = self->nci;
 
     /* Any activation stops CE reactivation timer if it's running */
-    gutil_source_clear(&priv->ce_reactivation_timer);
+    nci_clock_clear(priv->clock, &priv->ce_reactivation_timer);
+
+    if (ntf->rf_intf == NCI_RF_INTERFACE_NFCEE_DIRECT) {
+        /* RF traffic goes straight to NFCEE, there's nothing for us here */
+        GDEBUG("NFCEE Direct interface activated");
+        nci_adapter_set_internal_state(priv, NCI_ADAPTER_IDLE);
+        nci_adapter_drop_all(self);
+        nci_clock_clear(priv->clock, &priv->presence_check_timer);
+        g_signal_emit(self, nci_adapter_signals[SIGNAL_NFCEE_ACTIVATED], 0,
+            ntf);
+        return;
+    }
 
     /* Update the adapter state */
     switch (priv->internal_state) {
@@ -1062,7 +1520,7 @@ nci_adapter_activation(
         break;
     case NCI_ADAPTER_HAVE_INITIATOR:
         if (nci_adapter_intf_info_matches(priv->active_intf, ntf)) {
-            if (priv->host) {
+            if (nci_adapter_have_host(priv)) {
                 GDEBUG("CE host spontaneously reactivated");
                 nci_adapter_set_internal_state(priv,
                     NCI_ADAPTER_REACTIVATED_CE);
@@ -1095,6 +1553,22 @@ nci_adapter_activation(
             /* Continue to object detection */
         }
         break;
+    case NCI_ADAPTER_SLEEPING_CE:
+        if (nci_adapter_intf_info_matches(priv->active_intf, ntf)) {
+            /*
+             * The reader has woken us up. Resume right away, there's
+             * no need to relock the technology or wait for anything.
+             */
+            GDEBUG("CE initiator woke up");
+            nci_adapter_set_internal_state(priv, NCI_ADAPTER_HAVE_INITIATOR);
+            nfc_initiator_reactivated(priv->initiator);
+        } else {
+            GDEBUG("Different initiator has arrived, dropping the old one");
+            nci_adapter_set_internal_state(priv, NCI_ADAPTER_IDLE);
+            nci_adapter_drop_initiator(self);
+            /* Continue to object detection */
+        }
+        break;
     case NCI_ADAPTER_REACTIVATING_TARGET:
         if (nci_adapter_intf_info_matches(priv->active_intf, ntf)) {
             GDEBUG("Target reactivated");
@@ -1111,16 +1585,17 @@ nci_adapter_activation(
 
     /* Object detection logic */
     if (!self->target && !priv->initiator) {
-        NfcTarget* target = self->target = nci_target_new(self, ntf);
+        NfcTarget* target = self->target = klass->create_target(self, ntf);
 
         if (target) {
+            priv->endpoint = nci_target_endpoint(target);
             nci_adapter_set_internal_state(priv, NCI_ADAPTER_HAVE_TARGET);
 
             /* Check if it's a peer interface */
-            if (!nci_adapter_create_peer_initiator(self, target, ntf)) {
+            if (!NCI_PLUGIN_PEER ||
+                !nci_adapter_create_peer_initiator(self, target, ntf)) {
                /* Otherwise assume a tag */
-                nci_adapter_intf_info_free(priv->active_intf);
-                priv->active_intf = nci_adapter_intf_info_new(ntf);
+                nci_adapter_set_active_intf(priv, ntf);
                 if (!nci_adapter_create_known_tag(self, target, ntf)) {
                     NfcParamPoll poll;
 
@@ -1129,17 +1604,19 @@ nci_adapter_activation(
                             nci_adapter_get_mode_param(&poll, ntf)));
                 }
             }
-        } else {
+        } else if (NCI_PLUGIN_PEER || NCI_PLUGIN_CE) {
             /* Try initiator then */
-            NfcInitiator* initiator = nci_initiator_new(self, ntf);
+            NfcInitiator* initiator = klass->create_initiator(self, ntf);
 
             if (initiator) {
-                if (nci_adapter_create_peer_target(self, initiator, ntf) ||
-                    nci_adapter_create_host(self, initiator, ntf)) {
+                if ((NCI_PLUGIN_PEER &&
+                    nci_adapter_create_peer_target(self, initiator, ntf)) ||
+                    (NCI_PLUGIN_CE &&
+                    nci_adapter_create_host(self, initiator, ntf))) {
                     /* Keep the initiator */
                     priv->initiator = initiator;
-                    nci_adapter_intf_info_free(priv->active_intf);
-                    priv->active_intf = nci_adapter_intf_info_new(ntf);
+                    priv->endpoint = nci_initiator_endpoint(initiator);
+                    nci_adapter_set_active_intf(priv, ntf);
                     nci_adapter_set_internal_state(priv,
                         NCI_ADAPTER_HAVE_INITIATOR);
                 } else {
@@ -1152,11 +1629,12 @@ nci_adapter_activation(
     /* Start periodic presence checks */
     if (nci_adapter_need_presence_checks(self)) {
         if (!priv->presence_check_timer) {
-            priv->presence_check_timer = g_timeout_add(PRESENCE_CHECK_PERIOD_MS,
-                nci_adapter_presence_check_timer, self);
+            priv->presence_check_timer = nci_clock_timeout_add(priv->clock,
+                PRESENCE_CHECK_PERIOD_MS, nci_adapter_presence_check_timer,
+                self);
         }
     } else {
-        gutil_source_clear(&priv->presence_check_timer);
+        nci_clock_clear(priv->clock, &priv->presence_check_timer);
     }
 
     /* If we don't know what this is, switch back to DISCOVERY */
@@ -1184,37 +1662,13 @@ nci_adapter_deactivation(
         nci_adapter_set_internal_state(priv, NCI_ADAPTER_REACTIVATING_CE);
         nci_adapter_start_ce_reactivation_timer(self);
         break;
+    case NCI_ADAPTER_SLEEPING_CE:
+        /* The reader has left while we were sleeping */
+        nci_adapter_start_ce_reactivation(self);
+        break;
     case NCI_ADAPTER_HAVE_INITIATOR:
-        if (priv->host) {
-            NCI_TECH ce_tech = NCI_TECH_NONE;
-
-            /* Lock the card emulation tech */
-            switch (priv->initiator->technology) {
-            case NFC_TECHNOLOGY_A:
-                ce_tech = NCI_TECH_A_LISTEN;
-                break;
-            case NFC_TECHNOLOGY_B:
-                ce_tech = NCI_TECH_B_LISTEN;
-                break;
-            case NFC_TECHNOLOGY_F:
-            case NFC_TECHNOLOGY_UNKNOWN:
-                break;
-            }
-
-            nci_adapter_set_internal_state(priv, NCI_ADAPTER_REACTIVATING_CE);
-            nci_adapter_start_ce_reactivation_timer(self);
-
-            /*
-             * The same technology must be used for reactivation, otherwise
-             * the peer may not (and most likely won't) recognize us as the
-             * came card.
-             */
-            if (ce_tech) {
-                const NCI_TECH tech = priv->active_techs & ce_tech;
-
-                priv->active_tech_mask = ce_tech;
-                nci_core_set_tech(self->nci, tech);
-            }
+        if (nci_adapter_have_host(priv)) {
+            nci_adapter_start_ce_reactivation(self);
             break;
         }
         /* fallthrough */
@@ -1227,150 +1681,1309 @@ nci_adapter_deactivation(
 }
 
 /*==========================================================================*
- * NCI core events
+ * NFCEE and listen mode routing
  *==========================================================================*/
 
 static
-void
-nci_adapter_nci_intf_activated(
-    NciCore* nci,
-    const NciIntfActivationNtf* ntf,
-    void* user_data)
+NciNfcee*
+nci_adapter_nfcee_new(
+    const guint8* id_status,
+    const guint8* protocols,
+    guint num_protocols)
 {
-    NciAdapter* self = THIS(user_data);
+    NciNfcee* nfcee = g_malloc(G_ALIGN8(sizeof(NciNfcee)) + num_protocols);
+    guint8* ptr = (guint8*)nfcee + G_ALIGN8(sizeof(NciNfcee));
+
+    nfcee->id = id_status[0];
+    nfcee->status = id_status[1];
+    nfcee->protocols.bytes = ptr;
+    nfcee->protocols.size = num_protocols;
+    memcpy(ptr, protocols, num_protocols);
+    return nfcee;
+}
 
-    g_object_ref(self);
-    nci_adapter_activation(self, ntf);
-    g_object_unref(self);
+static
+NciNfcee*
+nci_adapter_nfcee_find(
+    NciAdapterPriv* priv,
+    guint8 id)
+{
+    guint i;
+
+    for (i = 0; i + 1 < priv->nfcees->len; i++) {
+        NciNfcee* nfcee = priv->nfcees->pdata[i];
+
+        if (nfcee->id == id) {
+            return nfcee;
+        }
+    }
+    return NULL;
+}
+
+static inline
+gboolean
+nci_adapter_nfcee_failed(
+    NciAdapterPriv* priv,
+    guint8 id)
+{
+    return (priv->nfcee_failed[id / 32] & (1u << (id % 32))) != 0;
 }
 
 static
 void
-nci_adapter_nci_next_state_changed(
-    NciCore* nci,
-    void* user_data)
+nci_adapter_nfcee_enable_routed(
+    NciAdapter* self);
+
+static
+void
+nci_adapter_nfcee_enable_done(
+    NciAdapter* self,
+    gboolean ok)
 {
-    NciAdapter* self = THIS(user_data);
-    NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
+    NciAdapterPriv* priv = self->priv;
+    const guint8 id = priv->nfcee_enabling;
+    NciNfcee* nfcee = nci_adapter_nfcee_find(priv, id);
 
-    klass->next_state_changed(self);
+    priv->nfcee_enable_pending = FALSE;
+    if (priv->nfcc_reset) {
+        /* Nothing failed, it will be enabled again after the reset */
+        return;
+    }
+    if (ok) {
+        GDEBUG("NFCEE 0x%02x enabled", id);
+        if (nfcee) {
+            nfcee->status = NCI_NFCEE_STATUS_ENABLED;
+        }
+    } else {
+        GWARN("Failed to enable NFCEE 0x%02x", id);
+        priv->nfcee_failed[id / 32] |= (1u << (id % 32));
+    }
+
+    /* Move on to the next one */
+    nci_adapter_nfcee_enable_routed(self);
 }
 
 static
 void
-nci_adapter_nci_current_state_changed(
-    NciCore* nci,
+nci_adapter_nfcee_enable_rsp(
+    NciAdapterIo* io,
+    const GUtilData* rsp,
     void* user_data)
 {
     NciAdapter* self = THIS(user_data);
-    NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
 
-    klass->current_state_changed(self);
+    self->priv->nfcee_enable_id = 0;
+    if (rsp && rsp->size >= 1 && rsp->bytes[0] == NCI_STATUS_OK) {
+        /* NCI 2.0 reports the outcome with NFCEE_MODE_SET_NTF */
+        if (io->nci_version < 0x20) {
+            nci_adapter_nfcee_enable_done(self, TRUE);
+        }
+    } else {
+        nci_adapter_nfcee_enable_done(self, FALSE);
+    }
 }
 
-/*==========================================================================*
- * Interface
- *==========================================================================*/
-
+static
 void
-nci_adapter_init_base(
+nci_adapter_nfcee_mode_set_ntf(
     NciAdapter* self,
-    NciHalIo* io)
+    const GUtilData* payload)
 {
     NciAdapterPriv* priv = self->priv;
 
-    self->nci = nci_core_new(io);
-    priv->active_techs = priv->supported_techs = nci_core_get_tech(self->nci);
-    priv->nci_event_id[CORE_EVENT_CURRENT_STATE] =
-        nci_core_add_current_state_changed_handler(self->nci,
-            nci_adapter_nci_current_state_changed, self);
-    priv->nci_event_id[CORE_EVENT_NEXT_STATE] =
-        nci_core_add_next_state_changed_handler(self->nci,
+    /* Status(1) */
+    if (priv->nfcee_enable_pending && !priv->nfcee_enable_id) {
+        nci_adapter_nfcee_enable_done(self, payload->size >= 1 &&
+            payload->bytes[0] == NCI_STATUS_OK);
+    }
+}
+
+static
+void
+nci_adapter_nfcee_enable_routed(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+    guint i;
+
+    /* Enable the NFCEEs which have something routed to them */
+    for (i = 0; i + 1 < priv->nfcees->len &&
+        !priv->nfcee_enable_pending; i++) {
+        NciNfcee* nfcee = priv->nfcees->pdata[i];
+
+        if (nfcee->status == NCI_NFCEE_STATUS_DISABLED &&
+            !nci_adapter_nfcee_failed(priv, nfcee->id) &&
+            nci_routing_nfcee_used(priv->routing, nfcee->id)) {
+            const guint8 cmd[] = { nfcee->id, 0x01 /* Enable */ };
+            GBytes* payload = g_bytes_new(cmd, sizeof(cmd));
+
+            GDEBUG("Enabling NFCEE 0x%02x", nfcee->id);
+            priv->nfcee_enable_id = nci_adapter_io_send_cmd(priv->io,
+                NCI_GID_NFCEE, NCI_OID_NFCEE_MODE_SET, payload,
+                nci_adapter_nfcee_enable_rsp, self);
+            g_bytes_unref(payload);
+            if (!priv->nfcee_enable_id) {
+                break;
+            }
+            /* The status changes when NFCC confirms it */
+            priv->nfcee_enable_pending = TRUE;
+            priv->nfcee_enabling = nfcee->id;
+        }
+    }
+}
+
+static
+void
+nci_adapter_nfcee_discover_ntf(
+    NciAdapter* self,
+    const GUtilData* payload)
+{
+    NciAdapterPriv* priv = self->priv;
+    const guint8* pkt = payload->bytes;
+
+    /*
+     * NFCEE ID(1), NFCEE Status(1), Number of Protocol Information
+     * Entries(1), Protocols(n), ...
+     */
+    if (payload->size >= 3 && payload->size >= 3u + pkt[2]) {
+        GPtrArray* list = priv->nfcees;
+        NciNfcee* nfcee = nci_adapter_nfcee_find(priv, pkt[0]);
+
+        GDEBUG("NFCEE 0x%02x status %u", pkt[0], pkt[1]);
+        if (nfcee) {
+            g_ptr_array_remove(list, nfcee);
+        }
+        priv->nfcee_failed[pkt[0] / 32] &= ~(1u << (pkt[0] % 32));
+        /* Keep the array NULL terminated */
+        list->pdata[list->len - 1] = nci_adapter_nfcee_new(pkt, pkt + 3,
+            pkt[2]);
+        g_ptr_array_add(list, NULL);
+        nci_adapter_nfcee_enable_routed(self);
+    }
+}
+
+static
+void
+nci_adapter_nfcee_discover_rsp(
+    NciAdapterIo* io,
+    const GUtilData* rsp,
+    void* user_data)
+{
+    if (rsp && rsp->size >= 2 && rsp->bytes[0] == NCI_STATUS_OK) {
+        /* NFCEE_DISCOVER_NTFs will follow */
+        GDEBUG("%u NFCEE(s)", rsp->bytes[1]);
+    } else {
+        GDEBUG("NFCEE discovery failed");
+    }
+}
+
+static
+void
+nci_adapter_nfcee_check(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    if (!priv->nfcee_discovered && !priv->nfcc_reset &&
+        self->nci->current_state == NCI_RFST_IDLE) {
+        GBytes* payload;
+
+        /* NCI 1.x requires Discovery Action, NCI 2.x has no payload */
+        if (priv->io->nci_version >= 0x20) {
+            payload = NULL;
+        } else {
+            static const guint8 enable = 0x01;
+
+            payload = g_bytes_new_static(&enable, 1);
+        }
+        priv->nfcee_discovered = TRUE;
+        nci_adapter_io_send_cmd(priv->io, NCI_GID_NFCEE,
+            NCI_OID_NFCEE_DISCOVER, payload,
+            nci_adapter_nfcee_discover_rsp, NULL);
+        if (payload) {
+            g_bytes_unref(payload);
+        }
+    }
+}
+
+static
+void
+nci_adapter_nfcee_action_ntf(
+    NciAdapter* self,
+    const GUtilData* payload)
+{
+    const guint8* pkt = payload->bytes;
+
+    /* NFCEE ID(1), Trigger(1), Supporting Data Length(1), Data(n) */
+    if (payload->size >= 3 && payload->size >= 3u + pkt[2]) {
+        NciNfceeAction action;
+
+        action.id = pkt[0];
+        action.trigger = pkt[1];
+        action.data.bytes = pkt + 3;
+        action.data.size = pkt[2];
+        GDEBUG("NFCEE 0x%02x action 0x%02x", action.id, action.trigger);
+        g_signal_emit(self, nci_adapter_signals[SIGNAL_NFCEE_ACTION], 0,
+            &action);
+    }
+}
+
+static
+void
+nci_adapter_routing_rsp(
+    NciAdapterIo* io,
+    const GUtilData* rsp,
+    void* user_data)
+{
+    if (!rsp || rsp->size < 1 || rsp->bytes[0] != NCI_STATUS_OK) {
+        GWARN("Failed to update listen mode routing");
+    }
+}
+
+static
+void
+nci_adapter_routing_push(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+    GPtrArray* cmds = nci_routing_commit(priv->routing);
+    guint i;
+
+    GDEBUG("Updating listen mode routing");
+    for (i = 0; i < cmds->len; i++) {
+        nci_adapter_io_send_cmd(priv->io, NCI_GID_RF,
+            NCI_OID_RF_SET_LISTEN_MODE_ROUTING, cmds->pdata[i],
+            nci_adapter_routing_rsp, NULL);
+    }
+    g_ptr_array_free(cmds, TRUE);
+}
+
+static
+void
+nci_adapter_routing_check(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+    NciCore* nci = self->nci;
+
+    if (priv->routing_dirty && nci && !priv->nfcc_reset) {
+        if (nci->current_state == NCI_RFST_IDLE) {
+            priv->routing_dirty = FALSE;
+            if (nci_routing_changed(priv->routing)) {
+                nci_adapter_routing_push(self);
+            }
+        } else if (nci->current_state == NCI_RFST_DISCOVERY &&
+            nci->next_state == NCI_RFST_DISCOVERY &&
+            priv->internal_state == NCI_ADAPTER_IDLE) {
+            if (nci_routing_changed(priv->routing)) {
+                /*
+                 * Routing can only be updated in RFST_IDLE. Nothing
+                 * is going on at the moment, bounce through IDLE.
+                 */
+                GDEBUG("Need RFST_IDLE to update routing");
+                nci_core_set_state(nci, NCI_RFST_IDLE);
+            } else {
+                priv->routing_dirty = FALSE;
+            }
+        }
+        /* Otherwise wait until RF interface gets deactivated */
+    }
+}
+
+static
+gboolean
+nci_adapter_routing_check_cb(
+    gpointer user_data)
+{
+    NciAdapter* self = THIS(user_data);
+
+    self->priv->routing_check_source = NULL;
+    nci_adapter_routing_check(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_adapter_routing_changed(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    /* Batch the changes */
+    priv->routing_dirty = TRUE;
+    if (!priv->routing_check_source) {
+        priv->routing_check_source = nci_idle_add(nci_adapter_routing_check_cb,
+            self);
+    }
+}
+
+/*==========================================================================*
+ * Logical connections
+ *==========================================================================*/
+
+static inline NciAdapterConnPriv* nci_adapter_conn_cast(NciAdapterConn* pub)
+    { return G_CAST(pub, NciAdapterConnPriv, pub); }
+
+static
+void
+nci_adapter_conn_send_close(
+    NciAdapterPriv* priv,
+    guint8 cid)
+{
+    const guint8 cmd[] = { cid };
+    GBytes* payload = g_bytes_new(cmd, sizeof(cmd));
+
+    nci_adapter_io_send_cmd(priv->io, NCI_GID_CORE, NCI_OID_CORE_CONN_CLOSE,
+        payload, NULL, NULL);
+    g_bytes_unref(payload);
+}
+
+static
+void
+nci_adapter_conn_lost(
+    NciAdapter* self,
+    NciAdapterConnPriv* conn)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    if (conn->open) {
+        conn->open = FALSE;
+        priv->conn_by_cid[conn->pub.cid] = NULL;
+        nci_adapter_io_conn_close(priv->io, conn->pub.cid);
+    }
+    conn->create_id = 0;
+    if (conn->cb.closed) {
+        conn->cb.closed(&conn->pub, conn->user_data);
+    }
+}
+
+static
+void
+nci_adapter_conn_create_rsp(
+    NciAdapterIo* io,
+    const GUtilData* rsp,
+    void* user_data)
+{
+    NciAdapterConnPriv* conn = user_data;
+    NciAdapter* self = conn->pub.adapter;
+    NciAdapterPriv* priv = self->priv;
+
+    /*
+     * Status(1), Max Data Packet Payload Size(1), Initial Number of
+     * Credits(1), Conn ID(1)
+     */
+    conn->create_id = 0;
+    if (rsp && rsp->size >= 4 && rsp->bytes[0] == NCI_STATUS_OK) {
+        const guint8 cid = rsp->bytes[3] & NCI_MAX_CONN_ID;
+
+        if (!priv->conn_by_cid[cid] && nci_adapter_io_conn_open(io, cid,
+            rsp->bytes[1], rsp->bytes[2])) {
+            GDEBUG("NFCEE 0x%02x conn %u", conn->pub.nfcee, cid);
+            conn->pub.cid = cid;
+            conn->open = TRUE;
+            priv->conn_by_cid[cid] = conn;
+            if (conn->cb.opened) {
+                conn->cb.opened(&conn->pub, conn->user_data);
+            }
+            return;
+        }
+
+        /* NFCC thinks it's open, don't leave it hanging there */
+        GWARN("Can't use conn %u", cid);
+        nci_adapter_conn_send_close(priv, cid);
+    }
+    GWARN("Failed to connect to NFCEE 0x%02x", conn->pub.nfcee);
+    nci_adapter_conn_lost(self, conn);
+}
+
+static
+void
+nci_adapter_conn_reset(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+    GSList* l = priv->conns;
+
+    /* The list may change while callbacks are running */
+    while (l) {
+        NciAdapterConnPriv* conn = l->data;
+
+        l = l->next;
+        if (conn->open) {
+            nci_adapter_conn_lost(self, conn);
+        }
+    }
+}
+
+static
+void
+nci_adapter_conn_free(
+    NciAdapterConnPriv* conn)
+{
+    NCI_OBJECT_DESTROYED(NCI_OBJECT_CONN);
+    g_slice_free(NciAdapterConnPriv, conn);
+}
+
+/*==========================================================================*
+ * NciAdapterIo callbacks
+ *==========================================================================*/
+
+static
+void
+nci_adapter_nfcc_state_clear(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    /* Everything has to be done again */
+    g_ptr_array_set_size(priv->nfcees, 0);
+    g_ptr_array_add(priv->nfcees, NULL);
+    priv->nfcee_discovered = FALSE;
+    priv->nfcee_enable_pending = FALSE;
+    nci_adapter_io_cancel(priv->io, priv->nfcee_enable_id);
+    priv->nfcee_enable_id = 0;
+    memset(priv->nfcee_failed, 0, sizeof(priv->nfcee_failed));
+    nci_routing_reset(priv->routing);
+    nci_adapter_conn_reset(self);
+}
+
+static
+void
+nci_adapter_io_reset_started(
+    NciAdapterIo* io,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+
+    /* Nothing can be sent until CORE_INIT_RSP */
+    GDEBUG("NFCC is being reset");
+    self->priv->nfcc_reset = TRUE;
+    nci_adapter_nfcc_state_clear(self);
+}
+
+static
+void
+nci_adapter_io_reset(
+    NciAdapterIo* io,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+    NciAdapterPriv* priv = self->priv;
+
+    /* Normally it's already clear, unless CORE_RESET bypassed us */
+    priv->nfcc_reset = FALSE;
+    nci_adapter_nfcc_state_clear(self);
+    nci_routing_set_limits(priv->routing, io->max_routing_table_size,
+        io->nci_version >= 0x20);
+    priv->routing_dirty = TRUE;
+}
+
+static
+void
+nci_adapter_io_data(
+    NciAdapterIo* io,
+    guint8 cid,
+    const GUtilData* data,
+    void* user_data)
+{
+    NciAdapterConnPriv* conn = THIS(user_data)->priv->conn_by_cid[cid];
+
+    if (conn && conn->cb.received) {
+        conn->cb.received(&conn->pub, data, conn->user_data);
+    }
+}
+
+static
+gboolean
+nci_adapter_io_ntf(
+    NciAdapterIo* io,
+    guint8 gid,
+    guint8 oid,
+    const GUtilData* payload,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+
+    switch (gid) {
+    case NCI_GID_NFCEE:
+        if (oid == NCI_OID_NFCEE_DISCOVER) {
+            nci_adapter_nfcee_discover_ntf(self, payload);
+        } else if (oid == NCI_OID_NFCEE_MODE_SET) {
+            nci_adapter_nfcee_mode_set_ntf(self, payload);
+        }
+        /* NciCore doesn't care about NFCEE notifications */
+        return TRUE;
+    case NCI_GID_RF:
+        if (oid == NCI_OID_RF_NFCEE_ACTION) {
+            nci_adapter_nfcee_action_ntf(self, payload);
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
+static
+GBytes*
+nci_adapter_io_core_cmd(
+    NciAdapterIo* io,
+    guint8 gid,
+    guint8 oid,
+    const GUtilData* payload,
+    void* user_data)
+{
+    if (gid == NCI_GID_RF && oid == NCI_OID_RF_SET_LISTEN_MODE_ROUTING) {
+        NciAdapter* self = THIS(user_data);
+        NciAdapterPriv* priv = self->priv;
+
+        /* Merge NciCore's routing table with ours */
+        if (nci_routing_set_core_table(priv->routing, payload)) {
+            GPtrArray* cmds = nci_routing_commit(priv->routing);
+            GBytes* last;
+            guint i;
+
+            /* All but the last part are sent by us */
+            for (i = 0; i + 1 < cmds->len; i++) {
+                nci_adapter_io_send_cmd(io, NCI_GID_RF,
+                    NCI_OID_RF_SET_LISTEN_MODE_ROUTING, cmds->pdata[i],
+                    nci_adapter_routing_rsp, NULL);
+            }
+            last = g_bytes_ref(cmds->pdata[cmds->len - 1]);
+            g_ptr_array_free(cmds, TRUE);
+            priv->routing_dirty = FALSE;
+            return last;
+        }
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * NCI core events
+ *==========================================================================*/
+
+static
+void
+nci_adapter_nci_intf_activated(
+    NciCore* nci,
+    const NciIntfActivationNtf* ntf,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+    NciAdapterPriv* priv = self->priv;
+    const NCI_ADAPTER_STATE prev_state = priv->internal_state;
+    const gint64 prev_state_since = priv->internal_state_since;
+
+    g_object_ref(self);
+    NCI_PROBE4(activation_start, ntf->rf_intf, ntf->protocol, ntf->mode,
+        priv->internal_state);
+    if (priv->trace) {
+        nci_trace_add(priv->trace, NCI_TRACE_TRACK_RF, NCI_TRACE_INSTANT,
+            "activation", ntf->rf_intf);
+    }
+    nci_adapter_latency_start(priv, NCI_ADAPTER_LATENCY_PUBLISH);
+    priv->published = FALSE;
+    NCI_ADAPTER_GET_CLASS(self)->intf_activated(self, ntf);
+    if (priv->published) {
+        nci_adapter_latency_done(self, NCI_ADAPTER_LATENCY_PUBLISH);
+    } else {
+        /* Reactivations don't publish anything */
+        priv->latency_start[NCI_ADAPTER_LATENCY_PUBLISH] = 0;
+    }
+    if ((prev_state == NCI_ADAPTER_REACTIVATING_TARGET ||
+        prev_state == NCI_ADAPTER_REACTIVATING_CE) &&
+        priv->internal_state != prev_state &&
+        priv->internal_state != NCI_ADAPTER_IDLE) {
+        nci_adapter_latency_sample(self, NCI_ADAPTER_LATENCY_REACTIVATION,
+            nci_clock_now(priv->clock) - prev_state_since,
+            NCI_SLO_FLAGS_NONE);
+    }
+    NCI_PROBE1(activation_done, priv->internal_state);
+    g_object_unref(self);
+}
+
+static
+void
+nci_adapter_nci_data_packet(
+    NciCore* nci,
+    guint8 cid,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NciAdapterEndpoint* endpoint = THIS(user_data)->priv->endpoint;
+
+    if (cid == NCI_STATIC_RF_CONN_ID && endpoint) {
+        endpoint->fn->data_packet(endpoint, data, len);
+    } else {
+        GDEBUG("Unhandled data packet, cid=0x%02x %u byte(s)", cid, len);
+    }
+}
+
+static
+void
+nci_adapter_nci_next_state_changed(
+    NciCore* nci,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+    NciAdapterPriv* priv = self->priv;
+    NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
+
+    /* NFCC is being (re)initialized */
+    if (nci->next_state == NCI_STATE_INIT &&
+        !priv->latency_start[NCI_ADAPTER_LATENCY_STARTUP]) {
+        nci_adapter_latency_start(priv, NCI_ADAPTER_LATENCY_STARTUP);
+    }
+    klass->next_state_changed(self);
+}
+
+static
+void
+nci_adapter_nci_current_state_changed(
+    NciCore* nci,
+    void* user_data)
+{
+    NciAdapter* self = THIS(user_data);
+    NciAdapterPriv* priv = self->priv;
+    NciAdapterClass* klass = NCI_ADAPTER_GET_CLASS(self);
+
+    if (priv->core_state != nci->current_state) {
+        const gint64 now = nci_clock_now(priv->clock);
+
+        nci_residency_add(priv->core_residency + priv->core_state,
+            now - priv->core_state_since);
+        priv->core_state_since = now;
+        priv->core_state = nci->current_state;
+        if (priv->core_state == NCI_RFST_DISCOVERY) {
+            nci_adapter_latency_done(self, NCI_ADAPTER_LATENCY_STARTUP);
+        }
+    }
+    if (priv->trace) {
+        nci_trace_add(priv->trace, NCI_TRACE_TRACK_RF, NCI_TRACE_STATE,
+            nci_adapter_core_state_name(nci->current_state), 0);
+    }
+    klass->current_state_changed(self);
+}
+
+/*==========================================================================*
+ * Interface
+ *==========================================================================*/
+
+void
+nci_adapter_init_base(
+    NciAdapter* self,
+    NciHalIo* io)
+{
+    static const NciAdapterIoCallbacks io_cb = {
+        .reset_started = nci_adapter_io_reset_started,
+        .reset = nci_adapter_io_reset,
+        .ntf = nci_adapter_io_ntf,
+        .core_cmd = nci_adapter_io_core_cmd,
+        .data = nci_adapter_io_data
+    };
+    NciAdapterPriv* priv = self->priv;
+
+    priv->io = nci_adapter_io_new(io, &io_cb, self);
+    priv->io->clock = priv->clock;
+    self->nci = nci_core_new(priv->io->hal);
+    priv->active_techs = priv->supported_techs = nci_core_get_tech(self->nci);
+    priv->core_state = self->nci->current_state;
+    priv->core_state_since = nci_clock_now(priv->clock);
+    priv->nci_event_id[CORE_EVENT_CURRENT_STATE] =
+        nci_core_add_current_state_changed_handler(self->nci,
+            nci_adapter_nci_current_state_changed, self);
+    priv->nci_event_id[CORE_EVENT_NEXT_STATE] =
+        nci_core_add_next_state_changed_handler(self->nci,
             nci_adapter_nci_next_state_changed, self);
     priv->nci_event_id[CORE_EVENT_INTF_ACTIVATED] =
         nci_core_add_intf_activated_handler(self->nci,
             nci_adapter_nci_intf_activated, self);
+    priv->nci_event_id[CORE_EVENT_DATA_PACKET] =
+        nci_core_add_data_packet_handler(self->nci,
+            nci_adapter_nci_data_packet, self);
+}
+
+/*
+ * This is supposed to be called from finalize method of the derived class
+ * to make sure that NciCore is freed before NciHalIo in cases when NciHalIo
+ * is allocated dynamically. Note that in that case it will be called twice,
+ * once by the derived class and once by nci_adapter_finalize.
+ */
+void
+nci_adapter_finalize_core(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    nci_source_clear(&priv->mode_check_source);
+    if (self->nci) {
+        nci_core_remove_all_handlers(self->nci, priv->nci_event_id);
+        nci_core_free(self->nci);
+        self->nci = NULL;
+    }
+    nci_trace_unref(priv->trace);
+    priv->trace = NULL;
+    if (priv->io) {
+        nci_capture_unref(priv->io->capture);
+        nci_adapter_io_free(priv->io);
+        priv->io = NULL;
+    }
+}
+
+gboolean
+nci_adapter_reactivate(
+    NciAdapter* self,
+    NfcTarget* target)
+{
+    if (self && self->target == target && target) {
+        NciAdapterPriv* priv = self->priv;
+        NciCore* nci = self->nci;
+
+        if (priv->active_intf &&
+            priv->internal_state == NCI_ADAPTER_HAVE_TARGET && nci &&
+            ((nci->current_state == NCI_RFST_POLL_ACTIVE &&
+              nci->next_state == NCI_RFST_POLL_ACTIVE) ||
+             (nci->current_state == NCI_RFST_LISTEN_ACTIVE &&
+              nci->next_state == NCI_RFST_LISTEN_ACTIVE))) {
+            GDEBUG("Reactivating the interface");
+            nci_adapter_set_internal_state(priv,
+                NCI_ADAPTER_REACTIVATING_TARGET);
+            /* Stop presence checks for the time being */
+            nci_clock_clear(priv->clock, &priv->presence_check_timer);
+            /* Switch to discovery and expect the same target to reappear */
+            nci_core_set_state(nci, NCI_RFST_DISCOVERY);
+            return TRUE;
+        }
+    }
+    GWARN("Can't reactivate the tag in this state");
+    return FALSE;
+}
+
+void
+nci_adapter_deactivate_target(
+    NciAdapter* self,
+    NfcTarget* target)
+{
+    if (self && self->target == target && target) {
+        nci_adapter_drop_target(self);
+        if (self->parent.powered) {
+            nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
+        }
+    }
+}
+
+void
+nci_adapter_deactivate_initiator(
+    NciAdapter* self,
+    NfcInitiator* initiator)
+{
+    if (self && initiator) {
+        NciAdapterPriv* priv = self->priv;
+
+        if (priv->initiator == initiator) {
+            nci_adapter_drop_initiator(self);
+            if (self->parent.powered) {
+                nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
+            }
+        }
+    }
+}
+
+const NciNfcee* const*
+nci_adapter_nfcees(
+    NciAdapter* self)
+{
+    return G_LIKELY(self) ? (const NciNfcee* const*)
+        self->priv->nfcees->pdata : NULL;
+}
+
+guint
+nci_adapter_add_route(
+    NciAdapter* self,
+    const NciRoute* route)
+{
+    if (G_LIKELY(self)) {
+        NciAdapterPriv* priv = self->priv;
+        const guint id = nci_routing_add(priv->routing, route);
+
+        if (id) {
+            /* New routes give the NFCEEs which refused another chance */
+            memset(priv->nfcee_failed, 0, sizeof(priv->nfcee_failed));
+            nci_adapter_nfcee_enable_routed(self);
+            nci_adapter_routing_changed(self);
+            return id;
+        }
+    }
+    return 0;
 }
 
-/*
- * This is supposed to be called from finalize method of the derived class
- * to make sure that NciCore is freed before NciHalIo in cases when NciHalIo
- * is allocated dynamically. Note that in that case it will be called twice,
- * once by the derived class and once by nci_adapter_finalize.
- */
 void
-nci_adapter_finalize_core(
+nci_adapter_remove_route(
+    NciAdapter* self,
+    guint id)
+{
+    if (G_LIKELY(self) && nci_routing_remove(self->priv->routing, id)) {
+        nci_adapter_routing_changed(self);
+    }
+}
+
+void
+nci_adapter_get_routing_usage(
+    NciAdapter* self,
+    NciRoutingUsage* usage)
+{
+    if (G_LIKELY(usage)) {
+        if (G_LIKELY(self)) {
+            *usage = *nci_routing_usage(self->priv->routing);
+        } else {
+            memset(usage, 0, sizeof(*usage));
+        }
+    }
+}
+
+gulong
+nci_adapter_add_nfcee_activated_handler(
+    NciAdapter* self,
+    NciAdapterNfceeActivationFunc func,
+    void* user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(func)) ? g_signal_connect(self,
+        SIGNAL_NFCEE_ACTIVATED_NAME, G_CALLBACK(func), user_data) : 0;
+}
+
+gulong
+nci_adapter_add_nfcee_action_handler(
+    NciAdapter* self,
+    NciAdapterNfceeActionFunc func,
+    void* user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(func)) ? g_signal_connect(self,
+        SIGNAL_NFCEE_ACTION_NAME, G_CALLBACK(func), user_data) : 0;
+}
+
+void
+nci_adapter_remove_handler(
+    NciAdapter* self,
+    gulong id)
+{
+    if (G_LIKELY(self) && G_LIKELY(id)) {
+        g_signal_handler_disconnect(self, id);
+    }
+}
+
+NciAdapterConn*
+nci_adapter_conn_open(
+    NciAdapter* self,
+    guint8 nfcee,
+    guint8 protocol,
+    const NciAdapterConnCallbacks* cb,
+    void* user_data)
+{
+    if (G_LIKELY(self) && !self->priv->nfcc_reset) {
+        NciAdapterPriv* priv = self->priv;
+        NciAdapterConnPriv* conn = g_slice_new0(NciAdapterConnPriv);
+        /*
+         * Destination Type(1) = NFCEE, Number of Parameters(1),
+         * NFCEE Value TLV: Type(1), Length(1), NFCEE ID(1), Protocol(1)
+         */
+        const guint8 cmd[] = { 0x03, 0x01, 0x01, 0x02, nfcee, protocol };
+        GBytes* payload = g_bytes_new(cmd, sizeof(cmd));
+
+        NCI_OBJECT_CREATED(NCI_OBJECT_CONN);
+        conn->pub.adapter = g_object_ref(self);
+        conn->pub.nfcee = nfcee;
+        conn->pub.protocol = protocol;
+        if (cb) {
+            conn->cb = *cb;
+        }
+        conn->user_data = user_data;
+        conn->create_id = nci_adapter_io_send_cmd(priv->io, NCI_GID_CORE,
+            NCI_OID_CORE_CONN_CREATE, payload, nci_adapter_conn_create_rsp,
+            conn);
+        g_bytes_unref(payload);
+        if (conn->create_id) {
+            priv->conns = g_slist_append(priv->conns, conn);
+            return &conn->pub;
+        }
+        g_object_unref(self);
+        nci_adapter_conn_free(conn);
+    }
+    return NULL;
+}
+
+gboolean
+nci_adapter_conn_send(
+    NciAdapterConn* pub,
+    GBytes* data)
+{
+    if (G_LIKELY(pub)) {
+        NciAdapterConnPriv* conn = nci_adapter_conn_cast(pub);
+
+        return conn->open && nci_adapter_io_send_data(pub->adapter->priv->io,
+            pub->cid, data);
+    }
+    return FALSE;
+}
+
+void
+nci_adapter_conn_close(
+    NciAdapterConn* pub)
+{
+    if (G_LIKELY(pub)) {
+        NciAdapterConnPriv* conn = nci_adapter_conn_cast(pub);
+        NciAdapter* self = pub->adapter;
+        NciAdapterPriv* priv = self->priv;
+
+        priv->conns = g_slist_remove(priv->conns, conn);
+        if (conn->create_id) {
+            nci_adapter_io_cancel(priv->io, conn->create_id);
+        }
+        if (conn->open) {
+            priv->conn_by_cid[pub->cid] = NULL;
+            nci_adapter_io_conn_close(priv->io, pub->cid);
+            nci_adapter_conn_send_close(priv, pub->cid);
+        }
+        nci_adapter_conn_free(conn);
+        g_object_unref(self);
+    }
+}
+
+void
+nci_adapter_object_counts(
+    NciObjectCounts* counts)
+{
+    if (G_LIKELY(counts)) {
+        counts->targets = g_atomic_int_get(nci_object_count +
+            NCI_OBJECT_TARGET);
+        counts->initiators = g_atomic_int_get(nci_object_count +
+            NCI_OBJECT_INITIATOR);
+        counts->intf_blocks = g_atomic_int_get(nci_object_count +
+            NCI_OBJECT_INTF_BLOCK);
+        counts->conns = g_atomic_int_get(nci_object_count +
+            NCI_OBJECT_CONN);
+    }
+}
+
+gboolean
+nci_adapter_get_core_residency(
+    NciAdapter* self,
+    NCI_STATE state,
+    NciResidency* residency)
+{
+    if (G_LIKELY(self) && G_LIKELY(residency) && state < NCI_CORE_STATES) {
+        NciAdapterPriv* priv = self->priv;
+
+        *residency = priv->core_residency[state];
+        if (priv->core_state == state) {
+            residency->total_us += nci_clock_now(priv->clock) -
+                priv->core_state_since;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+nci_adapter_get_latency(
+    NciAdapter* self,
+    NCI_ADAPTER_LATENCY which,
+    NciLatency* latency)
+{
+    if (G_LIKELY(self) && G_LIKELY(latency) &&
+        which < NCI_ADAPTER_LATENCY_COUNT) {
+        *latency = self->priv->latency[which];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+nci_adapter_get_apdu_stats(
+    NciAdapter* self,
+    guint8 ins,
+    NciApduStats* stats)
+{
+    if (G_LIKELY(self) && G_LIKELY(stats) && self->priv->apdu_stats[ins]) {
+        *stats = *self->priv->apdu_stats[ins];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+nci_adapter_clear_apdu_stats(
     NciAdapter* self)
 {
-    NciAdapterPriv* priv = self->priv;
+    if (G_LIKELY(self)) {
+        nci_adapter_clear_apdu_stats_priv(self->priv);
+    }
+}
 
-    gutil_source_clear(&priv->mode_check_id);
-    if (self->nci) {
-        nci_core_remove_all_handlers(self->nci, priv->nci_event_id);
-        nci_core_free(self->nci);
-        self->nci = NULL;
+void
+nci_adapter_export_metrics(
+    NciAdapter* self,
+    NciMetricsSink* sink)
+{
+    if (G_LIKELY(self) && G_LIKELY(sink)) {
+        static const char* latency_names[NCI_ADAPTER_LATENCY_COUNT] = {
+            "mode_switch", "startup", "publish", "transmit", "reactivation"
+        };
+        const NciMetricsSinkFunctions* fn = sink->fn;
+        NciAdapterPriv* priv = self->priv;
+        NciResidency core[NCI_CORE_STATES];
+        NciResidency internal[NCI_ADAPTER_STATES];
+        const char* core_names[NCI_CORE_STATES];
+        const char* internal_names[NCI_ADAPTER_STATES];
+        NciObjectCounts objects;
+        guint i;
+
+        for (i = 0; i < NCI_CORE_STATES; i++) {
+            core_names[i] = nci_adapter_core_state_name(i);
+            nci_adapter_get_core_residency(self, i, core + i);
+        }
+        for (i = 0; i < NCI_ADAPTER_STATES; i++) {
+            internal_names[i] = nci_adapter_internal_state_name(i);
+            nci_adapter_get_state_residency(self, i, internal + i);
+        }
+        nci_adapter_export_residency(sink, "core_state", core,
+            core_names, NCI_CORE_STATES);
+        nci_adapter_export_residency(sink, "adapter_state", internal,
+            internal_names, NCI_ADAPTER_STATES);
+
+        for (i = 0; i < NCI_ADAPTER_LATENCY_COUNT; i++) {
+            fn->histogram(sink, "latency", "kind", latency_names[i],
+                &priv->latency[i].hist);
+        }
+
+        nci_adapter_export_apdu_stats(priv, sink);
+
+        fn->value(sink, "slo_snapshots", NCI_METRIC_GAUGE, NULL, NULL,
+            priv->slo_snapshots.length);
+
+        nci_adapter_object_counts(&objects);
+        fn->value(sink, "objects", NCI_METRIC_GAUGE, "type", "target",
+            objects.targets);
+        fn->value(sink, "objects", NCI_METRIC_GAUGE, "type", "initiator",
+            objects.initiators);
+        fn->value(sink, "objects", NCI_METRIC_GAUGE, "type", "intf_block",
+            objects.intf_blocks);
+        fn->value(sink, "objects", NCI_METRIC_GAUGE, "type", "conn",
+            objects.conns);
+    }
+}
+
+void
+nci_adapter_set_latency_threshold(
+    NciAdapter* self,
+    NCI_ADAPTER_LATENCY which,
+    guint ms)
+{
+    if (G_LIKELY(self) && which < NCI_ADAPTER_LATENCY_COUNT) {
+        self->priv->latency_threshold_ms[which] = ms;
+    }
+}
+
+guint
+nci_adapter_slo_snapshot_count(
+    NciAdapter* self)
+{
+    return G_LIKELY(self) ? self->priv->slo_snapshots.length : 0;
+}
+
+const NciSloSnapshot*
+nci_adapter_slo_snapshot(
+    NciAdapter* self,
+    guint index)
+{
+    if (G_LIKELY(self)) {
+        NciAdapterSloSnapshot* snapshot =
+            g_queue_peek_nth(&self->priv->slo_snapshots, index);
+
+        if (snapshot) {
+            return &snapshot->pub;
+        }
+    }
+    return NULL;
+}
+
+void
+nci_adapter_clear_slo_snapshots(
+    NciAdapter* self)
+{
+    if (G_LIKELY(self)) {
+        nci_adapter_clear_slo_snapshots_priv(self->priv);
     }
 }
 
+const char*
+nci_adapter_state_name(
+    guint state)
+{
+    return (state < NCI_ADAPTER_STATES) ?
+        nci_adapter_internal_state_name(state) : NULL;
+}
+
 gboolean
-nci_adapter_reactivate(
+nci_adapter_get_state_residency(
     NciAdapter* self,
-    NfcTarget* target)
+    guint state,
+    NciResidency* residency)
 {
-    if (self && self->target == target && target) {
+    if (G_LIKELY(self) && G_LIKELY(residency) &&
+        state < NCI_ADAPTER_STATES) {
         NciAdapterPriv* priv = self->priv;
-        NciCore* nci = self->nci;
 
-        if (priv->active_intf &&
-            priv->internal_state == NCI_ADAPTER_HAVE_TARGET && nci &&
-            ((nci->current_state == NCI_RFST_POLL_ACTIVE &&
-              nci->next_state == NCI_RFST_POLL_ACTIVE) ||
-             (nci->current_state == NCI_RFST_LISTEN_ACTIVE &&
-              nci->next_state == NCI_RFST_LISTEN_ACTIVE))) {
-            GDEBUG("Reactivating the interface");
-            nci_adapter_set_internal_state(priv,
-                NCI_ADAPTER_REACTIVATING_TARGET);
-            /* Stop presence checks for the time being */
-            gutil_source_clear(&priv->presence_check_timer);
-            /* Switch to discovery and expect the same target to reappear */
-            nci_core_set_state(nci, NCI_RFST_DISCOVERY);
-            return TRUE;
+        *residency = priv->internal_residency[state];
+        if (priv->internal_state == state) {
+            residency->total_us += nci_clock_now(priv->clock) -
+                priv->internal_state_since;
         }
+        return TRUE;
     }
-    GWARN("Can't reactivate the tag in this state");
     return FALSE;
 }
 
 void
-nci_adapter_deactivate_target(
+nci_adapter_set_capture(
     NciAdapter* self,
-    NfcTarget* target)
+    NciCapture* capture)
 {
-    if (self && self->target == target && target) {
-        nci_adapter_drop_target(self);
-        if (self->parent.powered) {
-            nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
+    if (G_LIKELY(self) && self->priv->io) {
+        NciAdapterIo* io = self->priv->io;
+
+        if (io->capture != capture) {
+            nci_capture_unref(io->capture);
+            io->capture = nci_capture_ref(capture);
         }
     }
 }
 
 void
-nci_adapter_deactivate_initiator(
+nci_adapter_set_trace(
     NciAdapter* self,
-    NfcInitiator* initiator)
+    NciTrace* trace)
 {
-    if (self && initiator) {
+    if (G_LIKELY(self)) {
         NciAdapterPriv* priv = self->priv;
 
-        if (priv->initiator == initiator) {
-            nci_adapter_drop_initiator(self);
-            if (self->parent.powered) {
-                nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
+        if (priv->trace != trace) {
+            nci_trace_unref(priv->trace);
+            priv->trace = nci_trace_ref(trace);
+            if (trace) {
+                nci_trace_set_clock(trace, priv->clock);
+
+                /* Start with the current states */
+                nci_trace_add(trace, NCI_TRACE_TRACK_ADAPTER,
+                    NCI_TRACE_STATE, nci_adapter_internal_state_name
+                        (priv->internal_state), 0);
+                if (self->nci) {
+                    nci_trace_add(trace, NCI_TRACE_TRACK_RF,
+                        NCI_TRACE_STATE, nci_adapter_core_state_name
+                            (self->nci->current_state), 0);
+                }
+            }
+        }
+    }
+}
+
+void
+nci_adapter_set_clock(
+    NciAdapter* self,
+    NciClock* clock)
+{
+    if (G_LIKELY(self) && self->priv->clock != clock) {
+        NciAdapterPriv* priv = self->priv;
+        const gint64 delta = nci_clock_now(clock) - nci_clock_now(priv->clock);
+        const gboolean presence_check = (priv->presence_check_timer != NULL);
+        const gboolean ce_reactivation = (priv->ce_reactivation_timer != NULL);
+        guint i;
+
+        /* Timers can only be removed by the clock which has issued them */
+        nci_clock_clear(priv->clock, &priv->presence_check_timer);
+        nci_clock_clear(priv->clock, &priv->ce_reactivation_timer);
+
+        /* Keep the intervals being measured */
+        priv->core_state_since += delta;
+        priv->internal_state_since += delta;
+        for (i = 0; i < NCI_ADAPTER_LATENCY_COUNT; i++) {
+            if (priv->latency_start[i]) {
+                priv->latency_start[i] += delta;
             }
         }
+
+        priv->clock = clock;
+        if (priv->io) {
+            nci_adapter_io_set_clock(priv->io, clock);
+        }
+        nci_trace_set_clock(priv->trace, clock);
+        if (presence_check) {
+            priv->presence_check_timer = nci_clock_timeout_add(clock,
+                PRESENCE_CHECK_PERIOD_MS, nci_adapter_presence_check_timer,
+                self);
+        }
+        if (ce_reactivation) {
+            priv->ce_reactivation_timer = nci_clock_timeout_add(clock,
+                CE_REACTIVATION_TIMEOUT_MS, nci_adapter_ce_reactivation_timeout,
+                self);
+        }
+    }
+}
+
+void
+nci_adapter_latency_sample(
+    NciAdapter* self,
+    NCI_ADAPTER_LATENCY which,
+    gint64 us,
+    NCI_SLO_FLAGS flags)
+{
+    NciAdapterPriv* priv = self->priv;
+    const guint threshold_ms = priv->latency_threshold_ms[which];
+
+    nci_latency_add(priv->latency + which, us);
+    if (threshold_ms && us > (gint64) threshold_ms * 1000) {
+        nci_adapter_slo_snapshot_take(self, which, us, flags);
+    }
+}
+
+void
+nci_adapter_apdu_sample(
+    NciAdapter* self,
+    guint8 cla,
+    guint8 ins,
+    gint64 host_us,
+    gint64 send_us)
+{
+    NciAdapterPriv* priv = self->priv;
+    NciApduStats* stats = priv->apdu_stats[ins];
+
+    if (!stats) {
+        stats = priv->apdu_stats[ins] = g_new0(NciApduStats, 1);
+        stats->ins = ins;
+    }
+    stats->cla = cla;
+    if (send_us < 0) {
+        stats->errors++;
+    } else {
+        nci_histogram_add(&stats->host, host_us);
+        nci_histogram_add(&stats->send, send_us);
+        nci_histogram_add(&stats->total, host_us + send_us);
     }
 }
 
+NciTrace*
+nci_adapter_trace(
+    NciAdapter* self)
+{
+    return self->priv->trace;
+}
+
+NciClock*
+nci_adapter_clock(
+    NciAdapter* self)
+{
+    return G_LIKELY(self) ? self->priv->clock : NULL;
+}
+
 /*==========================================================================*
  * Methods
  *==========================================================================*/
@@ -1388,18 +3001,19 @@ nci_adapter_submit_mode_request(
     if (mode & NFC_MODE_READER_WRITER) {
         op_mode |= (NFC_OP_MODE_RW | NFC_OP_MODE_POLL);
     }
-    if (mode & NFC_MODE_P2P_INITIATOR) {
+    if (NCI_PLUGIN_PEER && (mode & NFC_MODE_P2P_INITIATOR)) {
         op_mode |= (NFC_OP_MODE_PEER | NFC_OP_MODE_POLL);
     }
-    if (mode & NFC_MODE_P2P_TARGET) {
+    if (NCI_PLUGIN_PEER && (mode & NFC_MODE_P2P_TARGET)) {
         op_mode |= (NFC_OP_MODE_PEER | NFC_OP_MODE_LISTEN);
     }
-    if (mode & NFC_MODE_CARD_EMILATION) {
+    if (NCI_PLUGIN_CE && (mode & NFC_MODE_CARD_EMILATION)) {
         op_mode |= (NFC_OP_MODE_CE | NFC_OP_MODE_LISTEN);
     }
 
     priv->desired_mode = mode;
     priv->mode_change_pending = TRUE;
+    nci_adapter_latency_start(priv, NCI_ADAPTER_LATENCY_MODE_SWITCH);
     nci_core_set_op_mode(self->nci, op_mode);
     if (op_mode != NFC_OP_MODE_NONE && adapter->powered) {
         nci_core_set_state(self->nci, NCI_RFST_DISCOVERY);
@@ -1417,6 +3031,7 @@ nci_adapter_cancel_mode_request(
     NciAdapterPriv* priv = self->priv;
 
     priv->mode_change_pending = FALSE;
+    priv->latency_start[NCI_ADAPTER_LATENCY_MODE_SWITCH] = 0;
     nci_adapter_schedule_mode_check(self);
 }
 
@@ -1425,10 +3040,41 @@ void
 nci_adapter_current_state_changed(
     NciAdapter* self)
 {
+    /* Our commands must be queued before NciCore moves on */
+    nci_adapter_nfcee_check(self);
+    nci_adapter_routing_check(self);
     nci_adapter_state_check(self);
     nci_adapter_mode_check(self);
 }
 
+static
+void
+nci_adapter_listen_sleep(
+    NciAdapter* self)
+{
+    NciAdapterPriv* priv = self->priv;
+
+    switch (priv->internal_state) {
+    case NCI_ADAPTER_HAVE_INITIATOR:
+    case NCI_ADAPTER_REACTIVATED_CE:
+        if (nci_adapter_have_host(priv)) {
+            /*
+             * The reader has put us to sleep with HLTA or SLP_REQ and is
+             * expected to wake us up with the same technology. Keep the
+             * initiator and the host alive in the meantime.
+             */
+            nci_adapter_set_internal_state(priv, NCI_ADAPTER_SLEEPING_CE);
+        }
+        break;
+    case NCI_ADAPTER_IDLE:
+    case NCI_ADAPTER_HAVE_TARGET:
+    case NCI_ADAPTER_REACTIVATING_TARGET:
+    case NCI_ADAPTER_REACTIVATING_CE:
+    case NCI_ADAPTER_SLEEPING_CE:
+        break;
+    }
+}
+
 static
 void
 nci_adapter_next_state_changed(
@@ -1452,7 +3098,9 @@ nci_adapter_next_state_changed(
     case NCI_RFST_W4_HOST_SELECT:
     case NCI_RFST_POLL_ACTIVE:
     case NCI_RFST_LISTEN_ACTIVE:
+        break;
     case NCI_RFST_LISTEN_SLEEP:
+        nci_adapter_listen_sleep(self);
         break;
     default:
         nci_adapter_set_internal_state(priv, NCI_ADAPTER_IDLE);
@@ -1463,6 +3111,33 @@ nci_adapter_next_state_changed(
     nci_adapter_mode_check(self);
 }
 
+static
+void
+nci_adapter_intf_activated(
+    NciAdapter* self,
+    const NciIntfActivationNtf* ntf)
+{
+    nci_adapter_activation(self, ntf);
+}
+
+static
+NfcTarget*
+nci_adapter_create_target(
+    NciAdapter* self,
+    const NciIntfActivationNtf* ntf)
+{
+    return nci_target_new(self, ntf);
+}
+
+static
+NfcInitiator*
+nci_adapter_create_initiator(
+    NciAdapter* self,
+    const NciIntfActivationNtf* ntf)
+{
+    return nci_initiator_new(self, ntf);
+}
+
 static
 NFC_TECHNOLOGY
 nci_adapter_get_supported_techs(
@@ -1515,15 +3190,25 @@ nci_adapter_init(
         NciAdapterPriv);
 
     self->priv = priv;
+    priv->nfcees = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(priv->nfcees, NULL);
+    priv->routing = nci_routing_new();
     priv->active_tech_mask = NCI_TECH_ALL;
     priv->internal_state = NCI_ADAPTER_IDLE;
-    adapter->supported_modes = NFC_MODE_READER_WRITER |
-        NFC_MODE_P2P_INITIATOR | NFC_MODE_P2P_TARGET |
-        NFC_MODE_CARD_EMILATION;
+    priv->internal_state_since = nci_clock_now(priv->clock);
+    g_queue_init(&priv->slo_snapshots);
+    adapter->supported_modes = NFC_MODE_READER_WRITER;
     adapter->supported_tags = NFC_TAG_TYPE_MIFARE_ULTRALIGHT;
     adapter->supported_protocols = NFC_PROTOCOL_T2_TAG |
-        NFC_PROTOCOL_T4A_TAG | NFC_PROTOCOL_T4B_TAG |
-        NFC_PROTOCOL_NFC_DEP;
+        NFC_PROTOCOL_T4A_TAG | NFC_PROTOCOL_T4B_TAG;
+    if (NCI_PLUGIN_PEER) {
+        adapter->supported_modes |= NFC_MODE_P2P_INITIATOR |
+            NFC_MODE_P2P_TARGET;
+        adapter->supported_protocols |= NFC_PROTOCOL_NFC_DEP;
+    }
+    if (NCI_PLUGIN_CE) {
+        adapter->supported_modes |= NFC_MODE_CARD_EMILATION;
+    }
 }
 
 static
@@ -1546,9 +3231,16 @@ nci_adapter_finalize(
     nci_adapter_set_active_tag(priv, NULL);
     nci_adapter_set_active_peer(priv, NULL);
     nci_adapter_set_active_host(priv, NULL);
-    gutil_source_clear(&priv->ce_reactivation_timer);
-    gutil_source_clear(&priv->presence_check_timer);
+    nci_clock_clear(priv->clock, &priv->ce_reactivation_timer);
+    nci_clock_clear(priv->clock, &priv->presence_check_timer);
+    nci_source_clear(&priv->routing_check_source);
     nci_adapter_finalize_core(self);
+    nci_routing_free(priv->routing);
+    nci_adapter_intf_info_free(priv->active_intf);
+    nci_adapter_intf_info_free(priv->spare_intf);
+    nci_adapter_clear_slo_snapshots_priv(priv);
+    nci_adapter_clear_apdu_stats_priv(priv);
+    g_ptr_array_free(priv->nfcees, TRUE);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
 
@@ -1563,12 +3255,24 @@ nci_adapter_class_init(
     g_type_class_add_private(klass, sizeof(NciAdapterPriv));
     klass->current_state_changed = nci_adapter_current_state_changed;
     klass->next_state_changed = nci_adapter_next_state_changed;
+    klass->intf_activated = nci_adapter_intf_activated;
+    klass->create_target = nci_adapter_create_target;
+    klass->create_initiator = nci_adapter_create_initiator;
+    klass->presence_check = nci_adapter_presence_check;
     adapter_class->submit_mode_request = nci_adapter_submit_mode_request;
     adapter_class->cancel_mode_request = nci_adapter_cancel_mode_request;
     adapter_class->get_supported_techs = nci_adapter_get_supported_techs;
     adapter_class->set_allowed_techs = nci_adapter_set_allowed_techs;
     object_class->dispose = nci_adapter_dispose;
     object_class->finalize = nci_adapter_finalize;
+    nci_adapter_signals[SIGNAL_NFCEE_ACTIVATED] =
+        g_signal_new(SIGNAL_NFCEE_ACTIVATED_NAME,
+            G_OBJECT_CLASS_TYPE(klass), G_SIGNAL_RUN_FIRST,
+            0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_POINTER);
+    nci_adapter_signals[SIGNAL_NFCEE_ACTION] =
+        g_signal_new(SIGNAL_NFCEE_ACTION_NAME,
+            G_OBJECT_CLASS_TYPE(klass), G_SIGNAL_RUN_FIRST,
+            0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_POINTER);
 }
 
 /*
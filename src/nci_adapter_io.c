@@ -0,0 +1,1082 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+#include "nci_capture.h"
+#include "nci_clock.h"
+
+#include <gutil_misc.h>
+#include <gutil_macros.h>
+
+/*
+ * The NFCC is supposed to respond within 1 second (CORE_RESET and such
+ * may take longer but those are never issued by the adapter itself).
+ */
+#define NCI_ADAPTER_IO_CMD_TIMEOUT_MS (2000)
+
+typedef enum nci_adapter_io_writer {
+    WRITER_NONE,
+    WRITER_CORE,
+    WRITER_ADAPTER,
+    WRITER_DATA
+} NCI_ADAPTER_IO_WRITER;
+
+typedef struct nci_adapter_io_cmd {
+    guint id;
+    guint8 hdr[NCI_HDR_SIZE];
+    GBytes* payload;
+    NciAdapterIoRspFunc done;
+    void* user_data;
+} NciAdapterIoCmd;
+
+typedef struct nci_adapter_io_conn {
+    gboolean open;
+    guint8 max_payload;
+    guint8 credits;             /* Or NCI_CONN_NO_FLOW_CONTROL */
+    GQueue tx;                  /* GBytes */
+    guint tx_offset;            /* Already sent part of the first one */
+    GByteArray* rx;             /* Partial incoming message */
+} NciAdapterIoConn;
+
+typedef struct nci_adapter_io_priv {
+    NciAdapterIo pub;
+    NciHalIo io;                /* pub.hal points here */
+    NciHalClient client;        /* What the real HAL talks to */
+    NciHalIo* hal;              /* The real HAL */
+    NciHalClient* core;         /* NciCore's client */
+    const NciAdapterIoCallbacks* cb;
+    void* user_data;
+    NCI_ADAPTER_IO_WRITER writer;
+    GByteArray* rx;             /* Partial incoming packet */
+    GByteArray* rsp;            /* Segmented response to our command */
+    GByteArray* core_write;     /* Deferred write from NciCore */
+    NciHalClientFunc core_write_done;
+    gboolean core_write_deferred;
+    gboolean core_cmd_pending;  /* NciCore is waiting for response */
+    GQueue cmd_queue;
+    NciAdapterIoCmd* cmd;       /* Our command waiting for response */
+    guint8 late_rsp[2];         /* GID/OID of the timed out command */
+    gboolean expect_late_rsp;
+    NciClockTimer* cmd_timeout;
+    guint last_id;
+    NciAdapterIoConn conn[NCI_MAX_CONN_ID + 1]; /* Indexed by cid */
+    guint8 data_hdr[NCI_HDR_SIZE];
+    guint8 tx_cid;              /* Connection being written to */
+    guint8 tx_next;             /* Round robin */
+    guint tx_len;
+    GBytes* tx_data;            /* Being written */
+} NciAdapterIoPriv;
+
+static inline NciAdapterIoPriv* nci_adapter_io_cast(NciAdapterIo* pub)
+    { return G_CAST(pub, NciAdapterIoPriv, pub); }
+
+static
+void
+nci_adapter_io_pump(
+    NciAdapterIoPriv* self);
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+nci_adapter_io_cmd_free(
+    NciAdapterIoCmd* cmd)
+{
+    if (cmd->payload) {
+        g_bytes_unref(cmd->payload);
+    }
+    g_slice_free(NciAdapterIoCmd, cmd);
+}
+
+static
+void
+nci_adapter_io_cmd_done(
+    NciAdapterIoPriv* self,
+    NciAdapterIoCmd* cmd,
+    const GUtilData* rsp)
+{
+    if (cmd->done) {
+        cmd->done(&self->pub, rsp, cmd->user_data);
+    }
+    nci_adapter_io_cmd_free(cmd);
+}
+
+static
+void
+nci_adapter_io_fail_all(
+    NciAdapterIoPriv* self)
+{
+    NciAdapterIoCmd* cmd = self->cmd;
+
+    nci_clock_clear(self->pub.clock, &self->cmd_timeout);
+    if (cmd) {
+        self->cmd = NULL;
+        nci_adapter_io_cmd_done(self, cmd, NULL);
+    }
+    while ((cmd = g_queue_pop_head(&self->cmd_queue)) != NULL) {
+        nci_adapter_io_cmd_done(self, cmd, NULL);
+    }
+    g_byte_array_set_size(self->rsp, 0);
+}
+
+static
+void
+nci_adapter_io_conn_clear(
+    NciAdapterIoConn* conn)
+{
+    GBytes* data;
+
+    conn->open = FALSE;
+    conn->tx_offset = 0;
+    while ((data = g_queue_pop_head(&conn->tx)) != NULL) {
+        g_bytes_unref(data);
+    }
+    if (conn->rx) {
+        g_byte_array_set_size(conn->rx, 0);
+    }
+}
+
+static
+void
+nci_adapter_io_conn_clear_all(
+    NciAdapterIoPriv* self)
+{
+    guint i;
+
+    for (i = 0; i <= NCI_MAX_CONN_ID; i++) {
+        nci_adapter_io_conn_clear(self->conn + i);
+    }
+}
+
+static
+gboolean
+nci_adapter_io_cmd_timeout(
+    gpointer user_data)
+{
+    NciAdapterIoPriv* self = user_data;
+    NciAdapterIoCmd* cmd = self->cmd;
+
+    GWARN("Command %02x/%02x timed out", cmd->hdr[0] & NCI_HDR_GID_MASK,
+        cmd->hdr[1]);
+    self->cmd_timeout = NULL;
+    self->cmd = NULL;
+
+    /* Swallow the response if it arrives after all */
+    self->late_rsp[0] = cmd->hdr[0] & NCI_HDR_GID_MASK;
+    self->late_rsp[1] = cmd->hdr[1];
+    self->expect_late_rsp = TRUE;
+    g_byte_array_set_size(self->rsp, 0);
+    nci_adapter_io_cmd_done(self, cmd, NULL);
+    nci_adapter_io_pump(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nci_adapter_io_write_done(
+    NciHalClient* client,
+    gboolean ok)
+{
+    NciAdapterIoPriv* self = G_CAST(client, NciAdapterIoPriv, client);
+    const NCI_ADAPTER_IO_WRITER writer = self->writer;
+
+    self->writer = WRITER_NONE;
+    if (writer == WRITER_CORE) {
+        NciHalClientFunc done = self->core_write_done;
+
+        self->core_write_done = NULL;
+        if (done) {
+            done(self->core, ok);
+        }
+    } else if (writer == WRITER_ADAPTER && !ok && self->cmd) {
+        NciAdapterIoCmd* cmd = self->cmd;
+
+        GWARN("Failed to send command %02x/%02x", cmd->hdr[0] &
+            NCI_HDR_GID_MASK, cmd->hdr[1]);
+        nci_clock_clear(self->pub.clock, &self->cmd_timeout);
+        self->cmd = NULL;
+        nci_adapter_io_cmd_done(self, cmd, NULL);
+    } else if (writer == WRITER_DATA) {
+        NciAdapterIoConn* conn = self->conn + self->tx_cid;
+        GBytes* data = self->tx_data;
+
+        self->tx_data = NULL;
+        if (conn->open && g_queue_peek_head(&conn->tx) == data) {
+            if (ok) {
+                conn->tx_offset += self->tx_len;
+            } else {
+                GWARN("Failed to send data to conn %u", self->tx_cid);
+            }
+            if (!ok || conn->tx_offset >= g_bytes_get_size(data)) {
+                g_bytes_unref(g_queue_pop_head(&conn->tx));
+                conn->tx_offset = 0;
+            }
+        }
+        g_bytes_unref(data);
+    }
+    nci_adapter_io_pump(self);
+}
+
+static
+gboolean
+nci_adapter_io_hal_write(
+    NciAdapterIoPriv* self,
+    const GUtilData* chunks,
+    guint count)
+{
+    if (self->pub.capture) {
+        nci_capture_frame_at(self->pub.capture, nci_clock_now(self->pub.clock),
+            NCI_CAPTURE_RECORD_TX, chunks, count);
+    }
+    return self->hal->fn->write(self->hal, chunks, count,
+        nci_adapter_io_write_done);
+}
+
+static
+gboolean
+nci_adapter_io_write_core(
+    NciAdapterIoPriv* self,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc done)
+{
+    self->writer = WRITER_CORE;
+    self->core_write_done = done;
+    if (nci_adapter_io_hal_write(self, chunks, count)) {
+        return TRUE;
+    } else {
+        self->writer = WRITER_NONE;
+        self->core_write_done = NULL;
+        return FALSE;
+    }
+}
+
+static
+void
+nci_adapter_io_pump_data(
+    NciAdapterIoPriv* self)
+{
+    guint i;
+
+    for (i = 0; i <= NCI_MAX_CONN_ID; i++) {
+        const guint8 cid = (self->tx_next + i) & NCI_MAX_CONN_ID;
+        NciAdapterIoConn* conn = self->conn + cid;
+        GBytes* data = g_queue_peek_head(&conn->tx);
+
+        if (data && conn->credits) {
+            gsize size;
+            const guint8* bytes = g_bytes_get_data(data, &size);
+            const guint left = size - conn->tx_offset;
+            const guint len = MIN(left, conn->max_payload);
+            GUtilData chunks[2];
+
+            /* Segment the message if necessary */
+            self->data_hdr[0] = NCI_HDR_MT_DATA | cid |
+                ((len < left) ? NCI_HDR_PBF : 0);
+            self->data_hdr[1] = 0;
+            self->data_hdr[2] = (guint8) len;
+            chunks[0].bytes = self->data_hdr;
+            chunks[0].size = sizeof(self->data_hdr);
+            chunks[1].bytes = bytes + conn->tx_offset;
+            chunks[1].size = len;
+
+            self->writer = WRITER_DATA;
+            self->tx_cid = cid;
+            self->tx_next = (cid + 1) & NCI_MAX_CONN_ID;
+            self->tx_len = len;
+            self->tx_data = g_bytes_ref(data);
+            if (nci_adapter_io_hal_write(self, chunks, len ? 2 : 1)) {
+                if (conn->credits != NCI_CONN_NO_FLOW_CONTROL) {
+                    conn->credits--;
+                }
+            } else {
+                GWARN("Failed to write data to conn %u", cid);
+                self->writer = WRITER_NONE;
+                self->tx_data = NULL;
+                g_bytes_unref(data);
+                g_bytes_unref(g_queue_pop_head(&conn->tx));
+                conn->tx_offset = 0;
+                continue;
+            }
+            break;
+        }
+    }
+}
+
+static
+void
+nci_adapter_io_pump(
+    NciAdapterIoPriv* self)
+{
+    if (self->writer != WRITER_NONE) {
+        /* Wait for the current write to complete */
+        return;
+    }
+
+    /* Our own commands go first, unless NciCore is waiting for response */
+    if (!self->cmd && !self->core_cmd_pending &&
+        !g_queue_is_empty(&self->cmd_queue)) {
+        NciAdapterIoCmd* cmd = g_queue_pop_head(&self->cmd_queue);
+        GUtilData chunks[2];
+        guint count = 1;
+
+        chunks[0].bytes = cmd->hdr;
+        chunks[0].size = sizeof(cmd->hdr);
+        if (cmd->payload && gutil_data_from_bytes(chunks + 1,
+            cmd->payload)->size) {
+            count++;
+        }
+        self->cmd = cmd;
+        self->writer = WRITER_ADAPTER;
+        if (nci_adapter_io_hal_write(self, chunks, count)) {
+            self->cmd_timeout = nci_clock_timeout_add(self->pub.clock,
+                NCI_ADAPTER_IO_CMD_TIMEOUT_MS, nci_adapter_io_cmd_timeout,
+                self);
+        } else {
+            GWARN("Failed to write command %02x/%02x", cmd->hdr[0] &
+                NCI_HDR_GID_MASK, cmd->hdr[1]);
+            self->writer = WRITER_NONE;
+            self->cmd = NULL;
+            nci_adapter_io_cmd_done(self, cmd, NULL);
+            nci_adapter_io_pump(self);
+        }
+        return;
+    }
+
+    /* Then whatever NciCore has been trying to write */
+    if (self->core_write_deferred) {
+        const guint8* pkt = self->core_write->data;
+        const gboolean is_cmd = (pkt[0] & NCI_HDR_MT_MASK) == NCI_HDR_MT_CMD;
+
+        if (!is_cmd || !self->cmd) {
+            GUtilData chunk;
+            NciHalClientFunc done = self->core_write_done;
+
+            chunk.bytes = pkt;
+            chunk.size = self->core_write->len;
+            self->core_write_deferred = FALSE;
+            if (is_cmd && !(pkt[0] & NCI_HDR_PBF)) {
+                self->core_cmd_pending = TRUE;
+            }
+            if (!nci_adapter_io_write_core(self, &chunk, 1, done)) {
+                /* Deferred write can only fail asynchronously */
+                GWARN("Failed to write deferred packet");
+                if (done) {
+                    done(self->core, FALSE);
+                }
+            }
+            return;
+        }
+    }
+
+    /* And finally the data for our own connections */
+    nci_adapter_io_pump_data(self);
+}
+
+static
+void
+nci_adapter_io_snoop_core_rsp(
+    NciAdapterIoPriv* self,
+    guint8 gid,
+    guint8 oid,
+    const guint8* payload,
+    guint len)
+{
+    NciAdapterIo* pub = &self->pub;
+
+    if (gid == NCI_GID_CORE) {
+        switch (oid) {
+        case NCI_OID_CORE_RESET:
+            /*
+             * NCI 1.x: Status, NCI Version, Configuration Status
+             * NCI 2.x: Status (version comes with CORE_RESET_NTF)
+             */
+            if (len >= 3 && payload[0] == NCI_STATUS_OK) {
+                pub->nci_version = payload[1];
+            }
+            break;
+        case NCI_OID_CORE_INIT:
+            if (len >= 5 && payload[0] == NCI_STATUS_OK) {
+                pub->nfcc_features = payload[1] | (payload[2] << 8) |
+                    (payload[3] << 16) | (payload[4] << 24);
+                if (pub->nci_version >= 0x20) {
+                    /*
+                     * Status(1), Features(4), Max Logical Connections(1),
+                     * Max Routing Table Size(2), ...
+                     */
+                    if (len >= 8) {
+                        pub->max_routing_table_size = payload[6] |
+                            (payload[7] << 8);
+                    }
+                } else if (len >= 6) {
+                    /*
+                     * Status(1), Features(4), Number of Interfaces(1),
+                     * Interfaces(n), Max Logical Connections(1),
+                     * Max Routing Table Size(2), ...
+                     */
+                    const guint off = 6 + payload[5] + 1;
+
+                    if (len >= off + 2) {
+                        pub->max_routing_table_size = payload[off] |
+                            (payload[off + 1] << 8);
+                    }
+                }
+                GDEBUG("NCI %u.%u, features 0x%08x, routing table %u bytes",
+                    pub->nci_version >> 4, pub->nci_version & 0x0f,
+                    pub->nfcc_features, pub->max_routing_table_size);
+                if (self->cb->reset) {
+                    self->cb->reset(pub, self->user_data);
+                }
+            }
+            break;
+        }
+    }
+}
+
+static
+void
+nci_adapter_io_handle_rsp(
+    NciAdapterIoPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    const guint8 gid = pkt[0] & NCI_HDR_GID_MASK;
+    const guint8 oid = pkt[1] & NCI_HDR_OID_MASK;
+    NciAdapterIoCmd* cmd = self->cmd;
+
+    if (cmd && (cmd->hdr[0] & NCI_HDR_GID_MASK) == gid && cmd->hdr[1] == oid) {
+        /* Response to our command */
+        g_byte_array_append(self->rsp, pkt + NCI_HDR_SIZE,
+            len - NCI_HDR_SIZE);
+        if (!(pkt[0] & NCI_HDR_PBF)) {
+            GUtilData rsp;
+
+            rsp.bytes = self->rsp->data;
+            rsp.size = self->rsp->len;
+            nci_clock_clear(self->pub.clock, &self->cmd_timeout);
+            self->cmd = NULL;
+            nci_adapter_io_cmd_done(self, cmd, &rsp);
+            g_byte_array_set_size(self->rsp, 0);
+            nci_adapter_io_pump(self);
+        }
+    } else if (self->expect_late_rsp && self->late_rsp[0] == gid &&
+        self->late_rsp[1] == oid) {
+        GDEBUG("Dropping late response %02x/%02x", gid, oid);
+        if (!(pkt[0] & NCI_HDR_PBF)) {
+            self->expect_late_rsp = FALSE;
+        }
+    } else {
+        if (!(pkt[0] & NCI_HDR_PBF)) {
+            self->core_cmd_pending = FALSE;
+            nci_adapter_io_snoop_core_rsp(self, gid, oid, pkt + NCI_HDR_SIZE,
+                len - NCI_HDR_SIZE);
+        }
+        self->core->fn->read(self->core, pkt, len);
+        nci_adapter_io_pump(self);
+    }
+}
+
+static
+void
+nci_adapter_io_handle_ntf(
+    NciAdapterIoPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    const guint8 gid = pkt[0] & NCI_HDR_GID_MASK;
+    const guint8 oid = pkt[1] & NCI_HDR_OID_MASK;
+
+    if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_RESET &&
+        len >= NCI_HDR_SIZE + 3) {
+        /* NCI 2.x: Reset Trigger, Configuration Status, NCI Version, ... */
+        self->pub.nci_version = pkt[NCI_HDR_SIZE + 2];
+    }
+
+    if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_CONN_CREDITS &&
+        !(pkt[0] & NCI_HDR_PBF) && len > NCI_HDR_SIZE) {
+        /* Number of Entries(1), then Conn ID(1) + Credits(1) each */
+        guint8 buf[NCI_HDR_SIZE + NCI_MAX_CTRL_PAYLOAD];
+        const guint8* entry = pkt + NCI_HDR_SIZE + 1;
+        const guint8* end = pkt + len;
+        guint8* out = buf + NCI_HDR_SIZE + 1;
+        gboolean ours = FALSE;
+
+        for (; entry + 2 <= end; entry += 2) {
+            NciAdapterIoConn* conn = self->conn + (entry[0] &
+                NCI_MAX_CONN_ID);
+
+            if (conn->open) {
+                if (conn->credits != NCI_CONN_NO_FLOW_CONTROL) {
+                    conn->credits = MIN(conn->credits + entry[1],
+                        NCI_CONN_NO_FLOW_CONTROL - 1);
+                }
+                ours = TRUE;
+            } else {
+                *out++ = entry[0];
+                *out++ = entry[1];
+            }
+        }
+        if (ours) {
+            const guint n = (out - buf - NCI_HDR_SIZE - 1) / 2;
+
+            if (n) {
+                /* Pass the rest to NciCore */
+                buf[0] = pkt[0];
+                buf[1] = pkt[1];
+                buf[2] = (guint8) (out - buf - NCI_HDR_SIZE);
+                buf[3] = (guint8) n;
+                self->core->fn->read(self->core, buf, out - buf);
+            }
+            nci_adapter_io_pump(self);
+            return;
+        }
+    }
+
+    /* Segmented notifications are left to NciCore */
+    if (!(pkt[0] & NCI_HDR_PBF) && self->cb->ntf) {
+        GUtilData payload;
+
+        payload.bytes = pkt + NCI_HDR_SIZE;
+        payload.size = len - NCI_HDR_SIZE;
+        if (self->cb->ntf(&self->pub, gid, oid, &payload, self->user_data)) {
+            return;
+        }
+    }
+    self->core->fn->read(self->core, pkt, len);
+}
+
+static
+void
+nci_adapter_io_handle_data(
+    NciAdapterIoPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    const guint8 cid = pkt[0] & NCI_HDR_CID_MASK;
+    NciAdapterIoConn* conn = self->conn + cid;
+
+    if (!conn->open) {
+        self->core->fn->read(self->core, pkt, len);
+    } else if ((pkt[0] & NCI_HDR_PBF) || (conn->rx && conn->rx->len)) {
+        /* Reassemble the segmented message */
+        if (!conn->rx) {
+            conn->rx = g_byte_array_new();
+        }
+        g_byte_array_append(conn->rx, pkt + NCI_HDR_SIZE,
+            len - NCI_HDR_SIZE);
+        if (!(pkt[0] & NCI_HDR_PBF)) {
+            GUtilData data;
+
+            data.bytes = conn->rx->data;
+            data.size = conn->rx->len;
+            if (self->cb->data) {
+                self->cb->data(&self->pub, cid, &data, self->user_data);
+            }
+            g_byte_array_set_size(conn->rx, 0);
+        }
+    } else if (self->cb->data) {
+        GUtilData data;
+
+        data.bytes = pkt + NCI_HDR_SIZE;
+        data.size = len - NCI_HDR_SIZE;
+        self->cb->data(&self->pub, cid, &data, self->user_data);
+    }
+}
+
+static
+void
+nci_adapter_io_handle_packet(
+    NciAdapterIoPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    if (self->pub.capture) {
+        GUtilData frame;
+
+        frame.bytes = pkt;
+        frame.size = len;
+        nci_capture_frame_at(self->pub.capture, nci_clock_now(self->pub.clock),
+            NCI_CAPTURE_RECORD_RX, &frame, 1);
+    }
+
+    switch (pkt[0] & NCI_HDR_MT_MASK) {
+    case NCI_HDR_MT_RSP:
+        nci_adapter_io_handle_rsp(self, pkt, len);
+        break;
+    case NCI_HDR_MT_NTF:
+        nci_adapter_io_handle_ntf(self, pkt, len);
+        break;
+    case NCI_HDR_MT_DATA:
+        nci_adapter_io_handle_data(self, pkt, len);
+        break;
+    default:
+        self->core->fn->read(self->core, pkt, len);
+        break;
+    }
+}
+
+/*==========================================================================*
+ * NciHalClient (what the real HAL sees)
+ *==========================================================================*/
+
+static
+void
+nci_adapter_io_client_error(
+    NciHalClient* client)
+{
+    NciAdapterIoPriv* self = G_CAST(client, NciAdapterIoPriv, client);
+
+    nci_adapter_io_fail_all(self);
+    if (self->core) {
+        self->core->fn->error(self->core);
+    }
+}
+
+static
+void
+nci_adapter_io_client_read(
+    NciHalClient* client,
+    const void* data,
+    guint len)
+{
+    NciAdapterIoPriv* self = G_CAST(client, NciAdapterIoPriv, client);
+    GByteArray* rx = self->rx;
+    const guint8* ptr = data;
+    const guint8* end = ptr + len;
+
+    if (!self->core) {
+        return;
+    }
+
+    /* Complete the partial packet first */
+    if (rx->len) {
+        guint need;
+
+        if (rx->len < NCI_HDR_SIZE) {
+            const guint n = MIN(NCI_HDR_SIZE - rx->len, (guint)(end - ptr));
+
+            g_byte_array_append(rx, ptr, n);
+            ptr += n;
+        }
+        if (rx->len < NCI_HDR_SIZE) {
+            return;
+        }
+        need = NCI_HDR_SIZE + rx->data[2] - rx->len;
+        if (need > (guint)(end - ptr)) {
+            g_byte_array_append(rx, ptr, end - ptr);
+            return;
+        }
+        g_byte_array_append(rx, ptr, need);
+        ptr += need;
+        nci_adapter_io_handle_packet(self, rx->data, rx->len);
+        g_byte_array_set_size(rx, 0);
+    }
+
+    /* Whole packets are handled without copying */
+    while (ptr < end) {
+        const guint avail = end - ptr;
+
+        if (avail >= NCI_HDR_SIZE && avail >= (guint)(NCI_HDR_SIZE + ptr[2])) {
+            const guint pkt_len = NCI_HDR_SIZE + ptr[2];
+
+            nci_adapter_io_handle_packet(self, ptr, pkt_len);
+            ptr += pkt_len;
+        } else {
+            g_byte_array_append(rx, ptr, avail);
+            break;
+        }
+    }
+}
+
+/*==========================================================================*
+ * NciHalIo (what NciCore sees)
+ *==========================================================================*/
+
+static
+gboolean
+nci_adapter_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciAdapterIoPriv* self = G_CAST(io, NciAdapterIoPriv, io);
+
+    self->core = client;
+    if (self->hal->fn->start(self->hal, &self->client)) {
+        return TRUE;
+    }
+    self->core = NULL;
+    return FALSE;
+}
+
+static
+void
+nci_adapter_io_stop(
+    NciHalIo* io)
+{
+    NciAdapterIoPriv* self = G_CAST(io, NciAdapterIoPriv, io);
+
+    self->hal->fn->stop(self->hal);
+    self->core = NULL;
+    self->writer = WRITER_NONE;
+    self->core_write_done = NULL;
+    self->core_write_deferred = FALSE;
+    self->core_cmd_pending = FALSE;
+    self->expect_late_rsp = FALSE;
+    if (self->tx_data) {
+        g_bytes_unref(self->tx_data);
+        self->tx_data = NULL;
+    }
+    g_byte_array_set_size(self->rx, 0);
+    nci_adapter_io_conn_clear_all(self);
+    nci_adapter_io_fail_all(self);
+}
+
+static
+gboolean
+nci_adapter_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciAdapterIoPriv* self = G_CAST(io, NciAdapterIoPriv, io);
+    const guint8* hdr = chunks[0].bytes;
+    GBytes* replacement = NULL;
+    gboolean is_cmd;
+    guint i;
+
+    GASSERT(count && chunks[0].size >= NCI_HDR_SIZE);
+    is_cmd = (hdr[0] & NCI_HDR_MT_MASK) == NCI_HDR_MT_CMD;
+    if (is_cmd) {
+        const guint8 gid = hdr[0] & NCI_HDR_GID_MASK;
+        const guint8 oid = hdr[1] & NCI_HDR_OID_MASK;
+
+        if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_RESET) {
+            /*
+             * Whatever we were doing is about to be lost. Tell the
+             * adapter first, so that the failing completions don't
+             * queue new commands ahead of CORE_RESET.
+             */
+            if (self->cb->reset_started) {
+                self->cb->reset_started(&self->pub, self->user_data);
+            }
+            nci_adapter_io_conn_clear_all(self);
+            nci_adapter_io_fail_all(self);
+            self->pub.nci_version = 0;
+            self->expect_late_rsp = FALSE;
+        } else if (self->cb->core_cmd && !(hdr[0] & NCI_HDR_PBF)) {
+            /* Collect the payload and give the adapter a chance to edit it */
+            GByteArray* buf = g_byte_array_new();
+            GUtilData payload;
+
+            g_byte_array_append(buf, chunks[0].bytes + NCI_HDR_SIZE,
+                chunks[0].size - NCI_HDR_SIZE);
+            for (i = 1; i < count; i++) {
+                g_byte_array_append(buf, chunks[i].bytes, chunks[i].size);
+            }
+            payload.bytes = buf->data;
+            payload.size = buf->len;
+            replacement = self->cb->core_cmd(&self->pub, gid, oid, &payload,
+                self->user_data);
+            g_byte_array_unref(buf);
+        }
+    }
+
+    if (replacement || self->writer != WRITER_NONE || (is_cmd &&
+        (self->cmd || !g_queue_is_empty(&self->cmd_queue)))) {
+        /* Can't write it right away (or has to be rewritten) */
+        GByteArray* buf = self->core_write;
+
+        GASSERT(!self->core_write_deferred);
+        g_byte_array_set_size(buf, 0);
+        if (replacement) {
+            gsize size;
+            const guint8* data = g_bytes_get_data(replacement, &size);
+            guint8 h[NCI_HDR_SIZE];
+
+            h[0] = hdr[0];
+            h[1] = hdr[1];
+            h[2] = (guint8) size;
+            g_byte_array_append(buf, h, sizeof(h));
+            g_byte_array_append(buf, data, size);
+            g_bytes_unref(replacement);
+        } else {
+            for (i = 0; i < count; i++) {
+                g_byte_array_append(buf, chunks[i].bytes, chunks[i].size);
+            }
+        }
+        self->core_write_deferred = TRUE;
+        self->core_write_done = complete;
+        nci_adapter_io_pump(self);
+        return TRUE;
+    } else if (nci_adapter_io_write_core(self, chunks, count, complete)) {
+        if (is_cmd && !(hdr[0] & NCI_HDR_PBF)) {
+            self->core_cmd_pending = TRUE;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+void
+nci_adapter_io_cancel_write(
+    NciHalIo* io)
+{
+    NciAdapterIoPriv* self = G_CAST(io, NciAdapterIoPriv, io);
+
+    if (self->core_write_deferred) {
+        self->core_write_deferred = FALSE;
+        self->core_write_done = NULL;
+    } else if (self->writer == WRITER_CORE) {
+        self->writer = WRITER_NONE;
+        self->core_write_done = NULL;
+        self->hal->fn->cancel_write(self->hal);
+        nci_adapter_io_pump(self);
+    }
+}
+
+/*==========================================================================*
+ * Internal API
+ *==========================================================================*/
+
+NciAdapterIo*
+nci_adapter_io_new(
+    NciHalIo* hal,
+    const NciAdapterIoCallbacks* cb,
+    void* user_data)
+{
+    static const NciHalIoFunctions io_fn = {
+        .start = nci_adapter_io_start,
+        .stop = nci_adapter_io_stop,
+        .write = nci_adapter_io_write,
+        .cancel_write = nci_adapter_io_cancel_write
+    };
+    static const NciHalClientFunctions client_fn = {
+        .error = nci_adapter_io_client_error,
+        .read = nci_adapter_io_client_read
+    };
+    NciAdapterIoPriv* self = g_slice_new0(NciAdapterIoPriv);
+    guint i;
+
+    self->io.fn = &io_fn;
+    self->client.fn = &client_fn;
+    self->pub.hal = &self->io;
+    self->hal = hal;
+    self->cb = cb;
+    self->user_data = user_data;
+    self->rx = g_byte_array_new();
+    self->rsp = g_byte_array_new();
+    self->core_write = g_byte_array_new();
+    g_queue_init(&self->cmd_queue);
+    for (i = 0; i <= NCI_MAX_CONN_ID; i++) {
+        g_queue_init(&self->conn[i].tx);
+    }
+    return &self->pub;
+}
+
+void
+nci_adapter_io_free(
+    NciAdapterIo* io)
+{
+    if (io) {
+        NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+        NciAdapterIoCmd* cmd;
+        guint i;
+
+        /* Completion callbacks are no longer welcome */
+        nci_clock_clear(self->pub.clock, &self->cmd_timeout);
+        if (self->cmd) {
+            nci_adapter_io_cmd_free(self->cmd);
+        }
+        while ((cmd = g_queue_pop_head(&self->cmd_queue)) != NULL) {
+            nci_adapter_io_cmd_free(cmd);
+        }
+        for (i = 0; i <= NCI_MAX_CONN_ID; i++) {
+            NciAdapterIoConn* conn = self->conn + i;
+
+            nci_adapter_io_conn_clear(conn);
+            if (conn->rx) {
+                g_byte_array_unref(conn->rx);
+            }
+        }
+        if (self->tx_data) {
+            g_bytes_unref(self->tx_data);
+        }
+        g_byte_array_unref(self->rx);
+        g_byte_array_unref(self->rsp);
+        g_byte_array_unref(self->core_write);
+        g_slice_free(NciAdapterIoPriv, self);
+    }
+}
+
+void
+nci_adapter_io_set_clock(
+    NciAdapterIo* io,
+    NciClock* clock)
+{
+    NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+
+    if (self->cmd_timeout) {
+        nci_clock_clear(io->clock, &self->cmd_timeout);
+        self->cmd_timeout = nci_clock_timeout_add(clock,
+            NCI_ADAPTER_IO_CMD_TIMEOUT_MS, nci_adapter_io_cmd_timeout, self);
+    }
+    io->clock = clock;
+}
+
+guint
+nci_adapter_io_send_cmd(
+    NciAdapterIo* io,
+    guint8 gid,
+    guint8 oid,
+    GBytes* payload,
+    NciAdapterIoRspFunc done,
+    void* user_data)
+{
+    if (G_LIKELY(io)) {
+        NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+        const gsize len = payload ? g_bytes_get_size(payload) : 0;
+
+        if (self->core && len <= NCI_MAX_CTRL_PAYLOAD) {
+            NciAdapterIoCmd* cmd = g_slice_new0(NciAdapterIoCmd);
+
+            if (!(cmd->id = ++(self->last_id))) {
+                cmd->id = ++(self->last_id);
+            }
+            cmd->hdr[0] = NCI_HDR_MT_CMD | (gid & NCI_HDR_GID_MASK);
+            cmd->hdr[1] = oid & NCI_HDR_OID_MASK;
+            cmd->hdr[2] = (guint8) len;
+            cmd->payload = payload ? g_bytes_ref(payload) : NULL;
+            cmd->done = done;
+            cmd->user_data = user_data;
+            g_queue_push_tail(&self->cmd_queue, cmd);
+            nci_adapter_io_pump(self);
+            return cmd->id;
+        }
+    }
+    return 0;
+}
+
+void
+nci_adapter_io_cancel(
+    NciAdapterIo* io,
+    guint id)
+{
+    if (G_LIKELY(io) && id) {
+        NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+        GList* l;
+
+        if (self->cmd && self->cmd->id == id) {
+            /* Already sent, just forget the completion callback */
+            self->cmd->done = NULL;
+            return;
+        }
+        for (l = self->cmd_queue.head; l; l = l->next) {
+            NciAdapterIoCmd* cmd = l->data;
+
+            if (cmd->id == id) {
+                g_queue_delete_link(&self->cmd_queue, l);
+                nci_adapter_io_cmd_free(cmd);
+                break;
+            }
+        }
+    }
+}
+
+gboolean
+nci_adapter_io_conn_open(
+    NciAdapterIo* io,
+    guint8 cid,
+    guint max_payload,
+    guint credits)
+{
+    if (G_LIKELY(io) && cid <= NCI_MAX_CONN_ID && max_payload) {
+        NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+        NciAdapterIoConn* conn = self->conn + cid;
+
+        nci_adapter_io_conn_clear(conn);
+        conn->open = TRUE;
+        conn->max_payload = (guint8) MIN(max_payload, NCI_MAX_CTRL_PAYLOAD);
+        conn->credits = (guint8) MIN(credits, NCI_CONN_NO_FLOW_CONTROL);
+        GDEBUG("Conn %u open, %u bytes, %u credits", cid, max_payload,
+            credits);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+nci_adapter_io_conn_close(
+    NciAdapterIo* io,
+    guint8 cid)
+{
+    if (G_LIKELY(io) && cid <= NCI_MAX_CONN_ID) {
+        nci_adapter_io_conn_clear(nci_adapter_io_cast(io)->conn + cid);
+    }
+}
+
+gboolean
+nci_adapter_io_send_data(
+    NciAdapterIo* io,
+    guint8 cid,
+    GBytes* data)
+{
+    if (G_LIKELY(io) && G_LIKELY(data) && cid <= NCI_MAX_CONN_ID) {
+        NciAdapterIoPriv* self = nci_adapter_io_cast(io);
+        NciAdapterIoConn* conn = self->conn + cid;
+
+        if (conn->open) {
+            g_queue_push_tail(&conn->tx, g_bytes_ref(data));
+            nci_adapter_io_pump(self);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
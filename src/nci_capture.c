@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_capture.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define CAPTURE_ALIGN(n) (((n) + 3) & ~3u)
+#define CAPTURE_MAX_CHUNKS (4)
+
+struct nci_capture {
+    gint ref_count;
+    int fd;
+    gint64 start;               /* Clock time of the first frame */
+    gint64 last;                /* Clock time of the last frame */
+    gboolean started;
+    gboolean failed;
+};
+
+/*==========================================================================*
+ * Record encoding
+ *==========================================================================*/
+
+static
+void
+nci_capture_put16(
+    guint8* ptr,
+    guint16 val)
+{
+    ptr[0] = (guint8) val;
+    ptr[1] = (guint8) (val >> 8);
+}
+
+static
+void
+nci_capture_put32(
+    guint8* ptr,
+    guint32 val)
+{
+    nci_capture_put16(ptr, (guint16) val);
+    nci_capture_put16(ptr + 2, (guint16) (val >> 16));
+}
+
+static
+void
+nci_capture_put64(
+    guint8* ptr,
+    guint64 val)
+{
+    nci_capture_put32(ptr, (guint32) val);
+    nci_capture_put32(ptr + 4, (guint32) (val >> 32));
+}
+
+/*==========================================================================*
+ * Capture
+ *==========================================================================*/
+
+static
+void
+nci_capture_writev(
+    NciCapture* self,
+    const struct iovec* iov,
+    guint count,
+    gsize total)
+{
+    ssize_t written;
+
+    do {
+        written = writev(self->fd, iov, count);
+    } while (written < 0 && errno == EINTR);
+    if (written != (ssize_t) total) {
+        /* Partial record would break the file, stop right here */
+        GWARN("Capture write failed: %s", (written < 0) ? strerror(errno) :
+            "short write");
+        self->failed = TRUE;
+    }
+}
+
+static
+void
+nci_capture_record(
+    NciCapture* self,
+    NCI_CAPTURE_RECORD_TYPE type,
+    guint32 delta,
+    const GUtilData* chunks,
+    guint count)
+{
+    static const guint8 zero[4] = { 0, 0, 0, 0 };
+    guint8 hdr[NCI_CAPTURE_RECORD_HEADER_SIZE];
+    struct iovec iov[CAPTURE_MAX_CHUNKS + 2];
+    gsize len = 0;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        len += chunks[i].size;
+    }
+    if (count > CAPTURE_MAX_CHUNKS || len > G_MAXUINT16) {
+        GWARN("Frame too large to capture (%u bytes)", (guint) len);
+        return;
+    }
+
+    nci_capture_put32(hdr, delta);
+    nci_capture_put16(hdr + 4, (guint16) len);
+    hdr[6] = (guint8) type;
+    hdr[7] = 0;
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    for (i = 0; i < count; i++) {
+        iov[i + 1].iov_base = (void*) chunks[i].bytes;
+        iov[i + 1].iov_len = chunks[i].size;
+    }
+    iov[count + 1].iov_base = (void*) zero;
+    iov[count + 1].iov_len = CAPTURE_ALIGN(len) - len;
+    nci_capture_writev(self, iov, count + 2, sizeof(hdr) +
+        CAPTURE_ALIGN(len));
+}
+
+NciCapture*
+nci_capture_new(
+    const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND |
+        O_CLOEXEC, 0644);
+
+    if (fd >= 0) {
+        NciCapture* self = g_slice_new0(NciCapture);
+        guint8 hdr[NCI_CAPTURE_HEADER_SIZE];
+        struct iovec iov;
+
+        g_atomic_int_set(&self->ref_count, 1);
+        self->fd = fd;
+        memcpy(hdr, NCI_CAPTURE_MAGIC, NCI_CAPTURE_MAGIC_SIZE);
+        nci_capture_put16(hdr + NCI_CAPTURE_MAGIC_SIZE, NCI_CAPTURE_VERSION);
+        nci_capture_put64(hdr + NCI_CAPTURE_MAGIC_SIZE + 2, g_get_real_time());
+        iov.iov_base = hdr;
+        iov.iov_len = sizeof(hdr);
+        nci_capture_writev(self, &iov, 1, sizeof(hdr));
+        if (!self->failed) {
+            GDEBUG("Capturing NCI traffic to %s", path);
+            return self;
+        }
+        nci_capture_unref(self);
+    } else {
+        GWARN("Can't open %s: %s", path, strerror(errno));
+    }
+    return NULL;
+}
+
+NciCapture*
+nci_capture_ref(
+    NciCapture* self)
+{
+    if (G_LIKELY(self)) {
+        g_atomic_int_inc(&self->ref_count);
+    }
+    return self;
+}
+
+void
+nci_capture_unref(
+    NciCapture* self)
+{
+    if (G_LIKELY(self) && g_atomic_int_dec_and_test(&self->ref_count)) {
+        close(self->fd);
+        g_slice_free(NciCapture, self);
+    }
+}
+
+void
+nci_capture_frame(
+    NciCapture* self,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const GUtilData* chunks,
+    guint count)
+{
+    nci_capture_frame_at(self, g_get_monotonic_time(), type, chunks, count);
+}
+
+void
+nci_capture_frame_at(
+    NciCapture* self,
+    gint64 now,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const GUtilData* chunks,
+    guint count)
+{
+    if (G_LIKELY(self) && !self->failed) {
+        gint64 delta;
+
+        if (!self->started) {
+            self->started = TRUE;
+            self->start = self->last = now;
+        } else if (now < self->last) {
+            /* Switched to a different clock, keep the timeline going */
+            self->start += now - self->last;
+            self->last = now;
+        }
+        delta = now - self->last;
+        self->last = now;
+        if (delta > G_MAXUINT32) {
+            guint8 clock[8];
+            GUtilData chunk;
+
+            nci_capture_put64(clock, now - self->start);
+            chunk.bytes = clock;
+            chunk.size = sizeof(clock);
+            nci_capture_record(self, NCI_CAPTURE_RECORD_CLOCK, 0, &chunk, 1);
+            nci_capture_record(self, type, 0, chunks, count);
+        } else {
+            nci_capture_record(self, type, (guint32) delta, chunks, count);
+        }
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_clock.h"
+#include "nci_plugin_p.h"
+
+#include <gutil_macros.h>
+
+typedef struct nci_virtual_timer {
+    gint64 due;
+    guint interval_ms;
+    GSourceFunc fn;
+    gpointer data;
+    gboolean removed;           /* Removed from its own callback */
+} NciVirtualTimer;
+
+typedef struct nci_virtual_clock {
+    NciClock clock;
+    gint64 now;
+    GQueue timers;              /* NciVirtualTimer, sorted by due time */
+    NciVirtualTimer* current;   /* The one being fired */
+} NciVirtualClock;
+
+static inline NciVirtualClock* nci_virtual_clock_cast(NciClock* clock)
+    { return G_CAST(clock, NciVirtualClock, clock); }
+
+/*==========================================================================*
+ * System clock
+ *==========================================================================*/
+
+static
+GSource*
+nci_source_attach(
+    GSource* source,
+    GSourceFunc fn,
+    gpointer data)
+{
+    g_source_set_callback(source, fn, data, NULL);
+    /* NULL thread-default context means the global default one */
+    g_source_attach(source, g_main_context_get_thread_default());
+    /* The context holds the reference while the source is attached */
+    g_source_unref(source);
+    return source;
+}
+
+static
+gint64
+nci_clock_system_now(
+    NciClock* clock)
+{
+    return g_get_monotonic_time();
+}
+
+static
+NciClockTimer*
+nci_clock_system_timeout_add(
+    NciClock* clock,
+    guint ms,
+    GSourceFunc fn,
+    gpointer data)
+{
+    return (NciClockTimer*) nci_source_attach(g_timeout_source_new(ms),
+        fn, data);
+}
+
+static
+void
+nci_clock_system_remove(
+    NciClock* clock,
+    NciClockTimer* timer)
+{
+    g_source_destroy((GSource*) timer);
+}
+
+/*==========================================================================*
+ * Virtual clock
+ *==========================================================================*/
+
+static
+void
+nci_virtual_clock_insert(
+    NciVirtualClock* self,
+    NciVirtualTimer* timer)
+{
+    GList* link = self->timers.tail;
+
+    /* Timers due at the same time fire in the order they were added */
+    while (link && ((NciVirtualTimer*) link->data)->due > timer->due) {
+        link = link->prev;
+    }
+    if (link) {
+        g_queue_insert_after(&self->timers, link, timer);
+    } else {
+        g_queue_push_head(&self->timers, timer);
+    }
+}
+
+static
+gint64
+nci_virtual_clock_now(
+    NciClock* clock)
+{
+    return nci_virtual_clock_cast(clock)->now;
+}
+
+static
+NciClockTimer*
+nci_virtual_clock_timeout_add(
+    NciClock* clock,
+    guint ms,
+    GSourceFunc fn,
+    gpointer data)
+{
+    NciVirtualClock* self = nci_virtual_clock_cast(clock);
+    NciVirtualTimer* timer = g_slice_new0(NciVirtualTimer);
+
+    timer->due = self->now + (gint64) ms * 1000;
+    timer->interval_ms = ms;
+    timer->fn = fn;
+    timer->data = data;
+    nci_virtual_clock_insert(self, timer);
+    return (NciClockTimer*) timer;
+}
+
+static
+void
+nci_virtual_clock_remove(
+    NciClock* clock,
+    NciClockTimer* handle)
+{
+    NciVirtualClock* self = nci_virtual_clock_cast(clock);
+    NciVirtualTimer* timer = (NciVirtualTimer*) handle;
+
+    if (self->current == timer) {
+        timer->removed = TRUE;
+    } else if (g_queue_remove(&self->timers, timer)) {
+        g_slice_free(NciVirtualTimer, timer);
+    }
+}
+
+static
+void
+nci_virtual_clock_fire(
+    NciVirtualClock* self)
+{
+    NciVirtualTimer* timer = g_queue_pop_head(&self->timers);
+
+    self->now = MAX(self->now, timer->due);
+    self->current = timer;
+    if (timer->fn(timer->data) && !timer->removed) {
+        timer->due += (gint64) timer->interval_ms * 1000;
+        self->current = NULL;
+        nci_virtual_clock_insert(self, timer);
+    } else {
+        self->current = NULL;
+        g_slice_free(NciVirtualTimer, timer);
+    }
+}
+
+static
+void
+nci_virtual_clock_idle(
+    GMainContext* context)
+{
+    while (g_main_context_iteration(context, FALSE));
+}
+
+/*==========================================================================*
+ * Internal API
+ *==========================================================================*/
+
+GSource*
+nci_idle_add(
+    GSourceFunc fn,
+    gpointer data)
+{
+    return nci_source_attach(g_idle_source_new(), fn, data);
+}
+
+GSource*
+nci_io_watch_add(
+    GIOChannel* channel,
+    GIOCondition condition,
+    GIOFunc fn,
+    gpointer data)
+{
+    return nci_source_attach(g_io_create_watch(channel, condition),
+        (GSourceFunc) (void (*)(void)) fn, data);
+}
+
+void
+nci_source_clear(
+    GSource** source)
+{
+    if (*source) {
+        /* Destroys it in whichever context it's attached to */
+        g_source_destroy(*source);
+        *source = NULL;
+    }
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciClock*
+nci_clock_system(
+    void)
+{
+    static const NciClockFunctions system_fn = {
+        .now = nci_clock_system_now,
+        .timeout_add = nci_clock_system_timeout_add,
+        .remove = nci_clock_system_remove
+    };
+    static NciClock system_clock = { &system_fn };
+
+    return &system_clock;
+}
+
+gint64
+nci_clock_now(
+    NciClock* clock)
+{
+    return clock ? clock->fn->now(clock) : nci_clock_system_now(NULL);
+}
+
+NciClockTimer*
+nci_clock_timeout_add(
+    NciClock* clock,
+    guint ms,
+    GSourceFunc fn,
+    gpointer data)
+{
+    return clock ? clock->fn->timeout_add(clock, ms, fn, data) :
+        nci_clock_system_timeout_add(NULL, ms, fn, data);
+}
+
+void
+nci_clock_clear(
+    NciClock* clock,
+    NciClockTimer** timer)
+{
+    if (*timer) {
+        if (clock) {
+            clock->fn->remove(clock, *timer);
+        } else {
+            nci_clock_system_remove(NULL, *timer);
+        }
+        *timer = NULL;
+    }
+}
+
+NciClock*
+nci_virtual_clock_new(
+    void)
+{
+    static const NciClockFunctions virtual_fn = {
+        .now = nci_virtual_clock_now,
+        .timeout_add = nci_virtual_clock_timeout_add,
+        .remove = nci_virtual_clock_remove
+    };
+    NciVirtualClock* self = g_slice_new0(NciVirtualClock);
+
+    self->clock.fn = &virtual_fn;
+    self->now = NCI_VIRTUAL_CLOCK_START;
+    g_queue_init(&self->timers);
+    return &self->clock;
+}
+
+void
+nci_virtual_clock_free(
+    NciClock* clock)
+{
+    if (G_LIKELY(clock)) {
+        NciVirtualClock* self = nci_virtual_clock_cast(clock);
+        NciVirtualTimer* timer;
+
+        while ((timer = g_queue_pop_head(&self->timers)) != NULL) {
+            g_slice_free(NciVirtualTimer, timer);
+        }
+        g_slice_free(NciVirtualClock, self);
+    }
+}
+
+void
+nci_virtual_clock_run(
+    NciClock* clock,
+    GMainContext* context,
+    gint64 us)
+{
+    if (G_LIKELY(clock)) {
+        NciVirtualClock* self = nci_virtual_clock_cast(clock);
+        const gint64 end = self->now + MAX(us, 0);
+        const NciVirtualTimer* next;
+
+        nci_virtual_clock_idle(context);
+        while ((next = g_queue_peek_head(&self->timers)) != NULL &&
+            next->due <= end) {
+            nci_virtual_clock_fire(self);
+            nci_virtual_clock_idle(context);
+        }
+        self->now = end;
+    }
+}
+
+guint
+nci_virtual_clock_pending(
+    NciClock* clock)
+{
+    return G_LIKELY(clock) ? nci_virtual_clock_cast(clock)->timers.length : 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_hal_dev.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Room for 15 packets with the largest possible payload */
+#define HAL_DEV_RX_BUF_SIZE (4096)
+
+typedef struct nci_hal_dev_priv {
+    NciHalDev pub;
+    NciHalIo io;
+    NciHalClient* client;
+    NCI_HAL_DEV_FLAGS flags;
+    GIOChannel* channel;
+    GSource* read_source;
+    GSource* write_source;      /* Waiting for the fd to become writable */
+    GSource* complete_source;   /* Write completion */
+    NciHalClientFunc write_complete;
+    GByteArray* tx;             /* Being written, reused */
+    guint tx_done;
+    guint rx_len;               /* Bytes buffered in rx */
+    guint8 rx[HAL_DEV_RX_BUF_SIZE];
+} NciHalDevPriv;
+
+static inline NciHalDevPriv* nci_hal_dev_cast(NciHalDev* pub)
+    { return G_CAST(pub, NciHalDevPriv, pub); }
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+nci_hal_dev_error(
+    NciHalDevPriv* self)
+{
+    NciHalClient* client = self->client;
+
+    nci_source_clear(&self->read_source);
+    nci_source_clear(&self->write_source);
+    if (client) {
+        client->fn->error(client);
+    }
+}
+
+static
+gboolean
+nci_hal_dev_deliver(
+    NciHalDevPriv* self,
+    const guint8* pkt,
+    guint len)
+{
+    /* The client may stop us from its callback */
+    if (self->client) {
+        self->pub.rx_packets++;
+        self->client->fn->read(self->client, pkt, len);
+    }
+    return self->client != NULL;
+}
+
+static
+ssize_t
+nci_hal_dev_read_fd(
+    NciHalDevPriv* self,
+    void* buf,
+    gsize size)
+{
+    ssize_t n;
+
+    do {
+        n = read(self->pub.fd, buf, size);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+/* Returns the number of packets, negative on error */
+static
+int
+nci_hal_dev_read_stream(
+    NciHalDevPriv* self)
+{
+    int packets = 0;
+
+    for (;;) {
+        const ssize_t n = nci_hal_dev_read_fd(self, self->rx + self->rx_len,
+            sizeof(self->rx) - self->rx_len);
+        const guint8* ptr;
+        const guint8* end;
+
+        if (n <= 0) {
+            return (n < 0 && errno == EAGAIN) ? packets : -1;
+        }
+
+        /* Deliver all complete packets, keep the rest */
+        ptr = self->rx;
+        end = ptr + self->rx_len + n;
+        while (ptr + NCI_HDR_SIZE <= end &&
+            ptr + NCI_HDR_SIZE + ptr[2] <= end) {
+            const guint len = NCI_HDR_SIZE + ptr[2];
+
+            packets++;
+            if (!nci_hal_dev_deliver(self, ptr, len)) {
+                self->rx_len = 0;
+                return packets;
+            }
+            ptr += len;
+        }
+        self->rx_len = end - ptr;
+        if (self->rx_len && ptr > self->rx) {
+            memmove(self->rx, ptr, self->rx_len);
+        }
+    }
+}
+
+/* Returns the number of packets, negative on error */
+static
+int
+nci_hal_dev_read_split(
+    NciHalDevPriv* self)
+{
+    int packets = 0;
+
+    for (;;) {
+        ssize_t n = nci_hal_dev_read_fd(self, self->rx, NCI_HDR_SIZE);
+
+        if (n == NCI_HDR_SIZE) {
+            const guint len = self->rx[2];
+
+            /* The payload is already there once the header is */
+            n = len ? nci_hal_dev_read_fd(self, self->rx + NCI_HDR_SIZE,
+                len) : 0;
+            if (n != (ssize_t) len) {
+                GWARN("Short NCI packet (%d bytes out of %u)", (int) n, len);
+                return -1;
+            }
+            packets++;
+            if (!nci_hal_dev_deliver(self, self->rx, NCI_HDR_SIZE + len)) {
+                return packets;
+            }
+        } else {
+            return (n < 0 && errno == EAGAIN) ? packets : -1;
+        }
+    }
+}
+
+static
+gboolean
+nci_hal_dev_read_event(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    NciHalDevPriv* self = user_data;
+    int packets = -1;
+
+    errno = 0;
+    if (condition & G_IO_IN) {
+        packets = (self->flags & NCI_HAL_DEV_FLAG_SPLIT_READS) ?
+            nci_hal_dev_read_split(self) : nci_hal_dev_read_stream(self);
+    }
+    if (packets > 0) {
+        self->pub.rx_wakeups++;
+    }
+    if (packets < 0) {
+        GWARN("NCI device read failed: %s", errno ? strerror(errno) :
+            "end of file");
+        self->read_source = NULL;
+        nci_hal_dev_error(self);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static
+gboolean
+nci_hal_dev_complete(
+    gpointer user_data)
+{
+    NciHalDevPriv* self = user_data;
+    NciHalClientFunc complete = self->write_complete;
+
+    self->complete_source = NULL;
+    self->write_complete = NULL;
+    if (complete && self->client) {
+        complete(self->client, TRUE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE on error */
+static
+gboolean
+nci_hal_dev_flush(
+    NciHalDevPriv* self)
+{
+    while (self->tx_done < self->tx->len) {
+        const ssize_t n = write(self->pub.fd, self->tx->data + self->tx_done,
+            self->tx->len - self->tx_done);
+
+        if (n > 0) {
+            self->tx_done += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            return TRUE;
+        } else {
+            GWARN("NCI device write failed: %s", strerror(errno));
+            return FALSE;
+        }
+    }
+
+    /* Done, complete asynchronously */
+    g_byte_array_set_size(self->tx, 0);
+    self->tx_done = 0;
+    if (!self->complete_source) {
+        self->complete_source = nci_idle_add(nci_hal_dev_complete, self);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+nci_hal_dev_write_event(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    NciHalDevPriv* self = user_data;
+
+    if ((condition & G_IO_OUT) && nci_hal_dev_flush(self)) {
+        if (self->tx->len) {
+            return G_SOURCE_CONTINUE;
+        }
+        self->write_source = NULL;
+        return G_SOURCE_REMOVE;
+    }
+    self->write_source = NULL;
+    nci_hal_dev_error(self);
+    return G_SOURCE_REMOVE;
+}
+
+/*==========================================================================*
+ * NciHalIo
+ *==========================================================================*/
+
+static
+gboolean
+nci_hal_dev_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciHalDevPriv* self = G_CAST(io, NciHalDevPriv, io);
+
+    self->client = client;
+    self->rx_len = 0;
+    if (!self->read_source) {
+        self->read_source = nci_io_watch_add(self->channel, G_IO_IN |
+            G_IO_ERR | G_IO_HUP | G_IO_NVAL, nci_hal_dev_read_event, self);
+    }
+    return TRUE;
+}
+
+static
+void
+nci_hal_dev_io_stop(
+    NciHalIo* io)
+{
+    NciHalDevPriv* self = G_CAST(io, NciHalDevPriv, io);
+
+    self->client = NULL;
+    self->write_complete = NULL;
+    nci_source_clear(&self->read_source);
+    nci_source_clear(&self->write_source);
+    nci_source_clear(&self->complete_source);
+    g_byte_array_set_size(self->tx, 0);
+    self->tx_done = 0;
+}
+
+static
+gboolean
+nci_hal_dev_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciHalDevPriv* self = G_CAST(io, NciHalDevPriv, io);
+    guint i;
+
+    if (self->tx->len || self->complete_source) {
+        GWARN("NCI device write is already in progress");
+        return FALSE;
+    }
+
+    /* One write() for the whole thing, the buffer is reused */
+    for (i = 0; i < count; i++) {
+        g_byte_array_append(self->tx, chunks[i].bytes, chunks[i].size);
+    }
+    self->pub.tx_writes++;
+    self->write_complete = complete;
+    if (!nci_hal_dev_flush(self)) {
+        g_byte_array_set_size(self->tx, 0);
+        self->write_complete = NULL;
+        return FALSE;
+    }
+    if (self->tx->len && !self->write_source) {
+        self->write_source = nci_io_watch_add(self->channel, G_IO_OUT |
+            G_IO_ERR | G_IO_HUP | G_IO_NVAL, nci_hal_dev_write_event, self);
+    }
+    return TRUE;
+}
+
+static
+void
+nci_hal_dev_io_cancel_write(
+    NciHalIo* io)
+{
+    NciHalDevPriv* self = G_CAST(io, NciHalDevPriv, io);
+
+    /*
+     * Whatever has been partially written has to be finished,
+     * otherwise the NFCC would lose track of the packet boundaries.
+     */
+    self->write_complete = NULL;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciHalDev*
+nci_hal_dev_new(
+    const char* path,
+    NCI_HAL_DEV_FLAGS flags)
+{
+    if (G_LIKELY(path)) {
+        const int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+        if (fd >= 0) {
+            return nci_hal_dev_new_fd(fd, flags);
+        }
+        GWARN("Can't open %s: %s", path, strerror(errno));
+    }
+    return NULL;
+}
+
+NciHalDev*
+nci_hal_dev_new_fd(
+    int fd,
+    NCI_HAL_DEV_FLAGS flags)
+{
+    if (G_LIKELY(fd >= 0)) {
+        static const NciHalIoFunctions dev_io_fn = {
+            .start = nci_hal_dev_io_start,
+            .stop = nci_hal_dev_io_stop,
+            .write = nci_hal_dev_io_write,
+            .cancel_write = nci_hal_dev_io_cancel_write
+        };
+        NciHalDevPriv* self = g_slice_new0(NciHalDevPriv);
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        self->io.fn = &dev_io_fn;
+        self->pub.io = &self->io;
+        self->pub.fd = fd;
+        self->flags = flags;
+        self->channel = g_io_channel_unix_new(fd);
+        self->tx = g_byte_array_sized_new(NCI_HDR_SIZE + 0xff);
+        return &self->pub;
+    }
+    return NULL;
+}
+
+void
+nci_hal_dev_free(
+    NciHalDev* dev)
+{
+    if (G_LIKELY(dev)) {
+        NciHalDevPriv* self = nci_hal_dev_cast(dev);
+
+        nci_hal_dev_io_stop(&self->io);
+        g_io_channel_unref(self->channel);
+        g_byte_array_unref(self->tx);
+        close(dev->fd);
+        g_slice_free(NciHalDevPriv, self);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
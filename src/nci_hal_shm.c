@@ -0,0 +1,779 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_hal_shm.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_macros.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#  define MFD_CLOEXEC (0x0001U)
+#endif
+
+#define HAL_SHM_MAGIC (0x5249434e) /* "NCIR" */
+#define HAL_SHM_MIN_RING_SIZE (0x200)
+#define HAL_SHM_MAX_RING_SIZE (0x1000000)
+#define HAL_SHM_CACHE_LINE (64)
+
+/*
+ * Shared memory layout. Each ring has a single producer and a single
+ * consumer, head and tail are free running and live in separate cache
+ * lines. Packets are stored back to back, NCI header tells where each
+ * one ends. The ring data follows the header.
+ */
+
+typedef struct nci_hal_shm_ring {
+    guint32 head;               /* Written by the producer */
+    guint8 pad1[HAL_SHM_CACHE_LINE - 4];
+    guint32 tail;               /* Written by the consumer */
+    guint32 waiting;            /* Producer is waiting for space */
+    guint8 pad2[HAL_SHM_CACHE_LINE - 8];
+} NciHalShmRing;
+
+typedef struct nci_hal_shm_layout {
+    guint32 magic;
+    guint32 ring_size;
+    guint32 closed;
+    guint8 pad[HAL_SHM_CACHE_LINE - 12];
+    NciHalShmRing ring[2];      /* Host to peer, peer to host */
+} NciHalShmLayout;
+
+typedef struct nci_hal_shm_priv {
+    NciHalShm pub;
+    NciHalIo io;
+    NciHalClient* client;
+    NciHalShmLayout* shared;
+    gsize map_size;
+    guint ring_size;
+    guint ring_mask;
+    NciHalShmRing* tx_ring;
+    NciHalShmRing* rx_ring;
+    guint8* tx_data;
+    guint8* rx_data;
+    GIOChannel* channel;
+    GSource* event_source;
+    GSource* complete_source;
+    NciHalClientFunc write_complete;
+    GByteArray* tx;             /* Waiting for space in the ring */
+    guint8 rx[NCI_HDR_SIZE + 0xff]; /* Packet wrapped around the end */
+} NciHalShmPriv;
+
+typedef struct nci_hal_shm_bridge_side {
+    NciHalClient client;
+    NciHalIo* io;
+    NciHalShmBridge* bridge;
+    struct nci_hal_shm_bridge_side* other;
+    GByteArray* queue;          /* Waiting to be written to io */
+    GByteArray* busy;           /* Being written to io */
+} NciHalShmBridgeSide;
+
+struct nci_hal_shm_bridge {
+    NciHalShmBridgeSide side[2]; /* Shared memory, the other io */
+    NciHalShmBridgeFunc closed;
+    void* user_data;
+    gboolean dead;
+};
+
+static inline NciHalShmPriv* nci_hal_shm_cast(NciHalShm* pub)
+    { return G_CAST(pub, NciHalShmPriv, pub); }
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+/*
+ * The other side is another process, possibly running on another
+ * core. GLib atomics only put the barrier in front of the load, so
+ * use the compiler builtins to get the ordering right.
+ */
+static inline guint32 nci_hal_shm_load(const guint32* ptr)
+    { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+static inline void nci_hal_shm_store(guint32* ptr, guint32 val)
+    { __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST); }
+
+static
+void
+nci_hal_shm_kick(
+    int fd)
+{
+    const guint64 one = 1;
+
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        GWARN("Failed to kick the doorbell: %s", strerror(errno));
+    }
+}
+
+static
+void
+nci_hal_shm_error(
+    NciHalShmPriv* self)
+{
+    NciHalClient* client = self->client;
+
+    nci_source_clear(&self->event_source);
+    if (client) {
+        client->fn->error(client);
+    }
+}
+
+static
+gboolean
+nci_hal_shm_complete(
+    gpointer user_data)
+{
+    NciHalShmPriv* self = user_data;
+    NciHalClientFunc complete = self->write_complete;
+
+    self->complete_source = NULL;
+    self->write_complete = NULL;
+    if (complete && self->client) {
+        complete(self->client, TRUE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE if there's not enough space in the ring */
+static
+gboolean
+nci_hal_shm_push(
+    NciHalShmPriv* self,
+    const GUtilData* chunks,
+    guint count)
+{
+    NciHalShmRing* ring = self->tx_ring;
+    const guint32 head = ring->head; /* Nobody else writes it */
+    guint32 pos = head;
+    gsize total = 0;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        total += chunks[i].size;
+    }
+    if (self->ring_size - (head - nci_hal_shm_load(&ring->tail)) < total) {
+        return FALSE;
+    }
+
+    for (i = 0; i < count; i++) {
+        const guint8* src = chunks[i].bytes;
+        const guint len = chunks[i].size;
+        const guint off = pos & self->ring_mask;
+        const guint first = MIN(len, self->ring_size - off);
+
+        memcpy(self->tx_data + off, src, first);
+        if (first < len) {
+            memcpy(self->tx_data, src + first, len - first);
+        }
+        pos += len;
+    }
+
+    /* Publish the whole thing at once */
+    nci_hal_shm_store(&ring->head, pos);
+    nci_hal_shm_kick(self->pub.tx_event);
+    return TRUE;
+}
+
+static
+void
+nci_hal_shm_flush(
+    NciHalShmPriv* self)
+{
+    GUtilData chunk;
+
+    chunk.bytes = self->tx->data;
+    chunk.size = self->tx->len;
+
+    /*
+     * Raise the flag before checking for space, so that the consumer
+     * either sees the flag or we see the space it has freed.
+     */
+    nci_hal_shm_store(&self->tx_ring->waiting, TRUE);
+    if (nci_hal_shm_push(self, &chunk, 1)) {
+        nci_hal_shm_store(&self->tx_ring->waiting, FALSE);
+        g_byte_array_set_size(self->tx, 0);
+        if (!self->complete_source) {
+            self->complete_source = nci_idle_add(nci_hal_shm_complete, self);
+        }
+    }
+}
+
+/* Returns the number of packets delivered, negative if the ring is broken */
+static
+int
+nci_hal_shm_drain(
+    NciHalShmPriv* self)
+{
+    NciHalShmRing* ring = self->rx_ring;
+    const guint32 head = nci_hal_shm_load(&ring->head);
+    guint32 tail = ring->tail; /* Nobody else writes it */
+    int packets = 0;
+
+    if (head - tail > self->ring_size) {
+        GWARN("Broken rx ring (head %u, tail %u)", head, tail);
+        return -1;
+    }
+
+    /* The client may stop us from its callback */
+    while (self->client && head - tail >= NCI_HDR_SIZE) {
+        const guint off = tail & self->ring_mask;
+        const guint len = NCI_HDR_SIZE +
+            self->rx_data[(tail + 2) & self->ring_mask];
+        const guint8* pkt;
+
+        /*
+         * The writer publishes whole packets only, so anything short
+         * means that the ring is corrupted. The length byte can't make
+         * len exceed the size of self->rx.
+         */
+        if (head - tail < len) {
+            GWARN("Truncated packet in rx ring (%u < %u)", head - tail, len);
+            nci_hal_shm_store(&ring->tail, tail);
+            return -1;
+        }
+
+        if (off + len <= self->ring_size) {
+            /* Nothing gets written there until we move the tail */
+            pkt = self->rx_data + off;
+        } else {
+            const guint first = self->ring_size - off;
+
+            memcpy(self->rx, self->rx_data + off, first);
+            memcpy(self->rx + first, self->rx_data, len - first);
+            pkt = self->rx;
+        }
+        tail += len;
+        packets++;
+        self->pub.rx_packets++;
+        self->client->fn->read(self->client, pkt, len);
+    }
+
+    nci_hal_shm_store(&ring->tail, tail);
+    if (__atomic_exchange_n(&ring->waiting, FALSE, __ATOMIC_SEQ_CST)) {
+        nci_hal_shm_kick(self->pub.tx_event);
+    }
+    return packets;
+}
+
+static
+gboolean
+nci_hal_shm_event(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    NciHalShmPriv* self = user_data;
+
+    if (condition & G_IO_IN) {
+        guint64 count;
+
+        /* Reset the counter before looking at the rings */
+        if (read(self->pub.rx_event, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+            GWARN("Doorbell read failed: %s", strerror(errno));
+        } else {
+            const int packets = nci_hal_shm_drain(self);
+
+            if (packets < 0) {
+                self->event_source = NULL;
+                nci_hal_shm_error(self);
+                return G_SOURCE_REMOVE;
+            } else if (packets) {
+                self->pub.rx_wakeups++;
+            }
+            if (self->tx->len) {
+                nci_hal_shm_flush(self);
+            }
+            if (!nci_hal_shm_load(&self->shared->closed)) {
+                return G_SOURCE_CONTINUE;
+            }
+            GDEBUG("The other side is gone");
+        }
+    }
+    self->event_source = NULL;
+    nci_hal_shm_error(self);
+    return G_SOURCE_REMOVE;
+}
+
+/*==========================================================================*
+ * NciHalIo
+ *==========================================================================*/
+
+static
+gboolean
+nci_hal_shm_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciHalShmPriv* self = G_CAST(io, NciHalShmPriv, io);
+
+    self->client = client;
+    if (!self->event_source) {
+        self->event_source = nci_io_watch_add(self->channel, G_IO_IN |
+            G_IO_ERR | G_IO_HUP | G_IO_NVAL, nci_hal_shm_event, self);
+    }
+
+    /* Pick up whatever has been queued before we started */
+    nci_hal_shm_kick(self->pub.rx_event);
+    return TRUE;
+}
+
+static
+void
+nci_hal_shm_io_stop(
+    NciHalIo* io)
+{
+    NciHalShmPriv* self = G_CAST(io, NciHalShmPriv, io);
+
+    self->client = NULL;
+    self->write_complete = NULL;
+    nci_source_clear(&self->event_source);
+    nci_source_clear(&self->complete_source);
+    g_byte_array_set_size(self->tx, 0);
+}
+
+static
+gboolean
+nci_hal_shm_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    NciHalShmPriv* self = G_CAST(io, NciHalShmPriv, io);
+
+    if (self->tx->len || self->complete_source) {
+        GWARN("Shared memory write is already in progress");
+        return FALSE;
+    }
+
+    self->pub.tx_packets++;
+    self->write_complete = complete;
+    if (nci_hal_shm_push(self, chunks, count)) {
+        /* Complete asynchronously */
+        self->complete_source = nci_idle_add(nci_hal_shm_complete, self);
+    } else {
+        guint i;
+
+        /* Wait until the other side makes room */
+        for (i = 0; i < count; i++) {
+            g_byte_array_append(self->tx, chunks[i].bytes, chunks[i].size);
+        }
+        if (self->tx->len > self->ring_size) {
+            GWARN("%u bytes won't fit into the ring", self->tx->len);
+            g_byte_array_set_size(self->tx, 0);
+            self->write_complete = NULL;
+            return FALSE;
+        }
+        nci_hal_shm_flush(self);
+    }
+    return TRUE;
+}
+
+static
+void
+nci_hal_shm_io_cancel_write(
+    NciHalIo* io)
+{
+    NciHalShmPriv* self = G_CAST(io, NciHalShmPriv, io);
+
+    /* Whatever is already in the ring stays there */
+    self->write_complete = NULL;
+}
+
+/*==========================================================================*
+ * Bridge
+ *==========================================================================*/
+
+static
+void
+nci_hal_shm_bridge_close(
+    NciHalShmBridge* self)
+{
+    if (!self->dead) {
+        self->dead = TRUE;
+        if (self->closed) {
+            self->closed(self, self->user_data);
+        }
+    }
+}
+
+static
+void
+nci_hal_shm_bridge_write_done(
+    NciHalClient* client,
+    gboolean ok);
+
+static
+void
+nci_hal_shm_bridge_flush(
+    NciHalShmBridgeSide* side)
+{
+    /* Whatever has piled up during the previous write goes in one go */
+    if (!side->busy->len && side->queue->len && !side->bridge->dead) {
+        GByteArray* buf = side->queue;
+        GUtilData chunk;
+
+        side->queue = side->busy;
+        side->busy = buf;
+        chunk.bytes = buf->data;
+        chunk.size = buf->len;
+        if (!side->io->fn->write(side->io, &chunk, 1,
+            nci_hal_shm_bridge_write_done)) {
+            g_byte_array_set_size(buf, 0);
+            nci_hal_shm_bridge_close(side->bridge);
+        }
+    }
+}
+
+static
+void
+nci_hal_shm_bridge_write_done(
+    NciHalClient* client,
+    gboolean ok)
+{
+    NciHalShmBridgeSide* side = G_CAST(client, NciHalShmBridgeSide, client);
+
+    g_byte_array_set_size(side->busy, 0);
+    if (ok) {
+        nci_hal_shm_bridge_flush(side);
+    } else {
+        nci_hal_shm_bridge_close(side->bridge);
+    }
+}
+
+static
+void
+nci_hal_shm_bridge_error(
+    NciHalClient* client)
+{
+    nci_hal_shm_bridge_close(G_CAST(client, NciHalShmBridgeSide,
+        client)->bridge);
+}
+
+static
+void
+nci_hal_shm_bridge_read(
+    NciHalClient* client,
+    const void* data,
+    guint len)
+{
+    NciHalShmBridgeSide* side = G_CAST(client, NciHalShmBridgeSide, client);
+    NciHalShmBridgeSide* other = side->other;
+
+    g_byte_array_append(other->queue, data, len);
+    nci_hal_shm_bridge_flush(other);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+static
+NciHalShm*
+nci_hal_shm_create(
+    int fd,
+    int rx_event,
+    int tx_event,
+    NciHalShmLayout* shared,
+    gsize map_size,
+    gboolean host)
+{
+    static const NciHalIoFunctions shm_io_fn = {
+        .start = nci_hal_shm_io_start,
+        .stop = nci_hal_shm_io_stop,
+        .write = nci_hal_shm_io_write,
+        .cancel_write = nci_hal_shm_io_cancel_write
+    };
+    NciHalShmPriv* self = g_slice_new0(NciHalShmPriv);
+    NciHalShm* shm = &self->pub;
+    guint8* data = (guint8*)(shared + 1);
+    const guint size = shared->ring_size;
+
+    self->io.fn = &shm_io_fn;
+    shm->io = &self->io;
+    shm->fd = fd;
+    shm->rx_event = rx_event;
+    shm->tx_event = tx_event;
+    self->shared = shared;
+    self->map_size = map_size;
+    self->ring_size = size;
+    self->ring_mask = size - 1;
+    self->tx_ring = shared->ring + (host ? 0 : 1);
+    self->rx_ring = shared->ring + (host ? 1 : 0);
+    self->tx_data = data + (host ? 0 : size);
+    self->rx_data = data + (host ? size : 0);
+    self->channel = g_io_channel_unix_new(rx_event);
+    self->tx = g_byte_array_new();
+    return shm;
+}
+
+NciHalShm*
+nci_hal_shm_new(
+    guint ring_size)
+{
+    const guint want = ring_size ? ring_size : NCI_HAL_SHM_DEFAULT_RING_SIZE;
+    guint size = HAL_SHM_MIN_RING_SIZE;
+    gsize map_size;
+    int fd;
+
+    while (size < want && size < HAL_SHM_MAX_RING_SIZE) {
+        size <<= 1;
+    }
+    map_size = sizeof(NciHalShmLayout) + 2 * size;
+
+#ifdef SYS_memfd_create
+    fd = syscall(SYS_memfd_create, "nci-hal-shm", MFD_CLOEXEC);
+#else
+    fd = -1;
+    errno = ENOSYS;
+#endif
+    if (fd < 0) {
+        GWARN("Can't create shared memory: %s", strerror(errno));
+    } else if (ftruncate(fd, map_size) < 0) {
+        GWARN("Can't allocate shared memory: %s", strerror(errno));
+        close(fd);
+    } else {
+        void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+
+        if (map == MAP_FAILED) {
+            GWARN("Can't map shared memory: %s", strerror(errno));
+            close(fd);
+        } else {
+            const int host_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            const int peer_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            if (host_event >= 0 && peer_event >= 0) {
+                NciHalShmLayout* shared = map; /* Zero-filled */
+
+                shared->magic = HAL_SHM_MAGIC;
+                shared->ring_size = size;
+                return nci_hal_shm_create(fd, host_event, peer_event,
+                    shared, map_size, TRUE);
+            }
+            GWARN("Can't create doorbells: %s", strerror(errno));
+            if (host_event >= 0) close(host_event);
+            if (peer_event >= 0) close(peer_event);
+            munmap(map, map_size);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+NciHalShm*
+nci_hal_shm_attach(
+    int fd,
+    int rx_event,
+    int tx_event)
+{
+    struct stat st;
+
+    if (fd >= 0 && rx_event >= 0 && tx_event >= 0 && !fstat(fd, &st) &&
+        st.st_size >= (off_t) sizeof(NciHalShmLayout)) {
+        const gsize map_size = st.st_size;
+        void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+
+        if (map != MAP_FAILED) {
+            NciHalShmLayout* shared = map;
+            const guint size = shared->ring_size;
+
+            if (shared->magic == HAL_SHM_MAGIC &&
+                size >= HAL_SHM_MIN_RING_SIZE &&
+                size <= HAL_SHM_MAX_RING_SIZE && !(size & (size - 1)) &&
+                sizeof(NciHalShmLayout) + 2 * size <= map_size) {
+                fcntl(rx_event, F_SETFL, fcntl(rx_event, F_GETFL) |
+                    O_NONBLOCK);
+                fcntl(tx_event, F_SETFL, fcntl(tx_event, F_GETFL) |
+                    O_NONBLOCK);
+                return nci_hal_shm_create(fd, rx_event, tx_event,
+                    shared, map_size, FALSE);
+            }
+            GWARN("Not an NCI shared memory region");
+            munmap(map, map_size);
+        }
+    }
+
+    /* We own the descriptors, even if we can't use them */
+    if (fd >= 0) close(fd);
+    if (rx_event >= 0) close(rx_event);
+    if (tx_event >= 0) close(tx_event);
+    return NULL;
+}
+
+void
+nci_hal_shm_free(
+    NciHalShm* shm)
+{
+    if (G_LIKELY(shm)) {
+        NciHalShmPriv* self = nci_hal_shm_cast(shm);
+
+        /* Let the other side know */
+        nci_hal_shm_store(&self->shared->closed, TRUE);
+        nci_hal_shm_kick(shm->tx_event);
+
+        nci_hal_shm_io_stop(&self->io);
+        g_io_channel_unref(self->channel);
+        g_byte_array_unref(self->tx);
+        munmap(self->shared, self->map_size);
+        close(shm->rx_event);
+        close(shm->tx_event);
+        close(shm->fd);
+        g_slice_free(NciHalShmPriv, self);
+    }
+}
+
+NciHalShmBridge*
+nci_hal_shm_bridge_new(
+    NciHalShm* shm,
+    NciHalIo* io,
+    NciHalShmBridgeFunc closed,
+    void* user_data)
+{
+    if (G_LIKELY(shm) && G_LIKELY(io)) {
+        static const NciHalClientFunctions bridge_client_fn = {
+            .error = nci_hal_shm_bridge_error,
+            .read = nci_hal_shm_bridge_read
+        };
+        NciHalShmBridge* self = g_slice_new0(NciHalShmBridge);
+        guint i;
+
+        self->side[0].io = shm->io;
+        self->side[1].io = io;
+        self->side[0].other = self->side + 1;
+        self->side[1].other = self->side;
+        self->closed = closed;
+        self->user_data = user_data;
+        for (i = 0; i < G_N_ELEMENTS(self->side); i++) {
+            NciHalShmBridgeSide* side = self->side + i;
+
+            side->client.fn = &bridge_client_fn;
+            side->bridge = self;
+            side->queue = g_byte_array_new();
+            side->busy = g_byte_array_new();
+        }
+        if (io->fn->start(io, &self->side[1].client)) {
+            if (shm->io->fn->start(shm->io, &self->side[0].client)) {
+                return self;
+            }
+            io->fn->stop(io);
+        }
+        self->side[0].io = self->side[1].io = NULL;
+        nci_hal_shm_bridge_free(self);
+    }
+    return NULL;
+}
+
+void
+nci_hal_shm_bridge_free(
+    NciHalShmBridge* self)
+{
+    if (G_LIKELY(self)) {
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS(self->side); i++) {
+            NciHalShmBridgeSide* side = self->side + i;
+
+            if (side->io) {
+                side->io->fn->stop(side->io);
+            }
+            g_byte_array_unref(side->queue);
+            g_byte_array_unref(side->busy);
+        }
+        g_slice_free(NciHalShmBridge, self);
+    }
+}
+
+pid_t
+nci_hal_shm_spawn(
+    NciHalShm* shm,
+    const char* path,
+    const char* const* args)
+{
+    pid_t pid = -1;
+
+    if (G_LIKELY(shm) && G_LIKELY(path)) {
+        const guint nargs = args ? g_strv_length((char**) args) : 0;
+        char** argv = g_new(char*, nargs + 5);
+        guint i, n = 0;
+
+        /* Everything is prepared before fork, the child only execs */
+        argv[n++] = g_strdup(path);
+        for (i = 0; i < nargs; i++) {
+            argv[n++] = g_strdup(args[i]);
+        }
+
+        /* The doorbells are swapped, as seen from the other side */
+        argv[n++] = g_strdup_printf("%d", shm->fd);
+        argv[n++] = g_strdup_printf("%d", shm->tx_event);
+        argv[n++] = g_strdup_printf("%d", shm->rx_event);
+        argv[n] = NULL;
+
+        pid = fork();
+        if (!pid) {
+            /* Only async-signal-safe calls from here on */
+            fcntl(shm->fd, F_SETFD, 0);
+            fcntl(shm->rx_event, F_SETFD, 0);
+            fcntl(shm->tx_event, F_SETFD, 0);
+            execv(path, argv);
+            _exit(127);
+        } else if (pid < 0) {
+            GWARN("Can't fork: %s", strerror(errno));
+        }
+        g_strfreev(argv);
+    }
+    return pid;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
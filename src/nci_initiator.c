@@ -40,28 +40,31 @@
 #include "nci_plugin_p.h"
 #include "nci_plugin_log.h"
 #include "nci_adapter_impl.h"
+#include "nci_clock.h"
 
 #include <nci_core.h>
 
 #include <nfc_initiator_impl.h>
 
-enum {
-    EVENT_DATA_PACKET,
-    EVENT_COUNT
-};
+#include <gutil_macros.h>
 
 typedef NfcInitiatorClass NciInitiatorClass;
 typedef struct nci_initiator {
     NfcInitiator initiator;
-    NciAdapter* adapter;
-    gulong event_id[EVENT_COUNT];
+    NciAdapter* adapter; /* Cleared when the initiator is gone */
+    NciAdapterEndpoint endpoint;
     guint response_in_progress;
+    gint64 apdu_received;   /* Zero if there's no command to time */
+    gint64 apdu_responded;
+    guint8 apdu_cla;
+    guint8 apdu_ins;
 } NciInitiator;
 
 GType nci_initiator_get_type(void) G_GNUC_INTERNAL;
 #define PARENT_CLASS nci_initiator_parent_class
 #define THIS_TYPE (nci_initiator_get_type())
 #define THIS(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), THIS_TYPE, NciInitiator))
+#define IS_THIS(obj) G_TYPE_CHECK_INSTANCE_TYPE((obj), THIS_TYPE)
 G_DEFINE_TYPE(NciInitiator, nci_initiator, NFC_TYPE_INITIATOR)
 
 static
@@ -75,12 +78,33 @@ nci_initiator_new_with_technology(
     return self;
 }
 
+static
+void
+nci_initiator_apdu_done(
+    NciInitiator* self,
+    gboolean ok)
+{
+    if (self->apdu_received) {
+        NciAdapter* adapter = self->adapter;
+
+        if (adapter && self->apdu_responded) {
+            const gint64 now = nci_clock_now(nci_adapter_clock(adapter));
+
+            nci_adapter_apdu_sample(adapter, self->apdu_cla, self->apdu_ins,
+                self->apdu_responded - self->apdu_received,
+                ok ? (now - self->apdu_responded) : -1);
+        }
+        self->apdu_received = self->apdu_responded = 0;
+    }
+}
+
 static
 void
 nci_initiator_cancel_response(
     NciInitiator* self)
 {
     if (self->response_in_progress) {
+        nci_initiator_apdu_done(self, FALSE);
         if (self->adapter) {
             nci_core_cancel(self->adapter->nci, self->response_in_progress);
         }
@@ -96,30 +120,34 @@ nci_initiator_drop_adapter(
     NciInitiator* self)
 {
     if (self->adapter) {
-        NciAdapter* adapter = self->adapter;
-
         nci_initiator_cancel_response(self);
-        nci_core_remove_all_handlers(adapter->nci, self->event_id);
-        g_object_remove_weak_pointer(G_OBJECT(adapter), (gpointer*)
-            &self->adapter);
         self->adapter = NULL;
     }
 }
 
 static
 void
-nci_initiator_data_packet_handler(
-    NciCore* nci,
-    guint8 cid,
+nci_initiator_data_packet(
+    NciAdapterEndpoint* endpoint,
     const void* data,
-    guint len,
-    void* user_data)
+    guint len)
 {
-    if (cid == NCI_STATIC_RF_CONN_ID) {
-        nfc_initiator_transmit(NFC_INITIATOR(user_data), data, len);
+    NciInitiator* self = G_CAST(endpoint, NciInitiator, endpoint);
+
+    /* C-APDU starts with CLA INS P1 P2 */
+    if (len >= 4 && (self->initiator.protocol &
+        (NFC_PROTOCOL_T4A_TAG | NFC_PROTOCOL_T4B_TAG))) {
+        const guint8* cmd = data;
+
+        self->apdu_received = nci_clock_now(nci_adapter_clock
+            (self->adapter));
+        self->apdu_responded = 0;
+        self->apdu_cla = cmd[0];
+        self->apdu_ins = cmd[1];
     } else {
-        GDEBUG("Unhandled data packet, cid=0x%02x %u byte(s)", cid, len);
+        self->apdu_received = 0;
     }
+    nfc_initiator_transmit(&self->initiator, data, len);
 }
 
 static
@@ -133,6 +161,7 @@ nci_initiator_response_sent(
 
     GASSERT(self->response_in_progress);
     self->response_in_progress = 0;
+    nci_initiator_apdu_done(self, success);
     nfc_initiator_response_sent(&self->initiator, success ?
         NFC_TRANSMIT_STATUS_OK : NFC_TRANSMIT_STATUS_ERROR);
 }
@@ -209,17 +238,20 @@ nci_initiator_new(
 
             initiator->protocol = protocol;
             self->adapter = adapter;
-            g_object_add_weak_pointer(G_OBJECT(adapter),
-                (gpointer*) &self->adapter);
-            self->event_id[EVENT_DATA_PACKET] =
-                nci_core_add_data_packet_handler(adapter->nci,
-                    nci_initiator_data_packet_handler, self);
             return initiator;
         }
     }
     return NULL;
 }
 
+NciAdapterEndpoint*
+nci_initiator_endpoint(
+    NfcInitiator* initiator)
+{
+    /* Derived adapters may create their own objects */
+    return IS_THIS(initiator) ? &THIS(initiator)->endpoint : NULL;
+}
+
 /*==========================================================================*
  * Methods
  *==========================================================================*/
@@ -239,6 +271,9 @@ nci_initiator_respond(
     if (adapter) {
         GBytes* bytes = g_bytes_new(data, len);
 
+        if (self->apdu_received) {
+            self->apdu_responded = nci_clock_now(nci_adapter_clock(adapter));
+        }
         self->response_in_progress = nci_core_send_data_msg(adapter->nci,
             NCI_STATIC_RF_CONN_ID, bytes, nci_initiator_response_sent,
             NULL, self);
@@ -279,6 +314,12 @@ void
 nci_initiator_init(
     NciInitiator* self)
 {
+    static const NciAdapterEndpointFunctions endpoint_fn = {
+        .data_packet = nci_initiator_data_packet
+    };
+
+    self->endpoint.fn = &endpoint_fn;
+    NCI_OBJECT_CREATED(NCI_OBJECT_INITIATOR);
 }
 
 static
@@ -290,6 +331,7 @@ nci_initiator_finalize(
 
     nci_initiator_cancel_response(self);
     nci_initiator_drop_adapter(self);
+    NCI_OBJECT_DESTROYED(NCI_OBJECT_INITIATOR);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
 
@@ -0,0 +1,580 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_metrics.h"
+#include "nci_clock.h"
+#include "nci_stats.h"
+#include "nci_adapter_impl.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <nfc_adapter_impl.h>
+
+#include <gutil_macros.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define METRICS_PREFIX "nci_"
+#define METRICS_TIME_SUFFIX "_us"
+#define METRICS_MAX_CLIENTS (8)
+
+typedef struct nci_prometheus_sink {
+    NciMetricsSink sink;
+    GString* out;
+    GString* family;            /* Name of the last metric family */
+    char* adapter;              /* Escaped adapter name or NULL */
+} NciPrometheusSink;
+
+typedef struct nci_metrics_file_job {
+    char* path;
+    GBytes* text;
+} NciMetricsFileJob;
+
+typedef struct nci_metrics_client {
+    NciMetricsExporter* exporter;
+    int fd;
+    GBytes* text;
+    gsize sent;
+    GSource* watch_source;
+} NciMetricsClient;
+
+struct nci_metrics_exporter {
+    NciAdapter* adapter;        /* Weak reference */
+    char* path;                 /* File or socket */
+    gboolean unix_socket;
+    int listen_fd;
+    GSource* listen_source;
+    NciClockTimer* timer;
+    GThreadPool* writer;        /* Writes the file off the main loop */
+    GBytes* text;               /* The most recent snapshot */
+    GSList* clients;
+};
+
+/*==========================================================================*
+ * Prometheus format
+ *==========================================================================*/
+
+static inline NciPrometheusSink* nci_prometheus_sink_cast(NciMetricsSink* s)
+    { return G_CAST(s, NciPrometheusSink, sink); }
+
+static
+char*
+nci_prometheus_escape(
+    const char* value)
+{
+    GString* buf = g_string_sized_new(strlen(value));
+    const char* ptr;
+
+    for (ptr = value; *ptr; ptr++) {
+        switch (*ptr) {
+        case '\\': g_string_append(buf, "\\\\"); break;
+        case '"': g_string_append(buf, "\\\""); break;
+        case '\n': g_string_append(buf, "\\n"); break;
+        default: g_string_append_c(buf, *ptr); break;
+        }
+    }
+    return g_string_free(buf, FALSE);
+}
+
+static
+void
+nci_prometheus_seconds(
+    GString* out,
+    guint64 us)
+{
+    /* Exact decimal representation, no floating point */
+    g_string_append_printf(out, "%" G_GUINT64_FORMAT ".%06u",
+        us / 1000000, (guint) (us % 1000000));
+}
+
+static
+void
+nci_prometheus_family(
+    NciPrometheusSink* self,
+    const char* name,
+    const char* type)
+{
+    if (strcmp(self->family->str, name)) {
+        g_string_assign(self->family, name);
+        g_string_append_printf(self->out, "# TYPE %s %s\n", name, type);
+    }
+}
+
+static
+void
+nci_prometheus_labels(
+    NciPrometheusSink* self,
+    const char* label,
+    const char* value,
+    const char* le)
+{
+    GString* out = self->out;
+    const char* sep = "{";
+
+    if (self->adapter) {
+        g_string_append_printf(out, "%sadapter=\"%s\"", sep, self->adapter);
+        sep = ",";
+    }
+    if (label && value) {
+        char* escaped = nci_prometheus_escape(value);
+
+        g_string_append_printf(out, "%s%s=\"%s\"", sep, label, escaped);
+        g_free(escaped);
+        sep = ",";
+    }
+    if (le) {
+        g_string_append_printf(out, "%sle=\"%s\"", sep, le);
+        sep = ",";
+    }
+    if (sep[0] == ',') {
+        g_string_append_c(out, '}');
+    }
+}
+
+static
+void
+nci_prometheus_value(
+    NciMetricsSink* sink,
+    const char* name,
+    NCI_METRIC_TYPE type,
+    const char* label,
+    const char* label_value,
+    guint64 value)
+{
+    NciPrometheusSink* self = nci_prometheus_sink_cast(sink);
+    const gsize len = strlen(name);
+    const gboolean is_time = g_str_has_suffix(name, METRICS_TIME_SUFFIX);
+    const gboolean is_counter = (type == NCI_METRIC_COUNTER);
+    GString* full = g_string_new(METRICS_PREFIX);
+
+    if (is_time) {
+        g_string_append_len(full, name, len - strlen(METRICS_TIME_SUFFIX));
+        g_string_append(full, "_seconds");
+    } else {
+        g_string_append(full, name);
+    }
+    if (is_counter) {
+        g_string_append(full, "_total");
+    }
+    nci_prometheus_family(self, full->str, is_counter ? "counter" : "gauge");
+    g_string_append(self->out, full->str);
+    nci_prometheus_labels(self, label, label_value, NULL);
+    g_string_append_c(self->out, ' ');
+    if (is_time) {
+        nci_prometheus_seconds(self->out, value);
+    } else {
+        g_string_append_printf(self->out, "%" G_GUINT64_FORMAT, value);
+    }
+    g_string_append_c(self->out, '\n');
+    g_string_free(full, TRUE);
+}
+
+static
+void
+nci_prometheus_histogram(
+    NciMetricsSink* sink,
+    const char* name,
+    const char* label,
+    const char* label_value,
+    const NciHistogram* hist)
+{
+    NciPrometheusSink* self = nci_prometheus_sink_cast(sink);
+    GString* out = self->out;
+    char* full = g_strconcat(METRICS_PREFIX, name, "_seconds", NULL);
+    GString* le = g_string_new(NULL);
+    guint64 total = 0;
+    guint i;
+
+    nci_prometheus_family(self, full, "histogram");
+
+    /* The last bucket has no fixed limit, it's covered by +Inf */
+    for (i = 0; i < NCI_HISTOGRAM_BUCKETS - 1; i++) {
+        total += hist->buckets[i];
+        g_string_truncate(le, 0);
+        nci_prometheus_seconds(le, nci_histogram_bucket_limit(hist, i));
+        g_string_append_printf(out, "%s_bucket", full);
+        nci_prometheus_labels(self, label, label_value, le->str);
+        g_string_append_printf(out, " %" G_GUINT64_FORMAT "\n", total);
+    }
+    g_string_append_printf(out, "%s_bucket", full);
+    nci_prometheus_labels(self, label, label_value, "+Inf");
+    g_string_append_printf(out, " %" G_GUINT64_FORMAT "\n", hist->count);
+
+    g_string_append_printf(out, "%s_sum", full);
+    nci_prometheus_labels(self, label, label_value, NULL);
+    g_string_append_c(out, ' ');
+    nci_prometheus_seconds(out, hist->sum_us);
+    g_string_append_c(out, '\n');
+
+    g_string_append_printf(out, "%s_count", full);
+    nci_prometheus_labels(self, label, label_value, NULL);
+    g_string_append_printf(out, " %" G_GUINT64_FORMAT "\n", hist->count);
+
+    g_string_free(le, TRUE);
+    g_free(full);
+}
+
+/*==========================================================================*
+ * Exporter
+ *==========================================================================*/
+
+static
+void
+nci_metrics_client_free(
+    NciMetricsClient* client)
+{
+    NciMetricsExporter* self = client->exporter;
+
+    self->clients = g_slist_remove(self->clients, client);
+    nci_source_clear(&client->watch_source);
+    close(client->fd);
+    g_bytes_unref(client->text);
+    g_slice_free(NciMetricsClient, client);
+}
+
+static
+gboolean
+nci_metrics_client_write(
+    NciMetricsClient* client)
+{
+    gsize size;
+    const guint8* data = g_bytes_get_data(client->text, &size);
+
+    while (client->sent < size) {
+        const ssize_t n = write(client->fd, data + client->sent,
+            size - client->sent);
+
+        if (n > 0) {
+            client->sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            return TRUE;
+        } else {
+            GDEBUG("Metrics client write failed: %s", strerror(errno));
+            break;
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+nci_metrics_client_event(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    NciMetricsClient* client = user_data;
+
+    if (!(condition & G_IO_OUT) || !nci_metrics_client_write(client)) {
+        client->watch_source = NULL;
+        nci_metrics_client_free(client);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static
+gboolean
+nci_metrics_exporter_accept(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    NciMetricsExporter* self = user_data;
+    const int fd = accept(self->listen_fd, NULL, NULL);
+
+    if (fd >= 0) {
+        if (g_slist_length(self->clients) >= METRICS_MAX_CLIENTS) {
+            GDEBUG("Too many metrics clients");
+            close(fd);
+        } else {
+            NciMetricsClient* client = g_slice_new0(NciMetricsClient);
+
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            client->exporter = self;
+            client->fd = fd;
+            client->text = g_bytes_ref(self->text);
+            self->clients = g_slist_append(self->clients, client);
+            if (nci_metrics_client_write(client)) {
+                /* The rest goes out when the socket becomes writable */
+                GIOChannel* io = g_io_channel_unix_new(fd);
+
+                client->watch_source = nci_io_watch_add(io, G_IO_OUT | G_IO_ERR
+                    | G_IO_HUP | G_IO_NVAL, nci_metrics_client_event, client);
+                g_io_channel_unref(io);
+            } else {
+                nci_metrics_client_free(client);
+            }
+        }
+    } else if (errno != EAGAIN && errno != EINTR) {
+        GWARN("Metrics socket failed: %s", strerror(errno));
+        self->listen_source = NULL;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static
+gboolean
+nci_metrics_exporter_listen(
+    NciMetricsExporter* self)
+{
+    struct sockaddr_un addr;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(self->path) >= sizeof(addr.sun_path)) {
+        GWARN("Socket path too long: %s", self->path);
+    } else if (fd < 0) {
+        GWARN("Can't create socket: %s", strerror(errno));
+    } else {
+        strcpy(addr.sun_path, self->path);
+        unlink(self->path);
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+            listen(fd, METRICS_MAX_CLIENTS) < 0) {
+            GWARN("Can't listen on %s: %s", self->path, strerror(errno));
+        } else {
+            GIOChannel* io = g_io_channel_unix_new(fd);
+
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            self->listen_fd = fd;
+            self->listen_source = nci_io_watch_add(io, G_IO_IN,
+                nci_metrics_exporter_accept, self);
+            g_io_channel_unref(io);
+            return TRUE;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return FALSE;
+}
+
+/* Runs on the writer thread */
+static
+void
+nci_metrics_file_job_run(
+    gpointer data,
+    gpointer user_data)
+{
+    NciMetricsFileJob* job = data;
+
+    /*
+     * Write a temporary file and rename it, so that readers never see
+     * a partially written one. There's no point in fsync'ing it, the
+     * metrics are refreshed anyway.
+     */
+    char* tmp = g_strconcat(job->path, ".tmp", NULL);
+    const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd >= 0) {
+        gsize size;
+        const void* text = g_bytes_get_data(job->text, &size);
+        const ssize_t written = write(fd, text, size);
+
+        close(fd);
+        if (written != (ssize_t) size || rename(tmp, job->path) < 0) {
+            GWARN("Failed to write %s", job->path);
+            unlink(tmp);
+        }
+    } else {
+        GWARN("Can't open %s: %s", tmp, strerror(errno));
+    }
+    g_free(tmp);
+    g_bytes_unref(job->text);
+    g_free(job->path);
+    g_slice_free(NciMetricsFileJob, job);
+}
+
+static
+void
+nci_metrics_exporter_write_file(
+    NciMetricsExporter* self)
+{
+    /*
+     * The file system may block (NFS, a busy flash device), which
+     * must not hold up RF handling on the main loop. If the writer
+     * still has a snapshot queued, the next update will catch up.
+     */
+    if (!g_thread_pool_unprocessed(self->writer)) {
+        NciMetricsFileJob* job = g_slice_new(NciMetricsFileJob);
+
+        job->path = g_strdup(self->path);
+        job->text = g_bytes_ref(self->text);
+        g_thread_pool_push(self->writer, job, NULL);
+    }
+}
+
+static
+gboolean
+nci_metrics_exporter_timer(
+    gpointer user_data)
+{
+    nci_metrics_exporter_update((NciMetricsExporter*) user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+char*
+nci_metrics_to_prometheus(
+    NciAdapter* adapter)
+{
+    static const NciMetricsSinkFunctions prometheus_fn = {
+        .value = nci_prometheus_value,
+        .histogram = nci_prometheus_histogram
+    };
+    NciPrometheusSink prometheus;
+    const char* name;
+
+    if (G_UNLIKELY(!adapter)) {
+        return NULL;
+    }
+
+    memset(&prometheus, 0, sizeof(prometheus));
+    prometheus.sink.fn = &prometheus_fn;
+    prometheus.out = g_string_sized_new(4096);
+    prometheus.family = g_string_new(NULL);
+    name = NFC_ADAPTER(adapter)->name;
+    if (name) {
+        prometheus.adapter = nci_prometheus_escape(name);
+    }
+    nci_adapter_export_metrics(adapter, &prometheus.sink);
+    g_string_free(prometheus.family, TRUE);
+    g_free(prometheus.adapter);
+    return g_string_free(prometheus.out, FALSE);
+}
+
+NciMetricsExporter*
+nci_metrics_exporter_new(
+    NciAdapter* adapter,
+    const char* path,
+    guint interval_ms)
+{
+    if (G_LIKELY(adapter) && G_LIKELY(path) && interval_ms) {
+        NciMetricsExporter* self = g_slice_new0(NciMetricsExporter);
+
+        self->listen_fd = -1;
+        self->adapter = adapter;
+        g_object_add_weak_pointer(G_OBJECT(adapter), (gpointer*)
+            &self->adapter);
+        if (g_str_has_prefix(path, NCI_METRICS_UNIX_PREFIX)) {
+            self->unix_socket = TRUE;
+            self->path = g_strdup(path + strlen(NCI_METRICS_UNIX_PREFIX));
+            if (!nci_metrics_exporter_listen(self)) {
+                nci_metrics_exporter_free(self);
+                return NULL;
+            }
+        } else {
+            self->path = g_strdup(path);
+            self->writer = g_thread_pool_new(nci_metrics_file_job_run, NULL,
+                1, FALSE, NULL);
+        }
+        nci_metrics_exporter_update(self);
+        self->timer = nci_clock_timeout_add(NULL, interval_ms,
+            nci_metrics_exporter_timer, self);
+        return self;
+    }
+    return NULL;
+}
+
+void
+nci_metrics_exporter_free(
+    NciMetricsExporter* self)
+{
+    if (G_LIKELY(self)) {
+        while (self->clients) {
+            nci_metrics_client_free(self->clients->data);
+        }
+        nci_clock_clear(NULL, &self->timer);
+        nci_source_clear(&self->listen_source);
+        if (self->listen_fd >= 0) {
+            close(self->listen_fd);
+            unlink(self->path);
+        }
+        if (self->writer) {
+            /* Let the last snapshot hit the disk */
+            g_thread_pool_free(self->writer, FALSE, TRUE);
+        }
+        if (self->adapter) {
+            g_object_remove_weak_pointer(G_OBJECT(self->adapter),
+                (gpointer*) &self->adapter);
+        }
+        if (self->text) {
+            g_bytes_unref(self->text);
+        }
+        g_free(self->path);
+        g_slice_free(NciMetricsExporter, self);
+    }
+}
+
+void
+nci_metrics_exporter_update(
+    NciMetricsExporter* self)
+{
+    if (G_LIKELY(self) && self->adapter) {
+        char* text = nci_metrics_to_prometheus(self->adapter);
+
+        /* Clients being served keep their own reference */
+        if (self->text) {
+            g_bytes_unref(self->text);
+        }
+        self->text = g_bytes_new_take(text, strlen(text));
+        if (!self->unix_socket) {
+            nci_metrics_exporter_write_file(self);
+        }
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
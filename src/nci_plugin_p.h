@@ -38,8 +38,375 @@
 #define NCI_PLUGIN_PRIVATE_H
 
 #include <nci_plugin_types.h>
+#include <nci_hal.h>
 #include <nfc_types.h>
 
+/*
+ * Optional subsystems, see PEER and CE in Makefile. Reader/writer mode
+ * is always there. These are plain constants rather than #ifdefs so
+ * that every configuration gets compiled and checked, the optimizer
+ * takes care of the dead code.
+ */
+#ifdef NCI_PLUGIN_NO_PEER
+#  define NCI_PLUGIN_PEER FALSE
+#else
+#  define NCI_PLUGIN_PEER TRUE
+#endif
+
+#ifdef NCI_PLUGIN_NO_CE
+#  define NCI_PLUGIN_CE FALSE
+#else
+#  define NCI_PLUGIN_CE TRUE
+#endif
+
+/* NCI packet header (NCI spec, section 3.4) */
+#define NCI_HDR_SIZE (3)
+#define NCI_HDR_MT_MASK (0xe0)
+#define NCI_HDR_MT_DATA (0x00)
+#define NCI_HDR_MT_CMD (0x20)
+#define NCI_HDR_MT_RSP (0x40)
+#define NCI_HDR_MT_NTF (0x60)
+#define NCI_HDR_PBF (0x10)
+#define NCI_HDR_GID_MASK (0x0f)
+#define NCI_HDR_CID_MASK (0x0f)
+#define NCI_HDR_OID_MASK (0x3f)
+#define NCI_MAX_CTRL_PAYLOAD (0xff)
+
+/* Group and opcode identifiers */
+#define NCI_GID_CORE (0x00)
+#define NCI_GID_RF (0x01)
+#define NCI_GID_NFCEE (0x02)
+#define NCI_OID_CORE_RESET (0x00)
+#define NCI_OID_CORE_INIT (0x01)
+#define NCI_OID_CORE_SET_CONFIG (0x02)
+#define NCI_OID_CORE_GET_CONFIG (0x03)
+#define NCI_OID_CORE_CONN_CREATE (0x04)
+#define NCI_OID_CORE_CONN_CLOSE (0x05)
+#define NCI_OID_CORE_CONN_CREDITS (0x06)
+#define NCI_OID_RF_DISCOVER_MAP (0x00)
+#define NCI_OID_RF_SET_LISTEN_MODE_ROUTING (0x01)
+#define NCI_OID_RF_DISCOVER (0x03)
+#define NCI_OID_RF_DISCOVER_SELECT (0x04)
+#define NCI_OID_RF_INTF_ACTIVATED (0x05)
+#define NCI_OID_RF_DEACTIVATE (0x06)
+#define NCI_OID_RF_NFCEE_ACTION (0x09)
+#define NCI_OID_NFCEE_DISCOVER (0x00)
+#define NCI_OID_NFCEE_MODE_SET (0x01)
+
+#define NCI_MAX_CONN_ID (0x0f)
+#define NCI_CONN_NO_FLOW_CONTROL (0xff)
+
+/*
+ * NciAdapterIo sits between NciCore and the HAL provided by the derived
+ * class. It passes everything through but also allows the adapter to
+ * send its own control commands (honoring the one-command-at-a-time rule)
+ * and to intercept notifications which NciCore doesn't know about.
+ *
+ * It also carries the traffic of the logical connections opened by the
+ * adapter itself (NciCore only knows about the static RF connection).
+ */
+typedef struct nci_adapter_io {
+    NciHalIo* hal;          /* What NciCore talks to */
+    guint8 nci_version;     /* Snooped from CORE_RESET, zero if unknown */
+    guint32 nfcc_features;  /* Snooped from CORE_INIT_RSP */
+    guint max_routing_table_size;
+    NciCapture* capture;    /* Owned by NciAdapter */
+    NciClock* clock;        /* NULL for the system clock */
+} NciAdapterIo;
+
+typedef struct nci_adapter_io_callbacks {
+    /* CORE_RESET is going out, pending commands are about to fail */
+    void (*reset_started)(NciAdapterIo* io, void* user_data);
+    /* NFCC has been reset and initialized, all the state is gone */
+    void (*reset)(NciAdapterIo* io, void* user_data);
+    /* Returns TRUE if the notification has been consumed */
+    gboolean (*ntf)(NciAdapterIo* io, guint8 gid, guint8 oid,
+        const GUtilData* payload, void* user_data);
+    /* Allows to replace the payload of the command sent by NciCore */
+    GBytes* (*core_cmd)(NciAdapterIo* io, guint8 gid, guint8 oid,
+        const GUtilData* payload, void* user_data);
+    /* Complete data message received over the connection opened by us */
+    void (*data)(NciAdapterIo* io, guint8 cid, const GUtilData* data,
+        void* user_data);
+} NciAdapterIoCallbacks;
+
+typedef
+void
+(*NciAdapterIoRspFunc)(
+    NciAdapterIo* io,
+    const GUtilData* rsp, /* NULL on failure */
+    void* user_data);
+
+NciAdapterIo*
+nci_adapter_io_new(
+    NciHalIo* hal,
+    const NciAdapterIoCallbacks* cb,
+    void* user_data)
+    G_GNUC_INTERNAL;
+
+void
+nci_adapter_io_free(
+    NciAdapterIo* io)
+    G_GNUC_INTERNAL;
+
+/* Moves the pending command timeout (if any) to the new clock */
+void
+nci_adapter_io_set_clock(
+    NciAdapterIo* io,
+    NciClock* clock)
+    G_GNUC_INTERNAL;
+
+guint
+nci_adapter_io_send_cmd(
+    NciAdapterIo* io,
+    guint8 gid,
+    guint8 oid,
+    GBytes* payload,
+    NciAdapterIoRspFunc done,
+    void* user_data)
+    G_GNUC_INTERNAL;
+
+void
+nci_adapter_io_cancel(
+    NciAdapterIo* io,
+    guint id)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_adapter_io_conn_open(
+    NciAdapterIo* io,
+    guint8 cid,
+    guint max_payload,
+    guint credits)
+    G_GNUC_INTERNAL;
+
+void
+nci_adapter_io_conn_close(
+    NciAdapterIo* io,
+    guint8 cid)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_adapter_io_send_data(
+    NciAdapterIo* io,
+    guint8 cid,
+    GBytes* data)
+    G_GNUC_INTERNAL;
+
+/* Live object accounting, see nci_adapter_object_counts() */
+typedef enum nci_object_type {
+    NCI_OBJECT_TARGET,
+    NCI_OBJECT_INITIATOR,
+    NCI_OBJECT_INTF_BLOCK,
+    NCI_OBJECT_CONN,
+    NCI_OBJECT_TYPES
+} NCI_OBJECT_TYPE;
+
+extern gint nci_object_count[NCI_OBJECT_TYPES] G_GNUC_INTERNAL;
+
+#define NCI_OBJECT_CREATED(type) \
+    g_atomic_int_inc(nci_object_count + (type))
+#define NCI_OBJECT_DESTROYED(type) \
+    ((void) g_atomic_int_dec_and_test(nci_object_count + (type)))
+
+/* Adapter timeline, see nci_trace.h */
+typedef enum nci_trace_track {
+    NCI_TRACE_TRACK_RF,         /* NciCore state */
+    NCI_TRACE_TRACK_ADAPTER,    /* Adapter's own state machine */
+    NCI_TRACE_TRACK_TRANSMIT,
+    NCI_TRACE_TRACK_PRESENCE,
+    NCI_TRACE_TRACK_TIMERS,
+    NCI_TRACE_TRACKS
+} NCI_TRACE_TRACK;
+
+typedef enum nci_trace_phase {
+    NCI_TRACE_STATE,            /* Lasts until the next state */
+    NCI_TRACE_BEGIN,
+    NCI_TRACE_END,
+    NCI_TRACE_INSTANT
+} NCI_TRACE_PHASE;
+
+/* The name must be a static string */
+void
+nci_trace_add(
+    NciTrace* trace,
+    NCI_TRACE_TRACK track,
+    NCI_TRACE_PHASE phase,
+    const char* name,
+    int arg)
+    G_GNUC_INTERNAL;
+
+NciTrace*
+nci_adapter_trace(
+    NciAdapter* adapter)
+    G_GNUC_INTERNAL;
+
+/* NULL for the system clock, see nci_clock.h */
+NciClock*
+nci_adapter_clock(
+    NciAdapter* adapter)
+    G_GNUC_INTERNAL;
+
+void
+nci_trace_set_clock(
+    NciTrace* trace,
+    NciClock* clock)
+    G_GNUC_INTERNAL;
+
+/* Last max_events events, g_free() the result */
+char*
+nci_trace_json(
+    NciTrace* trace,
+    guint max_events)
+    G_GNUC_INTERNAL;
+
+void
+nci_adapter_latency_sample(
+    NciAdapter* adapter,
+    NCI_ADAPTER_LATENCY which,
+    gint64 us,
+    NCI_SLO_FLAGS flags)
+    G_GNUC_INTERNAL;
+
+/*
+ * Sources attached to the thread-default main context, so that each
+ * adapter can be driven by its own thread, see nci_clock.h for timers.
+ * The context owns the source, the pointer remains valid until it's
+ * removed with nci_source_clear() or its callback returns FALSE.
+ */
+GSource*
+nci_idle_add(
+    GSourceFunc fn,
+    gpointer data)
+    G_GNUC_INTERNAL;
+
+GSource*
+nci_io_watch_add(
+    GIOChannel* channel,
+    GIOCondition condition,
+    GIOFunc fn,
+    gpointer data)
+    G_GNUC_INTERNAL;
+
+/* Destroys the source and zeros the pointer, does nothing if it's NULL */
+void
+nci_source_clear(
+    GSource** source)
+    G_GNUC_INTERNAL;
+
+/* Negative send_us means that the response failed to go out */
+void
+nci_adapter_apdu_sample(
+    NciAdapter* adapter,
+    guint8 cla,
+    guint8 ins,
+    gint64 host_us,
+    gint64 send_us)
+    G_GNUC_INTERNAL;
+
+/* Statistics, see nci_stats.h */
+void
+nci_histogram_add(
+    NciHistogram* hist,
+    gint64 us)
+    G_GNUC_INTERNAL;
+
+void
+nci_latency_add(
+    NciLatency* latency,
+    gint64 us)
+    G_GNUC_INTERNAL;
+
+void
+nci_residency_add(
+    NciResidency* res,
+    gint64 us)
+    G_GNUC_INTERNAL;
+
+/* Listen mode routing table */
+typedef struct nci_routing NciRouting;
+
+NciRouting*
+nci_routing_new(
+    void)
+    G_GNUC_INTERNAL;
+
+void
+nci_routing_free(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+guint
+nci_routing_add(
+    NciRouting* routing,
+    const NciRoute* route)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_routing_remove(
+    NciRouting* routing,
+    guint id)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_routing_nfcee_used(
+    NciRouting* routing,
+    guint8 nfcee)
+    G_GNUC_INTERNAL;
+
+void
+nci_routing_reset(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+void
+nci_routing_set_limits(
+    NciRouting* routing,
+    guint max_size,
+    gboolean prefix_match)
+    G_GNUC_INTERNAL;
+
+const NciRoutingUsage*
+nci_routing_usage(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_routing_set_core_table(
+    NciRouting* routing,
+    const GUtilData* payload)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_routing_core_table_known(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+gboolean
+nci_routing_changed(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+GPtrArray*
+nci_routing_commit(
+    NciRouting* routing)
+    G_GNUC_INTERNAL;
+
+/*
+ * Whoever is on the other end of the static RF connection. NciAdapter
+ * keeps the pointer to the current one and hands it the incoming data.
+ */
+typedef struct nci_adapter_endpoint NciAdapterEndpoint;
+
+typedef struct nci_adapter_endpoint_functions {
+    void (*data_packet)(NciAdapterEndpoint* endpoint, const void* data,
+        guint len);
+} NciAdapterEndpointFunctions;
+
+struct nci_adapter_endpoint {
+    const NciAdapterEndpointFunctions* fn;
+};
+
 typedef
 void
 (*NciTargetPresenseCheckFunc)(
@@ -59,6 +426,16 @@ nci_initiator_new(
     const NciIntfActivationNtf* ntf)
     G_GNUC_INTERNAL;
 
+NciAdapterEndpoint*
+nci_target_endpoint(
+    NfcTarget* target)
+    G_GNUC_INTERNAL;
+
+NciAdapterEndpoint*
+nci_initiator_endpoint(
+    NfcInitiator* initiator)
+    G_GNUC_INTERNAL;
+
 guint
 nci_target_presence_check(
     NfcTarget* target,
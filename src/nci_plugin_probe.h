@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NCI_PLUGIN_PROBE_H
+#define NCI_PLUGIN_PROBE_H
+
+/*
+ * USDT probes for perf, bpftrace and friends. Built in with
+ * "make USDT=1" (requires sys/sdt.h), compiled out otherwise.
+ * An unattached probe is a single nop instruction.
+ *
+ * List them with:
+ *
+ *   bpftrace -l 'usdt:/path/to/libnciplugin.so:nciplugin:*'
+ */
+
+#ifdef NCI_PLUGIN_USDT
+
+#include <sys/sdt.h>
+
+#define NCI_PROBE0(name) \
+    DTRACE_PROBE(nciplugin, name)
+#define NCI_PROBE1(name,a1) \
+    DTRACE_PROBE1(nciplugin, name, a1)
+#define NCI_PROBE2(name,a1,a2) \
+    DTRACE_PROBE2(nciplugin, name, a1, a2)
+#define NCI_PROBE3(name,a1,a2,a3) \
+    DTRACE_PROBE3(nciplugin, name, a1, a2, a3)
+#define NCI_PROBE4(name,a1,a2,a3,a4) \
+    DTRACE_PROBE4(nciplugin, name, a1, a2, a3, a4)
+
+#else
+
+#define NCI_PROBE0(name) ((void)0)
+#define NCI_PROBE1(name,a1) ((void)0)
+#define NCI_PROBE2(name,a1,a2) ((void)0)
+#define NCI_PROBE3(name,a1,a2,a3) ((void)0)
+#define NCI_PROBE4(name,a1,a2,a3,a4) ((void)0)
+
+#endif /* NCI_PLUGIN_USDT */
+
+#endif /* NCI_PLUGIN_PROBE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
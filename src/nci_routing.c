@@ -0,0 +1,806 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#include <gutil_misc.h>
+
+/*
+ * RF_SET_LISTEN_MODE_ROUTING_CMD always replaces the whole table, so
+ * the closest thing to an incremental update is not sending anything
+ * unless the encoded table has actually changed. The table is split
+ * into several commands (with More flag set) if it doesn't fit into
+ * a single control packet.
+ *
+ * Our technology and protocol entries go first, followed by AIDs and
+ * whatever NciCore wanted to have in the table (unless it's overridden
+ * by one of our entries).
+ *
+ * AID entries are sorted and de-duplicated, so that the encoded table
+ * doesn't depend on the order in which the routes were added. If the
+ * table doesn't fit into the NFCC, AIDs routed to the same place are
+ * merged into prefix entries (NCI 2.0 only). AIDs which still don't
+ * fit are dropped, the most recently added ones first.
+ */
+
+#define ROUTING_HDR_SIZE (2) /* More, Number of Routing Entries */
+#define ROUTING_CHUNK_SIZE (NCI_MAX_CTRL_PAYLOAD - ROUTING_HDR_SIZE)
+#define ROUTING_MORE (0x01)
+#define ROUTING_LAST (0x00)
+
+#define ROUTING_TLV_HDR_SIZE (2) /* Type, Length */
+#define ROUTING_VALUE_HDR_SIZE (2) /* Route, Power State */
+#define ROUTING_TYPE_MASK (0x0f)
+#define ROUTING_TYPE_AID_PREFIX (0x10)
+#define ROUTING_MAX_AID_LEN (16)
+#define ROUTING_MIN_AID_PREFIX (5) /* RID */
+
+typedef struct nci_routing_entry {
+    guint id;
+    NciRoute route;
+    guint8 aid[ROUTING_MAX_AID_LEN];
+} NciRoutingEntry;
+
+/* AID entry as it goes to the table */
+typedef struct nci_routing_aid {
+    guint id;               /* The most recent of the merged routes */
+    guint8 nfcee;
+    guint8 power;
+    guint8 prefix;
+    guint8 len;
+    guint8 aid[ROUTING_MAX_AID_LEN];
+} NciRoutingAid;
+
+struct nci_routing {
+    GPtrArray* entries;     /* NciRoutingEntry, in order of addition */
+    GBytes* core_table;     /* TLVs from the last NciCore's command */
+    GBytes* committed;      /* What the NFCC currently has */
+    NciRoutingUsage usage;  /* Of the committed table */
+    gboolean prefix_match;
+    guint last_id;
+};
+
+static
+void
+nci_routing_entry_free(
+    gpointer data)
+{
+    g_slice_free(NciRoutingEntry, data);
+}
+
+static
+guint
+nci_routing_entry_size(
+    const NciRoute* route)
+{
+    return ROUTING_TLV_HDR_SIZE + ROUTING_VALUE_HDR_SIZE +
+        ((route->type == NCI_ROUTE_AID) ? route->value.aid.size : 1);
+}
+
+static
+void
+nci_routing_entry_encode(
+    GByteArray* buf,
+    const NciRoute* route)
+{
+    guint8 hdr[ROUTING_TLV_HDR_SIZE + ROUTING_VALUE_HDR_SIZE + 1];
+
+    hdr[0] = (guint8) route->type;
+    hdr[1] = (guint8) (nci_routing_entry_size(route) - ROUTING_TLV_HDR_SIZE);
+    hdr[2] = route->nfcee;
+    hdr[3] = (guint8) route->power;
+    switch (route->type) {
+    case NCI_ROUTE_TECHNOLOGY:
+        hdr[4] = (guint8) route->value.tech;
+        break;
+    case NCI_ROUTE_PROTOCOL:
+        hdr[4] = (guint8) route->value.protocol;
+        break;
+    case NCI_ROUTE_AID:
+        /* Those are encoded by nci_routing_aid_encode() */
+        return;
+    }
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+}
+
+static
+guint
+nci_routing_aid_size(
+    const NciRoutingAid* aid)
+{
+    return ROUTING_TLV_HDR_SIZE + ROUTING_VALUE_HDR_SIZE + aid->len;
+}
+
+static
+void
+nci_routing_aid_encode(
+    GByteArray* buf,
+    const NciRoutingAid* aid)
+{
+    guint8 hdr[ROUTING_TLV_HDR_SIZE + ROUTING_VALUE_HDR_SIZE];
+
+    hdr[0] = NCI_ROUTE_AID | (aid->prefix ? ROUTING_TYPE_AID_PREFIX : 0);
+    hdr[1] = ROUTING_VALUE_HDR_SIZE + aid->len;
+    hdr[2] = aid->nfcee;
+    hdr[3] = aid->power;
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+    g_byte_array_append(buf, aid->aid, aid->len);
+}
+
+static
+gboolean
+nci_routing_aid_same_route(
+    const NciRoutingAid* a1,
+    const NciRoutingAid* a2)
+{
+    return a1->nfcee == a2->nfcee && a1->power == a2->power;
+}
+
+static
+gboolean
+nci_routing_aid_same_value(
+    const NciRoutingAid* a1,
+    const NciRoutingAid* a2)
+{
+    return a1->prefix == a2->prefix && a1->len == a2->len &&
+        !memcmp(a1->aid, a2->aid, a1->len);
+}
+
+/* TRUE if the prefix entry p matches everything that a matches */
+static
+gboolean
+nci_routing_aid_covers(
+    const NciRoutingAid* p,
+    const NciRoutingAid* a)
+{
+    return p->prefix && p->len <= a->len && !memcmp(p->aid, a->aid, p->len);
+}
+
+static
+gint
+nci_routing_aid_compare(
+    gconstpointer p1,
+    gconstpointer p2)
+{
+    const NciRoutingAid* a1 = p1;
+    const NciRoutingAid* a2 = p2;
+    const int diff = memcmp(a1->aid, a2->aid, MIN(a1->len, a2->len));
+
+    if (diff) {
+        return diff;
+    } else if (a1->len != a2->len) {
+        return (gint) a1->len - (gint) a2->len;
+    } else if (a1->prefix != a2->prefix) {
+        return (gint) a1->prefix - (gint) a2->prefix;
+    } else if (a1->nfcee != a2->nfcee) {
+        return (gint) a1->nfcee - (gint) a2->nfcee;
+    } else {
+        return (gint) a1->power - (gint) a2->power;
+    }
+}
+
+/* TRUE if the prefix doesn't cover anything routed elsewhere */
+static
+gboolean
+nci_routing_aid_prefix_ok(
+    GArray* aids,
+    const NciRoutingAid* p)
+{
+    guint i;
+
+    for (i = 0; i < aids->len; i++) {
+        const NciRoutingAid* a = &g_array_index(aids, NciRoutingAid, i);
+
+        if (!nci_routing_aid_same_route(a, p) &&
+            (nci_routing_aid_covers(p, a) || nci_routing_aid_covers(a, p))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Removes entries made redundant by the prefix entries */
+static
+void
+nci_routing_aid_compact(
+    GArray* aids)
+{
+    guint i = 0;
+
+    g_array_sort(aids, nci_routing_aid_compare);
+    while (i < aids->len) {
+        NciRoutingAid* a = &g_array_index(aids, NciRoutingAid, i);
+        guint j;
+
+        for (j = 0; j < aids->len; j++) {
+            NciRoutingAid* p = &g_array_index(aids, NciRoutingAid, j);
+
+            if (j != i && nci_routing_aid_same_route(a, p) &&
+                nci_routing_aid_covers(p, a) &&
+                (!nci_routing_aid_same_value(a, p) || j < i) &&
+                nci_routing_aid_prefix_ok(aids, p)) {
+                p->id = MAX(p->id, a->id);
+                break;
+            }
+        }
+        if (j < aids->len) {
+            g_array_remove_index(aids, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Collects sorted AID entries, the last added wins in case of conflict */
+static
+GArray*
+nci_routing_aid_collect(
+    NciRouting* self)
+{
+    GArray* aids = g_array_new(FALSE, FALSE, sizeof(NciRoutingAid));
+    guint i;
+
+    for (i = 0; i < self->entries->len; i++) {
+        const NciRoutingEntry* entry = self->entries->pdata[i];
+        const NciRoute* route = &entry->route;
+
+        if (route->type == NCI_ROUTE_AID) {
+            NciRoutingAid aid;
+            guint j;
+
+            memset(&aid, 0, sizeof(aid));
+            aid.id = entry->id;
+            aid.nfcee = route->nfcee;
+            aid.power = (guint8) route->power;
+            aid.prefix = (self->prefix_match &&
+                (route->flags & NCI_ROUTE_FLAG_AID_PREFIX)) ? 1 : 0;
+            aid.len = (guint8) route->value.aid.size;
+            memcpy(aid.aid, route->value.aid.bytes, aid.len);
+
+            for (j = 0; j < aids->len; j++) {
+                NciRoutingAid* prev = &g_array_index(aids, NciRoutingAid, j);
+
+                if (nci_routing_aid_same_value(prev, &aid)) {
+                    /* Entries are sorted by id, this one is newer */
+                    *prev = aid;
+                    break;
+                }
+            }
+            if (j == aids->len) {
+                g_array_append_val(aids, aid);
+            }
+        }
+    }
+    nci_routing_aid_compact(aids);
+    return aids;
+}
+
+static
+guint
+nci_routing_aid_total_size(
+    GArray* aids)
+{
+    guint i, size = 0;
+
+    for (i = 0; i < aids->len; i++) {
+        size += nci_routing_aid_size(&g_array_index(aids, NciRoutingAid, i));
+    }
+    return size;
+}
+
+/* Merges two neighbours with the longest common prefix */
+static
+gboolean
+nci_routing_aid_merge(
+    GArray* aids)
+{
+    NciRoutingAid best;
+    guint i;
+
+    best.len = 0;
+    for (i = 0; i + 1 < aids->len; i++) {
+        const NciRoutingAid* a1 = &g_array_index(aids, NciRoutingAid, i);
+        const NciRoutingAid* a2 = &g_array_index(aids, NciRoutingAid, i + 1);
+
+        if (nci_routing_aid_same_route(a1, a2)) {
+            const guint max = MIN(a1->len, a2->len);
+            guint len = 0;
+
+            while (len < max && a1->aid[len] == a2->aid[len]) {
+                len++;
+            }
+            if (len >= ROUTING_MIN_AID_PREFIX && len > best.len) {
+                NciRoutingAid p = *a1;
+
+                p.id = MAX(a1->id, a2->id);
+                p.prefix = 1;
+                p.len = (guint8) len;
+                if (nci_routing_aid_prefix_ok(aids, &p)) {
+                    best = p;
+                }
+            }
+        }
+    }
+
+    if (best.len) {
+        g_array_append_val(aids, best);
+        nci_routing_aid_compact(aids);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+void
+nci_routing_aid_drop_newest(
+    GArray* aids)
+{
+    guint i, newest = 0;
+
+    for (i = 1; i < aids->len; i++) {
+        if (g_array_index(aids, NciRoutingAid, i).id >
+            g_array_index(aids, NciRoutingAid, newest).id) {
+            newest = i;
+        }
+    }
+    g_array_remove_index(aids, newest);
+}
+
+/* Counts AID routes which didn't make it to the table */
+static
+guint
+nci_routing_aid_dropped(
+    NciRouting* self,
+    GArray* aids)
+{
+    guint i, dropped = 0;
+
+    for (i = 0; i < self->entries->len; i++) {
+        const NciRoutingEntry* entry = self->entries->pdata[i];
+        const NciRoute* route = &entry->route;
+
+        if (route->type == NCI_ROUTE_AID) {
+            guint j;
+
+            for (j = 0; j < aids->len; j++) {
+                const NciRoutingAid* a = &g_array_index(aids,
+                    NciRoutingAid, j);
+
+                if (a->nfcee == route->nfcee &&
+                    a->power == (guint8) route->power &&
+                    a->len <= route->value.aid.size &&
+                    !memcmp(a->aid, route->value.aid.bytes, a->len) &&
+                    (a->prefix || a->len == route->value.aid.size)) {
+                    break;
+                }
+            }
+            if (j == aids->len) {
+                dropped++;
+            }
+        }
+    }
+    return dropped;
+}
+
+static
+gboolean
+nci_routing_overrides(
+    NciRouting* self,
+    const guint8* tlv)
+{
+    const guint8 type = tlv[0] & ROUTING_TYPE_MASK;
+    const guint8 len = tlv[1];
+    guint i;
+
+    /* Value is Route(1), Power State(1) followed by tech/protocol/AID */
+    if (len < ROUTING_VALUE_HDR_SIZE) {
+        return FALSE;
+    }
+    for (i = 0; i < self->entries->len; i++) {
+        const NciRoutingEntry* entry = self->entries->pdata[i];
+        const NciRoute* route = &entry->route;
+
+        if ((guint8) route->type == type) {
+            const guint8* value = tlv + ROUTING_TLV_HDR_SIZE +
+                ROUTING_VALUE_HDR_SIZE;
+            const guint value_len = len - ROUTING_VALUE_HDR_SIZE;
+
+            switch (route->type) {
+            case NCI_ROUTE_TECHNOLOGY:
+                if (value_len == 1 && value[0] == route->value.tech) {
+                    return TRUE;
+                }
+                break;
+            case NCI_ROUTE_PROTOCOL:
+                if (value_len == 1 && value[0] == route->value.protocol) {
+                    return TRUE;
+                }
+                break;
+            case NCI_ROUTE_AID:
+                if (value_len == route->value.aid.size &&
+                    !memcmp(value, route->value.aid.bytes, value_len)) {
+                    return TRUE;
+                }
+                break;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/* Returns the number of entries, fills in their sizes */
+static
+guint
+nci_routing_encode(
+    NciRouting* self,
+    GByteArray* buf,
+    GArray* sizes,
+    NciRoutingUsage* usage)
+{
+    const guint8* core = NULL;
+    const guint8* core_end = NULL;
+    const guint8* ptr;
+    GArray* aids = nci_routing_aid_collect(self);
+    guint i, size, fixed = 0, count = 0;
+
+    memset(usage, 0, sizeof(*usage));
+    usage->max_size = self->usage.max_size;
+
+    /* Technology and protocol entries */
+    for (i = 0; i < self->entries->len; i++) {
+        const NciRoutingEntry* entry = self->entries->pdata[i];
+
+        if (entry->route.type == NCI_ROUTE_AID) {
+            usage->aids++;
+        } else {
+            size = nci_routing_entry_size(&entry->route);
+            nci_routing_entry_encode(buf, &entry->route);
+            g_array_append_val(sizes, size);
+            fixed += size;
+            count++;
+        }
+    }
+
+    /* NciCore entries which haven't been overridden */
+    if (self->core_table) {
+        gsize len;
+
+        core = g_bytes_get_data(self->core_table, &len);
+        core_end = core + len;
+        for (ptr = core; ptr + ROUTING_TLV_HDR_SIZE <= core_end &&
+             ptr + ROUTING_TLV_HDR_SIZE + ptr[1] <= core_end;
+             ptr += ROUTING_TLV_HDR_SIZE + ptr[1]) {
+            if (!nci_routing_overrides(self, ptr)) {
+                fixed += ROUTING_TLV_HDR_SIZE + ptr[1];
+            }
+        }
+    }
+
+    /* Make AIDs fit into whatever space is left */
+    if (usage->max_size) {
+        const guint avail = (usage->max_size > fixed) ?
+            (usage->max_size - fixed) : 0;
+
+        while (nci_routing_aid_total_size(aids) > avail) {
+            if (!self->prefix_match || !nci_routing_aid_merge(aids)) {
+                nci_routing_aid_drop_newest(aids);
+            }
+        }
+    }
+
+    for (i = 0; i < aids->len; i++) {
+        const NciRoutingAid* aid = &g_array_index(aids, NciRoutingAid, i);
+
+        size = nci_routing_aid_size(aid);
+        nci_routing_aid_encode(buf, aid);
+        g_array_append_val(sizes, size);
+        count++;
+    }
+
+    if (core) {
+        for (ptr = core; ptr + ROUTING_TLV_HDR_SIZE <= core_end &&
+             ptr + ROUTING_TLV_HDR_SIZE + ptr[1] <= core_end;
+             ptr += size) {
+            size = ROUTING_TLV_HDR_SIZE + ptr[1];
+            if (!nci_routing_overrides(self, ptr)) {
+                g_byte_array_append(buf, ptr, size);
+                g_array_append_val(sizes, size);
+                count++;
+            }
+        }
+    }
+
+    usage->size = buf->len;
+    usage->entries = count;
+    usage->aid_entries = aids->len;
+    usage->dropped = nci_routing_aid_dropped(self, aids);
+    g_array_free(aids, TRUE);
+    return count;
+}
+
+/*==========================================================================*
+ * Internal API
+ *==========================================================================*/
+
+NciRouting*
+nci_routing_new(
+    void)
+{
+    NciRouting* self = g_slice_new0(NciRouting);
+
+    self->entries = g_ptr_array_new_with_free_func(nci_routing_entry_free);
+    return self;
+}
+
+void
+nci_routing_free(
+    NciRouting* self)
+{
+    if (self) {
+        g_ptr_array_free(self->entries, TRUE);
+        if (self->core_table) {
+            g_bytes_unref(self->core_table);
+        }
+        if (self->committed) {
+            g_bytes_unref(self->committed);
+        }
+        g_slice_free(NciRouting, self);
+    }
+}
+
+guint
+nci_routing_add(
+    NciRouting* self,
+    const NciRoute* route)
+{
+    if (G_LIKELY(self) && G_LIKELY(route)) {
+        NciRoutingEntry* entry;
+
+        switch (route->type) {
+        case NCI_ROUTE_TECHNOLOGY:
+        case NCI_ROUTE_PROTOCOL:
+            break;
+        case NCI_ROUTE_AID:
+            if (route->value.aid.size <= ROUTING_MAX_AID_LEN) {
+                break;
+            }
+            /* fallthrough */
+        default:
+            GWARN("Invalid route");
+            return 0;
+        }
+
+        entry = g_slice_new(NciRoutingEntry);
+        entry->route = *route;
+        if (route->type == NCI_ROUTE_AID) {
+            entry->route.value.aid.bytes = entry->aid;
+            memcpy(entry->aid, route->value.aid.bytes, route->value.aid.size);
+        }
+        if (!(entry->id = ++(self->last_id))) {
+            entry->id = ++(self->last_id);
+        }
+        g_ptr_array_add(self->entries, entry);
+        return entry->id;
+    }
+    return 0;
+}
+
+gboolean
+nci_routing_remove(
+    NciRouting* self,
+    guint id)
+{
+    if (G_LIKELY(self) && G_LIKELY(id)) {
+        guint i;
+
+        for (i = 0; i < self->entries->len; i++) {
+            const NciRoutingEntry* entry = self->entries->pdata[i];
+
+            if (entry->id == id) {
+                g_ptr_array_remove_index(self->entries, i);
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+gboolean
+nci_routing_nfcee_used(
+    NciRouting* self,
+    guint8 nfcee)
+{
+    guint i;
+
+    for (i = 0; i < self->entries->len; i++) {
+        const NciRoutingEntry* entry = self->entries->pdata[i];
+
+        if (entry->route.nfcee == nfcee) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void
+nci_routing_reset(
+    NciRouting* self)
+{
+    const guint max_size = self->usage.max_size;
+
+    /* NFCC has forgotten everything */
+    memset(&self->usage, 0, sizeof(self->usage));
+    self->usage.max_size = max_size;
+    if (self->committed) {
+        g_bytes_unref(self->committed);
+        self->committed = NULL;
+    }
+    if (self->core_table) {
+        g_bytes_unref(self->core_table);
+        self->core_table = NULL;
+    }
+}
+
+void
+nci_routing_set_limits(
+    NciRouting* self,
+    guint max_size,
+    gboolean prefix_match)
+{
+    self->usage.max_size = max_size;
+    self->prefix_match = prefix_match;
+}
+
+const NciRoutingUsage*
+nci_routing_usage(
+    NciRouting* self)
+{
+    return &self->usage;
+}
+
+gboolean
+nci_routing_set_core_table(
+    NciRouting* self,
+    const GUtilData* payload)
+{
+    if (payload->size >= ROUTING_HDR_SIZE &&
+        payload->bytes[0] == ROUTING_LAST) {
+        if (self->core_table) {
+            g_bytes_unref(self->core_table);
+        }
+        self->core_table = g_bytes_new(payload->bytes + ROUTING_HDR_SIZE,
+            payload->size - ROUTING_HDR_SIZE);
+        return TRUE;
+    }
+    GDEBUG("Leaving multi-part routing table alone");
+    return FALSE;
+}
+
+gboolean
+nci_routing_core_table_known(
+    NciRouting* self)
+{
+    return self->core_table != NULL;
+}
+
+gboolean
+nci_routing_changed(
+    NciRouting* self)
+{
+    GByteArray* buf = g_byte_array_new();
+    GArray* sizes = g_array_new(FALSE, FALSE, sizeof(guint));
+    NciRoutingUsage usage;
+    gboolean changed;
+
+    nci_routing_encode(self, buf, sizes, &usage);
+    if (self->committed) {
+        gsize len;
+        const void* data = g_bytes_get_data(self->committed, &len);
+
+        changed = (len != buf->len || memcmp(data, buf->data, len));
+    } else {
+        changed = (buf->len > 0);
+    }
+    g_array_free(sizes, TRUE);
+    g_byte_array_unref(buf);
+    return changed;
+}
+
+/* Returns payloads of RF_SET_LISTEN_MODE_ROUTING_CMD, at least one */
+GPtrArray*
+nci_routing_commit(
+    NciRouting* self)
+{
+    GPtrArray* cmds = g_ptr_array_new_with_free_func((GDestroyNotify)
+        g_bytes_unref);
+    GByteArray* buf = g_byte_array_new();
+    GArray* sizes = g_array_new(FALSE, FALSE, sizeof(guint));
+    NciRoutingUsage usage;
+    const guint count = nci_routing_encode(self, buf, sizes, &usage);
+    const guint8* ptr = buf->data;
+    guint i = 0;
+
+    do {
+        GByteArray* cmd = g_byte_array_sized_new(NCI_MAX_CTRL_PAYLOAD);
+        guint8 hdr[ROUTING_HDR_SIZE];
+        guint n = 0, size = 0;
+
+        /* Each command carries as many whole entries as fits */
+        while (i + n < count && size + g_array_index(sizes, guint, i + n)
+            <= ROUTING_CHUNK_SIZE) {
+            size += g_array_index(sizes, guint, i + n);
+            n++;
+        }
+        if (!n && i < count) {
+            /* Can't really happen, every entry fits into a packet */
+            GWARN("Routing entry is too large");
+            break;
+        }
+        i += n;
+        hdr[0] = (i < count) ? ROUTING_MORE : ROUTING_LAST;
+        hdr[1] = (guint8) n;
+        g_byte_array_append(cmd, hdr, sizeof(hdr));
+        g_byte_array_append(cmd, ptr, size);
+        ptr += size;
+        g_ptr_array_add(cmds, g_byte_array_free_to_bytes(cmd));
+    } while (i < count);
+
+    if (usage.dropped) {
+        GWARN("%u AID route(s) didn't fit into the routing table",
+            usage.dropped);
+    }
+    GDEBUG("Routing table %u/%u bytes, %u entries (%u AIDs in %u)",
+        usage.size, usage.max_size, usage.entries, usage.aids,
+        usage.aid_entries);
+    self->usage = usage;
+    if (self->committed) {
+        g_bytes_unref(self->committed);
+    }
+    self->committed = g_byte_array_free_to_bytes(buf);
+    g_array_free(sizes, TRUE);
+    return cmds;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_stats.h"
+#include "nci_plugin_p.h"
+
+/*==========================================================================*
+ * Internal API
+ *==========================================================================*/
+
+void
+nci_histogram_add(
+    NciHistogram* hist,
+    gint64 us)
+{
+    guint i;
+
+    if (us < 0) {
+        us = 0;
+    }
+
+    /* Upper bounds are inclusive, like Prometheus "le" */
+    for (i = 0; i < NCI_HISTOGRAM_BUCKETS - 1; i++) {
+        if ((guint64) us <= nci_histogram_bucket_limit(NULL, i)) {
+            break;
+        }
+    }
+    hist->buckets[i]++;
+    hist->count++;
+    hist->sum_us += us;
+    if (hist->max_us < (guint64) us) {
+        hist->max_us = us;
+    }
+}
+
+void
+nci_latency_add(
+    NciLatency* latency,
+    gint64 us)
+{
+    latency->last_us = MAX(us, 0);
+    nci_histogram_add(&latency->hist, us);
+}
+
+void
+nci_residency_add(
+    NciResidency* res,
+    gint64 us)
+{
+    res->total_us += MAX(us, 0);
+    res->visits++;
+    nci_histogram_add(&res->hist, us);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+guint64
+nci_histogram_bucket_limit(
+    const NciHistogram* hist,
+    guint bucket)
+{
+    if (bucket < NCI_HISTOGRAM_BUCKETS - 1) {
+        return (G_GUINT64_CONSTANT(1000) << bucket);
+    } else {
+        return hist ? hist->max_us : 0;
+    }
+}
+
+guint64
+nci_histogram_percentile(
+    const NciHistogram* hist,
+    guint percent)
+{
+    if (G_LIKELY(hist) && hist->count) {
+        const guint64 rank = (hist->count * MIN(percent, 100) + 99) / 100;
+        guint64 seen = 0;
+        guint i;
+
+        for (i = 0; i < NCI_HISTOGRAM_BUCKETS; i++) {
+            seen += hist->buckets[i];
+            if (seen >= MAX(rank, 1)) {
+                return MIN(nci_histogram_bucket_limit(hist, i), hist->max_us);
+            }
+        }
+        return hist->max_us;
+    }
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
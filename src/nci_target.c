@@ -39,12 +39,16 @@
 
 #include "nci_plugin_p.h"
 #include "nci_plugin_log.h"
+#include "nci_plugin_probe.h"
 #include "nci_adapter_impl.h"
+#include "nci_clock.h"
 
 #include <nci_core.h>
 
 #include <nfc_target_impl.h>
 
+#include <gutil_macros.h>
+
 #define T2T_CMD_READ (0x30)
 
 /*
@@ -57,17 +61,13 @@
  */
 #define ISO_DEP_TRANSMIT_TIMEOUT_MS (2500)
 
-enum {
-    EVENT_DATA_PACKET,
-    EVENT_COUNT
-};
-
 typedef NfcTargetClass NciTargetClass;
 typedef struct nci_target NciTarget;
 
 typedef struct nci_target_presence_check {
     NciTargetPresenseCheckFunc done;
     void* user_data;
+    gboolean embedded;
 } NciTargetPresenceCheck;
 
 typedef
@@ -85,19 +85,22 @@ gboolean
 
 struct nci_target {
     NfcTarget target;
-    NciAdapter* adapter;
-    gulong event_id[EVENT_COUNT];
+    NciAdapter* adapter; /* Cleared when the target is gone */
+    NciAdapterEndpoint endpoint;
     guint send_in_progress;
     gboolean transmit_in_progress;
+    gint64 transmit_start;
     GBytes* pending_reply; /* Reply arrived before send has completed */
     NciTargetPresenceCheckFunc presence_check_fn;
     NciTargetTransmitFinishFunc transmit_finish_fn;
+    NciTargetPresenceCheck presence_check; /* Unless it's busy */
 };
 
 GType nci_target_get_type(void) G_GNUC_INTERNAL;
 #define PARENT_CLASS nci_target_parent_class
 #define THIS_TYPE (nci_target_get_type())
 #define THIS(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), THIS_TYPE, NciTarget))
+#define IS_THIS(obj) G_TYPE_CHECK_INSTANCE_TYPE((obj), THIS_TYPE)
 G_DEFINE_TYPE(NciTarget, nci_target, NFC_TYPE_TARGET)
 
 static
@@ -114,12 +117,19 @@ nci_target_new_with_technology(
 static
 NciTargetPresenceCheck*
 nci_target_presence_check_new(
+    NciTarget* self,
     NciTargetPresenseCheckFunc fn,
     void* user_data)
 {
-    NciTargetPresenceCheck* check =
-        g_slice_new(NciTargetPresenceCheck);
+    NciTargetPresenceCheck* check = &self->presence_check;
 
+    /* Normally there's only one presence check at a time */
+    if (check->done) {
+        check = g_slice_new(NciTargetPresenceCheck);
+        check->embedded = FALSE;
+    } else {
+        check->embedded = TRUE;
+    }
     check->done = fn;
     check->user_data = user_data;
     return check;
@@ -130,7 +140,12 @@ void
 nci_target_presence_check_free(
     NciTargetPresenceCheck* check)
 {
-    g_slice_free(NciTargetPresenceCheck, check);
+    if (check->embedded) {
+        check->done = NULL;
+        check->user_data = NULL;
+    } else {
+        g_slice_free(NciTargetPresenceCheck, check);
+    }
 }
 
 static
@@ -164,12 +179,7 @@ nci_target_drop_adapter(
     NciTarget* self)
 {
     if (self->adapter) {
-        NciAdapter* adapter = self->adapter;
-
         nci_target_cancel_send(self);
-        nci_core_remove_all_handlers(adapter->nci, self->event_id);
-        g_object_remove_weak_pointer(G_OBJECT(adapter), (gpointer*)
-            &self->adapter);
         self->adapter = NULL;
     }
 }
@@ -179,11 +189,24 @@ void
 nci_target_finish_transmit(
     NciTarget* self,
     const guint8* payload,
-    guint len)
+    guint len,
+    NCI_SLO_FLAGS flags)
 {
     NfcTarget* target = &self->target;
+    NciAdapter* adapter = self->adapter;
 
     self->transmit_in_progress = FALSE;
+    if (adapter) {
+        NciTrace* trace = nci_adapter_trace(adapter);
+
+        if (trace) {
+            nci_trace_add(trace, NCI_TRACE_TRACK_TRANSMIT, NCI_TRACE_END,
+                "transmit", len);
+        }
+        nci_adapter_latency_sample(adapter, NCI_ADAPTER_LATENCY_TRANSMIT,
+            nci_clock_now(nci_adapter_clock(adapter)) - self->transmit_start,
+            flags);
+    }
     if (!self->transmit_finish_fn ||
         !self->transmit_finish_fn(target, payload, len)) {
         nfc_target_transmit_done(target, NFC_TRANSMIT_STATUS_ERROR, NULL, 0);
@@ -198,8 +221,14 @@ nci_target_data_sent(
     void* user_data)
 {
     NciTarget* self = THIS(user_data);
+    NciTrace* trace = self->adapter ? nci_adapter_trace(self->adapter) : NULL;
 
     GASSERT(self->send_in_progress);
+    NCI_PROBE2(data_sent, success, self->pending_reply != NULL);
+    if (trace) {
+        nci_trace_add(trace, NCI_TRACE_TRACK_TRANSMIT, NCI_TRACE_INSTANT,
+            "sent", success);
+    }
     self->send_in_progress = 0;
 
     if (self->pending_reply) {
@@ -210,24 +239,24 @@ nci_target_data_sent(
         /* We have been waiting for this send to complete */
         GDEBUG("Send completed");
         self->pending_reply = NULL;
-        nci_target_finish_transmit(self, payload, len);
+        nci_target_finish_transmit(self, payload, len,
+            NCI_SLO_FLAG_EARLY_REPLY);
         g_bytes_unref(reply);
     }
 }
 
 static
 void
-nci_target_data_packet_handler(
-    NciCore* nci,
-    guint8 cid,
+nci_target_data_packet(
+    NciAdapterEndpoint* endpoint,
     const void* data,
-    guint len,
-    void* user_data)
+    guint len)
 {
-    NciTarget* self = THIS(user_data);
+    NciTarget* self = G_CAST(endpoint, NciTarget, endpoint);
 
-    if (cid == NCI_STATIC_RF_CONN_ID && self->transmit_in_progress &&
-        !self->pending_reply) {
+    NCI_PROBE3(data_packet, len, self->transmit_in_progress,
+        self->send_in_progress != 0);
+    if (self->transmit_in_progress && !self->pending_reply) {
         if (G_UNLIKELY(self->send_in_progress)) {
             /*
              * Due to multi-threaded nature of pn547 driver and services,
@@ -238,10 +267,11 @@ nci_target_data_packet_handler(
             GDEBUG("Waiting for send to complete");
             self->pending_reply = g_bytes_new(data, len);
         } else {
-            nci_target_finish_transmit(self, data, len);
+            nci_target_finish_transmit(self, data, len,
+                NCI_SLO_FLAGS_NONE);
         }
     } else {
-        GDEBUG("Unhandled data packet, cid=0x%02x %u byte(s)", cid, len);
+        GDEBUG("Unhandled data packet, %u byte(s)", len);
     }
 }
 
@@ -436,7 +466,9 @@ nci_target_new(
             }
             break;
         case NCI_PROTOCOL_NFC_DEP:
-            protocol = NFC_PROTOCOL_NFC_DEP;
+            if (NCI_PLUGIN_PEER) {
+                protocol = NFC_PROTOCOL_NFC_DEP;
+            }
             break;
         default:
             GDEBUG("Unsupported protocol 0x%02x", ntf->protocol);
@@ -483,11 +515,6 @@ nci_target_new(
                 self->presence_check_fn = presence_check;
                 self->transmit_finish_fn = transmit_finish;
                 nfc_target_set_transmit_timeout(target, tx_timeout);
-                g_object_add_weak_pointer(G_OBJECT(adapter),
-                    (gpointer*) &self->adapter);
-                self->event_id[EVENT_DATA_PACKET] =
-                    nci_core_add_data_packet_handler(adapter->nci,
-                        nci_target_data_packet_handler, self);
                 return target;
             }
         }
@@ -495,18 +522,26 @@ nci_target_new(
     return NULL;
 }
 
+NciAdapterEndpoint*
+nci_target_endpoint(
+    NfcTarget* target)
+{
+    /* Derived adapters may create their own objects */
+    return IS_THIS(target) ? &THIS(target)->endpoint : NULL;
+}
+
 guint
 nci_target_presence_check(
     NfcTarget* target,
     NciTargetPresenseCheckFunc fn,
     void* user_data)
 {
-    if (G_LIKELY(target)) {
+    if (IS_THIS(target)) {
         NciTarget* self = THIS(target);
 
-        if (self && self->presence_check_fn) {
+        if (self->presence_check_fn) {
             NciTargetPresenceCheck* check =
-                nci_target_presence_check_new(fn, user_data);
+                nci_target_presence_check_new(self, fn, user_data);
             const guint id = self->presence_check_fn(self, check);
 
             if (id) {
@@ -534,15 +569,22 @@ nci_target_transmit(
 
     GASSERT(!self->send_in_progress);
     GASSERT(!self->transmit_in_progress);
+    NCI_PROBE1(transmit, len);
     if (adapter) {
+        NciTrace* trace = nci_adapter_trace(adapter);
         GBytes* bytes = g_bytes_new(data, len);
 
+        self->transmit_start = nci_clock_now(nci_adapter_clock(adapter));
         self->send_in_progress = nci_core_send_data_msg(adapter->nci,
             NCI_STATIC_RF_CONN_ID, bytes, nci_target_data_sent,
             NULL, self);
         g_bytes_unref(bytes);
         if (self->send_in_progress) {
             self->transmit_in_progress = TRUE;
+            if (trace) {
+                nci_trace_add(trace, NCI_TRACE_TRACK_TRANSMIT,
+                    NCI_TRACE_BEGIN, "transmit", len);
+            }
             return TRUE;
         }
     }
@@ -596,6 +638,12 @@ void
 nci_target_init(
     NciTarget* self)
 {
+    static const NciAdapterEndpointFunctions endpoint_fn = {
+        .data_packet = nci_target_data_packet
+    };
+
+    self->endpoint.fn = &endpoint_fn;
+    NCI_OBJECT_CREATED(NCI_OBJECT_TARGET);
 }
 
 static
@@ -604,6 +652,7 @@ nci_target_finalize(
     GObject* object)
 {
     nci_target_drop_adapter(THIS(object));
+    NCI_OBJECT_DESTROYED(NCI_OBJECT_TARGET);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
 
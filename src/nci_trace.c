@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nci_trace.h"
+#include "nci_clock.h"
+#include "nci_plugin_p.h"
+#include "nci_plugin_log.h"
+
+#define TRACE_DEFAULT_EVENTS (4096)
+#define TRACE_PID (1)
+
+typedef struct nci_trace_event {
+    gint64 ts;                  /* Monotonic time, microseconds */
+    const char* name;
+    guint8 track;
+    guint8 phase;
+    int arg;
+} NciTraceEvent;
+
+struct nci_trace {
+    gint ref_count;
+    NciTraceEvent* events;
+    guint size;
+    guint count;
+    guint next;                 /* Where the next event goes */
+    NciClock* clock;            /* NULL for the system clock */
+};
+
+static const char* const nci_trace_track_name[] = {
+    "NCI state",                /* NCI_TRACE_TRACK_RF */
+    "Adapter state",            /* NCI_TRACE_TRACK_ADAPTER */
+    "Transmit",                 /* NCI_TRACE_TRACK_TRANSMIT */
+    "Presence check",           /* NCI_TRACE_TRACK_PRESENCE */
+    "Timers"                    /* NCI_TRACE_TRACK_TIMERS */
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(nci_trace_track_name) == NCI_TRACE_TRACKS);
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+const NciTraceEvent*
+nci_trace_event_at(
+    NciTrace* self,
+    guint i)
+{
+    /* Index 0 is the oldest event */
+    return self->events + ((self->next + self->size - self->count + i) %
+        self->size);
+}
+
+static
+void
+nci_trace_json_event(
+    GString* out,
+    const char* name,
+    char ph,
+    gint64 ts,
+    guint track)
+{
+    if (out->len && out->str[out->len - 1] != '[') {
+        g_string_append_c(out, ',');
+    }
+    g_string_append_printf(out, "\n{\"name\":\"%s\",\"ph\":\"%c\","
+        "\"pid\":%d,\"tid\":%u,\"ts\":%" G_GINT64_FORMAT, name, ph,
+        TRACE_PID, track + 1, ts);
+}
+
+/*==========================================================================*
+ * Internal API
+ *==========================================================================*/
+
+void
+nci_trace_add(
+    NciTrace* self,
+    NCI_TRACE_TRACK track,
+    NCI_TRACE_PHASE phase,
+    const char* name,
+    int arg)
+{
+    if (G_LIKELY(self)) {
+        NciTraceEvent* event = self->events + self->next;
+
+        event->ts = nci_clock_now(self->clock);
+        event->name = name;
+        event->track = (guint8) track;
+        event->phase = (guint8) phase;
+        event->arg = arg;
+        self->next = (self->next + 1) % self->size;
+        if (self->count < self->size) {
+            self->count++;
+        }
+    }
+}
+
+void
+nci_trace_set_clock(
+    NciTrace* self,
+    NciClock* clock)
+{
+    if (G_LIKELY(self)) {
+        self->clock = clock;
+    }
+}
+
+char*
+nci_trace_json(
+    NciTrace* self,
+    guint max_events)
+{
+    if (G_LIKELY(self)) {
+        const guint skip = (self->count > max_events) ?
+            (self->count - max_events) : 0;
+        GString* out = g_string_new("{\"displayTimeUnit\":\"ms\","
+            "\"traceEvents\":[");
+        const NciTraceEvent* state[NCI_TRACE_TRACKS];
+        const gint64 now = nci_clock_now(self->clock);
+        guint i;
+
+        memset(state, 0, sizeof(state));
+        for (i = 0; i < NCI_TRACE_TRACKS; i++) {
+            nci_trace_json_event(out, "thread_name", 'M', 0, i);
+            g_string_append_printf(out, ",\"args\":{\"name\":\"%s\"}}",
+                nci_trace_track_name[i]);
+        }
+
+        for (i = skip; i < self->count; i++) {
+            const NciTraceEvent* e = nci_trace_event_at(self, i);
+            const NciTraceEvent* prev;
+
+            switch ((NCI_TRACE_PHASE) e->phase) {
+            case NCI_TRACE_STATE:
+                /* The new state completes the previous one */
+                prev = state[e->track];
+                if (prev) {
+                    nci_trace_json_event(out, prev->name, 'X', prev->ts,
+                        prev->track);
+                    g_string_append_printf(out, ",\"dur\":%"
+                        G_GINT64_FORMAT "}", e->ts - prev->ts);
+                }
+                state[e->track] = e;
+                break;
+            case NCI_TRACE_BEGIN:
+                nci_trace_json_event(out, e->name, 'B', e->ts, e->track);
+                g_string_append_printf(out, ",\"args\":{\"arg\":%d}}",
+                    e->arg);
+                break;
+            case NCI_TRACE_END:
+                nci_trace_json_event(out, e->name, 'E', e->ts, e->track);
+                g_string_append_printf(out, ",\"args\":{\"result\":%d}}",
+                    e->arg);
+                break;
+            case NCI_TRACE_INSTANT:
+                nci_trace_json_event(out, e->name, 'i', e->ts, e->track);
+                g_string_append_printf(out, ",\"s\":\"t\","
+                    "\"args\":{\"arg\":%d}}", e->arg);
+                break;
+            }
+        }
+
+        /* Current states last until now */
+        for (i = 0; i < NCI_TRACE_TRACKS; i++) {
+            const NciTraceEvent* e = state[i];
+
+            if (e) {
+                nci_trace_json_event(out, e->name, 'X', e->ts, e->track);
+                g_string_append_printf(out, ",\"dur\":%" G_GINT64_FORMAT
+                    "}", now - e->ts);
+            }
+        }
+        g_string_append(out, "\n]}\n");
+        return g_string_free(out, FALSE);
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+NciTrace*
+nci_trace_new(
+    guint max_events)
+{
+    NciTrace* self = g_slice_new0(NciTrace);
+
+    g_atomic_int_set(&self->ref_count, 1);
+    self->size = max_events ? max_events : TRACE_DEFAULT_EVENTS;
+    self->events = g_new(NciTraceEvent, self->size);
+    return self;
+}
+
+NciTrace*
+nci_trace_ref(
+    NciTrace* self)
+{
+    if (G_LIKELY(self)) {
+        g_atomic_int_inc(&self->ref_count);
+    }
+    return self;
+}
+
+void
+nci_trace_unref(
+    NciTrace* self)
+{
+    if (G_LIKELY(self) && g_atomic_int_dec_and_test(&self->ref_count)) {
+        g_free(self->events);
+        g_slice_free(NciTrace, self);
+    }
+}
+
+void
+nci_trace_clear(
+    NciTrace* self)
+{
+    if (G_LIKELY(self)) {
+        self->count = self->next = 0;
+    }
+}
+
+char*
+nci_trace_to_json(
+    NciTrace* self)
+{
+    return self ? nci_trace_json(self, self->count) : NULL;
+}
+
+gboolean
+nci_trace_save(
+    NciTrace* self,
+    const char* path)
+{
+    char* json = nci_trace_to_json(self);
+
+    if (json) {
+        GError* error = NULL;
+        const gboolean ok = g_file_set_contents(path, json, -1, &error);
+
+        if (!ok) {
+            GWARN("%s", error->message);
+            g_error_free(error);
+        }
+        g_free(json);
+        return ok;
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * Scalability benchmark. Runs N adapters against NciSim, either all of
+ * them in one main context or each one in its own thread with its own
+ * thread-default context, and pushes taps through all of them at once.
+ * Reports aggregate activations/s and transmit throughput, p50/p99 of
+ * the real time it takes to serve a tap and CPU time per adapter.
+ *
+ * Milestone latencies (startup, mode switch, publishing, transmit and
+ * reactivation) come from nci_adapter_get_latency() and are measured on
+ * the virtual clocks. They show how long the plugin's NCI sequences take
+ * given the simulated NFCC turnaround (see --rsp-latency and friends),
+ * which is zero by default.
+ *
+ * --weak-refs puts back the weak pointer bookkeeping the activation path
+ * used to do (a weak pointer on the published tag or host and one on the
+ * adapter, for each tap) to compare against the current code.
+ *
+ * Timeouts run on virtual clocks (one per adapter), so that everything
+ * measured is the CPU work and whatever the adapters have to wait for
+ * each other, e.g. the shared main loop, global locks or logging.
+ */
+
+#define _GNU_SOURCE /* RUSAGE_THREAD */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <nfc_adapter.h>
+
+#include <gutil_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define RET_OK (0)
+#define RET_CMDLINE (1)
+#define RET_ERR (2)
+
+/* Virtual time per tap */
+#define BENCH_PRESENT_MS (600)  /* Activation, reading, presence checks */
+#define BENCH_GONE_MS (1600)    /* Longer than CE reactivation timeout */
+
+typedef enum bench_object_type {
+    BENCH_T2,
+    BENCH_T4,
+    BENCH_READER,
+    BENCH_MIX
+} BENCH_OBJECT_TYPE;
+
+typedef struct bench_opt {
+    guint adapters;
+    guint taps;
+    gboolean threads;
+    gboolean weak_refs;
+    BENCH_OBJECT_TYPE type;
+    NFC_MODE mode;
+    guint mode_switches;
+    NciSimConfig sim;
+} BenchOpt;
+
+typedef struct bench_adapter {
+    const BenchOpt* opt;
+    TestSim* test;
+    GThread* thread;
+    guint* times;               /* Microseconds per tap */
+    guint ntimes;
+    guint64 cpu_us;
+    guint tx;                   /* Data packets sent to NFCC */
+    gboolean ok;
+    NciLatency latency[NCI_ADAPTER_LATENCY_COUNT];
+    gulong weak_event_id[4];
+    gpointer weak_obj;
+    gpointer weak_adapter;
+} BenchAdapter;
+
+typedef struct bench_start {
+    GMutex mutex;
+    GCond cond;
+    guint ready;
+    gboolean go;
+} BenchStart;
+
+static BenchStart bench_start;
+
+static const guint8 bench_select_ndef_app[] = {
+    0x00, 0xa4, 0x04, 0x00, 0x07, 0xd2, 0x76, 0x00,
+    0x00, 0x85, 0x01, 0x01, 0x00
+};
+
+static
+void
+bench_log_discard(
+    const char* name,
+    int level,
+    const char* format,
+    va_list va)
+{
+    /* Formatting is still done, the output is not */
+    char buf[256];
+
+    g_vsnprintf(buf, sizeof(buf), format, va);
+}
+
+static
+NciSimObject*
+bench_object_new(
+    BENCH_OBJECT_TYPE type,
+    guint tap)
+{
+    static const GUtilData apdus[] = {
+        { bench_select_ndef_app, sizeof(bench_select_ndef_app) }
+    };
+
+    if (type == BENCH_MIX) {
+        type = NCI_PLUGIN_CE ? (tap % 3) : (tap % 2);
+    }
+    switch (type) {
+    case BENCH_T2:
+        return nci_sim_tag_t2_new(NULL, NULL);
+    case BENCH_T4:
+        return nci_sim_tag_t4_new(NULL, NULL);
+    case BENCH_READER:
+        return nci_sim_reader_new(apdus, G_N_ELEMENTS(apdus), NULL, NULL);
+    case BENCH_MIX:
+        break;
+    }
+    return NULL;
+}
+
+static
+guint64
+bench_cpu_us(
+    int who)
+{
+    struct rusage usage;
+
+    memset(&usage, 0, sizeof(usage));
+    getrusage(who, &usage);
+    return (guint64) usage.ru_utime.tv_sec * 1000000 +
+        usage.ru_utime.tv_usec + (guint64) usage.ru_stime.tv_sec * 1000000 +
+        usage.ru_stime.tv_usec;
+}
+
+static
+int
+bench_compare_uint(
+    const void* a,
+    const void* b)
+{
+    const guint x = *(const guint*)a;
+    const guint y = *(const guint*)b;
+
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/*==========================================================================*
+ * Weak pointer emulation
+ *==========================================================================*/
+
+static
+void
+bench_weak_add(
+    BenchAdapter* ba,
+    NfcAdapter* adapter,
+    gpointer obj)
+{
+    ba->weak_obj = obj;
+    g_object_add_weak_pointer(G_OBJECT(obj), &ba->weak_obj);
+    ba->weak_adapter = adapter;
+    g_object_add_weak_pointer(G_OBJECT(adapter), &ba->weak_adapter);
+}
+
+static
+void
+bench_weak_remove(
+    BenchAdapter* ba)
+{
+    if (ba->weak_obj) {
+        g_object_remove_weak_pointer(G_OBJECT(ba->weak_obj), &ba->weak_obj);
+        ba->weak_obj = NULL;
+    }
+    if (ba->weak_adapter) {
+        g_object_remove_weak_pointer(G_OBJECT(ba->weak_adapter),
+            &ba->weak_adapter);
+        ba->weak_adapter = NULL;
+    }
+}
+
+static
+void
+bench_weak_tag_added(
+    NfcAdapter* adapter,
+    NfcTag* tag,
+    void* ba)
+{
+    bench_weak_add(ba, adapter, tag);
+}
+
+static
+void
+bench_weak_host_added(
+    NfcAdapter* adapter,
+    NfcHost* host,
+    void* ba)
+{
+    bench_weak_add(ba, adapter, host);
+}
+
+static
+void
+bench_weak_tag_removed(
+    NfcAdapter* adapter,
+    NfcTag* tag,
+    void* ba)
+{
+    bench_weak_remove(ba);
+}
+
+static
+void
+bench_weak_host_removed(
+    NfcAdapter* adapter,
+    NfcHost* host,
+    void* ba)
+{
+    bench_weak_remove(ba);
+}
+
+/*==========================================================================*
+ * Adapter
+ *==========================================================================*/
+
+static
+void
+bench_adapter_init(
+    BenchAdapter* ba)
+{
+    const BenchOpt* opt = ba->opt;
+
+    ba->test = test_sim_new(&opt->sim, opt->mode);
+    ba->times = g_new(guint, opt->taps);
+    ba->ntimes = 0;
+    ba->ok = TRUE;
+    if (opt->weak_refs) {
+        NfcAdapter* adapter = NFC_ADAPTER(ba->test->adapter);
+
+        ba->weak_event_id[0] = nfc_adapter_add_tag_added_handler(adapter,
+            bench_weak_tag_added, ba);
+        ba->weak_event_id[1] = nfc_adapter_add_tag_removed_handler(adapter,
+            bench_weak_tag_removed, ba);
+        ba->weak_event_id[2] = nfc_adapter_add_host_added_handler(adapter,
+            bench_weak_host_added, ba);
+        ba->weak_event_id[3] = nfc_adapter_add_host_removed_handler(adapter,
+            bench_weak_host_removed, ba);
+    }
+}
+
+static
+void
+bench_adapter_check(
+    BenchAdapter* ba)
+{
+    TestSim* test = ba->test;
+
+    if (test->tags_added + test->hosts_added != ba->ntimes ||
+        test->tags_removed + test->hosts_removed != ba->ntimes) {
+        GERR("%u taps, %u/%u tags, %u/%u hosts", ba->ntimes,
+            test->tags_added, test->tags_removed,
+            test->hosts_added, test->hosts_removed);
+        ba->ok = FALSE;
+    }
+}
+
+static
+void
+bench_adapter_deinit(
+    BenchAdapter* ba)
+{
+    const BenchOpt* opt = ba->opt;
+    NfcAdapter* adapter = NFC_ADAPTER(ba->test->adapter);
+    guint i;
+
+    /* Back and forth, each one is a mode switch */
+    for (i = 0; i < opt->mode_switches; i++) {
+        nfc_adapter_request_mode(adapter, (i % 2) ? opt->mode :
+            NFC_MODE_NONE);
+        test_sim_run(ba->test, 1000);
+    }
+    for (i = 0; i < NCI_ADAPTER_LATENCY_COUNT; i++) {
+        nci_adapter_get_latency(ba->test->adapter, i, ba->latency + i);
+    }
+
+    nfc_adapter_remove_all_handlers(adapter, ba->weak_event_id);
+    bench_weak_remove(ba);
+    ba->tx = ba->test->tx_data;
+    test_sim_free(ba->test);
+    ba->test = NULL;
+}
+
+/*==========================================================================*
+ * One context
+ *==========================================================================*/
+
+static
+void
+bench_run_shared(
+    const BenchOpt* opt,
+    BenchAdapter* adapters)
+{
+    NciSimObject** objs = g_new0(NciSimObject*, opt->adapters);
+    const guint64 cpu = bench_cpu_us(RUSAGE_SELF);
+    guint i, tap;
+
+    /*
+     * Taps arrive at all adapters at once and are served by the same
+     * loop. Each tap takes from the moment it arrived until its adapter
+     * is done with it.
+     */
+    for (tap = 0; tap < opt->taps; tap++) {
+        const gint64 start = g_get_monotonic_time();
+
+        for (i = 0; i < opt->adapters; i++) {
+            objs[i] = bench_object_new(opt->type, tap);
+            nci_sim_place(adapters[i].test->sim, objs[i]);
+        }
+        for (i = 0; i < opt->adapters; i++) {
+            BenchAdapter* ba = adapters + i;
+
+            test_sim_run(ba->test, BENCH_PRESENT_MS);
+            nci_sim_take(ba->test->sim);
+            test_sim_run(ba->test, BENCH_GONE_MS);
+            ba->times[ba->ntimes++] = (guint)
+                (g_get_monotonic_time() - start);
+            nci_sim_object_unref(objs[i]);
+        }
+    }
+
+    for (i = 0; i < opt->adapters; i++) {
+        adapters[i].cpu_us = (bench_cpu_us(RUSAGE_SELF) - cpu) /
+            opt->adapters;
+        bench_adapter_check(adapters + i);
+    }
+    g_free(objs);
+}
+
+/*==========================================================================*
+ * Thread per adapter
+ *==========================================================================*/
+
+static
+gpointer
+bench_thread(
+    gpointer data)
+{
+    BenchAdapter* ba = data;
+    const BenchOpt* opt = ba->opt;
+    GMainContext* context = g_main_context_new();
+    guint64 cpu;
+    guint tap;
+
+    /* Everything the adapter creates goes to this context */
+    g_main_context_push_thread_default(context);
+    bench_adapter_init(ba);
+
+    g_mutex_lock(&bench_start.mutex);
+    bench_start.ready++;
+    g_cond_broadcast(&bench_start.cond);
+    while (!bench_start.go) {
+        g_cond_wait(&bench_start.cond, &bench_start.mutex);
+    }
+    g_mutex_unlock(&bench_start.mutex);
+
+    cpu = bench_cpu_us(RUSAGE_THREAD);
+    for (tap = 0; tap < opt->taps; tap++) {
+        NciSimObject* obj = bench_object_new(opt->type, tap);
+        const gint64 start = g_get_monotonic_time();
+
+        nci_sim_place(ba->test->sim, obj);
+        test_sim_run(ba->test, BENCH_PRESENT_MS);
+        nci_sim_take(ba->test->sim);
+        test_sim_run(ba->test, BENCH_GONE_MS);
+        ba->times[ba->ntimes++] = (guint) (g_get_monotonic_time() - start);
+        nci_sim_object_unref(obj);
+    }
+    ba->cpu_us = bench_cpu_us(RUSAGE_THREAD) - cpu;
+
+    bench_adapter_check(ba);
+    bench_adapter_deinit(ba);
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    return NULL;
+}
+
+/* Returns the start time */
+static
+gint64
+bench_run_threads(
+    const BenchOpt* opt,
+    BenchAdapter* adapters)
+{
+    gint64 start;
+    guint i;
+
+    for (i = 0; i < opt->adapters; i++) {
+        adapters[i].thread = g_thread_new("nci-bench", bench_thread,
+            adapters + i);
+    }
+
+    /* Start all at once */
+    g_mutex_lock(&bench_start.mutex);
+    while (bench_start.ready < opt->adapters) {
+        g_cond_wait(&bench_start.cond, &bench_start.mutex);
+    }
+    start = g_get_monotonic_time();
+    bench_start.go = TRUE;
+    g_cond_broadcast(&bench_start.cond);
+    g_mutex_unlock(&bench_start.mutex);
+
+    for (i = 0; i < opt->adapters; i++) {
+        g_thread_join(adapters[i].thread);
+        adapters[i].thread = NULL;
+    }
+    return start;
+}
+
+/*==========================================================================*
+ * Report
+ *==========================================================================*/
+
+static
+void
+bench_report_latency(
+    const BenchOpt* opt,
+    const BenchAdapter* adapters,
+    NCI_ADAPTER_LATENCY which,
+    const char* name)
+{
+    NciHistogram hist;
+    guint i, k;
+
+    /* All adapters together */
+    memset(&hist, 0, sizeof(hist));
+    for (i = 0; i < opt->adapters; i++) {
+        const NciHistogram* h = &adapters[i].latency[which].hist;
+
+        hist.count += h->count;
+        hist.sum_us += h->sum_us;
+        hist.max_us = MAX(hist.max_us, h->max_us);
+        for (k = 0; k < NCI_HISTOGRAM_BUCKETS; k++) {
+            hist.buckets[k] += h->buckets[k];
+        }
+    }
+    if (hist.count) {
+        printf("%s latency: %u samples, avg %.1f ms, p50 %.1f ms, "
+            "p99 %.1f ms, max %.1f ms\n", name, (guint) hist.count,
+            hist.sum_us / 1000.0 / hist.count,
+            nci_histogram_percentile(&hist, 50) / 1000.0,
+            nci_histogram_percentile(&hist, 99) / 1000.0,
+            hist.max_us / 1000.0);
+    }
+}
+
+static
+int
+bench_run(
+    const BenchOpt* opt)
+{
+    BenchAdapter* adapters = g_new0(BenchAdapter, opt->adapters);
+    const guint total = opt->adapters * opt->taps;
+    guint* times = g_new(guint, total);
+    guint64 tx = 0, cpu = 0;
+    gint64 start, wall;
+    int ret = RET_OK;
+    guint i, n = 0;
+
+    for (i = 0; i < opt->adapters; i++) {
+        adapters[i].opt = opt;
+    }
+
+    g_mutex_init(&bench_start.mutex);
+    g_cond_init(&bench_start.cond);
+    if (opt->threads) {
+        start = bench_run_threads(opt, adapters);
+    } else {
+        for (i = 0; i < opt->adapters; i++) {
+            bench_adapter_init(adapters + i);
+        }
+        start = g_get_monotonic_time();
+        bench_run_shared(opt, adapters);
+    }
+    wall = MAX(g_get_monotonic_time() - start, 1);
+
+    for (i = 0; i < opt->adapters; i++) {
+        BenchAdapter* ba = adapters + i;
+
+        if (ba->test) {
+            bench_adapter_deinit(ba);
+        }
+        tx += ba->tx;
+        memcpy(times + n, ba->times, ba->ntimes * sizeof(times[0]));
+        n += ba->ntimes;
+        cpu += ba->cpu_us;
+        if (!ba->ok) {
+            ret = RET_ERR;
+        }
+        g_free(ba->times);
+    }
+
+    if (n) {
+        qsort(times, n, sizeof(times[0]), bench_compare_uint);
+        printf("Adapters: %u (%s%s)\n", opt->adapters, opt->threads ?
+            "thread each" : "one context", opt->weak_refs ?
+            ", weak refs" : "");
+        printf("Taps: %u\n", n);
+        printf("Activations/s: %.1f\n", n * 1e6 / wall);
+        printf("Transmits/s: %.1f\n", tx * 1e6 / wall);
+        printf("Tap p50: %u us\n", times[n / 2]);
+        printf("Tap p99: %u us\n", times[(n * 99) / 100]);
+        printf("CPU per adapter: %u ms\n", (guint)
+            (cpu / opt->adapters / 1000));
+        printf("CPU per tap: %u us\n", (guint) (cpu / n));
+        bench_report_latency(opt, adapters, NCI_ADAPTER_LATENCY_STARTUP,
+            "Startup");
+        bench_report_latency(opt, adapters, NCI_ADAPTER_LATENCY_MODE_SWITCH,
+            "Mode switch");
+        bench_report_latency(opt, adapters, NCI_ADAPTER_LATENCY_PUBLISH,
+            "Publish");
+        bench_report_latency(opt, adapters, NCI_ADAPTER_LATENCY_TRANSMIT,
+            "Transmit");
+        bench_report_latency(opt, adapters, NCI_ADAPTER_LATENCY_REACTIVATION,
+            "Reactivation");
+    }
+
+    g_cond_clear(&bench_start.cond);
+    g_mutex_clear(&bench_start.mutex);
+    g_free(times);
+    g_free(adapters);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = RET_CMDLINE;
+    gboolean verbose = FALSE;
+    gboolean log = FALSE;
+    gboolean threads = FALSE;
+    gboolean weak_refs = FALSE;
+    int adapters = 4;
+    int taps = 1000;
+    int mode_switches = 10;
+    int rsp_latency = 0, rf_latency = 0, data_latency = 0;
+    char* type = NULL;
+    GOptionEntry entries[] = {
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+          "Enable verbose output", NULL },
+        { "adapters", 'a', 0, G_OPTION_ARG_INT, &adapters,
+          "Number of adapters [4]", "N" },
+        { "taps", 'n', 0, G_OPTION_ARG_INT, &taps,
+          "Taps per adapter [1000]", "N" },
+        { "threads", 't', 0, G_OPTION_ARG_NONE, &threads,
+          "Run each adapter in its own thread", NULL },
+        { "object", 'o', 0, G_OPTION_ARG_STRING, &type,
+          "What's being tapped (t2, t4, reader or mix) [mix]", "TYPE" },
+        { "log", 'l', 0, G_OPTION_ARG_NONE, &log,
+          "Format plugin's verbose log but discard it", NULL },
+        { "weak-refs", 'w', 0, G_OPTION_ARG_NONE, &weak_refs,
+          "Emulate per-tap weak pointer bookkeeping", NULL },
+        { "mode-switches", 'm', 0, G_OPTION_ARG_INT, &mode_switches,
+          "Mode switches per adapter after the taps [10]", "N" },
+        { "rsp-latency", 0, 0, G_OPTION_ARG_INT, &rsp_latency,
+          "Simulated NFCC control message turnaround [0]", "MS" },
+        { "rf-latency", 0, 0, G_OPTION_ARG_INT, &rf_latency,
+          "Simulated activation and deactivation time [0]", "MS" },
+        { "data-latency", 0, 0, G_OPTION_ARG_INT, &data_latency,
+          "Simulated tag turnaround [0]", "MS" },
+        { NULL }
+    };
+    GError* error = NULL;
+    GOptionContext* options = g_option_context_new(NULL);
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    g_option_context_set_summary(options,
+        "Multi-adapter scalability benchmark.");
+    if (g_option_context_parse(options, &argc, &argv, &error)) {
+        BenchOpt opt;
+
+        memset(&opt, 0, sizeof(opt));
+        opt.mode = NFC_MODE_READER_WRITER;
+        if (NCI_PLUGIN_CE) {
+            opt.mode |= NFC_MODE_CARD_EMILATION;
+        }
+        if (!type || !g_strcmp0(type, "mix")) {
+            opt.type = BENCH_MIX;
+        } else if (!g_strcmp0(type, "t2")) {
+            opt.type = BENCH_T2;
+        } else if (!g_strcmp0(type, "t4")) {
+            opt.type = BENCH_T4;
+        } else if (!g_strcmp0(type, "reader") && NCI_PLUGIN_CE) {
+            opt.type = BENCH_READER;
+        } else {
+            adapters = 0;
+        }
+        if (argc == 1 && adapters > 0 && taps > 0 && mode_switches >= 0 &&
+            rsp_latency >= 0 && rf_latency >= 0 && data_latency >= 0) {
+            opt.adapters = adapters;
+            opt.taps = taps;
+            opt.threads = threads;
+            opt.weak_refs = weak_refs;
+            opt.mode_switches = mode_switches;
+            opt.sim.rsp_latency_ms = rsp_latency;
+            opt.sim.rf_latency_ms = rf_latency;
+            opt.sim.data_latency_ms = data_latency;
+            gutil_log_timestamp = FALSE;
+            gutil_log_default.level = verbose ?
+                GLOG_LEVEL_VERBOSE : GLOG_LEVEL_WARN;
+            if (log) {
+                gutil_log_func = bench_log_discard;
+                NCI_PLUGIN_LOG_MODULE.level = GLOG_LEVEL_VERBOSE;
+            } else {
+                NCI_PLUGIN_LOG_MODULE.level = verbose ?
+                    GLOG_LEVEL_VERBOSE : GLOG_LEVEL_WARN;
+            }
+            ret = bench_run(&opt);
+        } else {
+            char* help = g_option_context_get_help(options, TRUE, NULL);
+
+            fprintf(stderr, "%s", help);
+            g_free(help);
+        }
+    } else {
+        fprintf(stderr, "%s\n", GERRMSG(error));
+        g_error_free(error);
+    }
+    g_option_context_free(options);
+    g_free(type);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
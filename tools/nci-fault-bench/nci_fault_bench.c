@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * Timeout policy benchmark. Puts NciFault between the adapter and NciSim
+ * and taps tags under a number of fault profiles (delays, jitter, dropped
+ * notifications, reordered completions, slow bus). For each profile it
+ * reports how long it takes to notice that a tag has gone, and how often
+ * a tag that's still there is declared lost (false losses). Everything
+ * runs on the virtual clock, so the results are reproducible and long
+ * presence times cost nothing.
+ */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <gutil_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RET_OK (0)
+#define RET_CMDLINE (1)
+
+#define FAULT_BENCH_STEP_MS (1)
+#define FAULT_BENCH_ACTIVATION_MS (2000)
+#define FAULT_BENCH_DETECTION_MS (10000)
+
+typedef struct fault_bench_policy {
+    const char* name;
+    NciFaultConfig config;
+} FaultBenchPolicy;
+
+typedef struct fault_bench_opt {
+    guint taps;
+    guint present_ms;
+    gboolean t4;
+    guint32 seed;
+} FaultBenchOpt;
+
+typedef struct fault_bench_result {
+    guint taps;
+    guint missed;               /* Never activated */
+    guint false_losses;
+    guint undetected;           /* Removal not noticed in time */
+    guint* detect_ms;
+    guint detected;
+} FaultBenchResult;
+
+static const FaultBenchPolicy fault_bench_policies[] = {
+    { "none", { 0, 0, 0, 0, FALSE, 0 } },
+    { "delay", { 20, 0, 0, 0, FALSE, 0 } },
+    { "jitter", { 5, 50, 0, 0, FALSE, 0 } },
+    { "drop", { 0, 0, 50, 0, FALSE, 0 } },
+    { "reorder", { 0, 0, 0, 0, TRUE, 0 } },
+    { "slow-bus", { 0, 0, 0, 4800, FALSE, 0 } },
+    { "worst", { 20, 50, 50, 4800, TRUE, 0 } }
+};
+
+/* Somewhat realistic NFCC, all in milliseconds */
+static const NciSimConfig fault_bench_sim = { 0x20, 1, 5, 2 };
+
+static
+int
+fault_bench_compare_uint(
+    const void* a,
+    const void* b)
+{
+    const guint x = *(const guint*)a;
+    const guint y = *(const guint*)b;
+
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static
+guint
+fault_bench_tags_present(
+    TestSim* test)
+{
+    return test->tags_added - test->tags_removed;
+}
+
+/* Returns virtual milliseconds it took, or max_ms + 1 if it didn't */
+static
+guint
+fault_bench_wait(
+    TestSim* test,
+    gboolean present,
+    guint max_ms)
+{
+    guint ms = 0;
+
+    while ((fault_bench_tags_present(test) != 0) != present) {
+        if (ms > max_ms) {
+            break;
+        }
+        test_sim_run(test, FAULT_BENCH_STEP_MS);
+        ms += FAULT_BENCH_STEP_MS;
+    }
+    return ms;
+}
+
+static
+void
+fault_bench_run_policy(
+    const FaultBenchOpt* opt,
+    const FaultBenchPolicy* policy,
+    FaultBenchResult* res)
+{
+    NciFaultConfig config = policy->config;
+    TestSim* test;
+    guint tap;
+
+    config.seed = opt->seed;
+    test = test_sim_new_fault(&fault_bench_sim, &config,
+        NFC_MODE_READER_WRITER);
+
+    memset(res, 0, sizeof(*res));
+    res->detect_ms = g_new(guint, opt->taps);
+    for (tap = 0; tap < opt->taps; tap++) {
+        NciSimObject* obj = opt->t4 ? nci_sim_tag_t4_new(NULL, NULL) :
+            nci_sim_tag_t2_new(NULL, NULL);
+
+        res->taps++;
+        nci_sim_place(test->sim, obj);
+        if (fault_bench_wait(test, TRUE, FAULT_BENCH_ACTIVATION_MS) >
+            FAULT_BENCH_ACTIVATION_MS) {
+            res->missed++;
+        } else {
+            const guint removed = test->tags_removed;
+
+            /* Whatever gets removed while the tag is there is a loss */
+            test_sim_run(test, opt->present_ms);
+            res->false_losses += test->tags_removed - removed;
+        }
+
+        /* Removal can only be noticed if the tag is there right now */
+        if (fault_bench_tags_present(test)) {
+            guint ms;
+
+            nci_sim_take(test->sim);
+            ms = fault_bench_wait(test, FALSE, FAULT_BENCH_DETECTION_MS);
+            if (ms > FAULT_BENCH_DETECTION_MS) {
+                res->undetected++;
+            } else {
+                res->detect_ms[res->detected++] = ms;
+            }
+        } else {
+            nci_sim_take(test->sim);
+        }
+
+        /* Let everything settle */
+        test_sim_run(test, FAULT_BENCH_DETECTION_MS);
+        nci_sim_object_unref(obj);
+    }
+    test_sim_free(test);
+}
+
+static
+void
+fault_bench_report(
+    const FaultBenchOpt* opt,
+    const FaultBenchPolicy* policy,
+    FaultBenchResult* res)
+{
+    const double hours = (double) res->taps * opt->present_ms / 3600000.0;
+
+    printf("%-10s %6u %6u %6u %10.2f", policy->name, res->taps,
+        res->missed, res->false_losses, hours > 0 ?
+        (res->false_losses / hours) : 0.0);
+    if (res->detected) {
+        const guint n = res->detected;
+
+        qsort(res->detect_ms, n, sizeof(guint), fault_bench_compare_uint);
+        printf(" %6u %6u %6u", res->detect_ms[n / 2],
+            res->detect_ms[(n * 99) / 100], res->detect_ms[n - 1]);
+    } else {
+        printf(" %6s %6s %6s", "-", "-", "-");
+    }
+    printf(" %6u\n", res->undetected);
+}
+
+static
+int
+fault_bench_run(
+    const FaultBenchOpt* opt,
+    const FaultBenchPolicy* policies,
+    guint count)
+{
+    guint i;
+
+    printf("%-10s %6s %6s %6s %10s %6s %6s %6s %6s\n", "Policy", "Taps",
+        "Missed", "Lost", "Lost/hour", "p50ms", "p99ms", "Max", "Undet");
+    for (i = 0; i < count; i++) {
+        FaultBenchResult res;
+
+        fault_bench_run_policy(opt, policies + i, &res);
+        fault_bench_report(opt, policies + i, &res);
+        g_free(res.detect_ms);
+    }
+    return RET_OK;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = RET_CMDLINE;
+    gboolean verbose = FALSE;
+    gboolean reorder = FALSE;
+    gboolean t4 = FALSE;
+    int taps = 100;
+    int present = 5;
+    int delay = -1, jitter = -1, drop = -1, bps = -1;
+    int seed = 1;
+    char* name = NULL;
+    GOptionEntry entries[] = {
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+          "Enable verbose output", NULL },
+        { "taps", 'n', 0, G_OPTION_ARG_INT, &taps,
+          "Taps per policy [100]", "N" },
+        { "present", 'p', 0, G_OPTION_ARG_INT, &present,
+          "Seconds each tag stays in the field [5]", "SEC" },
+        { "t4", '4', 0, G_OPTION_ARG_NONE, &t4,
+          "Tap Type 4 tags rather than Type 2", NULL },
+        { "policy", 'P', 0, G_OPTION_ARG_STRING, &name,
+          "Run only this built-in policy", "NAME" },
+        { "delay", 0, 0, G_OPTION_ARG_INT, &delay,
+          "Custom policy: delay", "MS" },
+        { "jitter", 0, 0, G_OPTION_ARG_INT, &jitter,
+          "Custom policy: jitter", "MS" },
+        { "drop", 0, 0, G_OPTION_ARG_INT, &drop,
+          "Custom policy: dropped notifications", "PERMILLE" },
+        { "bps", 0, 0, G_OPTION_ARG_INT, &bps,
+          "Custom policy: bus throughput", "BYTES" },
+        { "reorder", 0, 0, G_OPTION_ARG_NONE, &reorder,
+          "Custom policy: data reply before send completion", NULL },
+        { "seed", 's', 0, G_OPTION_ARG_INT, &seed,
+          "Random seed [1]", "N" },
+        { NULL }
+    };
+    GError* error = NULL;
+    GOptionContext* options = g_option_context_new(NULL);
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    g_option_context_set_summary(options, "Runs taps under various fault "
+        "profiles and reports removal detection time and false losses.");
+    if (g_option_context_parse(options, &argc, &argv, &error)) {
+        const FaultBenchPolicy* policies = fault_bench_policies;
+        guint count = G_N_ELEMENTS(fault_bench_policies);
+        FaultBenchPolicy custom;
+        gboolean ok = (argc == 1 && taps > 0 && present >= 0);
+
+        if (delay >= 0 || jitter >= 0 || drop >= 0 || bps >= 0 || reorder) {
+            memset(&custom, 0, sizeof(custom));
+            custom.name = "custom";
+            custom.config.delay_ms = MAX(delay, 0);
+            custom.config.jitter_ms = MAX(jitter, 0);
+            custom.config.ntf_drop_permille = MAX(drop, 0);
+            custom.config.bytes_per_sec = MAX(bps, 0);
+            custom.config.reorder_data_completion = reorder;
+            policies = &custom;
+            count = 1;
+        } else if (name) {
+            guint i = 0;
+
+            while (i < count && g_strcmp0(policies[i].name, name)) {
+                i++;
+            }
+            if (i < count) {
+                policies += i;
+                count = 1;
+            } else {
+                ok = FALSE;
+            }
+        }
+        if (ok) {
+            FaultBenchOpt opt;
+
+            memset(&opt, 0, sizeof(opt));
+            opt.taps = taps;
+            opt.present_ms = present * 1000;
+            opt.t4 = t4;
+            opt.seed = seed;
+            gutil_log_timestamp = FALSE;
+            gutil_log_default.level = verbose ?
+                GLOG_LEVEL_VERBOSE : GLOG_LEVEL_WARN;
+            NCI_PLUGIN_LOG_MODULE.level = verbose ?
+                GLOG_LEVEL_VERBOSE : GLOG_LEVEL_ERR;
+            ret = fault_bench_run(&opt, policies, count);
+        } else {
+            char* help = g_option_context_get_help(options, TRUE, NULL);
+
+            fprintf(stderr, "%s", help);
+            g_free(help);
+        }
+    } else {
+        fprintf(stderr, "%s\n", GERRMSG(error));
+        g_error_free(error);
+    }
+    g_option_context_free(options);
+    g_free(name);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * Stand-in for a vendor process owning the NFCC. Attaches to the shared
+ * memory region created by nci_hal_shm_new() and bridges it to NciSim.
+ * Normally started with nci_hal_shm_spawn(), which appends the inherited
+ * descriptors to the command line.
+ */
+
+#include "nci_hal_shm.h"
+#include "nci_sim.h"
+#include "nci_plugin_types.h"
+
+#define GLOG_MODULE_NAME NCI_PLUGIN_LOG_MODULE
+#include <gutil_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RET_OK (0)
+#define RET_CMDLINE (1)
+#define RET_ERR (2)
+
+GLOG_MODULE_DEFINE("nci-shm-sim");
+
+static
+void
+nci_shm_sim_closed(
+    NciHalShmBridge* bridge,
+    void* loop)
+{
+    GDEBUG("Host is gone");
+    g_main_loop_quit(loop);
+}
+
+static
+NciSimObject*
+nci_shm_sim_object(
+    const char* type)
+{
+    if (!type || !g_strcmp0(type, "none")) {
+        return NULL;
+    } else if (!g_strcmp0(type, "t2")) {
+        return nci_sim_tag_t2_new(NULL, NULL);
+    } else if (!g_strcmp0(type, "t4")) {
+        return nci_sim_tag_t4_new(NULL, NULL);
+    } else if (!g_strcmp0(type, "peer")) {
+        return nci_sim_peer_new();
+    } else if (!g_strcmp0(type, "reader")) {
+        return nci_sim_reader_new(NULL, 0, NULL, NULL);
+    } else {
+        return NULL;
+    }
+}
+
+static
+int
+nci_shm_sim_run(
+    int fd,
+    int rx_event,
+    int tx_event,
+    const NciSimConfig* config,
+    NciSimObject* obj)
+{
+    int ret = RET_ERR;
+    NciHalShm* shm = nci_hal_shm_attach(fd, rx_event, tx_event);
+
+    if (shm) {
+        GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+        NciSim* sim = nci_sim_new(config);
+        NciHalShmBridge* bridge;
+
+        if (obj) {
+            nci_sim_place(sim, obj);
+        }
+        bridge = nci_hal_shm_bridge_new(shm, sim->io, nci_shm_sim_closed,
+            loop);
+        if (bridge) {
+            g_main_loop_run(loop);
+            nci_hal_shm_bridge_free(bridge);
+            ret = RET_OK;
+        } else {
+            GERR("Failed to bridge the shared memory");
+        }
+        nci_sim_free(sim);
+        nci_hal_shm_free(shm);
+        g_main_loop_unref(loop);
+    } else {
+        GERR("Failed to attach to the shared memory");
+    }
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = RET_CMDLINE;
+    gboolean verbose = FALSE;
+    int nci_version = 2;
+    char* type = NULL;
+    GOptionEntry entries[] = {
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+          "Enable verbose output", NULL },
+        { "nci", 'n', 0, G_OPTION_ARG_INT, &nci_version,
+          "NCI version (1 or 2) [2]", "VERSION" },
+        { "object", 'o', 0, G_OPTION_ARG_STRING, &type,
+          "Object in the field (t2, t4, peer, reader or none) [none]",
+          "TYPE" },
+        { NULL }
+    };
+    GError* error = NULL;
+    GOptionContext* options = g_option_context_new("FD RX_EVENT TX_EVENT");
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    g_option_context_set_summary(options,
+        "Bridges the shared memory NCI transport to a simulated NFCC.");
+    if (g_option_context_parse(options, &argc, &argv, &error)) {
+        NciSimObject* obj = nci_shm_sim_object(type);
+
+        if (argc == 4 && (nci_version == 1 || nci_version == 2) &&
+            (obj || !type || !g_strcmp0(type, "none"))) {
+            NciSimConfig config;
+
+            memset(&config, 0, sizeof(config));
+            config.nci_version = (nci_version == 1) ? 0x10 : 0x20;
+            gutil_log_timestamp = FALSE;
+            gutil_log_default.level = verbose ?
+                GLOG_LEVEL_VERBOSE : GLOG_LEVEL_INFO;
+            ret = nci_shm_sim_run(atoi(argv[1]), atoi(argv[2]),
+                atoi(argv[3]), &config, obj);
+        } else {
+            char* help = g_option_context_get_help(options, TRUE, NULL);
+
+            fprintf(stderr, "%s", help);
+            g_free(help);
+        }
+        nci_sim_object_unref(obj);
+    } else {
+        fprintf(stderr, "%s\n", GERRMSG(error));
+        g_error_free(error);
+    }
+    g_option_context_free(options);
+    g_free(type);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * Soak test. Runs NciAdapter against NciSim on the virtual clock through
+ * any number of activation, transmit, presence check and deactivation
+ * cycles, rotating the endpoint types. Every window of cycles it reports
+ * RSS, heap usage, live plugin objects and p50/p99 of the real time spent
+ * per cycle, and fails if any of those grows or drifts past the allowed
+ * slack relative to the first window.
+ */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <gutil_log.h>
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RET_OK (0)
+#define RET_CMDLINE (1)
+#define RET_ERR (2)
+
+/* Virtual time, costs nothing */
+#define SOAK_PRESENT_MS (600)   /* Activation, reading, presence checks */
+#define SOAK_GONE_MS (1600)     /* Longer than CE reactivation timeout */
+
+typedef enum soak_object_type {
+    SOAK_T2,
+    SOAK_T4,
+    SOAK_PEER,
+    SOAK_READER,
+    SOAK_OBJECT_TYPES
+} SOAK_OBJECT_TYPE;
+
+typedef struct soak_opt {
+    guint cycles;
+    guint window;
+    guint rss_slack_kb;
+    guint heap_slack_kb;
+    guint p50_drift;            /* Percent */
+    guint p99_drift;            /* Percent */
+} SoakOpt;
+
+typedef struct soak_sample {
+    gsize rss_kb;
+    gsize heap_kb;
+    NciObjectCounts objects;
+    guint p50_us;
+    guint p99_us;
+} SoakSample;
+
+static const guint8 soak_select_ndef_app[] = {
+    0x00, 0xa4, 0x04, 0x00, 0x07, 0xd2, 0x76, 0x00,
+    0x00, 0x85, 0x01, 0x01, 0x00
+};
+static const guint8 soak_select_cc[] = {
+    0x00, 0xa4, 0x00, 0x0c, 0x02, 0xe1, 0x03
+};
+
+static
+NciSimObject*
+soak_object_new(
+    SOAK_OBJECT_TYPE type)
+{
+    static const GUtilData apdus[] = {
+        { soak_select_ndef_app, sizeof(soak_select_ndef_app) },
+        { soak_select_cc, sizeof(soak_select_cc) }
+    };
+
+    switch (type) {
+    case SOAK_T2:
+        return nci_sim_tag_t2_new(NULL, NULL);
+    case SOAK_T4:
+        return nci_sim_tag_t4_new(NULL, NULL);
+    case SOAK_PEER:
+        return NCI_PLUGIN_PEER ? nci_sim_peer_new() : NULL;
+    case SOAK_READER:
+        return NCI_PLUGIN_CE ? nci_sim_reader_new(apdus,
+            G_N_ELEMENTS(apdus), NULL, NULL) : NULL;
+    case SOAK_OBJECT_TYPES:
+        break;
+    }
+    return NULL;
+}
+
+static
+int
+soak_compare_uint(
+    const void* a,
+    const void* b)
+{
+    const guint x = *(const guint*)a;
+    const guint y = *(const guint*)b;
+
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static
+gsize
+soak_rss_kb(
+    void)
+{
+    gsize rss = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+
+    if (f) {
+        unsigned long size, resident;
+
+        if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+            rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        fclose(f);
+    }
+    return rss;
+}
+
+static
+gsize
+soak_heap_kb(
+    void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2,33)
+    const struct mallinfo2 mi = mallinfo2();
+
+    return (mi.uordblks + mi.hblkhd) / 1024;
+#elif defined(__GLIBC__)
+    const struct mallinfo mi = mallinfo();
+
+    return ((gsize)(guint)mi.uordblks + (guint)mi.hblkhd) / 1024;
+#else
+    return 0;
+#endif
+}
+
+static
+void
+soak_sample(
+    SoakSample* sample,
+    guint* times,
+    guint count)
+{
+    qsort(times, count, sizeof(times[0]), soak_compare_uint);
+    sample->p50_us = times[count / 2];
+    sample->p99_us = times[(count * 99) / 100];
+    sample->rss_kb = soak_rss_kb();
+    sample->heap_kb = soak_heap_kb();
+    nci_adapter_object_counts(&sample->objects);
+}
+
+static
+gboolean
+soak_check(
+    const SoakOpt* opt,
+    const SoakSample* base,
+    const SoakSample* now)
+{
+    gboolean ok = TRUE;
+
+    if (now->rss_kb > base->rss_kb + opt->rss_slack_kb) {
+        GERR("RSS has grown from %u to %u kB", (guint) base->rss_kb,
+            (guint) now->rss_kb);
+        ok = FALSE;
+    }
+    if (now->heap_kb > base->heap_kb + opt->heap_slack_kb) {
+        GERR("Heap has grown from %u to %u kB", (guint) base->heap_kb,
+            (guint) now->heap_kb);
+        ok = FALSE;
+    }
+    if (now->objects.targets > base->objects.targets ||
+        now->objects.initiators > base->objects.initiators ||
+        now->objects.intf_blocks > base->objects.intf_blocks ||
+        now->objects.conns > base->objects.conns) {
+        GERR("Plugin objects have grown from %u/%u/%u/%u to %u/%u/%u/%u",
+            base->objects.targets, base->objects.initiators,
+            base->objects.intf_blocks, base->objects.conns,
+            now->objects.targets, now->objects.initiators,
+            now->objects.intf_blocks, now->objects.conns);
+        ok = FALSE;
+    }
+    if ((guint64) now->p50_us * 100 >
+        (guint64) base->p50_us * (100 + opt->p50_drift)) {
+        GERR("p50 has drifted from %u to %u us", base->p50_us, now->p50_us);
+        ok = FALSE;
+    }
+    if ((guint64) now->p99_us * 100 >
+        (guint64) base->p99_us * (100 + opt->p99_drift)) {
+        GERR("p99 has drifted from %u to %u us", base->p99_us, now->p99_us);
+        ok = FALSE;
+    }
+    return ok;
+}
+
+static
+int
+soak_run(
+    const SoakOpt* opt,
+    NFC_MODE mode)
+{
+    TestSim* test = test_sim_new(NULL, mode);
+    guint* times = g_new(guint, opt->window);
+    SoakSample base, now;
+    gboolean have_base = FALSE;
+    int ret = RET_OK;
+    guint i, k = 0, type = 0;
+
+    memset(&base, 0, sizeof(base));
+    for (i = 0; i < opt->cycles && ret == RET_OK; i++) {
+        NciSimObject* obj = NULL;
+        gint64 start;
+
+        while (!obj) {
+            obj = soak_object_new(type);
+            type = (type + 1) % SOAK_OBJECT_TYPES;
+        }
+
+        start = g_get_monotonic_time();
+        nci_sim_place(test->sim, obj);
+        test_sim_run(test, SOAK_PRESENT_MS);
+        nci_sim_take(test->sim);
+        test_sim_run(test, SOAK_GONE_MS);
+        times[k++] = (guint)(g_get_monotonic_time() - start);
+        nci_sim_object_unref(obj);
+
+        /* Everything that has been published must be gone by now */
+        if (test->tags_added != test->tags_removed ||
+            test->peers_added != test->peers_removed ||
+            test->hosts_added != test->hosts_removed) {
+            GERR("Cycle %u: %u/%u tags, %u/%u peers, %u/%u hosts left", i,
+                test->tags_added - test->tags_removed, test->tags_added,
+                test->peers_added - test->peers_removed, test->peers_added,
+                test->hosts_added - test->hosts_removed, test->hosts_added);
+            ret = RET_ERR;
+        } else if (k == opt->window) {
+            soak_sample(&now, times, k);
+            k = 0;
+            GINFO("%u cycles: RSS %u kB, heap %u kB, objects %u/%u/%u/%u, "
+                "p50 %u us, p99 %u us", i + 1, (guint) now.rss_kb,
+                (guint) now.heap_kb, now.objects.targets,
+                now.objects.initiators, now.objects.intf_blocks,
+                now.objects.conns, now.p50_us, now.p99_us);
+            if (!have_base) {
+                /* The first window warms up caches and slices */
+                base = now;
+                have_base = TRUE;
+            } else if (!soak_check(opt, &base, &now)) {
+                ret = RET_ERR;
+            }
+        }
+    }
+
+    if (ret == RET_OK && !have_base) {
+        GWARN("Fewer cycles than one window, nothing to compare");
+    }
+    g_free(times);
+    test_sim_free(test);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = RET_CMDLINE;
+    gboolean verbose = FALSE;
+    int cycles = 1000000;
+    int window = 10000;
+    int rss_slack = 1024;
+    int heap_slack = 256;
+    int p50_drift = 50;
+    int p99_drift = 100;
+    GOptionEntry entries[] = {
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+          "Enable verbose output", NULL },
+        { "cycles", 'n', 0, G_OPTION_ARG_INT, &cycles,
+          "Number of tap cycles [1000000]", "N" },
+        { "window", 'w', 0, G_OPTION_ARG_INT, &window,
+          "Cycles per measurement window [10000]", "N" },
+        { "rss-slack", 0, 0, G_OPTION_ARG_INT, &rss_slack,
+          "Allowed RSS growth [1024]", "KB" },
+        { "heap-slack", 0, 0, G_OPTION_ARG_INT, &heap_slack,
+          "Allowed heap growth [256]", "KB" },
+        { "p50-drift", 0, 0, G_OPTION_ARG_INT, &p50_drift,
+          "Allowed p50 drift [50]", "PERCENT" },
+        { "p99-drift", 0, 0, G_OPTION_ARG_INT, &p99_drift,
+          "Allowed p99 drift [100]", "PERCENT" },
+        { NULL }
+    };
+    GError* error = NULL;
+    GOptionContext* options;
+
+    /* Make slices visible to the heap statistics */
+    g_setenv("G_SLICE", "always-malloc", TRUE);
+
+    options = g_option_context_new(NULL);
+    g_option_context_add_main_entries(options, entries, NULL);
+    g_option_context_set_summary(options,
+        "Soak test for memory growth and latency drift.");
+    if (g_option_context_parse(options, &argc, &argv, &error)) {
+        if (argc == 1 && cycles > 0 && window > 0 && rss_slack >= 0 &&
+            heap_slack >= 0 && p50_drift >= 0 && p99_drift >= 0) {
+            SoakOpt opt;
+            NFC_MODE mode = NFC_MODE_READER_WRITER;
+
+            memset(&opt, 0, sizeof(opt));
+            opt.cycles = cycles;
+            opt.window = window;
+            opt.rss_slack_kb = rss_slack;
+            opt.heap_slack_kb = heap_slack;
+            opt.p50_drift = p50_drift;
+            opt.p99_drift = p99_drift;
+            if (NCI_PLUGIN_PEER) {
+                mode |= NFC_MODE_P2P_INITIATOR;
+            }
+            if (NCI_PLUGIN_CE) {
+                mode |= NFC_MODE_CARD_EMILATION;
+            }
+            gutil_log_timestamp = TRUE;
+            gutil_log_default.level = GLOG_LEVEL_INFO;
+            NCI_PLUGIN_LOG_MODULE.level = verbose ?
+                GLOG_LEVEL_VERBOSE : GLOG_LEVEL_WARN;
+            ret = soak_run(&opt, mode);
+        } else {
+            char* help = g_option_context_get_help(options, TRUE, NULL);
+
+            fprintf(stderr, "%s", help);
+            g_free(help);
+        }
+    } else {
+        fprintf(stderr, "%s\n", GERRMSG(error));
+        g_error_free(error);
+    }
+    g_option_context_free(options);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
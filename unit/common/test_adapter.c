@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <nci_core.h>
+
+#include <nfc_adapter.h>
+
+#include <gutil_macros.h>
+
+#include <string.h>
+
+/*==========================================================================*
+ * Test adapter
+ *==========================================================================*/
+
+typedef NciAdapterClass TestAdapterClass;
+typedef struct test_adapter {
+    NciAdapter adapter;
+    GSource* power_source;
+    gboolean power_on;
+} TestAdapter;
+
+G_DEFINE_TYPE(TestAdapter, test_adapter, NCI_TYPE_ADAPTER)
+#define TEST_TYPE_ADAPTER (test_adapter_get_type())
+#define TEST_ADAPTER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+        TEST_TYPE_ADAPTER, TestAdapter))
+
+static
+gboolean
+test_adapter_power_done(
+    gpointer user_data)
+{
+    TestAdapter* self = TEST_ADAPTER(user_data);
+
+    self->power_source = NULL;
+    nfc_adapter_power_notify(NFC_ADAPTER(self), self->power_on, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+test_adapter_submit_power_request(
+    NfcAdapter* adapter,
+    gboolean on)
+{
+    TestAdapter* self = TEST_ADAPTER(adapter);
+    NciCore* nci = self->adapter.nci;
+
+    if (on) {
+        nci_core_restart(nci);
+    } else {
+        nci_core_set_state(nci, NCI_STATE_STOP);
+    }
+    self->power_on = on;
+    if (!self->power_source) {
+        self->power_source = nci_idle_add(test_adapter_power_done, self);
+    }
+    return TRUE;
+}
+
+static
+void
+test_adapter_cancel_power_request(
+    NfcAdapter* adapter)
+{
+    TestAdapter* self = TEST_ADAPTER(adapter);
+
+    nci_source_clear(&self->power_source);
+}
+
+static
+void
+test_adapter_init(
+    TestAdapter* self)
+{
+}
+
+static
+void
+test_adapter_finalize(
+    GObject* object)
+{
+    test_adapter_cancel_power_request(NFC_ADAPTER(object));
+    nci_adapter_finalize_core(NCI_ADAPTER(object));
+    G_OBJECT_CLASS(test_adapter_parent_class)->finalize(object);
+}
+
+static
+void
+test_adapter_class_init(
+    TestAdapterClass* klass)
+{
+    NfcAdapterClass* adapter_class = NFC_ADAPTER_CLASS(klass);
+
+    adapter_class->submit_power_request = test_adapter_submit_power_request;
+    adapter_class->cancel_power_request = test_adapter_cancel_power_request;
+    G_OBJECT_CLASS(klass)->finalize = test_adapter_finalize;
+}
+
+/*==========================================================================*
+ * Test harness
+ *==========================================================================*/
+
+enum test_sim_events {
+    TEST_EVENT_TAG_ADDED,
+    TEST_EVENT_TAG_REMOVED,
+    TEST_EVENT_PEER_ADDED,
+    TEST_EVENT_PEER_REMOVED,
+    TEST_EVENT_HOST_ADDED,
+    TEST_EVENT_HOST_REMOVED,
+    TEST_EVENT_COUNT
+};
+
+typedef struct test_sim_priv {
+    TestSim pub;
+    NciHalIo io;                /* Sits between NciAdapter and NciSim */
+    NciHalIo* hal;              /* NciSim or NciFault on top of it */
+    gulong event_id[TEST_EVENT_COUNT];
+} TestSimPriv;
+
+static inline TestSimPriv* test_sim_cast(TestSim* test)
+    { return G_CAST(test, TestSimPriv, pub); }
+static inline TestSimPriv* test_sim_io_cast(NciHalIo* io)
+    { return G_CAST(io, TestSimPriv, io); }
+
+static
+gboolean
+test_sim_io_start(
+    NciHalIo* io,
+    NciHalClient* client)
+{
+    NciHalIo* sim = test_sim_io_cast(io)->hal;
+
+    return sim->fn->start(sim, client);
+}
+
+static
+void
+test_sim_io_stop(
+    NciHalIo* io)
+{
+    NciHalIo* sim = test_sim_io_cast(io)->hal;
+
+    sim->fn->stop(sim);
+}
+
+static
+void
+test_sim_rf_discover(
+    TestSim* test,
+    const guint8* payload,
+    guint len)
+{
+    /* NumberOfConfigurations, then (Mode, Frequency) pairs */
+    if (len > 0) {
+        const guint8* ptr = payload + 1;
+        const guint8* end = payload + len;
+        guint n = payload[0];
+
+        while (n-- > 0 && ptr + 2 <= end) {
+            const guint8 mode = ptr[0];
+
+            if (mode & 0x80) {
+                test->listen_modes |= 1u << (mode & 0x1f);
+            } else {
+                test->poll_modes |= 1u << (mode & 0x1f);
+            }
+            ptr += 2;
+        }
+    }
+}
+
+static
+gboolean
+test_sim_io_write(
+    NciHalIo* io,
+    const GUtilData* chunks,
+    guint count,
+    NciHalClientFunc complete)
+{
+    TestSimPriv* self = test_sim_io_cast(io);
+    NciHalIo* sim = self->hal;
+    guint8 pkt[NCI_HDR_SIZE + 0xff];
+    guint i, len = 0;
+
+    /* The packet may come in several chunks */
+    for (i = 0; i < count && len < sizeof(pkt); i++) {
+        const guint n = MIN(chunks[i].size, sizeof(pkt) - len);
+
+        memcpy(pkt + len, chunks[i].bytes, n);
+        len += n;
+    }
+    if (len >= NCI_HDR_SIZE) {
+        const guint8 mt = pkt[0] & NCI_HDR_MT_MASK;
+
+        if (mt == NCI_HDR_MT_DATA) {
+            self->pub.tx_data++;
+        } else if (mt == NCI_HDR_MT_CMD && !(pkt[0] & NCI_HDR_PBF)) {
+            const guint8 gid = pkt[0] & NCI_HDR_GID_MASK;
+            const guint8 oid = pkt[1] & NCI_HDR_OID_MASK;
+            const guint cmd = TEST_SIM_CMD(gid, oid);
+
+            g_array_append_val(self->pub.cmds, cmd);
+            if (gid == NCI_GID_RF && oid == NCI_OID_RF_DISCOVER) {
+                test_sim_rf_discover(&self->pub, pkt + NCI_HDR_SIZE,
+                    MIN(pkt[2], len - NCI_HDR_SIZE));
+            }
+        }
+    }
+    return sim->fn->write(sim, chunks, count, complete);
+}
+
+static
+void
+test_sim_io_cancel_write(
+    NciHalIo* io)
+{
+    NciHalIo* sim = test_sim_io_cast(io)->hal;
+
+    sim->fn->cancel_write(sim);
+}
+
+static
+void
+test_sim_tag_added(
+    NfcAdapter* adapter,
+    NfcTag* tag,
+    void* test)
+{
+    ((TestSim*)test)->tags_added++;
+}
+
+static
+void
+test_sim_tag_removed(
+    NfcAdapter* adapter,
+    NfcTag* tag,
+    void* test)
+{
+    ((TestSim*)test)->tags_removed++;
+}
+
+static
+void
+test_sim_peer_added(
+    NfcAdapter* adapter,
+    NfcPeer* peer,
+    void* test)
+{
+    ((TestSim*)test)->peers_added++;
+}
+
+static
+void
+test_sim_peer_removed(
+    NfcAdapter* adapter,
+    NfcPeer* peer,
+    void* test)
+{
+    ((TestSim*)test)->peers_removed++;
+}
+
+static
+void
+test_sim_host_added(
+    NfcAdapter* adapter,
+    NfcHost* host,
+    void* test)
+{
+    ((TestSim*)test)->hosts_added++;
+}
+
+static
+void
+test_sim_host_removed(
+    NfcAdapter* adapter,
+    NfcHost* host,
+    void* test)
+{
+    ((TestSim*)test)->hosts_removed++;
+}
+
+static
+TestSim*
+test_sim_new_full(
+    const NciSimConfig* config,
+    const NciFaultConfig* fault,
+    NFC_MODE mode)
+{
+    static const NciHalIoFunctions test_sim_io_fn = {
+        .start = test_sim_io_start,
+        .stop = test_sim_io_stop,
+        .write = test_sim_io_write,
+        .cancel_write = test_sim_io_cancel_write
+    };
+    TestSimPriv* self = g_new0(TestSimPriv, 1);
+    TestSim* test = &self->pub;
+    NfcAdapter* adapter;
+
+    test->cmds = g_array_new(FALSE, FALSE, sizeof(guint));
+    test->clock = nci_virtual_clock_new();
+    test->sim = nci_sim_new(config);
+    nci_sim_set_clock(test->sim, test->clock);
+    if (fault) {
+        test->fault = nci_fault_new(test->sim->io, fault);
+        nci_fault_set_clock(test->fault, test->clock);
+        self->hal = test->fault->io;
+    } else {
+        self->hal = test->sim->io;
+    }
+    self->io.fn = &test_sim_io_fn;
+
+    test->adapter = g_object_new(TEST_TYPE_ADAPTER, NULL);
+    nci_adapter_set_clock(test->adapter, test->clock);
+    nci_adapter_init_base(test->adapter, &self->io);
+
+    adapter = NFC_ADAPTER(test->adapter);
+    self->event_id[TEST_EVENT_TAG_ADDED] =
+        nfc_adapter_add_tag_added_handler(adapter,
+            test_sim_tag_added, test);
+    self->event_id[TEST_EVENT_TAG_REMOVED] =
+        nfc_adapter_add_tag_removed_handler(adapter,
+            test_sim_tag_removed, test);
+    self->event_id[TEST_EVENT_PEER_ADDED] =
+        nfc_adapter_add_peer_added_handler(adapter,
+            test_sim_peer_added, test);
+    self->event_id[TEST_EVENT_PEER_REMOVED] =
+        nfc_adapter_add_peer_removed_handler(adapter,
+            test_sim_peer_removed, test);
+    self->event_id[TEST_EVENT_HOST_ADDED] =
+        nfc_adapter_add_host_added_handler(adapter,
+            test_sim_host_added, test);
+    self->event_id[TEST_EVENT_HOST_REMOVED] =
+        nfc_adapter_add_host_removed_handler(adapter,
+            test_sim_host_removed, test);
+
+    nfc_adapter_set_enabled(adapter, TRUE);
+    nfc_adapter_request_power(adapter, TRUE);
+    nfc_adapter_request_mode(adapter, mode);
+
+    /* Reset, initialization and RF_DISCOVER */
+    test_sim_run(test, 100);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+    return test;
+}
+
+TestSim*
+test_sim_new(
+    const NciSimConfig* config,
+    NFC_MODE mode)
+{
+    return test_sim_new_full(config, NULL, mode);
+}
+
+TestSim*
+test_sim_new_fault(
+    const NciSimConfig* config,
+    const NciFaultConfig* fault,
+    NFC_MODE mode)
+{
+    return test_sim_new_full(config, fault, mode);
+}
+
+void
+test_sim_free(
+    TestSim* test)
+{
+    if (test) {
+        TestSimPriv* self = test_sim_cast(test);
+
+        nfc_adapter_remove_all_handlers(NFC_ADAPTER(test->adapter),
+            self->event_id);
+        g_object_unref(test->adapter);
+        nci_fault_free(test->fault);
+        nci_sim_free(test->sim);
+
+        /* Nothing may be scheduled on the clock by now */
+        g_assert_cmpuint(nci_virtual_clock_pending(test->clock), == ,0);
+        nci_virtual_clock_free(test->clock);
+        g_array_free(test->cmds, TRUE);
+        g_free(self);
+    }
+}
+
+void
+test_sim_run(
+    TestSim* test,
+    guint ms)
+{
+    nci_virtual_clock_run(test->clock, g_main_context_get_thread_default(),
+        (gint64) ms * 1000);
+}
+
+guint
+test_sim_state_visits(
+    TestSim* test,
+    const char* state)
+{
+    const char* name;
+    guint i;
+
+    for (i = 0; (name = nci_adapter_state_name(i)) != NULL; i++) {
+        if (!g_strcmp0(name, state)) {
+            NciResidency res;
+
+            g_assert(nci_adapter_get_state_residency(test->adapter, i, &res));
+            return res.visits;
+        }
+    }
+    g_assert_not_reached();
+    return 0;
+}
+
+guint
+test_sim_cmd_count(
+    TestSim* test,
+    guint8 gid,
+    guint8 oid)
+{
+    const guint cmd = TEST_SIM_CMD(gid, oid);
+    guint i, n = 0;
+
+    for (i = 0; i < test->cmds->len; i++) {
+        if (g_array_index(test->cmds, guint, i) == cmd) {
+            n++;
+        }
+    }
+    return n;
+}
+
+guint64
+test_sim_latency_count(
+    TestSim* test,
+    NCI_ADAPTER_LATENCY which)
+{
+    NciLatency latency;
+
+    g_assert(nci_adapter_get_latency(test->adapter, which, &latency));
+    return latency.hist.count;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include "nci_adapter_impl.h"
+#include "nci_clock.h"
+#include "nci_fault.h"
+#include "nci_stats.h"
+#include "nci_sim.h"
+
+#define TEST_FLAG_DEBUG (0x01)
+#define TEST_SIM_CMD(gid,oid) (((guint)(gid) << 8) | (oid))
+
+typedef struct test_opt {
+    int flags;
+} TestOpt;
+
+/* Should be invoked after g_test_init */
+void
+test_init(
+    TestOpt* opt,
+    int argc,
+    char* argv[]);
+
+/*
+ * NciAdapter talking to NciSim, both running on the virtual clock.
+ * Counts what's going on at NFC core level and what's being sent to
+ * the simulated NFCC.
+ */
+
+typedef struct test_sim {
+    NciClock* clock;
+    NciSim* sim;
+    NciFault* fault;        /* NULL unless test_sim_new_fault() */
+    NciAdapter* adapter;
+    GArray* cmds;           /* TEST_SIM_CMD() of each command, in order */
+    guint tx_data;          /* Data packets sent to NFCC */
+    guint poll_modes;       /* Ever requested by RF_DISCOVER_CMD, */
+    guint listen_modes;     /* bit number is NCI_MODE & 0x1f */
+    guint tags_added;
+    guint tags_removed;
+    guint peers_added;
+    guint peers_removed;
+    guint hosts_added;
+    guint hosts_removed;
+} TestSim;
+
+/* Powers the adapter up and lets it reach RFST_DISCOVERY */
+TestSim*
+test_sim_new(
+    const NciSimConfig* config, /* NULL for defaults */
+    NFC_MODE mode);
+
+/* Same with NciFault between the adapter and NciSim */
+TestSim*
+test_sim_new_fault(
+    const NciSimConfig* config,
+    const NciFaultConfig* fault,
+    NFC_MODE mode);
+
+void
+test_sim_free(
+    TestSim* test);
+
+/*
+ * Advances the virtual time, processing everything on the way. Runs
+ * the thread-default context, the harness can be used by more than one
+ * thread at a time as long as each one has its own.
+ */
+void
+test_sim_run(
+    TestSim* test,
+    guint ms);
+
+/* Completed visits to the adapter state, by name */
+guint
+test_sim_state_visits(
+    TestSim* test,
+    const char* state);
+
+/* Number of commands with this GID and OID sent to NFCC */
+guint
+test_sim_cmd_count(
+    TestSim* test,
+    guint8 gid,
+    guint8 oid);
+
+/* Number of samples */
+guint64
+test_sim_latency_count(
+    TestSim* test,
+    NCI_ADAPTER_LATENCY which);
+
+#endif /* TEST_COMMON_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
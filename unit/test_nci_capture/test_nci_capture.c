@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include "nci_capture.h"
+#include "nci_replay.h"
+
+#include <gutil_macros.h>
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+static TestOpt test_opt;
+
+/* Doesn't fit into the 32-bit delta, needs a CLOCK record */
+#define TEST_LONG_GAP (G_GINT64_CONSTANT(0x100000000) + 5000)
+
+static const guint8 test_reset_cmd[] = { 0x20, 0x00, 0x01, 0x00 };
+static const guint8 test_reset_rsp[] = { 0x40, 0x00, 0x03, 0x00, 0x10, 0x00 };
+static const guint8 test_init_cmd[] = { 0x20, 0x01, 0x00 };
+static const guint8 test_ntf1[] = { 0x61, 0x05, 0x02, 0x01, 0x02 };
+static const guint8 test_ntf2[] = {
+    0x61, 0x06, 0x04, 0x01, 0x02, 0x03, 0x04
+};
+
+/*
+ * Records of the test capture. Frames of odd sizes are there to
+ * check the padding, the last one is preceded by a CLOCK record.
+ */
+#define TEST_REC_RESET_CMD (NCI_CAPTURE_HEADER_SIZE)
+#define TEST_REC_RESET_RSP (TEST_REC_RESET_CMD + 8 + 4)
+#define TEST_REC_INIT_CMD (TEST_REC_RESET_RSP + 8 + 8)
+#define TEST_REC_NTF1 (TEST_REC_INIT_CMD + 8 + 4)
+#define TEST_REC_CLOCK (TEST_REC_NTF1 + 8 + 8)
+#define TEST_REC_NTF2 (TEST_REC_CLOCK + 8 + 8)
+#define TEST_CAPTURE_SIZE (TEST_REC_NTF2 + 8 + 8)
+
+typedef struct test_capture {
+    char* dir;
+    char* path;
+} TestCapture;
+
+typedef struct test_replay {
+    NciHalClient client;
+    NciClock* clock;
+    NciReplay* replay;
+    GPtrArray* rx;              /* GBytes */
+    GArray* rx_time;            /* gint64 */
+    guint writes_done;
+    gboolean done;
+} TestReplay;
+
+static
+void
+test_capture_frame(
+    NciCapture* capture,
+    gint64 now,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const guint8* frame,
+    guint len)
+{
+    GUtilData chunk;
+
+    chunk.bytes = frame;
+    chunk.size = len;
+    nci_capture_frame_at(capture, now, type, &chunk, 1);
+}
+
+static
+void
+test_capture_init(
+    TestCapture* test)
+{
+    const gint64 t0 = NCI_VIRTUAL_CLOCK_START;
+    NciCapture* capture;
+    GUtilData chunks[2];
+
+    test->dir = g_dir_make_tmp("test_nci_capture_XXXXXX", NULL);
+    g_assert(test->dir);
+    test->path = g_build_filename(test->dir, "capture", NULL);
+    capture = nci_capture_new(test->path);
+    g_assert(capture);
+
+    test_capture_frame(capture, t0, NCI_CAPTURE_RECORD_TX,
+        test_reset_cmd, sizeof(test_reset_cmd));
+
+    /* Scattered frame gets written as one */
+    chunks[0].bytes = test_reset_rsp;
+    chunks[0].size = 3;
+    chunks[1].bytes = test_reset_rsp + 3;
+    chunks[1].size = sizeof(test_reset_rsp) - 3;
+    nci_capture_frame_at(capture, t0 + 1000, NCI_CAPTURE_RECORD_RX,
+        chunks, 2);
+
+    test_capture_frame(capture, t0 + 1500, NCI_CAPTURE_RECORD_TX,
+        test_init_cmd, sizeof(test_init_cmd));
+    test_capture_frame(capture, t0 + 3500, NCI_CAPTURE_RECORD_RX,
+        test_ntf1, sizeof(test_ntf1));
+    test_capture_frame(capture, t0 + 3500 + TEST_LONG_GAP,
+        NCI_CAPTURE_RECORD_RX, test_ntf2, sizeof(test_ntf2));
+    nci_capture_unref(capture);
+}
+
+/* Leaves only the first size bytes of the capture */
+static
+void
+test_capture_truncate(
+    TestCapture* test,
+    gsize size)
+{
+    gchar* data = NULL;
+    gsize len = 0;
+
+    g_assert(g_file_get_contents(test->path, &data, &len, NULL));
+    g_assert_cmpuint(len, >= ,size);
+    g_assert(g_file_set_contents(test->path, data, size, NULL));
+    g_free(data);
+}
+
+static
+void
+test_capture_deinit(
+    TestCapture* test)
+{
+    g_unlink(test->path);
+    g_rmdir(test->dir);
+    g_free(test->path);
+    g_free(test->dir);
+}
+
+/* Returns the offset of the next record */
+static
+guint
+test_capture_check_record(
+    const guint8* data,
+    guint off,
+    guint32 delta,
+    NCI_CAPTURE_RECORD_TYPE type,
+    const guint8* frame,
+    guint len)
+{
+    const guint8* rec = data + off;
+    guint i;
+
+    g_assert_cmpuint(off % 4, == ,0);
+    g_assert_cmpuint(rec[0] | (rec[1] << 8) | (rec[2] << 16) |
+        ((guint32) rec[3] << 24), == ,delta);
+    g_assert_cmpuint(rec[4] | (rec[5] << 8), == ,len);
+    g_assert_cmpuint(rec[6], == ,type);
+    g_assert_cmpuint(rec[7], == ,0);
+    g_assert(!memcmp(rec + NCI_CAPTURE_RECORD_HEADER_SIZE, frame, len));
+
+    /* Padded with zeros */
+    for (i = len; i % 4; i++) {
+        g_assert_cmpuint(rec[NCI_CAPTURE_RECORD_HEADER_SIZE + i], == ,0);
+    }
+    return off + NCI_CAPTURE_RECORD_HEADER_SIZE + i;
+}
+
+static
+void
+test_replay_client_error(
+    NciHalClient* client)
+{
+    g_assert_not_reached();
+}
+
+static
+void
+test_replay_client_read(
+    NciHalClient* client,
+    const void* data,
+    guint len)
+{
+    TestReplay* test = G_CAST(client, TestReplay, client);
+    const gint64 now = nci_clock_now(test->clock);
+
+    g_ptr_array_add(test->rx, g_bytes_new(data, len));
+    g_array_append_val(test->rx_time, now);
+}
+
+static
+void
+test_replay_write_done(
+    NciHalClient* client,
+    gboolean ok)
+{
+    TestReplay* test = G_CAST(client, TestReplay, client);
+
+    g_assert(ok);
+    test->writes_done++;
+}
+
+static
+void
+test_replay_done(
+    NciReplay* replay,
+    void* user_data)
+{
+    TestReplay* test = user_data;
+
+    g_assert(!test->done);
+    test->done = TRUE;
+}
+
+static
+void
+test_replay_init(
+    TestReplay* test,
+    const char* path)
+{
+    static const NciHalClientFunctions test_client_fn = {
+        .error = test_replay_client_error,
+        .read = test_replay_client_read
+    };
+    NciHalIo* io;
+
+    memset(test, 0, sizeof(*test));
+    test->client.fn = &test_client_fn;
+    test->clock = nci_virtual_clock_new();
+    test->rx = g_ptr_array_new_with_free_func((GDestroyNotify)
+        g_bytes_unref);
+    test->rx_time = g_array_new(FALSE, FALSE, sizeof(gint64));
+    test->replay = nci_replay_new(path, 1.0, test_replay_done, test);
+    g_assert(test->replay);
+    nci_replay_set_clock(test->replay, test->clock);
+    io = test->replay->io;
+    g_assert(io->fn->start(io, &test->client));
+}
+
+static
+void
+test_replay_run(
+    TestReplay* test,
+    gint64 us)
+{
+    nci_virtual_clock_run(test->clock, NULL, us);
+}
+
+static
+void
+test_replay_write(
+    TestReplay* test,
+    const guint8* frame,
+    guint len)
+{
+    NciHalIo* io = test->replay->io;
+    GUtilData chunk;
+
+    chunk.bytes = frame;
+    chunk.size = len;
+    g_assert(io->fn->write(io, &chunk, 1, test_replay_write_done));
+}
+
+static
+void
+test_replay_check_rx(
+    TestReplay* test,
+    guint i,
+    const guint8* frame,
+    guint len)
+{
+    const guint8* data;
+    gsize size;
+
+    g_assert_cmpuint(test->rx->len, > ,i);
+    data = g_bytes_get_data(test->rx->pdata[i], &size);
+    g_assert_cmpuint(size, == ,len);
+    g_assert(!memcmp(data, frame, len));
+}
+
+static
+void
+test_replay_deinit(
+    TestReplay* test)
+{
+    NciHalIo* io = test->replay->io;
+
+    io->fn->stop(io);
+    nci_replay_free(test->replay);
+    g_assert_cmpuint(nci_virtual_clock_pending(test->clock), == ,0);
+    nci_virtual_clock_free(test->clock);
+    g_ptr_array_free(test->rx, TRUE);
+    g_array_free(test->rx_time, TRUE);
+}
+
+/* Plays the host's part, returns the number of RX frames */
+static
+guint
+test_replay_script(
+    TestReplay* test)
+{
+    gint64 t;
+
+    /* Nothing happens until the host writes the first frame */
+    test_replay_run(test, 10000);
+    g_assert_cmpuint(test->rx->len, == ,0);
+    g_assert(!test->done);
+
+    t = nci_clock_now(test->clock);
+    test_replay_write(test, test_reset_cmd, sizeof(test_reset_cmd));
+    test_replay_run(test, 10000);
+    g_assert_cmpuint(test->writes_done, == ,1);
+    g_assert_cmpuint(test->rx->len, == ,1);
+    test_replay_check_rx(test, 0, test_reset_rsp, sizeof(test_reset_rsp));
+    g_assert_cmpint(g_array_index(test->rx_time, gint64, 0) - t, == ,1000);
+
+    t = nci_clock_now(test->clock);
+    test_replay_write(test, test_init_cmd, sizeof(test_init_cmd));
+    test_replay_run(test, TEST_LONG_GAP + 10000);
+    g_assert_cmpuint(test->writes_done, == ,2);
+    g_assert_cmpuint(test->rx->len, >= ,2);
+    test_replay_check_rx(test, 1, test_ntf1, sizeof(test_ntf1));
+    g_assert_cmpint(g_array_index(test->rx_time, gint64, 1) - t, == ,2000);
+    return test->rx->len;
+}
+
+/*==========================================================================*
+ * write
+ *==========================================================================*/
+
+static
+void
+test_write(
+    void)
+{
+    TestCapture capture;
+    gchar* contents = NULL;
+    const guint8* data;
+    gsize size = 0;
+    guint off;
+
+    test_capture_init(&capture);
+    g_assert(g_file_get_contents(capture.path, &contents, &size, NULL));
+    data = (const guint8*) contents;
+
+    /* Header */
+    g_assert_cmpuint(size, == ,TEST_CAPTURE_SIZE);
+    g_assert(!memcmp(data, NCI_CAPTURE_MAGIC, NCI_CAPTURE_MAGIC_SIZE));
+    g_assert_cmpuint(data[6] | (data[7] << 8), == ,NCI_CAPTURE_VERSION);
+
+    /* Records */
+    off = test_capture_check_record(data, NCI_CAPTURE_HEADER_SIZE, 0,
+        NCI_CAPTURE_RECORD_TX, test_reset_cmd, sizeof(test_reset_cmd));
+    g_assert_cmpuint(off, == ,TEST_REC_RESET_RSP);
+    off = test_capture_check_record(data, off, 1000,
+        NCI_CAPTURE_RECORD_RX, test_reset_rsp, sizeof(test_reset_rsp));
+    g_assert_cmpuint(off, == ,TEST_REC_INIT_CMD);
+    off = test_capture_check_record(data, off, 500,
+        NCI_CAPTURE_RECORD_TX, test_init_cmd, sizeof(test_init_cmd));
+    g_assert_cmpuint(off, == ,TEST_REC_NTF1);
+    off = test_capture_check_record(data, off, 2000,
+        NCI_CAPTURE_RECORD_RX, test_ntf1, sizeof(test_ntf1));
+    g_assert_cmpuint(off, == ,TEST_REC_CLOCK);
+
+    /* CLOCK record carries the offset since the first record */
+    g_assert_cmpuint(data[off + 4] | (data[off + 5] << 8), == ,8);
+    g_assert_cmpuint(data[off + 6], == ,NCI_CAPTURE_RECORD_CLOCK);
+    {
+        const guint8* p = data + off + NCI_CAPTURE_RECORD_HEADER_SIZE;
+        guint64 offset = 0;
+        int i;
+
+        for (i = 7; i >= 0; i--) {
+            offset = (offset << 8) | p[i];
+        }
+        g_assert_cmpuint(offset, == ,3500 + TEST_LONG_GAP);
+    }
+    off += NCI_CAPTURE_RECORD_HEADER_SIZE + 8;
+    g_assert_cmpuint(off, == ,TEST_REC_NTF2);
+    off = test_capture_check_record(data, off, 0,
+        NCI_CAPTURE_RECORD_RX, test_ntf2, sizeof(test_ntf2));
+    g_assert_cmpuint(off, == ,size);
+
+    g_free(contents);
+    test_capture_deinit(&capture);
+}
+
+/*==========================================================================*
+ * replay
+ *==========================================================================*/
+
+static
+void
+test_replay(
+    void)
+{
+    TestCapture capture;
+    TestReplay test;
+
+    test_capture_init(&capture);
+    test_replay_init(&test, capture.path);
+    g_assert_cmpuint(test_replay_script(&test), == ,3);
+
+    /* The delay accumulated by the CLOCK record is preserved */
+    test_replay_check_rx(&test, 2, test_ntf2, sizeof(test_ntf2));
+    g_assert_cmpint(g_array_index(test.rx_time, gint64, 2) -
+        g_array_index(test.rx_time, gint64, 1), == ,
+        TEST_LONG_GAP / 1000 * 1000);
+    g_assert(test.done);
+    g_assert_cmpuint(test.replay->frames, == ,5);
+    g_assert_cmpuint(test.replay->mismatches, == ,0);
+
+    test_replay_deinit(&test);
+    test_capture_deinit(&capture);
+}
+
+/*==========================================================================*
+ * mismatch
+ *==========================================================================*/
+
+static
+void
+test_mismatch(
+    void)
+{
+    static const guint8 wrong_cmd[] = { 0x20, 0x00, 0x01, 0x01 };
+    TestCapture capture;
+    TestReplay test;
+
+    /* Mismatch is counted, the replay goes on */
+    test_capture_init(&capture);
+    test_replay_init(&test, capture.path);
+    test_replay_write(&test, wrong_cmd, sizeof(wrong_cmd));
+    test_replay_run(&test, 10000);
+    g_assert_cmpuint(test.replay->mismatches, == ,1);
+    test_replay_check_rx(&test, 0, test_reset_rsp, sizeof(test_reset_rsp));
+
+    test_replay_deinit(&test);
+    test_capture_deinit(&capture);
+}
+
+/*==========================================================================*
+ * truncated
+ *==========================================================================*/
+
+static
+void
+test_truncated(
+    gsize size,
+    guint rx_count)
+{
+    TestCapture capture;
+    TestReplay test;
+
+    test_capture_init(&capture);
+    test_capture_truncate(&capture, size);
+    test_replay_init(&test, capture.path);
+    g_assert_cmpuint(test_replay_script(&test), == ,rx_count);
+
+    /* Whatever was complete has been replayed */
+    g_assert(test.done);
+    g_assert_cmpuint(test.replay->frames, == ,rx_count + 2);
+    g_assert_cmpuint(test.replay->mismatches, == ,0);
+
+    test_replay_deinit(&test);
+    test_capture_deinit(&capture);
+}
+
+static
+void
+test_truncated_padding(
+    void)
+{
+    /* The last frame is there, only its padding is missing */
+    test_truncated(TEST_REC_NTF2 + 8 + sizeof(test_ntf2), 3);
+}
+
+static
+void
+test_truncated_frame(
+    void)
+{
+    test_truncated(TEST_REC_NTF2 + 8 + sizeof(test_ntf2) - 1, 2);
+}
+
+static
+void
+test_truncated_header(
+    void)
+{
+    test_truncated(TEST_REC_NTF2 + 4, 2);
+}
+
+static
+void
+test_truncated_clock(
+    void)
+{
+    test_truncated(TEST_REC_CLOCK + 8 + 4, 2);
+}
+
+static
+void
+test_truncated_record(
+    void)
+{
+    /* Ends right after a complete record */
+    test_truncated(TEST_REC_CLOCK, 2);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_capture/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("write"), test_write);
+    g_test_add_func(TEST_("replay"), test_replay);
+    g_test_add_func(TEST_("mismatch"), test_mismatch);
+    g_test_add_func(TEST_("truncated/padding"), test_truncated_padding);
+    g_test_add_func(TEST_("truncated/frame"), test_truncated_frame);
+    g_test_add_func(TEST_("truncated/header"), test_truncated_header);
+    g_test_add_func(TEST_("truncated/clock"), test_truncated_clock);
+    g_test_add_func(TEST_("truncated/record"), test_truncated_record);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * Checks that the adapter sticks to the PEER/CE configuration it was
+ * built with. The top level "make test" runs this in all of them.
+ */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <nfc_adapter_impl.h>
+
+static TestOpt test_opt;
+
+#define TEST_ALL_MODES (NFC_MODE_READER_WRITER | NFC_MODE_P2P_INITIATOR | \
+    NFC_MODE_P2P_TARGET | NFC_MODE_CARD_EMILATION)
+#define TEST_MODE_BIT(mode) (1u << ((mode) & 0x1f))
+#define TEST_ACTIVE_MODES (TEST_MODE_BIT(NCI_MODE_ACTIVE_POLL_A) | \
+    TEST_MODE_BIT(NCI_MODE_ACTIVE_POLL_F))
+
+static
+void
+test_objects_gone(
+    void)
+{
+    NciObjectCounts counts;
+
+    nci_adapter_object_counts(&counts);
+    g_assert_cmpuint(counts.targets, == ,0);
+    g_assert_cmpuint(counts.initiators, == ,0);
+}
+
+/*==========================================================================*
+ * modes
+ *==========================================================================*/
+
+static
+void
+test_modes(
+    void)
+{
+    TestSim* test = test_sim_new(NULL, TEST_ALL_MODES);
+    NfcAdapter* adapter = NFC_ADAPTER(test->adapter);
+
+    /* Reader/writer is always there */
+    g_assert(adapter->supported_modes & NFC_MODE_READER_WRITER);
+    g_assert(test->poll_modes & TEST_MODE_BIT(NCI_MODE_PASSIVE_POLL_A));
+
+    if (NCI_PLUGIN_PEER) {
+        g_assert(adapter->supported_modes & NFC_MODE_P2P_INITIATOR);
+        g_assert(adapter->supported_modes & NFC_MODE_P2P_TARGET);
+    } else {
+        g_assert(!(adapter->supported_modes & (NFC_MODE_P2P_INITIATOR |
+            NFC_MODE_P2P_TARGET)));
+        g_assert(!(test->poll_modes & TEST_ACTIVE_MODES));
+        g_assert(!(test->listen_modes & TEST_ACTIVE_MODES));
+    }
+
+    if (NCI_PLUGIN_CE) {
+        g_assert(adapter->supported_modes & NFC_MODE_CARD_EMILATION);
+    } else {
+        g_assert(!(adapter->supported_modes & NFC_MODE_CARD_EMILATION));
+    }
+
+    if (NCI_PLUGIN_PEER || NCI_PLUGIN_CE) {
+        g_assert(test->listen_modes);
+    } else {
+        /* Reader-only never listens */
+        g_assert_cmpuint(test->listen_modes, == ,0);
+    }
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * tag
+ *==========================================================================*/
+
+static
+void
+test_tag(
+    void)
+{
+    TestSim* test = test_sim_new(NULL, TEST_ALL_MODES);
+    NciSimObject* obj = nci_sim_tag_t2_new(NULL, NULL);
+
+    nci_sim_place(test->sim, obj);
+    test_sim_run(test, 100);
+    g_assert_cmpuint(test->tags_added, == ,1);
+
+    nci_sim_take(test->sim);
+    test_sim_run(test, 100);
+    g_assert_cmpuint(test->tags_removed, == ,1);
+    nci_sim_object_unref(obj);
+    test_sim_free(test);
+    test_objects_gone();
+}
+
+/*==========================================================================*
+ * peer
+ *==========================================================================*/
+
+static
+void
+test_peer(
+    void)
+{
+    TestSim* test = test_sim_new(NULL, TEST_ALL_MODES);
+    NciSimObject* obj = nci_sim_peer_new();
+
+    nci_sim_place(test->sim, obj);
+    test_sim_run(test, 100);
+    if (NCI_PLUGIN_PEER) {
+        g_assert_cmpuint(test->peers_added, == ,1);
+    } else {
+        NciObjectCounts counts;
+
+        /* NFC-DEP target is ignored */
+        g_assert_cmpuint(test->peers_added, == ,0);
+        g_assert_cmpuint(test->tags_added, == ,0);
+        nci_adapter_object_counts(&counts);
+        g_assert_cmpuint(counts.targets, == ,0);
+    }
+
+    nci_sim_take(test->sim);
+    test_sim_run(test, 100);
+    g_assert_cmpuint(test->peers_removed, == ,test->peers_added);
+    nci_sim_object_unref(obj);
+    test_sim_free(test);
+    test_objects_gone();
+}
+
+/*==========================================================================*
+ * reader
+ *==========================================================================*/
+
+static
+void
+test_reader(
+    void)
+{
+    TestSim* test = test_sim_new(NULL, TEST_ALL_MODES);
+    NciSimObject* obj = nci_sim_reader_new(NULL, 0, NULL, NULL);
+
+    nci_sim_place(test->sim, obj);
+    test_sim_run(test, 100);
+    if (NCI_PLUGIN_CE) {
+        g_assert_cmpuint(test->hosts_added, == ,1);
+    } else {
+        NciObjectCounts counts;
+
+        /* Nothing is listening, so no initiator either */
+        g_assert_cmpuint(test->hosts_added, == ,0);
+        g_assert_cmpuint(test->peers_added, == ,0);
+        nci_adapter_object_counts(&counts);
+        g_assert_cmpuint(counts.initiators, == ,0);
+    }
+
+    /* Let the CE reactivation timeout expire */
+    nci_sim_take(test->sim);
+    test_sim_run(test, 2000);
+    g_assert_cmpuint(test->hosts_removed, == ,test->hosts_added);
+    nci_sim_object_unref(obj);
+    test_sim_free(test);
+    test_objects_gone();
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_config/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("modes"), test_modes);
+    g_test_add_func(TEST_("tag"), test_tag);
+    g_test_add_func(TEST_("peer"), test_peer);
+    g_test_add_func(TEST_("reader"), test_reader);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include "nci_hal_dev.h"
+#include "nci_plugin_p.h"
+
+#include <gutil_macros.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static TestOpt test_opt;
+
+/*
+ * NciHalDev owns one end of a socketpair, the test plays the NFCC
+ * on the other one.
+ */
+
+typedef struct test_dev {
+    NciHalClient client;
+    NciHalDev* dev;
+    int fd;
+    GByteArray* rx;             /* Everything received */
+    guint packets;
+    guint errors;
+    guint completed;
+} TestDev;
+
+static inline TestDev* test_dev_cast(NciHalClient* client)
+    { return G_CAST(client, TestDev, client); }
+
+static const guint8 test_pkt1[] = { 0x60, 0x06, 0x03, 0x01, 0x00, 0x01 };
+static const guint8 test_pkt2[] = { 0x61, 0x05, 0x00 };
+static const guint8 test_pkt3[] = { 0x00, 0x00, 0x02, 0x90, 0x00 };
+
+static
+void
+test_dev_error(
+    NciHalClient* client)
+{
+    test_dev_cast(client)->errors++;
+}
+
+static
+void
+test_dev_read(
+    NciHalClient* client,
+    const void* data,
+    guint len)
+{
+    TestDev* test = test_dev_cast(client);
+
+    /* Each callback gets exactly one packet */
+    g_assert_cmpuint(len, >= ,3);
+    g_assert_cmpuint(len, == ,3 + ((const guint8*)data)[2]);
+    g_byte_array_append(test->rx, data, len);
+    test->packets++;
+}
+
+static
+void
+test_dev_complete(
+    NciHalClient* client,
+    gboolean ok)
+{
+    g_assert(ok);
+    test_dev_cast(client)->completed++;
+}
+
+static
+void
+test_dev_init(
+    TestDev* test,
+    NCI_HAL_DEV_FLAGS flags)
+{
+    static const NciHalClientFunctions test_client_fn = {
+        .error = test_dev_error,
+        .read = test_dev_read
+    };
+    int fd[2];
+
+    memset(test, 0, sizeof(*test));
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    test->client.fn = &test_client_fn;
+    test->dev = nci_hal_dev_new_fd(fd[0], flags);
+    test->fd = fd[1];
+    test->rx = g_byte_array_new();
+    g_assert(test->dev);
+    g_assert(test->dev->io->fn->start(test->dev->io, &test->client));
+}
+
+static
+void
+test_dev_deinit(
+    TestDev* test)
+{
+    test->dev->io->fn->stop(test->dev->io);
+    nci_hal_dev_free(test->dev);
+    g_byte_array_unref(test->rx);
+    close(test->fd);
+}
+
+static
+void
+test_dev_send(
+    TestDev* test,
+    const void* data,
+    gsize len)
+{
+    g_assert_cmpint(write(test->fd, data, len), == ,len);
+}
+
+static
+void
+test_dev_run(
+    void)
+{
+    while (g_main_context_iteration(NULL, FALSE));
+}
+
+static
+void
+test_dev_assert_rx(
+    TestDev* test,
+    const GUtilData* expected,
+    guint count)
+{
+    guint i, off = 0;
+
+    for (i = 0; i < count; i++) {
+        g_assert_cmpuint(test->rx->len, >= ,off + expected[i].size);
+        g_assert(!memcmp(test->rx->data + off, expected[i].bytes,
+            expected[i].size));
+        off += expected[i].size;
+    }
+    g_assert_cmpuint(test->rx->len, == ,off);
+}
+
+/*==========================================================================*
+ * batch
+ *==========================================================================*/
+
+static
+void
+test_batch_flags(
+    NCI_HAL_DEV_FLAGS flags)
+{
+    static const GUtilData pkts[] = {
+        { test_pkt1, sizeof(test_pkt1) },
+        { test_pkt2, sizeof(test_pkt2) },
+        { test_pkt3, sizeof(test_pkt3) }
+    };
+    TestDev test;
+    guint8 buf[sizeof(test_pkt1) + sizeof(test_pkt2) + sizeof(test_pkt3)];
+
+    memcpy(buf, test_pkt1, sizeof(test_pkt1));
+    memcpy(buf + sizeof(test_pkt1), test_pkt2, sizeof(test_pkt2));
+    memcpy(buf + sizeof(test_pkt1) + sizeof(test_pkt2), test_pkt3,
+        sizeof(test_pkt3));
+
+    /* Three packets arrive at once and are handled in one wakeup */
+    test_dev_init(&test, flags);
+    test_dev_send(&test, buf, sizeof(buf));
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,3);
+    g_assert_cmpuint(test.errors, == ,0);
+    g_assert_cmpuint(test.dev->rx_packets, == ,3);
+    g_assert_cmpuint(test.dev->rx_wakeups, == ,1);
+    test_dev_assert_rx(&test, pkts, G_N_ELEMENTS(pkts));
+    test_dev_deinit(&test);
+}
+
+static
+void
+test_batch(
+    void)
+{
+    test_batch_flags(NCI_HAL_DEV_FLAGS_NONE);
+}
+
+static
+void
+test_batch_split_reads(
+    void)
+{
+    test_batch_flags(NCI_HAL_DEV_FLAG_SPLIT_READS);
+}
+
+/*==========================================================================*
+ * partial
+ *==========================================================================*/
+
+static
+void
+test_partial(
+    void)
+{
+    static const GUtilData pkts[] = {
+        { test_pkt1, sizeof(test_pkt1) },
+        { test_pkt3, sizeof(test_pkt3) }
+    };
+    TestDev test;
+
+    test_dev_init(&test, NCI_HAL_DEV_FLAGS_NONE);
+
+    /* Half of the header */
+    test_dev_send(&test, test_pkt1, 2);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,0);
+
+    /* The rest of the header and a part of the payload */
+    test_dev_send(&test, test_pkt1 + 2, 2);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,0);
+
+    /* The rest of the first packet glued to the beginning of the next */
+    test_dev_send(&test, test_pkt1 + 4, sizeof(test_pkt1) - 4);
+    test_dev_send(&test, test_pkt3, 1);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,1);
+
+    test_dev_send(&test, test_pkt3 + 1, sizeof(test_pkt3) - 1);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,2);
+    g_assert_cmpuint(test.errors, == ,0);
+    test_dev_assert_rx(&test, pkts, G_N_ELEMENTS(pkts));
+    test_dev_deinit(&test);
+}
+
+/*==========================================================================*
+ * short
+ *==========================================================================*/
+
+static
+void
+test_short(
+    void)
+{
+    TestDev test;
+
+    /* With split reads, the payload must follow the header */
+    test_dev_init(&test, NCI_HAL_DEV_FLAG_SPLIT_READS);
+    test_dev_send(&test, test_pkt1, sizeof(test_pkt1) - 1);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,0);
+    g_assert_cmpuint(test.errors, == ,1);
+    test_dev_deinit(&test);
+}
+
+/*==========================================================================*
+ * eof
+ *==========================================================================*/
+
+static
+void
+test_eof(
+    void)
+{
+    TestDev test;
+
+    test_dev_init(&test, NCI_HAL_DEV_FLAGS_NONE);
+    test_dev_send(&test, test_pkt2, sizeof(test_pkt2));
+    shutdown(test.fd, SHUT_WR);
+    test_dev_run();
+    g_assert_cmpuint(test.packets, == ,1);
+    g_assert_cmpuint(test.errors, == ,1);
+    test_dev_deinit(&test);
+}
+
+/*==========================================================================*
+ * write
+ *==========================================================================*/
+
+static
+void
+test_write(
+    void)
+{
+    TestDev test;
+    GUtilData chunks[2];
+    guint8 buf[sizeof(test_pkt1)];
+
+    test_dev_init(&test, NCI_HAL_DEV_FLAGS_NONE);
+
+    /* Header and payload go out with one write, completion is async */
+    chunks[0].bytes = test_pkt1;
+    chunks[0].size = NCI_HDR_SIZE;
+    chunks[1].bytes = test_pkt1 + NCI_HDR_SIZE;
+    chunks[1].size = sizeof(test_pkt1) - NCI_HDR_SIZE;
+    g_assert(test.dev->io->fn->write(test.dev->io, chunks, 2,
+        test_dev_complete));
+    g_assert_cmpuint(test.completed, == ,0);
+    test_dev_run();
+    g_assert_cmpuint(test.completed, == ,1);
+    g_assert_cmpuint(test.dev->tx_writes, == ,1);
+
+    g_assert_cmpint(read(test.fd, buf, sizeof(buf)), == ,sizeof(buf));
+    g_assert(!memcmp(buf, test_pkt1, sizeof(buf)));
+    test_dev_deinit(&test);
+}
+
+/*==========================================================================*
+ * write_partial
+ *==========================================================================*/
+
+static
+void
+test_write_partial(
+    void)
+{
+    TestDev test;
+    GUtilData chunk;
+    guint8 pkt[NCI_HDR_SIZE + 0xff];
+    guint8 buf[1024];
+    gsize filled = 0, drained = 0;
+    GByteArray* out = g_byte_array_new();
+    int sndbuf = 1;
+    ssize_t n;
+
+    test_dev_init(&test, NCI_HAL_DEV_FLAGS_NONE);
+    setsockopt(test.dev->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    /* Fill the socket up so that the next write can't go out in full */
+    memset(buf, 0xff, sizeof(buf));
+    while ((n = write(test.dev->fd, buf, sizeof(buf))) > 0) {
+        filled += n;
+    }
+    g_assert_cmpint(errno, == ,EAGAIN);
+
+    pkt[0] = 0x00;
+    pkt[1] = 0x00;
+    pkt[2] = 0xff;
+    for (n = NCI_HDR_SIZE; n < (ssize_t) sizeof(pkt); n++) {
+        pkt[n] = (guint8) n;
+    }
+    chunk.bytes = pkt;
+    chunk.size = sizeof(pkt);
+    g_assert(test.dev->io->fn->write(test.dev->io, &chunk, 1,
+        test_dev_complete));
+
+    /* Still waiting for the room, and nothing else may be written */
+    test_dev_run();
+    g_assert_cmpuint(test.completed, == ,0);
+    g_assert(!test.dev->io->fn->write(test.dev->io, &chunk, 1,
+        test_dev_complete));
+
+    /* Make some room a bit at a time, the rest goes out as it frees up */
+    while (drained < filled + sizeof(pkt)) {
+        n = read(test.fd, buf, sizeof(buf) / 4);
+        if (n > 0) {
+            if (drained + n > filled) {
+                const gsize skip = (drained < filled) ? (filled - drained) : 0;
+
+                g_byte_array_append(out, buf + skip, n - skip);
+            }
+            drained += n;
+        }
+        test_dev_run();
+    }
+    g_assert_cmpuint(test.completed, == ,1);
+    g_assert_cmpuint(out->len, == ,sizeof(pkt));
+    g_assert(!memcmp(out->data, pkt, sizeof(pkt)));
+    g_assert_cmpuint(test.errors, == ,0);
+    g_byte_array_unref(out);
+    test_dev_deinit(&test);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_hal_dev/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("batch"), test_batch);
+    g_test_add_func(TEST_("batch_split_reads"), test_batch_split_reads);
+    g_test_add_func(TEST_("partial"), test_partial);
+    g_test_add_func(TEST_("short"), test_short);
+    g_test_add_func(TEST_("eof"), test_eof);
+    g_test_add_func(TEST_("write"), test_write);
+    g_test_add_func(TEST_("write_partial"), test_write_partial);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
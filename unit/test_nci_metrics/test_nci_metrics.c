@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include "nci_metrics.h"
+#include "nci_plugin_p.h"
+
+#include <nfc_adapter.h>
+
+#include <string.h>
+
+static TestOpt test_opt;
+
+/* Needs escaping: backslash, quotes and newline */
+#define TEST_ADAPTER_NAME "nfc\"0\"\\\n"
+#define TEST_ADAPTER_LABEL "adapter=\"nfc\\\"0\\\"\\\\\\n\""
+#define TEST_LABELS TEST_ADAPTER_LABEL ",ins=\"a4\""
+#define TEST_INS (0xa4)
+
+/* Normally assigned by nfcd, the original one must be restored */
+static
+void
+test_set_name(
+    TestSim* test,
+    const char* name)
+{
+    NFC_ADAPTER(test->adapter)->name = name;
+}
+
+static
+char*
+test_line(
+    const char* name,
+    const char* labels,
+    const char* value)
+{
+    return g_strconcat("\n", name, "{" TEST_ADAPTER_LABEL, labels, "} ",
+        value, "\n", NULL);
+}
+
+static
+char*
+test_seconds(
+    guint64 us)
+{
+    return g_strdup_printf("%u.%06u", (guint) (us / 1000000),
+        (guint) (us % 1000000));
+}
+
+/*
+ * Checks that each family is announced once, by a single TYPE line
+ * followed by its samples, that counters end with _total, times are
+ * in seconds and histogram buckets are cumulative up to +Inf which
+ * matches the count.
+ */
+static
+void
+test_check_families(
+    const char* text)
+{
+    GHashTable* families = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, NULL);
+    char** lines = g_strsplit(text, "\n", -1);
+    char* family = NULL;
+    char* type = NULL;
+    guint64 bucket = 0, inf = 0;
+    guint i;
+
+    g_assert(g_str_has_suffix(text, "\n"));
+    for (i = 0; lines[i] && lines[i][0]; i++) {
+        const char* line = lines[i];
+
+        if (g_str_has_prefix(line, "# TYPE ")) {
+            char** parts = g_strsplit(line + 7, " ", -1);
+
+            g_assert_cmpuint(g_strv_length(parts), == ,2);
+            g_assert(!g_hash_table_contains(families, parts[0]));
+            g_assert(!strstr(parts[0], "_us"));
+            g_hash_table_add(families, g_strdup(parts[0]));
+            g_free(family);
+            g_free(type);
+            family = g_strdup(parts[0]);
+            type = g_strdup(parts[1]);
+            bucket = inf = 0;
+            g_strfreev(parts);
+        } else {
+            const char* labels = strchr(line, '{');
+            const char* value = strrchr(line, ' ');
+            char* name;
+            guint64 n;
+
+            g_assert(family);
+            g_assert(labels);
+            g_assert(value);
+            g_assert(g_str_has_prefix(labels, "{" TEST_ADAPTER_LABEL));
+            name = g_strndup(line, labels - line);
+            n = g_ascii_strtoull(value + 1, NULL, 10);
+            if (!strcmp(type, "histogram")) {
+                char* bucket_name = g_strconcat(family, "_bucket", NULL);
+                char* sum_name = g_strconcat(family, "_sum", NULL);
+                char* count_name = g_strconcat(family, "_count", NULL);
+
+                g_assert(g_str_has_suffix(family, "_seconds"));
+                if (!strcmp(name, bucket_name)) {
+                    g_assert_cmpuint(n, >= ,bucket);
+                    if (strstr(labels, ",le=\"+Inf\"}")) {
+                        /* Next series starts from scratch */
+                        inf = n;
+                        bucket = 0;
+                    } else {
+                        bucket = n;
+                    }
+                } else if (!strcmp(name, count_name)) {
+                    g_assert_cmpuint(n, == ,inf);
+                } else {
+                    g_assert_cmpstr(name, == ,sum_name);
+                }
+                g_free(bucket_name);
+                g_free(sum_name);
+                g_free(count_name);
+            } else {
+                g_assert_cmpstr(name, == ,family);
+                if (!strcmp(type, "counter")) {
+                    g_assert(g_str_has_suffix(name, "_total"));
+                } else {
+                    g_assert_cmpstr(type, == ,"gauge");
+                    g_assert(!g_str_has_suffix(name, "_total"));
+                }
+            }
+            g_free(name);
+        }
+    }
+    g_assert(!lines[i] || !lines[i + 1]);
+    g_free(family);
+    g_free(type);
+    g_strfreev(lines);
+    g_hash_table_destroy(families);
+}
+
+/*==========================================================================*
+ * null
+ *==========================================================================*/
+
+static
+void
+test_null(
+    void)
+{
+    g_assert(!nci_metrics_to_prometheus(NULL));
+}
+
+/*==========================================================================*
+ * golden
+ *==========================================================================*/
+
+static
+void
+test_golden(
+    void)
+{
+    static const char golden[] =
+    "# TYPE nci_apdu_seconds histogram\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.001000\"} 1\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.002000\"} 1\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.004000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.008000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.016000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.032000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.064000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.128000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.256000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"0.512000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"1.024000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"2.048000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"4.096000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"8.192000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"16.384000\"} 2\n"
+    "nci_apdu_seconds_bucket{" TEST_LABELS ",le=\"+Inf\"} 3\n"
+    "nci_apdu_seconds_sum{" TEST_LABELS "} 20.007500\n"
+    "nci_apdu_seconds_count{" TEST_LABELS "} 3\n"
+    "# TYPE nci_apdu_host_seconds histogram\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.001000\"} 1\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.002000\"} 2\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.004000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.008000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.016000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.032000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.064000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.128000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.256000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"0.512000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"1.024000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"2.048000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"4.096000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"8.192000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"16.384000\"} 3\n"
+    "nci_apdu_host_seconds_bucket{" TEST_LABELS ",le=\"+Inf\"} 3\n"
+    "nci_apdu_host_seconds_sum{" TEST_LABELS "} 0.004700\n"
+    "nci_apdu_host_seconds_count{" TEST_LABELS "} 3\n"
+    "# TYPE nci_apdu_send_seconds histogram\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.001000\"} 1\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.002000\"} 1\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.004000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.008000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.016000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.032000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.064000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.128000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.256000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"0.512000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"1.024000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"2.048000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"4.096000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"8.192000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"16.384000\"} 2\n"
+    "nci_apdu_send_seconds_bucket{" TEST_LABELS ",le=\"+Inf\"} 3\n"
+    "nci_apdu_send_seconds_sum{" TEST_LABELS "} 20.002800\n"
+    "nci_apdu_send_seconds_count{" TEST_LABELS "} 3\n"
+    "# TYPE nci_apdu_errors_total counter\n"
+    "nci_apdu_errors_total{" TEST_LABELS "} 1\n"
+    "# TYPE nci_slo_snapshots gauge\n"
+    "nci_slo_snapshots{" TEST_ADAPTER_LABEL "} 0\n";
+    TestSim* test = test_sim_new(NULL, NFC_MODE_READER_WRITER);
+    const char* name = NFC_ADAPTER(test->adapter)->name;
+    char* text;
+    char* apdu;
+    char* end;
+
+    /*
+     * 4 ms lands in the 4 ms bucket, the limits are inclusive. 20 s
+     * doesn't fit into any fixed bucket and only shows up in +Inf.
+     */
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS, 200, 300);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS, 1500, 2500);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS, 3000, 20000000);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS, 100, -1);
+
+    test_set_name(test, TEST_ADAPTER_NAME);
+    text = nci_metrics_to_prometheus(test->adapter);
+    test_set_name(test, name);
+
+    /* The APDU families don't depend on what NciCore has been doing */
+    apdu = strstr(text, "# TYPE nci_apdu_seconds histogram\n");
+    g_assert(apdu);
+    end = strstr(apdu, "# TYPE nci_objects gauge\n");
+    g_assert(end);
+    end[0] = 0;
+    g_assert_cmpstr(apdu, == ,golden);
+
+    g_free(text);
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * families
+ *==========================================================================*/
+
+static
+void
+test_families(
+    void)
+{
+    TestSim* test = test_sim_new(NULL, NFC_MODE_READER_WRITER);
+    const char* name = NFC_ADAPTER(test->adapter)->name;
+    const char* state;
+    NciLatency latency;
+    char* text;
+    char* line;
+    char* value;
+    guint i;
+
+    /* Something to be cumulative about */
+    test_sim_run(test, 1234);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS, 1500, 500);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS + 1, 500, 7000);
+    nci_adapter_apdu_sample(test->adapter, 0x00, TEST_INS + 1, 100, -1);
+
+    test_set_name(test, TEST_ADAPTER_NAME);
+    text = nci_metrics_to_prometheus(test->adapter);
+    test_set_name(test, name);
+    test_check_families(text);
+
+    /* Time counters are in seconds, with exact microseconds */
+    for (i = 0; (state = nci_adapter_state_name(i)) != NULL; i++) {
+        NciResidency res;
+        char* label = g_strdup_printf(",state=\"%s\"", state);
+
+        g_assert(nci_adapter_get_state_residency(test->adapter, i, &res));
+        value = test_seconds(res.total_us);
+        line = test_line("nci_adapter_state_time_seconds_total", label,
+            value);
+        g_assert(strstr(text, line));
+        g_free(line);
+        g_free(value);
+
+        value = g_strdup_printf("%u", res.visits);
+        line = test_line("nci_adapter_state_visits_total", label, value);
+        g_assert(strstr(text, line));
+        g_free(line);
+        g_free(value);
+        g_free(label);
+    }
+
+    g_assert(nci_adapter_get_latency(test->adapter,
+        NCI_ADAPTER_LATENCY_STARTUP, &latency));
+    g_assert_cmpuint(latency.hist.count, > ,0);
+    value = test_seconds(latency.hist.sum_us);
+    line = test_line("nci_latency_seconds_sum", ",kind=\"startup\"", value);
+    g_assert(strstr(text, line));
+    g_free(line);
+    g_free(value);
+
+    value = g_strdup_printf("%u", (guint) latency.hist.count);
+    line = test_line("nci_latency_seconds_bucket",
+        ",kind=\"startup\",le=\"+Inf\"", value);
+    g_assert(strstr(text, line));
+    g_free(line);
+    g_free(value);
+
+    g_free(text);
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_metrics/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("null"), test_null);
+    g_test_add_func(TEST_("golden"), test_golden);
+    g_test_add_func(TEST_("families"), test_families);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
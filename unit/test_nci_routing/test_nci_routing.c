@@ -0,0 +1,598 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+/*
+ * NciRouting is a pure module, these tests feed it routes and check
+ * the encoded RF_SET_LISTEN_MODE_ROUTING_CMD payloads byte by byte.
+ */
+
+#include "test_common.h"
+
+#include "nci_plugin_p.h"
+
+#include <string.h>
+
+static TestOpt test_opt;
+
+#define TEST_NFCEE (0x10)
+#define TEST_POWER NCI_ROUTE_POWER_ON
+#define TEST_AID_ENTRY_SIZE(n) (4 + (n)) /* Type, Length, Route, Power */
+
+static const guint8 test_aid1[] = {
+    0xa0, 0x00, 0x00, 0x00, 0x04, 0x10, 0x10
+};
+static const guint8 test_aid2[] = {
+    0xa0, 0x00, 0x00, 0x00, 0x04, 0x30, 0x60
+};
+static const guint8 test_aid3[] = {
+    0xa0, 0x00, 0x00, 0x00, 0x04, 0x99, 0x99
+};
+static const guint8 test_aid_rid[] = {
+    0xa0, 0x00, 0x00, 0x00, 0x04
+};
+
+static
+guint
+test_add_tech(
+    NciRouting* routing,
+    guint8 nfcee,
+    NCI_ROUTE_TECH tech)
+{
+    NciRoute route;
+
+    memset(&route, 0, sizeof(route));
+    route.type = NCI_ROUTE_TECHNOLOGY;
+    route.nfcee = nfcee;
+    route.power = TEST_POWER;
+    route.value.tech = tech;
+    return nci_routing_add(routing, &route);
+}
+
+static
+guint
+test_add_aid(
+    NciRouting* routing,
+    guint8 nfcee,
+    NCI_ROUTE_FLAGS flags,
+    const guint8* aid,
+    guint len)
+{
+    NciRoute route;
+
+    memset(&route, 0, sizeof(route));
+    route.type = NCI_ROUTE_AID;
+    route.nfcee = nfcee;
+    route.power = TEST_POWER;
+    route.flags = flags;
+    route.value.aid.bytes = aid;
+    route.value.aid.size = len;
+    return nci_routing_add(routing, &route);
+}
+
+/* Appends the expected encoding of an AID entry */
+static
+void
+test_expect_aid(
+    GByteArray* buf,
+    guint8 nfcee,
+    gboolean prefix,
+    const guint8* aid,
+    guint len)
+{
+    const guint8 hdr[] = {
+        NCI_ROUTE_AID | (prefix ? 0x10 : 0x00), 2 + len, nfcee, TEST_POWER
+    };
+
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+    g_byte_array_append(buf, aid, len);
+}
+
+/* Commits the table which must fit into a single command */
+static
+void
+test_commit_one(
+    NciRouting* routing,
+    guint count,
+    const GByteArray* expected)
+{
+    GPtrArray* cmds = nci_routing_commit(routing);
+    gsize size;
+    const guint8* data;
+
+    g_assert_cmpuint(cmds->len, == ,1);
+    data = g_bytes_get_data(cmds->pdata[0], &size);
+    g_assert_cmpuint(size, == ,2 + expected->len);
+    g_assert_cmpuint(data[0], == ,0x00); /* Last */
+    g_assert_cmpuint(data[1], == ,count);
+    g_assert(!memcmp(data + 2, expected->data, expected->len));
+    g_ptr_array_free(cmds, TRUE);
+    g_assert(!nci_routing_changed(routing));
+}
+
+/*==========================================================================*
+ * basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    static const guint8 tech_a[] = {
+        NCI_ROUTE_TECHNOLOGY, 0x03, TEST_NFCEE, TEST_POWER, NCI_ROUTE_TECH_A
+    };
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+
+    /* Technology entries go first, AIDs are sorted */
+    g_assert(!nci_routing_changed(routing));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2)));
+    g_assert(test_add_tech(routing, TEST_NFCEE, NCI_ROUTE_TECH_A));
+    g_assert(test_add_aid(routing, NCI_NFCEE_ID_DH, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(nci_routing_nfcee_used(routing, TEST_NFCEE));
+    g_assert(nci_routing_nfcee_used(routing, NCI_NFCEE_ID_DH));
+    g_assert(!nci_routing_nfcee_used(routing, TEST_NFCEE + 1));
+    g_assert(nci_routing_changed(routing));
+
+    g_byte_array_append(expected, tech_a, sizeof(tech_a));
+    test_expect_aid(expected, NCI_NFCEE_ID_DH, FALSE, test_aid1,
+        sizeof(test_aid1));
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid2,
+        sizeof(test_aid2));
+    test_commit_one(routing, 3, expected);
+
+    g_assert_cmpuint(usage->size, == ,expected->len);
+    g_assert_cmpuint(usage->max_size, == ,0);
+    g_assert_cmpuint(usage->entries, == ,3);
+    g_assert_cmpuint(usage->aids, == ,2);
+    g_assert_cmpuint(usage->aid_entries, == ,2);
+    g_assert_cmpuint(usage->dropped, == ,0);
+
+    /* Invalid routes are rejected */
+    g_assert(!nci_routing_remove(routing, 0));
+    g_assert(!test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        expected->data, 17));
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * no_change
+ *==========================================================================*/
+
+static
+void
+test_no_change(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    GPtrArray* cmds;
+    guint id1, id2, id3;
+
+    id1 = test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1));
+    id2 = test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2));
+    g_assert(nci_routing_changed(routing));
+    cmds = nci_routing_commit(routing);
+    g_ptr_array_free(cmds, TRUE);
+    g_assert(!nci_routing_changed(routing));
+
+    /* Adding and removing a route is not a change */
+    id3 = test_add_tech(routing, TEST_NFCEE, NCI_ROUTE_TECH_B);
+    g_assert(nci_routing_changed(routing));
+    g_assert(nci_routing_remove(routing, id3));
+    g_assert(!nci_routing_remove(routing, id3));
+    g_assert(!nci_routing_changed(routing));
+
+    /* Neither is adding the same routes in a different order */
+    g_assert(nci_routing_remove(routing, id1));
+    g_assert(nci_routing_remove(routing, id2));
+    g_assert(nci_routing_changed(routing));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(!nci_routing_changed(routing));
+
+    /* Or a duplicate */
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(!nci_routing_changed(routing));
+
+    /* After reset, NFCC needs the whole table again */
+    nci_routing_reset(routing);
+    g_assert(nci_routing_changed(routing));
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * core_table
+ *==========================================================================*/
+
+static
+void
+test_core_table(
+    void)
+{
+    static const guint8 core_cmd[] = {
+        0x00, 0x02, /* Last, 2 entries */
+        NCI_ROUTE_TECHNOLOGY, 0x03, NCI_NFCEE_ID_DH, TEST_POWER,
+        NCI_ROUTE_TECH_A,
+        NCI_ROUTE_TECHNOLOGY, 0x03, NCI_NFCEE_ID_DH, TEST_POWER,
+        NCI_ROUTE_TECH_B
+    };
+    static const guint8 core_more[] = { 0x01, 0x00 };
+    static const guint8 table[] = {
+        NCI_ROUTE_TECHNOLOGY, 0x03, TEST_NFCEE, TEST_POWER,
+        NCI_ROUTE_TECH_A,
+        NCI_ROUTE_TECHNOLOGY, 0x03, NCI_NFCEE_ID_DH, TEST_POWER,
+        NCI_ROUTE_TECH_B
+    };
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    GUtilData payload;
+
+    /* Multi-part tables from NciCore are left alone */
+    payload.bytes = core_more;
+    payload.size = sizeof(core_more);
+    g_assert(!nci_routing_set_core_table(routing, &payload));
+    g_assert(!nci_routing_core_table_known(routing));
+
+    /* Our technology A route overrides NciCore's, B stays */
+    payload.bytes = core_cmd;
+    payload.size = sizeof(core_cmd);
+    g_assert(nci_routing_set_core_table(routing, &payload));
+    g_assert(nci_routing_core_table_known(routing));
+    g_assert(test_add_tech(routing, TEST_NFCEE, NCI_ROUTE_TECH_A));
+    g_byte_array_append(expected, table, sizeof(table));
+    test_commit_one(routing, 2, expected);
+
+    nci_routing_reset(routing);
+    g_assert(!nci_routing_core_table_known(routing));
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * nci_version
+ *==========================================================================*/
+
+static
+void
+test_nci_version(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAG_AID_PREFIX,
+        test_aid_rid, sizeof(test_aid_rid)));
+
+    /* NCI 1.0 has no prefix matching, the flag is ignored */
+    nci_routing_set_limits(routing, 0, FALSE);
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_commit_one(routing, 1, expected);
+    g_assert_cmpuint(usage->size, == ,TEST_AID_ENTRY_SIZE(5));
+
+    /* Same size with NCI 2.0, but now it's a prefix entry */
+    nci_routing_set_limits(routing, 0, TRUE);
+    g_assert(nci_routing_changed(routing));
+    g_byte_array_set_size(expected, 0);
+    test_expect_aid(expected, TEST_NFCEE, TRUE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_commit_one(routing, 1, expected);
+    g_assert_cmpuint(usage->size, == ,TEST_AID_ENTRY_SIZE(5));
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * limit
+ *==========================================================================*/
+
+static
+void
+test_limit(
+    void)
+{
+    static const guint8 tech_a[] = {
+        NCI_ROUTE_TECHNOLOGY, 0x03, TEST_NFCEE, TEST_POWER, NCI_ROUTE_TECH_A
+    };
+    const guint max_size = sizeof(tech_a) + 2 * TEST_AID_ENTRY_SIZE(7);
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+
+    /* NCI 1.0 can't merge anything, the newest AID has to go */
+    nci_routing_set_limits(routing, max_size, FALSE);
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2)));
+    g_assert(test_add_aid(routing, NCI_NFCEE_ID_DH, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid3, sizeof(test_aid3)));
+    g_assert(test_add_tech(routing, TEST_NFCEE, NCI_ROUTE_TECH_A));
+
+    g_byte_array_append(expected, tech_a, sizeof(tech_a));
+    test_expect_aid(expected, NCI_NFCEE_ID_DH, FALSE, test_aid1,
+        sizeof(test_aid1));
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid2,
+        sizeof(test_aid2));
+    test_commit_one(routing, 3, expected);
+    g_assert_cmpuint(usage->size, == ,max_size);
+    g_assert_cmpuint(usage->max_size, == ,max_size);
+    g_assert_cmpuint(usage->entries, == ,3);
+    g_assert_cmpuint(usage->aids, == ,3);
+    g_assert_cmpuint(usage->aid_entries, == ,2);
+    g_assert_cmpuint(usage->dropped, == ,1);
+
+    /* Technology entries take priority, AIDs get whatever is left */
+    nci_routing_set_limits(routing, sizeof(tech_a), FALSE);
+    g_byte_array_set_size(expected, 0);
+    g_byte_array_append(expected, tech_a, sizeof(tech_a));
+    test_commit_one(routing, 1, expected);
+    g_assert_cmpuint(usage->aid_entries, == ,0);
+    g_assert_cmpuint(usage->dropped, == ,3);
+
+    /* The limit survives the reset */
+    nci_routing_reset(routing);
+    g_assert_cmpuint(usage->max_size, == ,sizeof(tech_a));
+    g_assert_cmpuint(usage->size, == ,0);
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * subset
+ *==========================================================================*/
+
+static
+void
+test_subset(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+    guint id;
+
+    /* The prefix entry covers the full AID routed to the same place */
+    nci_routing_set_limits(routing, 0, TRUE);
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAG_AID_PREFIX,
+        test_aid_rid, sizeof(test_aid_rid)));
+    test_expect_aid(expected, TEST_NFCEE, TRUE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_commit_one(routing, 1, expected);
+    g_assert_cmpuint(usage->aids, == ,2);
+    g_assert_cmpuint(usage->aid_entries, == ,1);
+    g_assert_cmpuint(usage->dropped, == ,0);
+
+    /* Not if the prefix also covers an AID routed elsewhere */
+    id = test_add_aid(routing, NCI_NFCEE_ID_DH, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2));
+    g_assert(id);
+    g_byte_array_set_size(expected, 0);
+    test_expect_aid(expected, TEST_NFCEE, TRUE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid1,
+        sizeof(test_aid1));
+    test_expect_aid(expected, NCI_NFCEE_ID_DH, FALSE, test_aid2,
+        sizeof(test_aid2));
+    test_commit_one(routing, 3, expected);
+    g_assert_cmpuint(usage->aid_entries, == ,3);
+
+    /* Without prefix matching both full AIDs are needed */
+    g_assert(nci_routing_remove(routing, id));
+    nci_routing_set_limits(routing, 0, FALSE);
+    g_byte_array_set_size(expected, 0);
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid1,
+        sizeof(test_aid1));
+    test_commit_one(routing, 2, expected);
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * merge
+ *==========================================================================*/
+
+static
+void
+test_merge(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+
+    /* Only a single RID prefix entry fits */
+    nci_routing_set_limits(routing, TEST_AID_ENTRY_SIZE(5), TRUE);
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid3, sizeof(test_aid3)));
+    test_expect_aid(expected, TEST_NFCEE, TRUE, test_aid_rid,
+        sizeof(test_aid_rid));
+    test_commit_one(routing, 1, expected);
+    g_assert_cmpuint(usage->size, == ,TEST_AID_ENTRY_SIZE(5));
+    g_assert_cmpuint(usage->aids, == ,3);
+    g_assert_cmpuint(usage->aid_entries, == ,1);
+    g_assert_cmpuint(usage->dropped, == ,0);
+
+    /* NCI 1.0 can't do that, and none of the full AIDs fits */
+    nci_routing_set_limits(routing, TEST_AID_ENTRY_SIZE(5), FALSE);
+    g_assert(nci_routing_changed(routing));
+    g_ptr_array_free(nci_routing_commit(routing), TRUE);
+    g_assert_cmpuint(usage->size, == ,0);
+    g_assert_cmpuint(usage->aid_entries, == ,0);
+    g_assert_cmpuint(usage->dropped, == ,3);
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * merge_conflict
+ *==========================================================================*/
+
+static
+void
+test_merge_conflict(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    GByteArray* expected = g_byte_array_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+
+    /*
+     * The AID in the middle goes elsewhere, a prefix entry for the other
+     * two would swallow it. The newest AID gets dropped instead.
+     */
+    nci_routing_set_limits(routing, 2 * TEST_AID_ENTRY_SIZE(7), TRUE);
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid1, sizeof(test_aid1)));
+    g_assert(test_add_aid(routing, NCI_NFCEE_ID_DH, NCI_ROUTE_FLAGS_NONE,
+        test_aid2, sizeof(test_aid2)));
+    g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+        test_aid3, sizeof(test_aid3)));
+    test_expect_aid(expected, TEST_NFCEE, FALSE, test_aid1,
+        sizeof(test_aid1));
+    test_expect_aid(expected, NCI_NFCEE_ID_DH, FALSE, test_aid2,
+        sizeof(test_aid2));
+    test_commit_one(routing, 2, expected);
+    g_assert_cmpuint(usage->aid_entries, == ,2);
+    g_assert_cmpuint(usage->dropped, == ,1);
+
+    g_byte_array_unref(expected);
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * split
+ *==========================================================================*/
+
+static
+void
+test_split(
+    void)
+{
+    NciRouting* routing = nci_routing_new();
+    const NciRoutingUsage* usage = nci_routing_usage(routing);
+    const guint entry_size = TEST_AID_ENTRY_SIZE(16);
+    const guint per_cmd = (NCI_MAX_CTRL_PAYLOAD - 2) / entry_size;
+    const guint n = per_cmd + 1;
+    GPtrArray* cmds;
+    const guint8* data;
+    gsize size;
+    guint i;
+
+    /* One entry more than fits into a single command */
+    for (i = 0; i < n; i++) {
+        guint8 aid[16];
+
+        memset(aid, 0, sizeof(aid));
+        memcpy(aid, test_aid_rid, sizeof(test_aid_rid));
+        aid[15] = (guint8) i;
+        g_assert(test_add_aid(routing, TEST_NFCEE, NCI_ROUTE_FLAGS_NONE,
+            aid, sizeof(aid)));
+    }
+
+    cmds = nci_routing_commit(routing);
+    g_assert_cmpuint(cmds->len, == ,2);
+    data = g_bytes_get_data(cmds->pdata[0], &size);
+    g_assert_cmpuint(size, == ,2 + per_cmd * entry_size);
+    g_assert_cmpuint(data[0], == ,0x01); /* More */
+    g_assert_cmpuint(data[1], == ,per_cmd);
+    data = g_bytes_get_data(cmds->pdata[1], &size);
+    g_assert_cmpuint(size, == ,2 + entry_size);
+    g_assert_cmpuint(data[0], == ,0x00); /* Last */
+    g_assert_cmpuint(data[1], == ,1);
+    g_assert_cmpuint(data[2 + 4 + 15], == ,per_cmd);
+    g_ptr_array_free(cmds, TRUE);
+
+    g_assert_cmpuint(usage->size, == ,n * entry_size);
+    g_assert_cmpuint(usage->entries, == ,n);
+    g_assert(!nci_routing_changed(routing));
+    nci_routing_free(routing);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_routing/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("no_change"), test_no_change);
+    g_test_add_func(TEST_("core_table"), test_core_table);
+    g_test_add_func(TEST_("nci_version"), test_nci_version);
+    g_test_add_func(TEST_("limit"), test_limit);
+    g_test_add_func(TEST_("subset"), test_subset);
+    g_test_add_func(TEST_("merge"), test_merge);
+    g_test_add_func(TEST_("merge_conflict"), test_merge_conflict);
+    g_test_add_func(TEST_("split"), test_split);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
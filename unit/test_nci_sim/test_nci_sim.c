@@ -0,0 +1,614 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include <string.h>
+
+#include "nci_plugin_p.h"
+
+#include <nci_core.h>
+
+static TestOpt test_opt;
+
+/* Presence checks run every 250 ms */
+#define TEST_PRESENCE_CHECK_MS (250)
+#define TEST_CE_REACTIVATION_TIMEOUT_MS (1500)
+
+static
+TestSim*
+test_sim_new_with_object(
+    guint8 nci_version,
+    NFC_MODE mode,
+    NciSimObject* obj)
+{
+    NciSimConfig config;
+    TestSim* test;
+
+    memset(&config, 0, sizeof(config));
+    config.nci_version = nci_version;
+    test = test_sim_new(&config, mode);
+    nci_sim_place(test->sim, obj);
+    nci_sim_object_unref(obj);
+    test_sim_run(test, 100);
+    return test;
+}
+
+/*==========================================================================*
+ * activation
+ *==========================================================================*/
+
+static
+void
+test_activation_tag(
+    guint8 nci_version,
+    NciSimObject* obj)
+{
+    TestSim* test = test_sim_new_with_object(nci_version,
+        NFC_MODE_READER_WRITER, obj);
+
+    g_assert(test->adapter->target);
+    g_assert_cmpuint(test->tags_added, == ,1);
+    g_assert_cmpuint(test->tags_removed, == ,0);
+    g_assert_cmpuint(test_sim_latency_count(test,
+        NCI_ADAPTER_LATENCY_PUBLISH), == ,1);
+
+    /* Take it away */
+    nci_sim_take(test->sim);
+    test_sim_run(test, 100);
+    g_assert(!test->adapter->target);
+    g_assert_cmpuint(test->tags_removed, == ,1);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+    test_sim_free(test);
+}
+
+static
+void
+test_activation_t2(
+    void)
+{
+    test_activation_tag(0x20, nci_sim_tag_t2_new(NULL, NULL));
+}
+
+static
+void
+test_activation_t2_nci1(
+    void)
+{
+    test_activation_tag(0x10, nci_sim_tag_t2_new(NULL, NULL));
+}
+
+static
+void
+test_activation_t4(
+    void)
+{
+    static const guint8 ndef[] = { 0xd0, 0x00, 0x00 }; /* Empty record */
+    GUtilData data;
+
+    data.bytes = ndef;
+    data.size = sizeof(ndef);
+    test_activation_tag(0x20, nci_sim_tag_t4_new(NULL, &data));
+}
+
+/*==========================================================================*
+ * bounce
+ *==========================================================================*/
+
+static
+void
+test_bounce(
+    void)
+{
+    TestSim* test = test_sim_new_with_object(0x20, NFC_MODE_READER_WRITER,
+        nci_sim_tag_t2_new(NULL, NULL));
+
+    g_assert_cmpuint(test->tags_added, == ,1);
+
+    /* Tag leaves the field and comes back, that's a new tag */
+    nci_sim_bounce(test->sim);
+    test_sim_run(test, 100);
+    g_assert(test->adapter->target);
+    g_assert_cmpuint(test->tags_added, == ,2);
+    g_assert_cmpuint(test->tags_removed, == ,1);
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * presence_check
+ *==========================================================================*/
+
+static
+void
+test_presence_check(
+    NciSimObject* obj)
+{
+    TestSim* test = test_sim_new_with_object(0x20, NFC_MODE_READER_WRITER,
+        obj);
+    const guint tx = test->tx_data;
+
+    /* Each presence check is a data packet */
+    test_sim_run(test, 4 * TEST_PRESENCE_CHECK_MS + 10);
+    g_assert_cmpuint(test->tx_data - tx, >= ,4);
+    g_assert(test->adapter->target);
+    g_assert_cmpuint(test->tags_removed, == ,0);
+
+    /* No more presence checks once the tag is gone */
+    nci_sim_take(test->sim);
+    test_sim_run(test, 10);
+    g_assert(!test->adapter->target);
+    g_assert_cmpuint(test->tags_removed, == ,1);
+    test_sim_free(test);
+}
+
+static
+void
+test_presence_check_t2(
+    void)
+{
+    test_presence_check(nci_sim_tag_t2_new(NULL, NULL));
+}
+
+static
+void
+test_presence_check_t4(
+    void)
+{
+    test_presence_check(nci_sim_tag_t4_new(NULL, NULL));
+}
+
+/*==========================================================================*
+ * reactivation
+ *==========================================================================*/
+
+static
+void
+test_reactivation(
+    void)
+{
+    TestSim* test = test_sim_new_with_object(0x20, NFC_MODE_READER_WRITER,
+        nci_sim_tag_t2_new(NULL, NULL));
+    NfcTarget* target = test->adapter->target;
+    guint tx;
+
+    g_assert(target);
+    g_assert(nci_adapter_reactivate(test->adapter, target));
+    test_sim_run(test, 100);
+
+    /* Same target, same tag */
+    g_assert(test->adapter->target == target);
+    g_assert_cmpuint(test->tags_added, == ,1);
+    g_assert_cmpuint(test->tags_removed, == ,0);
+    g_assert_cmpuint(test_sim_state_visits(test, "REACTIVATING_TARGET"),
+        == ,1);
+    g_assert_cmpuint(test_sim_latency_count(test,
+        NCI_ADAPTER_LATENCY_REACTIVATION), == ,1);
+
+    /* Presence checks resume */
+    tx = test->tx_data;
+    test_sim_run(test, 2 * TEST_PRESENCE_CHECK_MS + 10);
+    g_assert_cmpuint(test->tx_data - tx, >= ,2);
+    g_assert(test->adapter->target == target);
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * ce
+ *==========================================================================*/
+
+static
+TestSim*
+test_ce_new(
+    void)
+{
+    TestSim* test = test_sim_new_with_object(0x20, NFC_MODE_CARD_EMILATION,
+        nci_sim_reader_new(NULL, 0, NULL, NULL));
+
+    g_assert_cmpuint(test->hosts_added, == ,1);
+    g_assert_cmpuint(test->hosts_removed, == ,0);
+    return test;
+}
+
+static
+void
+test_ce_sleep(
+    void)
+{
+    TestSim* test = test_ce_new();
+
+    /* HLTA and wake up, the host survives */
+    nci_sim_sleep(test->sim);
+    test_sim_run(test, 100);
+    g_assert_cmpuint(test_sim_state_visits(test, "SLEEPING_CE"), == ,1);
+    g_assert_cmpuint(test->hosts_added, == ,1);
+    g_assert_cmpuint(test->hosts_removed, == ,0);
+
+    /* The reader leaves for good */
+    nci_sim_take(test->sim);
+    test_sim_run(test, TEST_CE_REACTIVATION_TIMEOUT_MS + 100);
+    g_assert_cmpuint(test->hosts_removed, == ,1);
+    test_sim_free(test);
+}
+
+static
+void
+test_ce_reactivation(
+    void)
+{
+    TestSim* test = test_ce_new();
+
+    /* The reader briefly loses the link, the host survives */
+    nci_sim_bounce(test->sim);
+    test_sim_run(test, 100);
+    g_assert_cmpuint(test_sim_state_visits(test, "REACTIVATING_CE"), == ,1);
+    g_assert_cmpuint(test_sim_latency_count(test,
+        NCI_ADAPTER_LATENCY_REACTIVATION), == ,1);
+    g_assert_cmpuint(test->hosts_added, == ,1);
+    g_assert_cmpuint(test->hosts_removed, == ,0);
+
+    /* The reader leaves for good */
+    nci_sim_take(test->sim);
+    test_sim_run(test, TEST_CE_REACTIVATION_TIMEOUT_MS + 100);
+    g_assert_cmpuint(test->hosts_removed, == ,1);
+    test_sim_free(test);
+}
+
+/*==========================================================================*
+ * nfcee
+ *==========================================================================*/
+
+#define TEST_NFCEE (0x80)
+#define TEST_NFCEE_LATENCY_MS (50)
+
+static const guint8 test_nfcee_aid[] = {
+    0xa0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10
+};
+
+static
+TestSim*
+test_nfcee_new(
+    guint8 nci_version,
+    guint nfcee_latency_ms)
+{
+    NciSimConfig config;
+    const NciNfcee* const* nfcees;
+    TestSim* test;
+
+    memset(&config, 0, sizeof(config));
+    config.nci_version = nci_version;
+    config.nfcee_id = TEST_NFCEE;
+    config.nfcee_latency_ms = nfcee_latency_ms;
+    test = test_sim_new(&config, NFC_MODE_READER_WRITER);
+
+    /* NFCEE gets discovered but there's no reason to enable it yet */
+    nfcees = nci_adapter_nfcees(test->adapter);
+    g_assert(nfcees[0]);
+    g_assert(!nfcees[1]);
+    g_assert_cmpuint(nfcees[0]->id, == ,TEST_NFCEE);
+    g_assert_cmpint(nfcees[0]->status, == ,NCI_NFCEE_STATUS_DISABLED);
+    g_assert_cmpuint(nfcees[0]->protocols.size, == ,1);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_DISCOVER), == ,1);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET), == ,0);
+    g_assert(!nci_sim_nfcee_enabled(test->sim));
+    return test;
+}
+
+static
+guint
+test_nfcee_add_tech(
+    TestSim* test,
+    NCI_ROUTE_TECH tech)
+{
+    NciRoute route;
+
+    memset(&route, 0, sizeof(route));
+    route.type = NCI_ROUTE_TECHNOLOGY;
+    route.nfcee = TEST_NFCEE;
+    route.power = NCI_ROUTE_POWER_ON;
+    route.value.tech = tech;
+    return nci_adapter_add_route(test->adapter, &route);
+}
+
+static
+guint
+test_nfcee_add_aid(
+    TestSim* test,
+    const guint8* aid,
+    guint len)
+{
+    NciRoute route;
+
+    memset(&route, 0, sizeof(route));
+    route.type = NCI_ROUTE_AID;
+    route.nfcee = TEST_NFCEE;
+    route.power = NCI_ROUTE_POWER_ON;
+    route.value.aid.bytes = aid;
+    route.value.aid.size = len;
+    return nci_adapter_add_route(test->adapter, &route);
+}
+
+/* Checks that NFCC has test_nfcee_aid routed to the NFCEE */
+static
+void
+test_nfcee_check_table(
+    TestSim* test)
+{
+    GBytes* table = nci_sim_routing_table(test->sim);
+    const guint8* data;
+    gsize size;
+
+    g_assert(table);
+    data = g_bytes_get_data(table, &size);
+    g_assert_cmpuint(size, == ,4 + sizeof(test_nfcee_aid));
+    g_assert_cmpuint(data[0], == ,NCI_ROUTE_AID);
+    g_assert_cmpuint(data[1], == ,2 + sizeof(test_nfcee_aid));
+    g_assert_cmpuint(data[2], == ,TEST_NFCEE);
+    g_assert_cmpuint(data[3], == ,NCI_ROUTE_POWER_ON);
+    g_assert(!memcmp(data + 4, test_nfcee_aid, sizeof(test_nfcee_aid)));
+}
+
+static
+void
+test_nfcee_discover(
+    void)
+{
+    test_sim_free(test_nfcee_new(0x20, 0));
+}
+
+static
+void
+test_nfcee_discover_nci1(
+    void)
+{
+    test_sim_free(test_nfcee_new(0x10, 0));
+}
+
+static
+void
+test_nfcee_mode_set(
+    guint8 nci_version)
+{
+    TestSim* test = test_nfcee_new(nci_version, TEST_NFCEE_LATENCY_MS);
+    const NciNfcee* const* nfcees;
+    GBytes* table;
+    guint id;
+
+    /* Routing something to the NFCEE enables it */
+    id = test_nfcee_add_aid(test, test_nfcee_aid, sizeof(test_nfcee_aid));
+    g_assert(id);
+    test_sim_run(test, TEST_NFCEE_LATENCY_MS + 100);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET), == ,1);
+    g_assert(nci_sim_nfcee_enabled(test->sim));
+    nfcees = nci_adapter_nfcees(test->adapter);
+    g_assert_cmpint(nfcees[0]->status, == ,NCI_NFCEE_STATUS_ENABLED);
+
+    /* The route gets to NFCC, and the adapter gets back to discovery */
+    test_nfcee_check_table(test);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+
+    /* Without the route, the table becomes empty */
+    nci_adapter_remove_route(test->adapter, id);
+    test_sim_run(test, 100);
+    table = nci_sim_routing_table(test->sim);
+    g_assert(table);
+    g_assert_cmpuint(g_bytes_get_size(table), == ,0);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET), == ,1);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+    test_sim_free(test);
+}
+
+static
+void
+test_nfcee_mode_set_nci2(
+    void)
+{
+    test_nfcee_mode_set(0x20);
+}
+
+static
+void
+test_nfcee_mode_set_nci1(
+    void)
+{
+    test_nfcee_mode_set(0x10);
+}
+
+static
+void
+test_nfcee_routing_split(
+    void)
+{
+    static const guint8 tech_a[] = {
+        NCI_ROUTE_TECHNOLOGY, 0x03, TEST_NFCEE, NCI_ROUTE_POWER_ON,
+        NCI_ROUTE_TECH_A
+    };
+    TestSim* test = test_nfcee_new(0x20, 0);
+    const guint cmds = test_sim_cmd_count(test, NCI_GID_RF,
+        NCI_OID_RF_SET_LISTEN_MODE_ROUTING);
+    NciRoutingUsage usage;
+    GBytes* table;
+    const guint8* data;
+    gsize size;
+    guint i;
+
+    /*
+     * 3 technology entries (5 bytes each) and 12 AIDs (20 bytes each)
+     * take 255 bytes. That fits into the NFCC (256 bytes) but not into
+     * a single command (2 bytes of header + 253 bytes of entries).
+     */
+    g_assert(test_nfcee_add_tech(test, NCI_ROUTE_TECH_A));
+    g_assert(test_nfcee_add_tech(test, NCI_ROUTE_TECH_B));
+    g_assert(test_nfcee_add_tech(test, NCI_ROUTE_TECH_F));
+    for (i = 0; i < 12; i++) {
+        guint8 aid[16];
+
+        memset(aid, 0, sizeof(aid));
+        memcpy(aid, test_nfcee_aid, sizeof(test_nfcee_aid));
+        aid[15] = (guint8) i;
+        g_assert(test_nfcee_add_aid(test, aid, sizeof(aid)));
+    }
+    test_sim_run(test, 100);
+
+    /* Two commands, NFCC has put them together */
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_RF,
+        NCI_OID_RF_SET_LISTEN_MODE_ROUTING) - cmds, == ,2);
+    nci_adapter_get_routing_usage(test->adapter, &usage);
+    g_assert_cmpuint(usage.size, == ,255);
+    g_assert_cmpuint(usage.entries, == ,15);
+    g_assert_cmpuint(usage.dropped, == ,0);
+    table = nci_sim_routing_table(test->sim);
+    g_assert(table);
+    data = g_bytes_get_data(table, &size);
+    g_assert_cmpuint(size, == ,usage.size);
+    g_assert(!memcmp(data, tech_a, sizeof(tech_a)));
+    g_assert_cmpuint(data[size - 1], == ,11);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+    test_sim_free(test);
+}
+
+static
+void
+test_nfcee_reset(
+    guint8 nci_version)
+{
+    const guint mode_set = TEST_SIM_CMD(NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET);
+    const guint reset = TEST_SIM_CMD(NCI_GID_CORE, NCI_OID_CORE_RESET);
+    TestSim* test = test_nfcee_new(nci_version, TEST_NFCEE_LATENCY_MS);
+    GArray* log = test->cmds;
+    const NciNfcee* const* nfcees;
+    guint i = log->len;
+
+    /* NFCC gets reset while it's enabling the NFCEE */
+    g_assert(test_nfcee_add_aid(test, test_nfcee_aid,
+        sizeof(test_nfcee_aid)));
+    test_sim_run(test, TEST_NFCEE_LATENCY_MS / 2);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET), == ,1);
+    nfcees = nci_adapter_nfcees(test->adapter);
+    g_assert_cmpint(nfcees[0]->status, == ,NCI_NFCEE_STATUS_DISABLED);
+    nci_core_restart(test->adapter->nci);
+    test_sim_run(test, TEST_NFCEE_LATENCY_MS + 100);
+
+    /* Nothing was sent to the NFCEE ahead of CORE_RESET */
+    while (i < log->len && g_array_index(log, guint, i) != mode_set) {
+        i++;
+    }
+    g_assert_cmpuint(i, < ,log->len);
+    for (i++; i < log->len && g_array_index(log, guint, i) != reset; i++) {
+        g_assert_cmpuint(g_array_index(log, guint, i), != ,mode_set);
+    }
+    g_assert_cmpuint(i, < ,log->len);
+
+    /* Then NFCEE got rediscovered and enabled, it didn't fail */
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_DISCOVER), == ,2);
+    g_assert_cmpuint(test_sim_cmd_count(test, NCI_GID_NFCEE,
+        NCI_OID_NFCEE_MODE_SET), == ,2);
+    g_assert(nci_sim_nfcee_enabled(test->sim));
+    nfcees = nci_adapter_nfcees(test->adapter);
+    g_assert(nfcees[0]);
+    g_assert_cmpint(nfcees[0]->status, == ,NCI_NFCEE_STATUS_ENABLED);
+    test_nfcee_check_table(test);
+    g_assert_cmpint(test->adapter->nci->current_state, == ,
+        NCI_RFST_DISCOVERY);
+    test_sim_free(test);
+}
+
+static
+void
+test_nfcee_reset_nci2(
+    void)
+{
+    test_nfcee_reset(0x20);
+}
+
+static
+void
+test_nfcee_reset_nci1(
+    void)
+{
+    test_nfcee_reset(0x10);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/nci_sim/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("activation/t2"), test_activation_t2);
+    g_test_add_func(TEST_("activation/t2_nci1"), test_activation_t2_nci1);
+    g_test_add_func(TEST_("activation/t4"), test_activation_t4);
+    g_test_add_func(TEST_("bounce"), test_bounce);
+    g_test_add_func(TEST_("presence_check/t2"), test_presence_check_t2);
+    g_test_add_func(TEST_("presence_check/t4"), test_presence_check_t4);
+    g_test_add_func(TEST_("reactivation"), test_reactivation);
+    g_test_add_func(TEST_("nfcee/discover"), test_nfcee_discover);
+    g_test_add_func(TEST_("nfcee/discover_nci1"), test_nfcee_discover_nci1);
+    g_test_add_func(TEST_("nfcee/mode_set"), test_nfcee_mode_set_nci2);
+    g_test_add_func(TEST_("nfcee/mode_set_nci1"), test_nfcee_mode_set_nci1);
+    g_test_add_func(TEST_("nfcee/routing_split"), test_nfcee_routing_split);
+    g_test_add_func(TEST_("nfcee/reset"), test_nfcee_reset_nci2);
+    g_test_add_func(TEST_("nfcee/reset_nci1"), test_nfcee_reset_nci1);
+    if (NCI_PLUGIN_CE) {
+        g_test_add_func(TEST_("ce/sleep"), test_ce_sleep);
+        g_test_add_func(TEST_("ce/reactivation"), test_ce_reactivation);
+    }
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */